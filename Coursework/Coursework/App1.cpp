@@ -1,6 +1,7 @@
 #include "App1.h"
 
 #include <nlohmann/json.hpp>
+#include <cfloat>
 
 #include "LightShader.h"
 #include "TerrainShader.h"
@@ -15,16 +16,42 @@
 #include "FinalPassShader.h"
 
 #include "GlobalLighting.h"
+#include "LightingCache.h"
+#include "ConstantBufferRing.h"
 #include "Cubemap.h"
 #include "Skybox.h"
+#include "EnvironmentLoader.h"
 
 #include "ShadowCubemap.h"
 
 #include "HeightmapFilters.h"
 #include "SerializationHelper.h"
-
-
-App1::App1()
+#include "ThreadPool.h"
+#include "MeshGeometryCache.h"
+#include "SoftwareShadowBaker.h"
+#include "OcclusionCuller.h"
+#include "D3D11Backend.h"
+#include "RecordingBackend.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "GPUMemoryTracker.h"
+#include "AssetLoader.h"
+#include "TextureCache.h"
+#include "MaterialArrays.h"
+#include "TextureStreamer.h"
+
+#include "stb_image.h"
+
+
+// faces of each environment that can be selected, in the Cubemap face order
+static const char* const s_SkyboxFaces[3][6] = {
+	{ "res/skybox/right.png", "res/skybox/left.png", "res/skybox/top.png", "res/skybox/bottom.png", "res/skybox/front.png", "res/skybox/back.png" },
+	{ "res/skybox2/px.png", "res/skybox2/nx.png", "res/skybox2/py.png", "res/skybox2/ny.png", "res/skybox2/pz.png", "res/skybox2/nz.png" },
+	{ "res/skybox3/px.png", "res/skybox3/nx.png", "res/skybox3/py.png", "res/skybox3/ny.png", "res/skybox3/pz.png", "res/skybox3/nz.png" }
+};
+
+App1::App1(const std::string& benchmarkConfig)
+	: m_BenchmarkOnStart(benchmarkConfig)
 {
 	m_TerrainMesh = nullptr;
 	m_TerrainShader = nullptr;
@@ -37,91 +64,155 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	// Call super/parent init function (required!)
 	BaseApplication::init(hinstance, hwnd, screenWidth, screenHeight, in, VSYNC, FULL_SCREEN);
 
-	// Load textures
-	textureMgr->loadTexture(L"oceanNormalMapA", L"res/waterNormals1.png");
-	textureMgr->loadTexture(L"oceanNormalMapB", L"res/waterNormals2.png");
+	m_ThreadPool = new ThreadPool;
+	m_SceneGraph = new SceneGraph(m_ThreadPool);
+	m_MeshGeometryCache = new MeshGeometryCache(renderer->getDevice());
+	m_OcclusionCuller = new OcclusionCuller(m_ThreadPool);
+
+	m_D3D11Backend = new D3D11Backend(renderer->getDevice(), renderer->getDeviceContext());
+	m_GraphicsBackend = new RecordingBackend(m_D3D11Backend);
+	m_Profiler = new Profiler(m_GraphicsBackend);
+	m_Benchmark = new Benchmark(m_Profiler);
+
+	// per-draw constants are sub-allocated from one large buffer
+	m_ConstantBufferRing = new ConstantBufferRing(m_GraphicsBackend);
+
+	// every texture and environment loaded from a file goes through the cache, including the framework's
+	m_TextureCache = new TextureCache(renderer->getDevice());
+	textureMgr->setLoadFunction([this](const wchar_t* filename)
+	{
+		return m_TextureCache->Acquire(filename, GPUMemoryTracker::Category::Textures);
+	});
+	// budgets are optional
+	GPUMemoryTracker::LoadBudgets("res/memory_budgets.json");
+
+	// textures, materials and the environment's faces are loaded in parallel
+	m_AssetLoader = new AssetLoader(renderer->getDevice(), renderer->getDeviceContext(), m_ThreadPool, m_TextureCache);
+
+	// Load textures, held until the cache is deleted
+	ID3D11ShaderResourceView* oceanNormalMaps[2] = { nullptr, nullptr };
+	MipGenerator::Settings normalMips;
+	normalMips.normalMap = true;
+	m_AssetLoader->AddTexture(L"res/waterNormals1.png", &oceanNormalMaps[0], GPUMemoryTracker::Category::Textures, normalMips);
+	m_AssetLoader->AddTexture(L"res/waterNormals2.png", &oceanNormalMaps[1], GPUMemoryTracker::Category::Textures, normalMips);
 
 	// Create materials
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Grass");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/grass");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/grass");
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Dirt");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/dirt");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/dirt");
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Sand");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/sand");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/sand");
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Rock");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/rock");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/rock");
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Snow");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/snow");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/snow");
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Worn Shiny Metal");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/worn_shiny_metal");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/worn_shiny_metal");
 		mat->SetMetalness(1.0f);
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Cement");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/cement");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/cement");
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Gold");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/gold");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/gold");
 		mat->SetMetalness(1.0f);
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Copper");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/copper");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/copper");
 		mat->SetMetalness(1.0f);
 	}
 	{
 		Material* mat = m_MaterialLibrary.CreateMaterial("Granite");
-		mat->LoadPBRFromDir(renderer->getDevice(), renderer->getDeviceContext(), L"res/pbr/granite");
+		mat->LoadPBRFromDir(m_AssetLoader, L"res/pbr/granite");
+	}
+	m_MaterialArrays = new MaterialArrays;
+	m_MaterialArrays->Load(m_AssetLoader, L"res/terrain");
+
+	// Load the environment map's faces
+	unsigned char* faceData[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+	int faceSizes[6] = { 0, 0, 0, 0, 0, 0 };
+	std::vector<AssetLoader::Handle> faceJobs;
+	for (int i = 0; i < 6; i++)
+	{
+		faceJobs.push_back(m_AssetLoader->AddJob(s_SkyboxFaces[0][i], [&faceData, &faceSizes, i]()
+		{
+			int width, height, channels;
+			faceData[i] = stbi_load(s_SkyboxFaces[0][i], &width, &height, &channels, 4);
+			assert(faceData[i] && width == height && "Failed to load environment face");
+			faceSizes[i] = width;
+		}));
 	}
+	m_AssetLoader->AddJob("Environment map", [this, &faceData, &faceSizes]()
+	{
+		for (int i = 1; i < 6; i++)
+			assert(faceSizes[i] == faceSizes[0] && "Environment faces must be the same size");
+		std::vector<std::string> faces(s_SkyboxFaces[0], s_SkyboxFaces[0] + 6);
+		m_EnvironmentMap = m_TextureCache->AcquireCubemap(faces, [&]() { return new Cubemap(renderer->getDevice(), faceData, faceSizes[0], faces); });
+		for (int i = 0; i < 6; i++)
+			stbi_image_free(faceData[i]);
+	}, faceJobs);
+
+	m_AssetLoader->Run();
+	for (const std::string& failed : m_AssetLoader->GetFailedTextures())
+		OutputDebugStringA(("Failed to load texture " + failed + "\n").c_str());
+
+	// material maps drop their largest mips when they are far away or over the materials' budget
+	size_t materialBudget = GPUMemoryTracker::GetBudget(GPUMemoryTracker::Category::Materials);
+	m_TextureStreamer = new TextureStreamer(m_TextureCache, materialBudget > 0 ? materialBudget : 256 * 1024 * 1024);
+	for (Material* material : m_MaterialLibrary.GetMaterials())
+		m_TextureStreamer->AddMaterial(material);
+	textureMgr->addTexture(L"oceanNormalMapA", oceanNormalMaps[0]);
+	textureMgr->addTexture(L"oceanNormalMapB", oceanNormalMaps[1]);
 
 	// Create global lighting object
-	m_GlobalLighting = new GlobalLighting(renderer->getDevice());
+	m_GlobalLighting = new GlobalLighting(renderer->getDevice(), m_GraphicsBackend, m_ThreadPool);
+	m_LightingCache = new LightingCache(renderer->getDevice(), m_GraphicsBackend, m_GlobalLighting);
 
 	// Create shaders
-	m_LightShader = new LightShader(renderer->getDevice(), hwnd, m_GlobalLighting);
-	m_TerrainShader = new TerrainShader(renderer->getDevice(), m_GlobalLighting);
-	m_TextureShader = new TextureShader(renderer->getDevice(), hwnd);
+	m_LightShader = new LightShader(renderer->getDevice(), hwnd, m_GlobalLighting, m_ConstantBufferRing);
+	m_TerrainShader = new TerrainShader(renderer->getDevice(), m_GlobalLighting, m_ConstantBufferRing);
+	m_TextureShader = new TextureShader(renderer->getDevice(), m_GraphicsBackend, hwnd);
 	
-	m_UnlitShader = new UnlitShader(renderer->getDevice(), hwnd);
-	m_UnlitTerrainShader = new UnlitTerrainShader(renderer->getDevice());
+	m_UnlitShader = new UnlitShader(renderer->getDevice(), m_GraphicsBackend, hwnd);
+	m_UnlitTerrainShader = new UnlitTerrainShader(renderer->getDevice(), m_GraphicsBackend);
 	
-	m_WaterShader = new WaterShader(renderer->getDevice(), m_GlobalLighting, textureMgr->getTexture(L"oceanNormalMapA"), textureMgr->getTexture(L"oceanNormalMapB"));
-	m_MeasureLuminenceShader = new MeasureLuminanceShader(renderer->getDevice(), screenWidth, screenHeight);
-	m_BloomShader = new BloomShader(renderer->getDevice(), screenWidth / 2, screenHeight / 2, 7);
-	m_FinalPassShader = new FinalPassShader(renderer->getDevice());
+	m_WaterShader = new WaterShader(renderer->getDevice(), m_GlobalLighting, m_ConstantBufferRing, textureMgr->getTexture(L"oceanNormalMapA"), textureMgr->getTexture(L"oceanNormalMapB"));
+	m_MeasureLuminenceShader = new MeasureLuminanceShader(renderer->getDevice(), m_GraphicsBackend, screenWidth, screenHeight);
+	m_BloomShader = new BloomShader(renderer->getDevice(), m_GraphicsBackend, screenWidth / 2, screenHeight / 2, 7);
+	m_FinalPassShader = new FinalPassShader(renderer->getDevice(), m_GraphicsBackend);
 
 	// Create render textures
 	m_SceneRenderTexture = new RenderTarget(renderer->getDevice(), screenWidth, screenHeight);
 	m_WaterRenderTexture = new RenderTarget(renderer->getDevice(), screenWidth, screenHeight);
 
-	// Create environment map
-	m_EnvironmentMap = new Cubemap(renderer->getDevice(), 
-		"res/skybox/right.png", "res/skybox/left.png", 
-		"res/skybox/top.png", "res/skybox/bottom.png",
-		"res/skybox/front.png", "res/skybox/back.png");
-
 	// process the environment map
 	m_GlobalLighting->SetAndProcessEnvironmentMap(renderer->getDeviceContext(), m_EnvironmentMap);
-	m_Skybox = new Skybox(renderer->getDevice(), m_EnvironmentMap);
+	m_Skybox = new Skybox(renderer->getDevice(), m_GraphicsBackend, m_EnvironmentMap);
+
+	// switching environment afterwards is done in the background
+	m_EnvironmentLoader = new EnvironmentLoader(renderer->getDevice(), m_GlobalLighting, m_TextureCache);
 
 	// Create geometry
 	m_CubeMesh = new CubeMesh(renderer->getDevice(), renderer->getDeviceContext());
 	m_SphereMesh = new SphereMesh(renderer->getDevice(), renderer->getDeviceContext());
 	m_PlaneMesh = new PlaneMesh(renderer->getDevice(), renderer->getDeviceContext(), 16);
 	m_ShadowMapMesh = new OrthoMesh(renderer->getDevice(), renderer->getDeviceContext(), 300, 300, (screenWidth / 2) - 150, (screenHeight / 2) - 150);
-	m_TerrainMesh = new TerrainMesh(renderer->getDevice(), 50.0f);
+	m_TerrainMesh = new TerrainMesh(renderer->getDevice(), m_GraphicsBackend, 50.0f);
 
 	// Create the rasterizer state for depth passes
 	m_ShadowRasterDesc.FillMode = D3D11_FILL_SOLID;
@@ -135,6 +226,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	m_ShadowRasterDesc.MultisampleEnable = false;
 	m_ShadowRasterDesc.AntialiasedLineEnable = false;
 	renderer->getDevice()->CreateRasterizerState(&m_ShadowRasterDesc, &m_ShadowRasterizerState);
+	m_SoftwareShadowBaker = new SoftwareShadowBaker(renderer->getDevice(), m_ThreadPool, m_MeshGeometryCache);
 
 	// Setup camera
 	camera->setPosition(20.0f, 16.0f, -24.0f);
@@ -154,6 +246,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 		m_GameObjects.push_back({ { -5.3f, 5, 9 }, m_CubeMesh, m_MaterialLibrary.GetMaterial("Granite") });
 		GameObject& cubeGO = m_GameObjects.back();
 		cubeGO.transform.SetScale({ 0.8f, 1.0f, 0.6f });
+		cubeGO.occluder = true;
 		cubeGO.transform.SetPitch(XMConvertToRadians(17.0f));
 		cubeGO.transform.SetRoll(XMConvertToRadians(-14.0f));
 	}
@@ -161,6 +254,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 		m_GameObjects.push_back({ { 11, 8, 21 }, m_CubeMesh, m_MaterialLibrary.GetMaterial("Gold") });
 		GameObject& cubeGO = m_GameObjects.back();
 		cubeGO.transform.SetScale({ 2.0f, 1.2f, 0.8f });
+		cubeGO.occluder = true;
 		cubeGO.transform.SetPitch(XMConvertToRadians(-24.0f));
 		cubeGO.transform.SetYaw(XMConvertToRadians(-24.0f));
 	}
@@ -173,6 +267,10 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 		terrainGO.AddMaterial(m_MaterialLibrary.GetMaterial("Snow"));
 	}
 
+	// every game object gets a node in the scene graph
+	for (auto& go : m_GameObjects)
+		go.node = m_SceneGraph->CreateNode();
+
 	// create lights
 	for (auto& light : m_Lights)
 	{
@@ -219,6 +317,20 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 		loadSettings(std::string(m_SaveFilePath));
 		applyFilterStack();
 	}
+
+	if (!m_BenchmarkOnStart.empty())
+	{
+		if (m_Benchmark->LoadConfig(m_BenchmarkOnStart))
+		{
+			startBenchmark();
+		}
+		else
+		{
+			// the first frame exits, so the run fails instead of opening the app without a benchmark
+			OutputDebugStringA(("Failed to load benchmark config " + m_BenchmarkOnStart + "\n").c_str());
+			m_BenchmarkSucceeded = false;
+		}
+	}
 }
 
 
@@ -252,8 +364,11 @@ App1::~App1()
 	if (m_SceneRenderTexture) delete m_SceneRenderTexture;
 	if (m_WaterRenderTexture) delete m_WaterRenderTexture;
 
+	// waits for a bake that is running, which uses global lighting
+	if (m_EnvironmentLoader) delete m_EnvironmentLoader;
 	if (m_GlobalLighting) delete m_GlobalLighting;
-	if (m_EnvironmentMap) delete m_EnvironmentMap;
+	if (m_LightingCache) delete m_LightingCache;
+	if (m_ConstantBufferRing) delete m_ConstantBufferRing;
 	if (m_Skybox) delete m_Skybox;
 
 	for (auto& light : m_Lights)
@@ -262,12 +377,36 @@ App1::~App1()
 	}
 
 	m_ShadowRasterizerState->Release();
+	if (m_SoftwareShadowBaker) delete m_SoftwareShadowBaker;
+	if (m_OcclusionCuller) delete m_OcclusionCuller;
+	if (m_MeshGeometryCache) delete m_MeshGeometryCache;
 
 	for (auto filter : m_HeightmapFilters)
 	{
 		if (filter) delete filter;
 	}
 	m_HeightmapFilters.clear();
+
+	if (m_SceneGraph) delete m_SceneGraph;
+	if (m_AssetLoader) delete m_AssetLoader;
+
+	// everything holding textures from the cache has to be gone before it is
+	// the streamer swaps material maps, so it goes first
+	if (m_TextureStreamer) delete m_TextureStreamer;
+	m_MaterialLibrary.Clear();
+	if (m_MaterialArrays) delete m_MaterialArrays;
+	if (m_TextureCache)
+	{
+		m_TextureCache->Release(m_EnvironmentMap);
+		delete m_TextureCache;
+	}
+	if (m_ThreadPool) delete m_ThreadPool;
+
+	// the profiler releases its queries through the backend
+	if (m_Benchmark) delete m_Benchmark;
+	if (m_Profiler) delete m_Profiler;
+	if (m_GraphicsBackend) delete m_GraphicsBackend;
+	if (m_D3D11Backend) delete m_D3D11Backend;
 }
 
 
@@ -275,13 +414,44 @@ bool App1::frame()
 {
 	bool result;
 
+	if (!m_BenchmarkSucceeded)
+	{
+		return false;
+	}
+
 	result = BaseApplication::frame();
 	if (!result)
 	{
 		return false;
 	}
 	
-	m_Time += timer->getTime();
+	if (m_Benchmark->IsRunning())
+	{
+		XMFLOAT3 position = camera->getPosition(), rotation = camera->getRotation();
+		m_Benchmark->BeginFrame(position, rotation);
+		camera->setPosition(position.x, position.y, position.z);
+		camera->setRotation(rotation.x, rotation.y, rotation.z);
+	}
+
+	// fixed while a benchmark is running, so that animation is the same every run
+	m_Time += getDeltaTime();
+
+	// swap in an environment that finished loading in the background
+	if (Cubemap* environment = m_EnvironmentLoader->Update())
+	{
+		m_Skybox->SetCubemap(environment);
+		m_TextureCache->Release(m_EnvironmentMap);
+		m_EnvironmentMap = environment;
+	}
+
+	// unused textures are kept until memory runs short
+	m_TextureCache->Trim();
+
+	// the terrain's patch height ranges arrive a frame or two after it is regenerated
+	m_TerrainMesh->UpdatePatchMinMax(renderer->getDeviceContext());
+
+	updateSceneGraph();
+	updateTextureStreaming();
 
 	// Render the graphics.
 	result = render();
@@ -290,24 +460,82 @@ bool App1::frame()
 		return false;
 	}
 
+	if (m_Benchmark->EndFrame())
+	{
+		bool written = m_Benchmark->WriteResults(m_Benchmark->GetConfig().output);
+		setPlaybackMode(false);
+
+		// started from the command line
+		if (!m_BenchmarkOnStart.empty())
+		{
+			if (!written)
+				OutputDebugStringA(("Failed to write benchmark results " + m_Benchmark->GetConfig().output + "\n").c_str());
+			m_BenchmarkSucceeded = written;
+			return false;
+		}
+	}
+
 	return true;
 }
 
+void App1::startBenchmark()
+{
+	const Benchmark::Config& config = m_Benchmark->GetConfig();
+	if (!config.preset.empty())
+	{
+		loadSettings(config.preset);
+		applyFilterStack();
+	}
+
+	m_Time = 0.0f;
+	setPlaybackMode(true, config.timestep);
+	m_Benchmark->Start();
+}
+
+void App1::updateSceneGraph()
+{
+	// push any modified transforms into the scene graph, then propagate world matrices
+	for (auto& go : m_GameObjects)
+	{
+		if (go.transform.IsDirty())
+		{
+			m_SceneGraph->SetLocalMatrix(go.node, go.transform.GetMatrix());
+			go.transform.ClearDirty();
+		}
+	}
+	m_SceneGraph->UpdateTransforms();
+}
+
 bool App1::render()
 {
 	// Generate the view matrix based on the camera's position.
 	camera->update();
 
+	m_Profiler->BeginFrame();
+	m_GraphicsBackend->ResetStats();
+	m_ConstantBufferRing->BeginFrame();
+
 	// shadow passes
 	renderer->getDeviceContext()->RSSetState(m_ShadowRasterizerState);
-	for (auto light : m_Lights)
 	{
-		if (light->IsEnabled() && light->IsShadowsEnabled())
-			depthPass(light);
+		Profiler::Scope shadowScope(m_Profiler, "Shadows");
+		for (size_t i = 0; i < m_Lights.size(); i++)
+		{
+			SceneLight* light = m_Lights[i];
+			if (m_UseBakedShadows && m_ShadowsBaked[i]) continue;
+			if (light->IsEnabled() && light->IsShadowsEnabled())
+			{
+				Profiler::Scope lightScope(m_Profiler, "Shadow Pass", static_cast<int>(i));
+				depthPass(light);
+			}
+		}
 	}
 	renderer->resetViewport();
 	renderer->setWireframeMode(wireframeToggle); // resets raster state
 
+	// lighting data is the same for every draw this frame
+	m_LightingCache->BeginFrame(renderer->getDeviceContext(), m_Lights.data(), m_Lights.size(), camera);
+
 	// render to a texture if post processing is enabled
 	if (m_EnablePostProcessing && !wireframeToggle)
 	{
@@ -321,10 +549,23 @@ bool App1::render()
 		renderer->setBackBufferRenderTarget();
 	}
 
+	// find what is hidden behind the terrain before drawing
+	{
+		Profiler::Scope scope(m_Profiler, "Occlusion");
+		occlusionPass();
+	}
+
 	// draw everything in the world
-	worldPass();
+	{
+		Profiler::Scope scope(m_Profiler, "World Pass");
+		worldPass();
+	}
 
-	if (m_LightDebugSpheres) renderLightDebugSpheres();
+	if (m_LightDebugSpheres)
+	{
+		Profiler::Scope scope(m_Profiler, "Light Debug Spheres");
+		renderLightDebugSpheres();
+	}
 
 	// post processing
 	renderer->setZBuffer(false);
@@ -335,6 +576,7 @@ bool App1::render()
 		// water is a post-processing effect and rendered afterwards
 		if (m_EnableWater)
 		{
+			Profiler::Scope scope(m_Profiler, "Water");
 			waterPass();
 			outputRT = m_WaterRenderTexture;
 		}
@@ -346,11 +588,18 @@ bool App1::render()
 
 		// Perform image processing on the scene prior to the final pass
 		if (m_FinalPassShader->TonemappingEnabled())
+		{
+			Profiler::Scope scope(m_Profiler, "Luminance");
 			m_MeasureLuminenceShader->Run(renderer->getDeviceContext(), outputRT->GetColourSRV(), outputRT->GetWidth(), outputRT->GetHeight());
+		}
 		if (m_FinalPassShader->BloomEnabled())
+		{
+			Profiler::Scope scope(m_Profiler, "Bloom");
 			m_BloomShader->Run(renderer->getDeviceContext(), outputRT->GetColourSRV());
+		}
 
 		// Final pass, render the post processing effects
+		Profiler::Scope scope(m_Profiler, "Final Pass");
 		m_FinalPassShader->setShaderParameters(renderer->getDeviceContext(), outputRT->GetColourSRV(), outputRT->GetDepthSRV(), m_MeasureLuminenceShader->GetResult(), outputRT->GetWidth(), outputRT->GetHeight(), m_BloomShader->GetSRV());
 		m_FinalPassShader->Render(renderer->getDeviceContext());
 	}
@@ -383,12 +632,19 @@ bool App1::render()
 	renderer->getDeviceContext()->HSSetShader(NULL, NULL, 0);
 	renderer->getDeviceContext()->DSSetShader(NULL, NULL, 0);
 
-	// Build GUI
-	gui();
+	{
+		Profiler::Scope scope(m_Profiler, "ImGui");
+
+		// Build GUI
+		gui();
+
+		// Render UI
+		ImGui::Render();
+		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	}
 
-	// Render UI
-	ImGui::Render();
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	m_ConstantBufferRing->EndFrame();
+	m_Profiler->EndFrame();
 
 	// Swap the buffers
 	renderer->endScene();
@@ -396,6 +652,68 @@ bool App1::render()
 	return true;
 }
 
+void App1::updateTextureStreaming()
+{
+	XMMATRIX worldMatrix = renderer->getWorldMatrix();
+	XMFLOAT3 cameraPosition = camera->getPosition();
+
+	m_TextureStreamer->BeginFrame(renderer->getProjectionMatrix(), static_cast<float>(sHeight));
+	for (auto& go : m_GameObjects)
+	{
+		XMMATRIX w = worldMatrix * m_SceneGraph->GetWorldMatrix(go.node);
+		float distance, extent, uvSize;
+		if (go.meshType == GameObject::MeshType::Terrain)
+		{
+			// drawn from the layer arrays, so its materials' maps can stream out unless something else uses them
+			if (m_TerrainShader->IsUsingLayerArrays()) continue;
+
+			// the height range is only known once the heightmap has been preprocessed
+			float size = go.mesh.terrain->GetSize();
+			XMFLOAT2 heights{ 0.0f, 0.0f };
+			const std::vector<XMFLOAT2>& patches = go.mesh.terrain->GetPatchMinMax();
+			if (!patches.empty()) heights = { FLT_MAX, -FLT_MAX };
+			for (const XMFLOAT2& patch : patches)
+			{
+				heights.x = (std::min)(heights.x, patch.x);
+				heights.y = (std::max)(heights.y, patch.y);
+			}
+
+			distance = TextureStreamer::DistanceToBounds(cameraPosition, { -0.5f * size, heights.x, -0.5f * size }, { 0.5f * size, heights.y, 0.5f * size }, w, &extent);
+			uvSize = size / m_TerrainShader->GetUVScale();
+		}
+		else
+		{
+			// the UVs are taken to span the object once
+			const MeshGeometryCache::Entry& geometry = m_MeshGeometryCache->Get(renderer->getDeviceContext(), go.mesh.regular);
+			distance = TextureStreamer::DistanceToBounds(cameraPosition, geometry.boundsMin, geometry.boundsMax, w, &extent);
+			uvSize = extent;
+		}
+
+		for (Material* material : go.materials)
+			m_TextureStreamer->AddUse(material, distance, uvSize);
+	}
+	m_TextureStreamer->Update();
+}
+
+void App1::occlusionPass()
+{
+	XMMATRIX worldMatrix = renderer->getWorldMatrix();
+
+	m_OcclusionCuller->BeginFrame(camera->getViewMatrix(), renderer->getProjectionMatrix());
+	if (!m_OcclusionCuller->IsEnabled()) return;
+
+	for (auto& go : m_GameObjects)
+	{
+		XMMATRIX w = worldMatrix * m_SceneGraph->GetWorldMatrix(go.node);
+		if (go.meshType == GameObject::MeshType::Terrain)
+			m_OcclusionCuller->AddTerrainOccluder(go.mesh.terrain, w);
+		else if (go.occluder)
+			m_OcclusionCuller->AddOccluder(&m_MeshGeometryCache->Get(renderer->getDeviceContext(), go.mesh.regular).geometry, w);
+	}
+
+	m_OcclusionCuller->RasterizeOccluders();
+}
+
 void App1::depthPass(SceneLight* light)
 {
 	// bind shadow map
@@ -435,7 +753,7 @@ void App1::depthPass(SceneLight* light)
 		{
 			if (!go.castsShadows) continue;
 
-			XMMATRIX w = worldMatrix * go.transform.GetMatrix();
+			XMMATRIX w = worldMatrix * m_SceneGraph->GetWorldMatrix(go.node);
 			switch (go.meshType)
 			{
 			case GameObject::MeshType::Regular:
@@ -455,6 +773,31 @@ void App1::depthPass(SceneLight* light)
 	}
 }
 
+void App1::bakeShadows(SceneLight* light)
+{
+	// same casters and world matrices as the depth pass
+	std::vector<SoftwareShadowBaker::Caster> casters;
+	for (auto& go : m_GameObjects)
+	{
+		if (!go.castsShadows) continue;
+
+		SoftwareShadowBaker::Caster caster;
+		if (go.meshType == GameObject::MeshType::Terrain)
+			caster.terrain = go.mesh.terrain;
+		else
+			caster.mesh = go.mesh.regular;
+		XMStoreFloat4x4(&caster.world, renderer->getWorldMatrix() * m_SceneGraph->GetWorldMatrix(go.node));
+		casters.push_back(caster);
+	}
+
+	m_SoftwareShadowBaker->Bake(renderer->getDeviceContext(), light, casters, m_ShadowRasterDesc);
+
+	for (size_t i = 0; i < m_Lights.size(); i++)
+	{
+		if (m_Lights[i] == light) m_ShadowsBaked[i] = true;
+	}
+}
+
 void App1::worldPass()
 {
 	// Get the world, view, projection, and ortho matrices from the camera and Direct3D objects.
@@ -465,17 +808,29 @@ void App1::worldPass()
 	// render each object with a lit shader
 	for (auto& go : m_GameObjects)
 	{
-		XMMATRIX w = worldMatrix * go.transform.GetMatrix();
+		XMMATRIX w = worldMatrix * m_SceneGraph->GetWorldMatrix(go.node);
+
+		// the terrain is only ever an occluder
+		if (go.meshType == GameObject::MeshType::Regular && m_OcclusionCuller->IsEnabled())
+		{
+			const MeshGeometryCache::Entry& geometry = m_MeshGeometryCache->Get(renderer->getDeviceContext(), go.mesh.regular);
+			if (!m_OcclusionCuller->IsVisible(geometry.boundsMin, geometry.boundsMax, w)) continue;
+		}
+
+		// regular meshes only use their first material
+		if (go.materialSet == LightingCache::InvalidMaterialSet)
+			go.materialSet = m_LightingCache->GetMaterialSet(go.materials.data(), go.meshType == GameObject::MeshType::Terrain ? go.materials.size() : 1);
+
 		switch (go.meshType)
 		{
 		case GameObject::MeshType::Regular:
 			go.mesh.regular->sendData(renderer->getDeviceContext());
-			m_LightShader->setShaderParameters(renderer->getDeviceContext(), w, viewMatrix, projectionMatrix, m_Lights.size(), m_Lights.data(), camera, go.materials[0]);
+			m_LightShader->setShaderParameters(renderer->getDeviceContext(), w, viewMatrix, projectionMatrix, m_LightingCache, go.materialSet);
 			m_LightShader->render(renderer->getDeviceContext(), go.mesh.regular->getIndexCount());
 			break;
 		case GameObject::MeshType::Terrain:
 			go.mesh.terrain->SendData(renderer->getDeviceContext());
-			m_TerrainShader->SetShaderParameters(renderer->getDeviceContext(), w, viewMatrix, projectionMatrix, go.mesh.terrain, m_Lights.size(), m_Lights.data(), camera, go.materials);
+			m_TerrainShader->SetShaderParameters(renderer->getDeviceContext(), w, viewMatrix, projectionMatrix, go.mesh.terrain, m_LightingCache, camera, go.materials, go.materialSet, m_MaterialArrays);
 			m_TerrainShader->Render(renderer->getDeviceContext(), go.mesh.terrain->GetIndexCount());
 			break;
 		default:
@@ -508,7 +863,9 @@ void App1::waterPass()
 	m_WaterRenderTexture->Set(renderer->getDeviceContext());
 
 	// render water
-	m_WaterShader->setShaderParameters(renderer->getDeviceContext(), viewMatrix, projectionMatrix, m_SceneRenderTexture, m_Lights.data(), m_Lights.size(), camera, m_Time);
+	// the skybox and debug passes have bound their own resources since the world pass
+	m_LightingCache->InvalidatePSResources();
+	m_WaterShader->setShaderParameters(renderer->getDeviceContext(), viewMatrix, projectionMatrix, m_SceneRenderTexture, m_LightingCache, camera, m_Time);
 	m_WaterShader->Render(renderer->getDeviceContext());
 }
 
@@ -520,6 +877,7 @@ void App1::renderLightDebugSpheres()
 	XMMATRIX viewMatrix = camera->getViewMatrix();
 	XMMATRIX projectionMatrix = renderer->getProjectionMatrix();
 
+	const MeshGeometryCache::Entry& sphereGeometry = m_MeshGeometryCache->Get(renderer->getDeviceContext(), m_SphereMesh);
 	m_SphereMesh->sendData(renderer->getDeviceContext());
 
 	for (auto& light : m_Lights)
@@ -528,6 +886,7 @@ void App1::renderLightDebugSpheres()
 
 		XMFLOAT3 p = light->GetPosition();
 		XMMATRIX w = worldMatrix * XMMatrixTranslation(p.x, p.y, p.z);
+		if (!m_OcclusionCuller->IsVisible(sphereGeometry.boundsMin, sphereGeometry.boundsMax, w)) continue;
 
 		m_UnlitShader->setShaderParameters(renderer->getDeviceContext(), w, viewMatrix, projectionMatrix);
 		m_UnlitShader->render(renderer->getDeviceContext(), m_SphereMesh->getIndexCount());
@@ -539,6 +898,30 @@ void App1::gui()
 	if (ImGui::CollapsingHeader("General"))
 	{
 		ImGui::Text("FPS: %.2f", timer->getFPS());
+		if (ImGui::TreeNode("Frame Times"))
+		{
+			Timer::FrameStats stats = timer->getFrameStats();
+			ImGui::Text("Last %d frames (ms): mean %.2f, p50 %.2f", stats.count, stats.mean, stats.p50);
+			ImGui::Text("p95 %.2f, p99 %.2f, max %.2f", stats.p95, stats.p99, stats.max);
+			ImGui::Text("Hitches: %d recent, %d total", stats.hitches, timer->getHitchCount());
+
+			static float frameTimes[Timer::frameHistorySize];
+			unsigned int count = timer->getFrameTimes(frameTimes, Timer::frameHistorySize);
+			ImGui::PlotLines("Frame times", frameTimes, count, 0, nullptr, 0.0f, stats.max, ImVec2(0, 60));
+
+			// bucket up to 4x the median, so that hitches land in the last few buckets
+			const int bucketCount = 32;
+			float buckets[bucketCount] = {};
+			float bucketWidth = (std::max)(stats.p50 * 4.0f, 1.0f) / bucketCount;
+			for (unsigned int i = 0; i < count; i++)
+				buckets[(std::min)(static_cast<int>(frameTimes[i] / bucketWidth), bucketCount - 1)] += 1.0f;
+			ImGui::PlotHistogram("Histogram", buckets, bucketCount, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+			ImGui::Text("Bucket width: %.2f ms", bucketWidth);
+
+			if (ImGui::Button("Export CSV"))
+				timer->writeCSV("frametimes.csv");
+			ImGui::TreePop();
+		}
 		ImGui::Checkbox("Wireframe mode", &wireframeToggle);
 		ImGui::Separator();
 
@@ -550,6 +933,43 @@ void App1::gui()
 			camera->setRotation(camRot.x, camRot.y, camRot.z);
 
 		ImGui::Checkbox("Draw Skybox", &m_DrawSkybox);
+		ImGui::Separator();
+
+		if (ImGui::TreeNode("Profiler"))
+		{
+			m_Profiler->SettingsGUI();
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Asset Loading"))
+		{
+			m_AssetLoader->TimingGUI();
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Texture Cache"))
+		{
+			m_TextureCache->SettingsGUI();
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Texture Streaming"))
+		{
+			m_TextureStreamer->SettingsGUI();
+			ImGui::TreePop();
+		}
+		if (GPUMemoryTracker::IsOverBudget())
+			ImGui::TextColored({ 1.0f, 0.3f, 0.3f, 1.0f }, "Over GPU memory budget!");
+		if (ImGui::TreeNode("GPU Memory"))
+		{
+			GPUMemoryTracker::SettingsGUI();
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Benchmark"))
+		{
+			if (m_Benchmark->SettingsGUI(camera->getPosition(), camera->getRotation()))
+				startBenchmark();
+			if (!m_Benchmark->IsRunning() && isPlaybackMode())
+				setPlaybackMode(false);
+			ImGui::TreePop();
+		}
 	}
 	ImGui::Separator();
 
@@ -565,6 +985,43 @@ void App1::gui()
 				if (m_Lights[m_SelectedShadowMap]->GetType() == SceneLight::LightType::Point)
 					ImGui::SliderInt("Cubemap face", &m_SelectedShadowCubemapFace, 0, 5);
 			}
+			ImGui::Separator();
+			if (ImGui::TreeNode("CPU Shadows"))
+			{
+				SceneLight* light = m_Lights[m_SelectedShadowMap];
+				ImGui::SliderInt("Light", &m_SelectedShadowMap, 0, static_cast<int>(m_Lights.size() - 1));
+				if (light->IsShadowsEnabled())
+				{
+					if (ImGui::Button("Bake"))
+						bakeShadows(light);
+					if (m_ShadowsBaked[m_SelectedShadowMap])
+					{
+						// compare before uploading, otherwise the shadow map already contains the bake
+						ImGui::SameLine();
+						if (ImGui::Button("Compare with GPU"))
+							m_SoftwareShadowBaker->Compare(renderer->getDeviceContext(), light, m_BakeCompareTolerance);
+						ImGui::SameLine();
+						if (ImGui::Button("Upload"))
+							m_SoftwareShadowBaker->Upload(renderer->getDeviceContext(), light);
+					}
+				}
+				ImGui::DragFloat("Compare tolerance", &m_BakeCompareTolerance, 0.0001f, 0.0f, 1.0f, "%.4f");
+				ImGui::Checkbox("Use baked shadows", &m_UseBakedShadows);
+				if (ImGui::Button("Clear bakes"))
+				{
+					m_ShadowsBaked.fill(false);
+					m_MeshGeometryCache->Clear();
+				}
+				m_SoftwareShadowBaker->SettingsGUI();
+
+				ImGui::TreePop();
+			}
+			ImGui::Separator();
+			m_LightingCache->SettingsGUI();
+			ImGui::Separator();
+			m_ConstantBufferRing->SettingsGUI();
+			ImGui::Separator();
+			m_GraphicsBackend->SettingsGUI();
 
 			ImGui::TreePop();
 		}
@@ -581,34 +1038,13 @@ void App1::gui()
 			if (selectedSkybox != m_SelectedSkybox)
 			{
 				m_SelectedSkybox = selectedSkybox;
-				delete m_EnvironmentMap;
-				if (m_SelectedSkybox == 0)
-				{
-					m_EnvironmentMap = new Cubemap(renderer->getDevice(), 
-						"res/skybox/right.png", "res/skybox/left.png", 
-						"res/skybox/top.png", "res/skybox/bottom.png",
-						"res/skybox/front.png", "res/skybox/back.png");
-				}
-				else if (m_SelectedSkybox == 1)
-				{
-					m_EnvironmentMap = new Cubemap(renderer->getDevice(),
-						"res/skybox2/px.png", "res/skybox2/nx.png",
-						"res/skybox2/py.png", "res/skybox2/ny.png",
-						"res/skybox2/pz.png", "res/skybox2/nz.png");
-				}
-				else if (m_SelectedSkybox == 2)
-				{
-					m_EnvironmentMap = new Cubemap(renderer->getDevice(),
-						"res/skybox3/px.png", "res/skybox3/nx.png",
-						"res/skybox3/py.png", "res/skybox3/ny.png",
-						"res/skybox3/pz.png", "res/skybox3/nz.png");
-				}
-				m_GlobalLighting->SetAndProcessEnvironmentMap(renderer->getDeviceContext(), m_EnvironmentMap);
-				m_Skybox->SetCubemap(m_EnvironmentMap);
+				// the current environment is kept until the new one is ready
+				m_EnvironmentLoader->Load(s_SkyboxFaces[m_SelectedSkybox]);
 			}
+			m_EnvironmentLoader->ProgressGUI();
 
 			ImGui::Separator();
-			m_GlobalLighting->SettingsGUI();
+			m_GlobalLighting->SettingsGUI(renderer->getDeviceContext());
 			ImGui::Separator();
 
 			int bias = m_ShadowRasterDesc.DepthBias;
@@ -668,6 +1104,24 @@ void App1::gui()
 			{
 				go.SettingsGUI(&m_MaterialLibrary);
 				ImGui::Separator();
+
+				// parent is given as the index of another game object, -1 for none
+				int parent = -1;
+				for (int i = 0; i < m_GameObjects.size(); i++)
+				{
+					if (m_GameObjects[i].node == m_SceneGraph->GetParent(go.node))
+						parent = i;
+				}
+				if (ImGui::InputInt("Parent", &parent))
+				{
+					if (parent < 0 || parent >= m_GameObjects.size())
+						m_SceneGraph->SetParent(go.node, SceneGraph::InvalidNode);
+					else if (parent != index && !m_SceneGraph->IsAncestor(go.node, m_GameObjects[parent].node))
+						m_SceneGraph->SetParent(go.node, m_GameObjects[parent].node);
+				}
+				if (go.meshType == GameObject::MeshType::Regular)
+					ImGui::Checkbox("Occluder", &go.occluder);
+				ImGui::Separator();
 				if (ImGui::Button("Move to Camera"))
 					go.transform.SetTranslation(camera->getPosition());
 				ImGui::Separator();
@@ -676,6 +1130,17 @@ void App1::gui()
 			}
 			index++;
 		}
+
+		if (ImGui::TreeNode("Scene Graph"))
+		{
+			m_SceneGraph->SettingsGUI();
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("Occlusion Culling"))
+		{
+			m_OcclusionCuller->SettingsGUI();
+			ImGui::TreePop();
+		}
 	}
 	ImGui::Separator();
 
@@ -697,7 +1162,7 @@ void App1::gui()
 		}
 		if (ImGui::TreeNode("Bloom"))
 		{
-			m_BloomShader->SettingsGUI();
+			m_BloomShader->SettingsGUI(renderer->getDeviceContext(), (m_EnableWater ? m_WaterRenderTexture : m_SceneRenderTexture)->GetColourSRV());
 			ImGui::TreePop();
 		}
 		if (ImGui::TreeNode("Tone mapping"))
@@ -844,7 +1309,7 @@ void App1::applyFilterStack()
 {
 	for (auto filter : m_HeightmapFilters)
 	{
-		filter->Run(renderer->getDeviceContext(), m_TerrainMesh->GetHeightmapUAV(), m_TerrainMesh->GetHeightmapResolution());
+		filter->Run(renderer->getDeviceContext(), m_ConstantBufferRing, m_TerrainMesh->GetHeightmapUAV(), m_TerrainMesh->GetHeightmapResolution());
 	}
 	m_TerrainMesh->PreprocessHeightmap(renderer->getDeviceContext());
 }
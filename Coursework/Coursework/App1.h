@@ -16,6 +16,7 @@
 
 #include "Transform.h"
 #include "GameObject.h"
+#include "SceneGraph.h"
 
 #include <array>
 
@@ -35,26 +36,53 @@ class BloomShader;
 class FinalPassShader;
 
 class GlobalLighting;
+class LightingCache;
+class ConstantBufferRing;
 class Cubemap;
 class Skybox;
+class EnvironmentLoader;
+
+class ThreadPool;
+class AssetLoader;
+class TextureCache;
+class MaterialArrays;
+class TextureStreamer;
+class MeshGeometryCache;
+class SoftwareShadowBaker;
+class OcclusionCuller;
+class D3D11Backend;
+class RecordingBackend;
+class Profiler;
+class Benchmark;
 
 
 class App1 : public BaseApplication
 {
 public:
 
-	App1();
+	// benchmarkConfig is run as soon as the app has loaded, and the app exits when it finishes
+	App1(const std::string& benchmarkConfig = "");
 	~App1();
 	void init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeight, Input* in, bool VSYNC, bool FULL_SCREEN);
 
 	bool frame();
 
+	// false if the benchmark from the command line couldn't be loaded or its results couldn't be written
+	bool BenchmarkSucceeded() const { return m_BenchmarkSucceeded; }
+
 protected:
 	bool render();
 	void gui();
 
+	void updateSceneGraph();
+	void updateTextureStreaming();
+
+	void startBenchmark();
+
 	// passes
+	void occlusionPass();
 	void depthPass(SceneLight* light);
+	void bakeShadows(SceneLight* light);
 	void worldPass();
 	
 	void waterPass();
@@ -74,6 +102,26 @@ protected:
 private:
 	float m_Time = 0.0f;
 
+	ThreadPool* m_ThreadPool = nullptr;
+	// loads the assets at start up, kept for its timings
+	AssetLoader* m_AssetLoader = nullptr;
+	// shared by everything that loads textures or environments from files
+	TextureCache* m_TextureCache = nullptr;
+	// the terrain materials as texture arrays, if they have been built
+	MaterialArrays* m_MaterialArrays = nullptr;
+	TextureStreamer* m_TextureStreamer = nullptr;
+
+	// graphics backend, the recording backend forwards to D3D11 and counts the commands sent through it
+	D3D11Backend* m_D3D11Backend = nullptr;
+	RecordingBackend* m_GraphicsBackend = nullptr;
+
+	Profiler* m_Profiler = nullptr;
+
+	// scripted flythrough, drives the camera at a fixed timestep while running
+	Benchmark* m_Benchmark = nullptr;
+	std::string m_BenchmarkOnStart;
+	bool m_BenchmarkSucceeded = true;
+
 	// Shaders
 	LightShader* m_LightShader = nullptr;
 	TerrainShader* m_TerrainShader = nullptr;
@@ -94,8 +142,11 @@ private:
 
 	// environment
 	GlobalLighting* m_GlobalLighting = nullptr;
+	LightingCache* m_LightingCache = nullptr;
+	ConstantBufferRing* m_ConstantBufferRing = nullptr;
 	Cubemap* m_EnvironmentMap = nullptr;
 	Skybox* m_Skybox = nullptr;
+	EnvironmentLoader* m_EnvironmentLoader = nullptr;
 	int m_SelectedSkybox = 0;
 	bool m_DrawSkybox = true;
 
@@ -107,6 +158,11 @@ private:
 
 	// game objects
 	std::vector<GameObject> m_GameObjects;
+	SceneGraph* m_SceneGraph = nullptr;
+
+	// CPU copies of mesh geometry, shared by the occlusion culler and the shadow baker
+	MeshGeometryCache* m_MeshGeometryCache = nullptr;
+	OcclusionCuller* m_OcclusionCuller = nullptr;
 
 	// lighting
 	std::array<SceneLight*, 4> m_Lights;
@@ -124,6 +180,12 @@ private:
 	int m_SelectedShadowCubemapFace = 0;
 	OrthoMesh* m_ShadowMapMesh = nullptr;
 
+	// shadow maps rendered on the CPU, lights with a baked shadow map skip their depth pass
+	SoftwareShadowBaker* m_SoftwareShadowBaker = nullptr;
+	std::array<bool, 4> m_ShadowsBaked{ false, false, false, false };
+	bool m_UseBakedShadows = false;
+	float m_BakeCompareTolerance = 0.001f;
+
 	// post processing
 	bool m_EnablePostProcessing = true;
 	bool m_EnableWater = true;
@@ -0,0 +1,202 @@
+#include "AssetLoader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+#include "imGUI/imgui.h"
+
+
+AssetLoader::AssetLoader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, ThreadPool* threadPool, TextureCache* textureCache)
+	: m_Device(device), m_DeviceContext(deviceContext), m_ThreadPool(threadPool), m_TextureCache(textureCache)
+{
+}
+
+AssetLoader::Handle AssetLoader::AddJob(const std::string& name, const Work& work, const std::vector<Handle>& dependencies)
+{
+	return CreateJob(name, work, dependencies, false);
+}
+
+AssetLoader::Handle AssetLoader::AddMainThreadJob(const std::string& name, const Work& work, const std::vector<Handle>& dependencies)
+{
+	return CreateJob(name, work, dependencies, true);
+}
+
+AssetLoader::Handle AssetLoader::AddTexture(const std::wstring& filename, ID3D11ShaderResourceView** srv, GPUMemoryTracker::Category category, const MipGenerator::Settings& mipSettings,
+	unsigned int skipMips, const std::vector<Handle>& dependencies, TextureFallback fallback)
+{
+	std::string name;
+	for (wchar_t c : filename) name += static_cast<char>(c);
+
+	// the cache reads, decodes and creates the texture on this thread, unless it has been loaded already
+	TextureCache* textureCache = m_TextureCache;
+	return AddJob(name, [=]()
+	{
+		*srv = textureCache->Acquire(filename, category, mipSettings, skipMips);
+		if (*srv) return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_FailedTextures.push_back(name);
+		}
+		if (fallback == TextureFallback::Default)
+			*srv = textureCache->AcquireFallback(mipSettings.normalMap);
+	}, dependencies);
+}
+
+void AssetLoader::Run()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Start = start;
+		for (Handle handle = m_FirstUnrun; handle < m_Jobs.size(); handle++)
+		{
+			Job& job = m_Jobs[handle];
+			(job.mainThread ? m_UnfinishedMainThreadJobs : m_UnfinishedWorkerJobs)++;
+			if (job.unfinishedDependencies == 0)
+				(job.mainThread ? m_ReadyMainThreadJobs : m_ReadyWorkerJobs).push_back(handle);
+		}
+		m_FirstUnrun = static_cast<Handle>(m_Jobs.size());
+	}
+
+	// every thread in the pool takes worker jobs while this thread takes the jobs that need the immediate context
+	// the pool blocks whoever dispatches to it, so that is done from another thread
+	std::thread dispatcher([this]()
+	{
+		m_ThreadPool->ParallelFor(m_ThreadPool->GetConcurrency(), 1, [this](size_t, size_t) { ProcessJobs(false); });
+	});
+	ProcessJobs(true);
+	dispatcher.join();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_TotalTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+float AssetLoader::GetSerialTime() const
+{
+	float total = 0.0f;
+	for (const JobTiming& timing : m_Timings)
+		total += timing.duration;
+	return total;
+}
+
+void AssetLoader::TimingGUI()
+{
+	float serial = GetSerialTime();
+	ImGui::Text("Loaded in %.1f ms, %.1f ms of work (%.1fx)", m_TotalTime, serial, m_TotalTime > 0.0f ? serial / m_TotalTime : 0.0f);
+	for (const std::string& failed : m_FailedTextures)
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Failed to load %s", failed.c_str());
+
+	// slowest first
+	std::vector<Handle> order(m_Timings.size());
+	for (Handle i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [this](Handle a, Handle b) { return m_Timings[a].duration > m_Timings[b].duration; });
+
+	ImGui::Separator();
+	ImGui::Columns(4, "asset_loader_columns");
+	ImGui::Text("Asset"); ImGui::NextColumn();
+	ImGui::Text("Thread"); ImGui::NextColumn();
+	ImGui::Text("Start (ms)"); ImGui::NextColumn();
+	ImGui::Text("Time (ms)"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (Handle handle : order)
+	{
+		const JobTiming& timing = m_Timings[handle];
+		ImGui::Text("%s", timing.name.c_str()); ImGui::NextColumn();
+		ImGui::Text(timing.mainThread ? "main" : "pool"); ImGui::NextColumn();
+		ImGui::Text("%.1f", timing.start); ImGui::NextColumn();
+		ImGui::Text("%.1f", timing.duration); ImGui::NextColumn();
+	}
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+}
+
+AssetLoader::Handle AssetLoader::CreateJob(const std::string& name, const Work& work, const std::vector<Handle>& dependencies, bool mainThread)
+{
+	Handle handle = static_cast<Handle>(m_Jobs.size());
+
+	Job job;
+	job.work = work;
+	job.mainThread = mainThread;
+	for (Handle dependency : dependencies)
+	{
+		assert(dependency < handle && "Dependencies must be added first!");
+		if (m_Jobs[dependency].finished) continue;
+		m_Jobs[dependency].dependents.push_back(handle);
+		job.unfinishedDependencies++;
+	}
+	m_Jobs.push_back(job);
+
+	JobTiming timing;
+	timing.name = name;
+	timing.mainThread = mainThread;
+	m_Timings.push_back(timing);
+
+	return handle;
+}
+
+void AssetLoader::ProcessJobs(bool mainThread)
+{
+	std::deque<Handle>& ready = mainThread ? m_ReadyMainThreadJobs : m_ReadyWorkerJobs;
+	unsigned int& unfinished = mainThread ? m_UnfinishedMainThreadJobs : m_UnfinishedWorkerJobs;
+	std::condition_variable& wake = mainThread ? m_MainThreadWake : m_WorkerWake;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		// nothing ready doesn't mean done, a job running elsewhere may make more ready
+		wake.wait(lock, [&]() { return !ready.empty() || unfinished == 0; });
+		if (ready.empty()) return;
+
+		Handle handle = ready.front();
+		ready.pop_front();
+		Work work;
+		work.swap(m_Jobs[handle].work);
+		lock.unlock();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		work();
+		auto end = std::chrono::high_resolution_clock::now();
+		work = nullptr;
+
+		lock.lock();
+		m_Timings[handle].start = std::chrono::duration<float, std::milli>(start - m_Start).count();
+		m_Timings[handle].duration = std::chrono::duration<float, std::milli>(end - start).count();
+		FinishJob(handle);
+	}
+}
+
+void AssetLoader::FinishJob(Handle handle)
+{
+	// called with the mutex locked
+	Job& job = m_Jobs[handle];
+	job.finished = true;
+
+	for (Handle dependent : job.dependents)
+	{
+		Job& other = m_Jobs[dependent];
+		if (--other.unfinishedDependencies > 0) continue;
+
+		if (other.mainThread)
+		{
+			m_ReadyMainThreadJobs.push_back(dependent);
+			m_MainThreadWake.notify_one();
+		}
+		else
+		{
+			m_ReadyWorkerJobs.push_back(dependent);
+			m_WorkerWake.notify_one();
+		}
+	}
+
+	// wake anything waiting for work that will never come
+	if (--(job.mainThread ? m_UnfinishedMainThreadJobs : m_UnfinishedWorkerJobs) == 0)
+		(job.mainThread ? m_MainThreadWake : m_WorkerWake).notify_all();
+}
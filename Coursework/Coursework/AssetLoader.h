@@ -0,0 +1,123 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "GPUMemoryTracker.h"
+#include "MipGenerator.h"
+
+class TextureCache;
+class ThreadPool;
+
+
+// Runs the jobs that load assets at start up as a dependency graph
+// Jobs that only read files, decode or use the (free threaded) device run on the thread pool,
+// jobs that need the immediate context run on the thread that calls Run, as soon as their dependencies finish
+//
+// Textures are read, decoded, given their mips and created on the pool through the texture cache, as the device is free threaded
+// Every job is timed, so the slowest assets can be found
+
+class AssetLoader
+{
+public:
+	typedef unsigned int Handle;
+	typedef std::function<void()> Work;
+
+	// what a texture that fails to load is replaced with
+	enum class TextureFallback
+	{
+		Default,	// the texture cache's white or flat normal texture
+		None		// left null, for users that have a fallback of their own
+	};
+
+	struct JobTiming
+	{
+		std::string name;
+		bool mainThread = false;
+		// from the start of the Run it was part of, in ms
+		float start = 0.0f;
+		float duration = 0.0f;
+	};
+
+public:
+	AssetLoader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, ThreadPool* threadPool, TextureCache* textureCache);
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// dependencies must have been added before the job that depends on them
+	Handle AddJob(const std::string& name, const Work& work, const std::vector<Handle>& dependencies = {});
+	Handle AddMainThreadJob(const std::string& name, const Work& work, const std::vector<Handle>& dependencies = {});
+
+	// srv is set once the returned job has finished and should be released to the texture cache
+	// mips are generated with mipSettings for anything that isn't a DDS, and the largest skipMips of them are left out
+	// a file that fails to load is added to GetFailedTextures and srv is set to the fallback
+	Handle AddTexture(const std::wstring& filename, ID3D11ShaderResourceView** srv, GPUMemoryTracker::Category category, const MipGenerator::Settings& mipSettings = MipGenerator::Settings(),
+		unsigned int skipMips = 0, const std::vector<Handle>& dependencies = {}, TextureFallback fallback = TextureFallback::Default);
+
+	// runs every job that has been added since the last run and returns when they have all finished
+	void Run();
+
+	inline ID3D11Device* GetDevice() const { return m_Device; }
+	// for main thread jobs
+	inline ID3D11DeviceContext* GetDeviceContext() const { return m_DeviceContext; }
+	inline TextureCache* GetTextureCache() const { return m_TextureCache; }
+	inline const std::vector<JobTiming>& GetTimings() const { return m_Timings; }
+	// once Run has returned
+	inline const std::vector<std::string>& GetFailedTextures() const { return m_FailedTextures; }
+	// wall clock time of the last Run, and the time the jobs would have taken one after another
+	inline float GetTotalTime() const { return m_TotalTime; }
+	float GetSerialTime() const;
+
+	void TimingGUI();
+
+private:
+	struct Job
+	{
+		// released once it has run
+		Work work;
+		bool mainThread = false;
+		bool finished = false;
+		unsigned int unfinishedDependencies = 0;
+		std::vector<Handle> dependents;
+	};
+
+	Handle CreateJob(const std::string& name, const Work& work, const std::vector<Handle>& dependencies, bool mainThread);
+
+	// process ready jobs until there are none left that this thread can run
+	void ProcessJobs(bool mainThread);
+	void FinishJob(Handle handle);
+
+private:
+	ID3D11Device* m_Device = nullptr;
+	ID3D11DeviceContext* m_DeviceContext = nullptr;
+	ThreadPool* m_ThreadPool = nullptr;
+	TextureCache* m_TextureCache = nullptr;
+
+	// indexed by handle
+	std::vector<Job> m_Jobs;
+	std::vector<JobTiming> m_Timings;
+	// added to by jobs with the mutex held
+	std::vector<std::string> m_FailedTextures;
+	// jobs before this have been run
+	Handle m_FirstUnrun = 0;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkerWake;
+	std::condition_variable m_MainThreadWake;
+	std::deque<Handle> m_ReadyWorkerJobs;
+	std::deque<Handle> m_ReadyMainThreadJobs;
+	unsigned int m_UnfinishedWorkerJobs = 0;
+	unsigned int m_UnfinishedMainThreadJobs = 0;
+
+	// start of the current run
+	std::chrono::high_resolution_clock::time_point m_Start;
+	float m_TotalTime = 0.0f;
+};
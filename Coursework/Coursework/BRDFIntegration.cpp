@@ -0,0 +1,149 @@
+#include "BRDFIntegration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "DDSFile.h"
+#include "ThreadPool.h"
+
+
+std::vector<uint16_t> BRDFIntegration::Generate(unsigned int resolution, unsigned int sampleCount, ThreadPool* threadPool)
+{
+	std::vector<uint16_t> lut(static_cast<size_t>(resolution) * resolution * 2);
+
+	// the half vectors only depend on roughness, so they are shared by every texel in a row
+	threadPool->ParallelFor(resolution, 1, [&](size_t begin, size_t end)
+	{
+		std::vector<XMFLOAT3> halfVectors;
+		for (size_t y = begin; y < end; y++)
+		{
+			// texel centres at 0 and 1, like the compute shader this replaced
+			float roughness = static_cast<float>(y) / (resolution - 1);
+			ImportanceSampleGGX(roughness, sampleCount, halfVectors);
+
+			uint16_t* row = lut.data() + y * resolution * 2;
+			for (unsigned int x = 0; x < resolution; x++)
+			{
+				float NdotV = static_cast<float>(x) / (resolution - 1);
+				XMFLOAT2 value = Integrate(NdotV, roughness, halfVectors);
+
+				row[2 * x] = static_cast<uint16_t>(std::lround((std::min)((std::max)(value.x, 0.0f), 1.0f) * 65535.0f));
+				row[2 * x + 1] = static_cast<uint16_t>(std::lround((std::min)((std::max)(value.y, 0.0f), 1.0f) * 65535.0f));
+			}
+		}
+	});
+
+	return lut;
+}
+
+XMFLOAT2 BRDFIntegration::Integrate(float NdotV, float roughness, unsigned int sampleCount)
+{
+	std::vector<XMFLOAT3> halfVectors;
+	ImportanceSampleGGX(roughness, sampleCount, halfVectors);
+	return Integrate(NdotV, roughness, halfVectors);
+}
+
+bool BRDFIntegration::Save(const std::string& file, const std::vector<uint16_t>& lut, unsigned int resolution)
+{
+	DDSFile::Image image;
+	image.format = DXGI_FORMAT_R16G16_UNORM;
+	image.width = resolution;
+	image.height = resolution;
+	image.data.resize(lut.size() * sizeof(uint16_t));
+	memcpy(image.data.data(), lut.data(), image.data.size());
+	return DDSFile::Write(file, image);
+}
+
+bool BRDFIntegration::Load(const std::string& file, std::vector<uint16_t>* lut, unsigned int* resolution)
+{
+	DDSFile::Image image;
+	if (!DDSFile::Read(file, &image)) return false;
+	if (image.format != DXGI_FORMAT_R16G16_UNORM || image.width != image.height || image.mipLevels != 1 || image.arraySize != 1)
+		return false;
+
+	lut->resize(image.data.size() / sizeof(uint16_t));
+	memcpy(lut->data(), image.data.data(), image.data.size());
+	*resolution = image.width;
+	return true;
+}
+
+bool BRDFIntegration::Bake(const std::string& file)
+{
+	ThreadPool threadPool;
+	std::vector<uint16_t> lut = Generate(DefaultResolution, DefaultSampleCount, &threadPool);
+
+	std::vector<uint16_t> existing;
+	unsigned int resolution = 0;
+	if (Load(file, &existing, &resolution) && resolution == DefaultResolution && existing == lut)
+		return true;
+	return Save(file, lut, DefaultResolution);
+}
+
+float BRDFIntegration::RadicalInverse(uint32_t bits)
+{
+	// Van der Corput sequence, the same bit reversal as in math.hlsli
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+void BRDFIntegration::ImportanceSampleGGX(float roughness, unsigned int sampleCount, std::vector<XMFLOAT3>& halfVectors)
+{
+	halfVectors.resize(sampleCount);
+
+	float a = roughness * roughness;
+	for (unsigned int i = 0; i < sampleCount; i++)
+	{
+		// Hammersley point
+		float xi0 = static_cast<float>(i) / sampleCount;
+		float xi1 = RadicalInverse(i);
+
+		float phi = 2.0f * XM_PI * xi0;
+		float cosTheta = std::sqrt((1.0f - xi1) / (1.0f + (a * a - 1.0f) * xi1));
+		float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+		// the tangent frame ImportanceSampleGGX in lighting.hlsli picks for a normal of +z
+		float hx = std::cos(phi) * sinTheta;
+		float hy = std::sin(phi) * sinTheta;
+		halfVectors[i] = XMFLOAT3(hy, -hx, cosTheta);
+	}
+}
+
+XMFLOAT2 BRDFIntegration::Integrate(float NdotV, float roughness, const std::vector<XMFLOAT3>& halfVectors)
+{
+	// at grazing angles the visibility term divides by zero, so keep just inside the hemisphere
+	NdotV = (std::max)(NdotV, 1e-4f);
+	XMFLOAT3 v(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+
+	// schlick-ggx geometry with the IBL definition of k
+	float k = (roughness * roughness) / 2.0f;
+	auto geometry = [k](float NdotX) { return NdotX / (NdotX * (1.0f - k) + k); };
+	float geometryV = geometry(NdotV);
+
+	float a = 0.0f;
+	float b = 0.0f;
+	for (const XMFLOAT3& h : halfVectors)
+	{
+		// reflect the view direction about the half vector
+		float VdotH = v.x * h.x + v.y * h.y + v.z * h.z;
+		float NdotL = 2.0f * VdotH * h.z - v.z;
+		if (NdotL <= 0.0f) continue;
+
+		VdotH = (std::max)(VdotH, 0.0f);
+		float NdotH = (std::max)(h.z, 0.0f);
+
+		float g = geometry(NdotL) * geometryV;
+		float gVis = (g * VdotH) / (NdotH * NdotV);
+		float fc = std::pow(1.0f - VdotH, 5.0f);
+
+		a += (1.0f - fc) * gVis;
+		b += fc * gVis;
+	}
+
+	float count = static_cast<float>(halfVectors.size());
+	return XMFLOAT2(a / count, b / count);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+class ThreadPool;
+
+
+// The split-sum BRDF integration lookup table for specular IBL
+// It only depends on NdotV (along x) and roughness (along y), so it is generated once on the CPU and stored as an asset,
+// the build runs the application with "-bake-brdf" after every link, so changes to the generator reach the asset
+//
+// Each texel is the (scale, bias) applied to F0, stored as R16G16_UNORM
+
+class BRDFIntegration
+{
+public:
+	static const unsigned int DefaultResolution = 512;
+	static const unsigned int DefaultSampleCount = 1024;
+
+public:
+	// pure static class
+	BRDFIntegration() = delete;
+
+	// texels are interleaved scale and bias, rows of increasing roughness
+	static std::vector<uint16_t> Generate(unsigned int resolution, unsigned int sampleCount, ThreadPool* threadPool);
+	// a single texel, using the same Hammersley sampling of the GGX distribution as the shaders
+	static XMFLOAT2 Integrate(float NdotV, float roughness, unsigned int sampleCount);
+
+	static bool Save(const std::string& file, const std::vector<uint16_t>& lut, unsigned int resolution);
+	static bool Load(const std::string& file, std::vector<uint16_t>* lut, unsigned int* resolution);
+
+	// generate with a thread pool of its own and save, for the command line
+	// a file that already matches is left alone, so the build doesn't touch it every time
+	static bool Bake(const std::string& file);
+
+private:
+	static float RadicalInverse(uint32_t bits);
+	// half vectors for every sample at this roughness, around +z
+	static void ImportanceSampleGGX(float roughness, unsigned int sampleCount, std::vector<XMFLOAT3>& halfVectors);
+	static XMFLOAT2 Integrate(float NdotV, float roughness, const std::vector<XMFLOAT3>& halfVectors);
+};
@@ -3,8 +3,8 @@
 #include <cassert>
 
 
-BaseFullScreenShader::BaseFullScreenShader(ID3D11Device* device)
-	: m_Device(device)
+BaseFullScreenShader::BaseFullScreenShader(ID3D11Device* device, IGraphicsBackend* backend)
+	: m_Device(device), m_Backend(backend)
 {
 }
 
@@ -37,7 +37,7 @@ void BaseFullScreenShader::Render(ID3D11DeviceContext* deviceContext)
 	deviceContext->PSSetShader(m_PixelShader, nullptr, 0);
 
 	// 4 indices are drawn, and these indices are used to construct the geometry in the vertex shader
-	deviceContext->Draw(4, 0);
+	m_Backend->Draw(4, 0);
 
 	deviceContext->VSSetShader(nullptr, nullptr, 0);
 	deviceContext->PSSetShader(nullptr, nullptr, 0);
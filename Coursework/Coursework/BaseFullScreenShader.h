@@ -3,13 +3,15 @@
 #include <d3d11.h>
 #include <d3dcompiler.h>
 
+#include "GraphicsBackend.h"
+
 /*
 A base class for any pixel shader that needs to be ran for every pixel on the display
 */
 class BaseFullScreenShader
 {
 public:
-	BaseFullScreenShader(ID3D11Device* device);
+	BaseFullScreenShader(ID3D11Device* device, IGraphicsBackend* backend);
 	virtual ~BaseFullScreenShader();
 
 
@@ -27,6 +29,7 @@ private:
 
 protected:
 	ID3D11Device* m_Device;
+	IGraphicsBackend* m_Backend;
 
 	ID3D11VertexShader* m_VertexShader = nullptr;
 	ID3D11PixelShader* m_PixelShader = nullptr;
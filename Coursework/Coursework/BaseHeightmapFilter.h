@@ -5,6 +5,8 @@
 #include <DirectXMath.h>
 #include "nlohmann/json.hpp"
 
+#include "ConstantBufferRing.h"
+
 
 class IHeightmapFilter
 {
@@ -12,7 +14,7 @@ public:
 	virtual ~IHeightmapFilter() = default;
 
 	// pure virtual methods for BaseHeightmapFilter to implemente
-	virtual void Run(ID3D11DeviceContext* deviceContext, ID3D11UnorderedAccessView* heightmap, unsigned int heightmapResolution) = 0;
+	virtual void Run(ID3D11DeviceContext* deviceContext, ConstantBufferRing* constantBufferRing, ID3D11UnorderedAccessView* heightmap, unsigned int heightmapResolution) = 0;
 	virtual bool SettingsGUI() = 0;
 	virtual nlohmann::json Serialize() const = 0;
 	virtual void LoadFromJson(const nlohmann::json& data) = 0;
@@ -48,40 +50,26 @@ public:
 		m_Device->CreateComputeShader(computeShaderBuffer->GetBufferPointer(), computeShaderBuffer->GetBufferSize(), NULL, &m_ComputeShader);
 
 		computeShaderBuffer->Release();
-
-		// Setup description of heightmap settings constant buffer
-		D3D11_BUFFER_DESC settingsBufferDesc;
-		settingsBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-		settingsBufferDesc.ByteWidth = sizeof(SettingsType);
-		settingsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		settingsBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		settingsBufferDesc.MiscFlags = 0;
-		settingsBufferDesc.StructureByteStride = 0;
-		m_Device->CreateBuffer(&settingsBufferDesc, NULL, &m_SettingsBuffer);
 	}
 
 	virtual ~BaseHeightmapFilter()
 	{
 		if (m_ComputeShader) m_ComputeShader->Release();
-		if (m_SettingsBuffer) m_SettingsBuffer->Release();
 	}
 
-	virtual void Run(ID3D11DeviceContext* deviceContext, ID3D11UnorderedAccessView* heightmap, unsigned int heightmapResolution) override final
+	virtual void Run(ID3D11DeviceContext* deviceContext, ConstantBufferRing* constantBufferRing, ID3D11UnorderedAccessView* heightmap, unsigned int heightmapResolution) override final
 	{
 		deviceContext->CSSetUnorderedAccessViews(0, 1, &heightmap, nullptr);
 
-		// update data in constant buffer
-		D3D11_MAPPED_SUBRESOURCE mappedResource;
-		deviceContext->Map(m_SettingsBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		memcpy(mappedResource.pData, &m_Settings, sizeof(m_Settings));
-		deviceContext->Unmap(m_SettingsBuffer, 0);
-		deviceContext->CSSetConstantBuffers(0, 1, &m_SettingsBuffer);
+		// settings are uploaded into the constant buffer ring
+		ConstantBufferRing::Allocation settingsBuffer = constantBufferRing->Upload(&m_Settings, sizeof(m_Settings));
+		constantBufferRing->BindCS(0, { settingsBuffer });
 
 		deviceContext->CSSetShader(m_ComputeShader, nullptr, 0);
 
 		// assume thread groups consist of 16x16x1 threads
 		unsigned int groupCount = (heightmapResolution + 15) / 16; // (fast ceiling of integer division)
-		deviceContext->Dispatch(groupCount, groupCount, 1);
+		constantBufferRing->GetBackend()->Dispatch(groupCount, groupCount, 1);
 
 		deviceContext->CSSetShader(nullptr, nullptr, 0);
 
@@ -113,6 +101,5 @@ protected:
 
 	ID3D11ComputeShader* m_ComputeShader = nullptr;
 	
-	ID3D11Buffer* m_SettingsBuffer = nullptr;
 	SettingsType m_Settings;
 };
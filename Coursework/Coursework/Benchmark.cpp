@@ -0,0 +1,338 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "Profiler.h"
+
+#include "imGUI/imgui.h"
+
+
+namespace
+{
+	// frames left to run after the last measured frame before giving up on its GPU timings
+	const int MaxDrainFrames = 16;
+
+	nlohmann::json Summarize(std::vector<float> samples)
+	{
+		nlohmann::json summary;
+		summary["samples"] = samples.size();
+		if (samples.empty()) return summary;
+
+		std::sort(samples.begin(), samples.end());
+		double total = 0.0;
+		for (float s : samples) total += s;
+
+		// nearest rank percentile
+		auto percentile = [&](float p)
+		{
+			size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+			return samples[std::min(std::max(rank, static_cast<size_t>(1)), samples.size()) - 1];
+		};
+
+		summary["mean"] = total / samples.size();
+		summary["min"] = samples.front();
+		summary["max"] = samples.back();
+		summary["p50"] = percentile(0.50f);
+		summary["p95"] = percentile(0.95f);
+		summary["p99"] = percentile(0.99f);
+		return summary;
+	}
+}
+
+
+nlohmann::json Benchmark::Config::Serialize() const
+{
+	nlohmann::json serialized;
+	serialized["preset"] = preset;
+	serialized["frames"] = frames;
+	serialized["warmupFrames"] = warmupFrames;
+	serialized["timestep"] = timestep;
+	serialized["output"] = output;
+	serialized["path"] = path.Serialize();
+	return serialized;
+}
+
+void Benchmark::Config::LoadFromJson(const nlohmann::json& data)
+{
+	if (data.contains("preset")) preset = data["preset"];
+	if (data.contains("frames")) frames = data["frames"];
+	if (data.contains("warmupFrames")) warmupFrames = data["warmupFrames"];
+	if (data.contains("timestep")) timestep = data["timestep"];
+	if (data.contains("output")) output = data["output"];
+	if (data.contains("path")) path.LoadFromJson(data["path"]);
+}
+
+
+Benchmark::Benchmark(Profiler* profiler)
+	: m_Profiler(profiler)
+{
+}
+
+bool Benchmark::LoadConfig(const std::string& file)
+{
+	std::ifstream infile(file);
+	if (!infile.is_open()) return false;
+
+	nlohmann::json data = nlohmann::json::parse(infile, nullptr, false);
+	if (data.is_discarded()) return false;
+
+	m_Config = Config();
+	m_Config.LoadFromJson(data);
+	return true;
+}
+
+bool Benchmark::SaveConfig(const std::string& file) const
+{
+	std::ofstream outfile(file);
+	if (!outfile.is_open()) return false;
+	outfile << m_Config.Serialize().dump(4);
+	return outfile.good();
+}
+
+void Benchmark::Start()
+{
+	assert(m_Profiler && "Benchmark needs a profiler!");
+
+	m_Frame = 0;
+	m_DrainFrames = 0;
+	m_FrameCPU.clear();
+	m_FrameGPU.clear();
+	m_FrameInterval.clear();
+	m_LastFrameStart = -1.0;
+	m_Passes.clear();
+
+	// every measured frame has to be profiled
+	m_ProfilerWasEnabled = m_Profiler->IsEnabled();
+	m_Profiler->SetEnabled(true);
+
+	m_State = m_Config.warmupFrames > 0 ? State::Warmup : State::Measuring;
+	m_FirstFrameIndex = m_Profiler->GetNextFrameIndex();
+	m_Status = "Running";
+}
+
+void Benchmark::Stop()
+{
+	if (!IsRunning()) return;
+
+	m_Profiler->SetEnabled(m_ProfilerWasEnabled);
+	m_State = State::Idle;
+	m_Status = "Aborted";
+}
+
+void Benchmark::BeginFrame(XMFLOAT3& cameraPosition, XMFLOAT3& cameraRotation)
+{
+	if (!IsRunning()) return;
+
+	if (m_State == State::Warmup && m_Frame >= m_Config.warmupFrames)
+		m_State = State::Measuring;
+	if (m_State == State::Measuring && m_Frame == m_Config.warmupFrames)
+	{
+		m_FirstFrameIndex = m_Profiler->GetNextFrameIndex();
+		m_LastFrameIndex = m_FirstFrameIndex + GetMeasuredFrameCount() - 1;
+		m_CollectedUpTo = m_FirstFrameIndex;
+	}
+
+	// warmup holds the start of the path, draining holds the end
+	int measuredFrame = std::min(std::max(m_Frame - m_Config.warmupFrames, 0), GetMeasuredFrameCount() - 1);
+	float time = m_Config.path.IsEmpty() ? 0.0f : m_Config.path.GetKeyframes().front().time + measuredFrame * m_Config.timestep;
+	m_Config.path.Evaluate(time, cameraPosition, cameraRotation);
+}
+
+bool Benchmark::EndFrame()
+{
+	if (!IsRunning()) return false;
+
+	m_Frame++;
+	if (m_State == State::Warmup) return false;
+
+	CollectTimings();
+
+	if (m_State == State::Measuring && m_Frame >= m_Config.warmupFrames + GetMeasuredFrameCount())
+		m_State = State::Draining;
+	if (m_State == State::Draining)
+	{
+		if (m_CollectedUpTo > m_LastFrameIndex || ++m_DrainFrames > MaxDrainFrames)
+		{
+			m_Profiler->SetEnabled(m_ProfilerWasEnabled);
+			m_State = State::Finished;
+			m_Status = "Finished, " + std::to_string(m_FrameCPU.size()) + " frames measured (" + std::to_string(m_FrameGPU.size()) + " with GPU timings)";
+			return true;
+		}
+	}
+	return false;
+}
+
+float Benchmark::GetProgress() const
+{
+	if (m_State == State::Idle) return 0.0f;
+	if (m_State == State::Finished) return 1.0f;
+
+	int total = m_Config.warmupFrames + GetMeasuredFrameCount();
+	return std::min(static_cast<float>(m_Frame) / total, 1.0f);
+}
+
+nlohmann::json Benchmark::GetResults() const
+{
+	nlohmann::json results;
+
+	nlohmann::json build;
+	build["date"] = __DATE__;
+	build["time"] = __TIME__;
+#ifdef _DEBUG
+	build["configuration"] = "Debug";
+#else
+	build["configuration"] = "Release";
+#endif
+	results["build"] = build;
+
+	results["preset"] = m_Config.preset;
+	results["frames"] = GetMeasuredFrameCount();
+	results["warmupFrames"] = m_Config.warmupFrames;
+	results["timestep"] = m_Config.timestep;
+	results["keyframes"] = m_Config.path.GetKeyframes().size();
+
+	// cpu is the time from the start to the end of the profiled frame, interval is from one frame start to the next (including present)
+	nlohmann::json frame;
+	frame["cpu"] = Summarize(m_FrameCPU);
+	frame["gpu"] = Summarize(m_FrameGPU);
+	frame["interval"] = Summarize(m_FrameInterval);
+	results["frame"] = frame;
+
+	nlohmann::json passes = nlohmann::json::array();
+	for (const PassSamples& pass : m_Passes)
+	{
+		nlohmann::json p;
+		p["name"] = pass.index >= 0 ? pass.name + " " + std::to_string(pass.index) : pass.name;
+		p["depth"] = pass.depth;
+		p["cpu"] = Summarize(pass.cpu);
+		p["gpu"] = Summarize(pass.gpu);
+		passes.push_back(p);
+	}
+	results["passes"] = passes;
+
+	return results;
+}
+
+bool Benchmark::WriteResults(const std::string& file) const
+{
+	std::ofstream outfile(file);
+	if (!outfile.is_open()) return false;
+	outfile << GetResults().dump(4);
+	return outfile.good();
+}
+
+bool Benchmark::SettingsGUI(const XMFLOAT3& cameraPosition, const XMFLOAT3& cameraRotation)
+{
+	if (IsRunning())
+	{
+		ImGui::Text(m_State == State::Warmup ? "Warming up" : m_State == State::Measuring ? "Measuring" : "Waiting for GPU timings");
+		ImGui::ProgressBar(GetProgress());
+		if (ImGui::Button("Abort"))
+			Stop();
+		return false;
+	}
+
+	ImGui::InputText("Config file", m_ConfigFile, sizeof(m_ConfigFile));
+	if (ImGui::Button("Load"))
+	{
+		m_Status = LoadConfig(m_ConfigFile) ? "Loaded config" : "Failed to load config!";
+		m_PresetBuffer[0] = '\0';
+		m_OutputBuffer[0] = '\0';
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Save"))
+		m_Status = SaveConfig(m_ConfigFile) ? "Saved config" : "Failed to save config!";
+
+	// the text buffers are filled from the config whenever it changes underneath them
+	if (m_PresetBuffer[0] == '\0') strncpy_s(m_PresetBuffer, m_Config.preset.c_str(), _TRUNCATE);
+	if (m_OutputBuffer[0] == '\0') strncpy_s(m_OutputBuffer, m_Config.output.c_str(), _TRUNCATE);
+	if (ImGui::InputText("Preset", m_PresetBuffer, sizeof(m_PresetBuffer)))
+		m_Config.preset = m_PresetBuffer;
+	if (ImGui::InputText("Results file", m_OutputBuffer, sizeof(m_OutputBuffer)))
+		m_Config.output = m_OutputBuffer;
+
+	ImGui::DragInt("Frames", &m_Config.frames, 1.0f, 0, 100000);
+	ImGui::SameLine();
+	ImGui::Text("(%d)", GetMeasuredFrameCount());
+	ImGui::DragInt("Warmup frames", &m_Config.warmupFrames, 1.0f, 0, 1000);
+	ImGui::DragFloat("Timestep", &m_Config.timestep, 0.001f, 0.001f, 0.1f, "%.4f");
+	ImGui::Separator();
+
+	ImGui::Text("Path: %d keyframes, %.2f s", static_cast<int>(m_Config.path.GetKeyframes().size()), m_Config.path.GetDuration());
+	ImGui::DragFloat("Keyframe spacing", &m_KeyframeSpacing, 0.1f, 0.1f, 60.0f, "%.1f s");
+	if (ImGui::Button("Add keyframe at camera"))
+	{
+		float time = m_Config.path.IsEmpty() ? 0.0f : m_Config.path.GetKeyframes().back().time + m_KeyframeSpacing;
+		m_Config.path.AddKeyframe(time, cameraPosition, cameraRotation);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Clear path"))
+		m_Config.path.Clear();
+	ImGui::Separator();
+
+	bool start = false;
+	if (m_Config.path.IsEmpty())
+		ImGui::Text("Record or load a path to run the benchmark");
+	else
+		start = ImGui::Button("Run");
+
+	if (!m_Status.empty())
+		ImGui::Text("%s", m_Status.c_str());
+	return start;
+}
+
+int Benchmark::GetMeasuredFrameCount() const
+{
+	if (m_Config.frames > 0) return m_Config.frames;
+
+	float timestep = std::max(m_Config.timestep, 1e-4f);
+	return std::max(static_cast<int>(std::ceil(m_Config.path.GetDuration() / timestep)) + 1, 1);
+}
+
+void Benchmark::CollectTimings()
+{
+	// find the first resolved frame that hasn't been collected yet, history is ordered by frame index
+	const std::deque<Profiler::FrameTiming>& history = m_Profiler->GetHistory();
+	size_t first = history.size();
+	while (first > 0 && history[first - 1].frameIndex >= m_CollectedUpTo)
+		first--;
+
+	for (size_t i = first; i < history.size(); i++)
+	{
+		const Profiler::FrameTiming& frame = history[i];
+		if (frame.frameIndex > m_LastFrameIndex) break;
+		m_CollectedUpTo = frame.frameIndex + 1;
+
+		m_FrameCPU.push_back(static_cast<float>(frame.cpuEnd - frame.cpuStart));
+		if (frame.gpuValid)
+			m_FrameGPU.push_back(static_cast<float>(frame.gpuDuration));
+		if (m_LastFrameStart >= 0.0)
+			m_FrameInterval.push_back(static_cast<float>(frame.cpuStart - m_LastFrameStart));
+		m_LastFrameStart = frame.cpuStart;
+
+		// passes are matched by name, index and depth, in the order they were first seen
+		for (const Profiler::ScopeTiming& scope : frame.scopes)
+		{
+			auto it = std::find_if(m_Passes.begin(), m_Passes.end(), [&](const PassSamples& p)
+			{
+				return p.index == scope.index && p.depth == scope.depth && p.name == scope.name;
+			});
+			if (it == m_Passes.end())
+			{
+				PassSamples pass;
+				pass.name = scope.name;
+				pass.index = scope.index;
+				pass.depth = scope.depth;
+				it = m_Passes.insert(m_Passes.end(), pass);
+			}
+
+			it->cpu.push_back(static_cast<float>(scope.cpuEnd - scope.cpuStart));
+			if (frame.gpuValid)
+				it->gpu.push_back(static_cast<float>(scope.gpuEnd - scope.gpuStart));
+		}
+	}
+}
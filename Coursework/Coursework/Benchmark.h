@@ -0,0 +1,118 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CameraPath.h"
+
+using namespace DirectX;
+
+class Profiler;
+
+
+// Deterministic flythrough benchmark
+// The camera is driven along a recorded path at a fixed simulated timestep (input is ignored while it runs),
+// so every run renders exactly the same frames regardless of how fast they are drawn.
+// Per pass CPU and GPU times are taken from the profiler for the measured frames, and written out as JSON once all
+// of the GPU timings have resolved
+//
+// A run is: warmup frames held at the start of the path, then the measured frames, then a few more frames held at the end
+// of the path while the last GPU results come back
+
+class Benchmark
+{
+public:
+	struct Config
+	{
+		CameraPath path;
+		std::string preset;							// terrain settings to load before running, left unchanged if empty
+		int frames = 0;								// measured frames, 0 to cover the whole path
+		int warmupFrames = 60;
+		float timestep = 1.0f / 60.0f;				// seconds of path time per frame
+		std::string output = "benchmark_results.json";
+
+		nlohmann::json Serialize() const;
+		void LoadFromJson(const nlohmann::json& data);
+	};
+
+	enum class State
+	{
+		Idle,
+		Warmup,
+		Measuring,
+		Draining,
+		Finished
+	};
+
+public:
+	Benchmark(Profiler* profiler);
+	~Benchmark() = default;
+
+	bool LoadConfig(const std::string& file);
+	bool SaveConfig(const std::string& file) const;
+	inline Config& GetConfig() { return m_Config; }
+
+	void Start();
+	void Stop();
+
+	// call before updating the scene, gives the camera transform for this frame
+	void BeginFrame(XMFLOAT3& cameraPosition, XMFLOAT3& cameraRotation);
+	// call after rendering, returns true on the frame the benchmark finishes
+	bool EndFrame();
+
+	inline bool IsRunning() const { return m_State != State::Idle && m_State != State::Finished; }
+	inline State GetState() const { return m_State; }
+	float GetProgress() const;
+
+	// aggregate timings of the last run
+	nlohmann::json GetResults() const;
+	bool WriteResults(const std::string& file) const;
+
+	// returns true if the benchmark should be started
+	bool SettingsGUI(const XMFLOAT3& cameraPosition, const XMFLOAT3& cameraRotation);
+
+private:
+	int GetMeasuredFrameCount() const;
+	void CollectTimings();
+
+private:
+	// samples of one scope across every measured frame, in ms
+	struct PassSamples
+	{
+		std::string name;
+		int index = -1;
+		int depth = 0;
+		std::vector<float> cpu;
+		std::vector<float> gpu;
+	};
+
+	Profiler* m_Profiler = nullptr;
+	Config m_Config;
+
+	State m_State = State::Idle;
+	int m_Frame = 0;
+	int m_DrainFrames = 0;
+	bool m_ProfilerWasEnabled = true;
+
+	// profiler frame indices of the measured frames
+	uint64_t m_FirstFrameIndex = 0;
+	uint64_t m_LastFrameIndex = 0;
+	uint64_t m_CollectedUpTo = 0;	// one past the last collected frame
+
+	std::vector<float> m_FrameCPU;
+	std::vector<float> m_FrameGPU;
+	std::vector<float> m_FrameInterval;
+	double m_LastFrameStart = -1.0;
+	std::vector<PassSamples> m_Passes;
+
+	// gui
+	char m_ConfigFile[128] = "res/benchmark/flythrough.json";
+	char m_PresetBuffer[128] = "";
+	char m_OutputBuffer[128] = "";
+	float m_KeyframeSpacing = 2.0f;
+	std::string m_Status;
+};
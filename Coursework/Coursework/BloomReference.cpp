@@ -0,0 +1,266 @@
+#include "BloomReference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+namespace
+{
+	// the same as LUM_VECTOR in common.hlsli
+	const XMFLOAT3 LuminanceWeights = { 0.299f, 0.587f, 0.114f };
+
+	const char* ModeNames[] = { "Gaussian (5 taps)", "Gaussian (3 linear taps)", "Dual Kawase" };
+
+	inline XMFLOAT4 Add(const XMFLOAT4& a, const XMFLOAT4& b) { return XMFLOAT4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+	inline XMFLOAT4 Scale(const XMFLOAT4& a, float s) { return XMFLOAT4(a.x * s, a.y * s, a.z * s, a.w * s); }
+
+	// the UV of the centre of an output texel
+	inline float TexelCenter(unsigned int i, unsigned int size) { return (static_cast<float>(i) + 0.5f) / static_cast<float>(size); }
+}
+
+
+const float BloomReference::GaussianWeights[3] = { 0.4062f, 0.2442f, 0.0545f };
+const float BloomReference::MaxLinearError = 1e-4f;
+
+BloomReference::LinearTaps BloomReference::MergeTaps(bool betweenTexels)
+{
+	const float* w = GaussianWeights;
+	LinearTaps taps;
+	if (!betweenTexels)
+	{
+		// the centre fetch is on a texel, the 1 and 2 texel taps merge into one fetch each side
+		taps.centerWeight = w[0];
+		taps.sideWeight = w[1] + w[2];
+		taps.sideOffset = (w[1] * 1.0f + w[2] * 2.0f) / taps.sideWeight;
+	}
+	else
+	{
+		// every 5 tap fetch averages two texels, so the kernel is 6 texels at +-0.5, +-1.5 and +-2.5
+		// the centre fetch covers the texels at +-0.5 as it is, the others merge into one fetch each side
+		float near = 0.5f * (w[1] + w[2]);
+		float far = 0.5f * w[2];
+		taps.centerWeight = w[0] + w[1];
+		taps.sideWeight = near + far;
+		taps.sideOffset = (near * 1.5f + far * 2.5f) / taps.sideWeight;
+	}
+	return taps;
+}
+
+BloomReference::Image BloomReference::Run(const Image& input, unsigned int width, unsigned int height, unsigned int levelCount, float threshold, Mode mode)
+{
+	// level sizes are rounded down like BloomShader's textures
+	std::vector<Image> levels;
+	levels.push_back(Brightpass(input, width, height, threshold));
+
+	for (unsigned int level = 1; level < levelCount; level++)
+	{
+		const Image& above = levels[level - 1];
+		unsigned int levelWidth = width >> level;
+		unsigned int levelHeight = height >> level;
+
+		if (mode == Mode::DualKawase)
+			levels.push_back(KawaseDown(above));
+		else
+		{
+			// the horizontal pass also halves the size
+			bool linear = mode == Mode::LinearGaussian;
+			Image horizontal = Blur(above, levelWidth, levelHeight, 1.0f, 0.0f, linear);
+			levels.push_back(Blur(horizontal, levelWidth, levelHeight, 0.0f, 1.0f, linear));
+		}
+	}
+
+	for (unsigned int level = levelCount - 1; level > 0; level--)
+	{
+		if (mode == Mode::DualKawase)
+			KawaseUp(levels[level], levels[level - 1]);
+		else
+			Combine(levels[level], levels[level - 1]);
+	}
+
+	return levels[0];
+}
+
+XMFLOAT4 BloomReference::Sample(const Image& image, float u, float v)
+{
+	float x = u * image.width - 0.5f;
+	float y = v * image.height - 0.5f;
+	float fx = x - std::floor(x);
+	float fy = y - std::floor(y);
+
+	int maxX = static_cast<int>(image.width) - 1;
+	int maxY = static_cast<int>(image.height) - 1;
+	unsigned int x0 = static_cast<unsigned int>((std::min)((std::max)(static_cast<int>(std::floor(x)), 0), maxX));
+	unsigned int x1 = static_cast<unsigned int>((std::min)((std::max)(static_cast<int>(std::floor(x)) + 1, 0), maxX));
+	unsigned int y0 = static_cast<unsigned int>((std::min)((std::max)(static_cast<int>(std::floor(y)), 0), maxY));
+	unsigned int y1 = static_cast<unsigned int>((std::min)((std::max)(static_cast<int>(std::floor(y)) + 1, 0), maxY));
+
+	XMFLOAT4 top = Add(Scale(image.At(x0, y0), 1.0f - fx), Scale(image.At(x1, y0), fx));
+	XMFLOAT4 bottom = Add(Scale(image.At(x0, y1), 1.0f - fx), Scale(image.At(x1, y1), fx));
+	return Add(Scale(top, 1.0f - fy), Scale(bottom, fy));
+}
+
+bool BloomReference::CanMergeTaps(unsigned int inputSize, unsigned int outputSize)
+{
+	return inputSize == outputSize || inputSize == outputSize * 2;
+}
+
+const char* BloomReference::GetModeName(Mode mode)
+{
+	return ModeNames[static_cast<int>(mode)];
+}
+
+bool BloomReference::SelfTest()
+{
+	bool passed = true;
+	auto check = [&passed](bool condition) { passed = passed && condition; };
+
+	// sparse bright texels over a dim background, so the brightpass keeps some and the blur spreads them
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// even sizes, odd sizes at the top, and sizes that only go odd a few levels down
+	const unsigned int sizes[][2] = { { 256, 144 }, { 250, 141 }, { 199, 77 }, { 320, 200 } };
+	for (const auto& size : sizes)
+	{
+		Image input(size[0], size[1]);
+		for (XMFLOAT4& texel : input.texels)
+		{
+			float scale = unit(random) < 0.05f ? 8.0f : 0.5f;
+			texel = XMFLOAT4(unit(random) * scale, unit(random) * scale, unit(random) * scale, 1.0f);
+		}
+
+		Image gaussian = Run(input, size[0], size[1], 5, 1.0f, Mode::Gaussian);
+		Image linear = Run(input, size[0], size[1], 5, 1.0f, Mode::LinearGaussian);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < gaussian.texels.size(); i++)
+		{
+			const XMFLOAT4& a = gaussian.texels[i];
+			const XMFLOAT4& b = linear.texels[i];
+			maxError = (std::max)(maxError, (std::max)(std::fabs(a.x - b.x), (std::max)(std::fabs(a.y - b.y), std::fabs(a.z - b.z))));
+		}
+		check(maxError <= MaxLinearError);
+	}
+
+	return passed;
+}
+
+BloomReference::Image BloomReference::Brightpass(const Image& input, unsigned int width, unsigned int height, float threshold)
+{
+	Image output(width, height);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			XMFLOAT4 s = Sample(input, TexelCenter(x, width), TexelCenter(y, height));
+			float lum = s.x * LuminanceWeights.x + s.y * LuminanceWeights.y + s.z * LuminanceWeights.z;
+			float filtered = lum >= threshold ? 1.0f : 0.0f;
+			float scale = filtered / (lum + 0.0001f);
+			output.At(x, y) = XMFLOAT4(s.x * scale, s.y * scale, s.z * scale, 1.0f);
+		}
+	}
+	return output;
+}
+
+BloomReference::Image BloomReference::Blur(const Image& input, unsigned int width, unsigned int height, float directionX, float directionY, bool linear)
+{
+	float stepU = directionX / input.width;
+	float stepV = directionY / input.height;
+	unsigned int inputSize = directionX > 0.0f ? input.width : input.height;
+	unsigned int outputSize = directionX > 0.0f ? width : height;
+	LinearTaps taps = MergeTaps(inputSize != outputSize);
+	// a pass from an odd size puts the fetches somewhere between on and between texels, where the merged taps are off
+	linear = linear && CanMergeTaps(inputSize, outputSize);
+
+	Image output(width, height);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float u = TexelCenter(x, width);
+			float v = TexelCenter(y, height);
+
+			XMFLOAT4 colour;
+			if (linear)
+			{
+				colour = Scale(Sample(input, u, v), taps.centerWeight);
+				XMFLOAT4 sides = Add(Sample(input, u - stepU * taps.sideOffset, v - stepV * taps.sideOffset), Sample(input, u + stepU * taps.sideOffset, v + stepV * taps.sideOffset));
+				colour = Add(colour, Scale(sides, taps.sideWeight));
+			}
+			else
+			{
+				colour = Scale(Sample(input, u, v), GaussianWeights[0]);
+				for (int i = 1; i <= 2; i++)
+				{
+					XMFLOAT4 sides = Add(Sample(input, u - stepU * i, v - stepV * i), Sample(input, u + stepU * i, v + stepV * i));
+					colour = Add(colour, Scale(sides, GaussianWeights[i]));
+				}
+			}
+			colour.w = 1.0f;
+			output.At(x, y) = colour;
+		}
+	}
+	return output;
+}
+
+BloomReference::Image BloomReference::KawaseDown(const Image& input)
+{
+	Image output(input.width / 2, input.height / 2);
+	float texelU = 1.0f / input.width;
+	float texelV = 1.0f / input.height;
+	for (unsigned int y = 0; y < output.height; y++)
+	{
+		for (unsigned int x = 0; x < output.width; x++)
+		{
+			float u = TexelCenter(x, output.width);
+			float v = TexelCenter(y, output.height);
+
+			XMFLOAT4 colour = Scale(Sample(input, u, v), 4.0f);
+			colour = Add(colour, Sample(input, u - texelU, v - texelV));
+			colour = Add(colour, Sample(input, u + texelU, v - texelV));
+			colour = Add(colour, Sample(input, u - texelU, v + texelV));
+			colour = Add(colour, Sample(input, u + texelU, v + texelV));
+			colour = Scale(colour, 1.0f / 8.0f);
+			colour.w = 1.0f;
+			output.At(x, y) = colour;
+		}
+	}
+	return output;
+}
+
+void BloomReference::KawaseUp(const Image& input, Image& output)
+{
+	float texelU = 1.0f / input.width;
+	float texelV = 1.0f / input.height;
+	for (unsigned int y = 0; y < output.height; y++)
+	{
+		for (unsigned int x = 0; x < output.width; x++)
+		{
+			float u = TexelCenter(x, output.width);
+			float v = TexelCenter(y, output.height);
+
+			XMFLOAT4 colour = Sample(input, u - texelU, v);
+			colour = Add(colour, Sample(input, u + texelU, v));
+			colour = Add(colour, Sample(input, u, v - texelV));
+			colour = Add(colour, Sample(input, u, v + texelV));
+			colour = Add(colour, Scale(Sample(input, u - 0.5f * texelU, v - 0.5f * texelV), 2.0f));
+			colour = Add(colour, Scale(Sample(input, u + 0.5f * texelU, v - 0.5f * texelV), 2.0f));
+			colour = Add(colour, Scale(Sample(input, u - 0.5f * texelU, v + 0.5f * texelV), 2.0f));
+			colour = Add(colour, Scale(Sample(input, u + 0.5f * texelU, v + 0.5f * texelV), 2.0f));
+			colour = Scale(colour, 1.0f / 12.0f);
+
+			XMFLOAT4& out = output.At(x, y);
+			out = XMFLOAT4(out.x + colour.x, out.y + colour.y, out.z + colour.z, out.w);
+		}
+	}
+}
+
+void BloomReference::Combine(const Image& input, Image& output)
+{
+	for (unsigned int y = 0; y < output.height; y++)
+	{
+		for (unsigned int x = 0; x < output.width; x++)
+			output.At(x, y) = Add(output.At(x, y), Sample(input, TexelCenter(x, output.width), TexelCenter(y, output.height)));
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <vector>
+
+using namespace DirectX;
+
+
+// CPU port of the bloom compute shaders, so what BloomShader outputs can be checked against a known result
+// Textures are sampled the way the GPU's bilinear clamp sampler does, so each mode gives the same output as its shaders
+// up to the sampler's filtering precision
+//
+// The 5 tap gaussian and the 3 tap one give the same result: a bilinear fetch between two texels weights them by
+// how close it is to each, so the two outer taps on each side can be one fetch at their weighted average offset.
+// That only holds when the fetches land on texels or exactly between them, so a pass from an odd size keeps all 5 taps
+// and the two modes match to float rounding at any size
+
+class BloomReference
+{
+public:
+	enum class Mode
+	{
+		Gaussian,			// separable 5 tap gaussian at each level, then every level added to the one above
+		LinearGaussian,		// the same blur with 3 bilinear fetches per pass
+		DualKawase,			// one 5 fetch pass down and one 8 fetch pass up per level
+		Count
+	};
+
+	// rgba, rows top to bottom
+	struct Image
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<XMFLOAT4> texels;
+
+		Image() = default;
+		Image(unsigned int w, unsigned int h) : width(w), height(h), texels(static_cast<size_t>(w) * h, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f)) {}
+		inline XMFLOAT4& At(unsigned int x, unsigned int y) { return texels[x + static_cast<size_t>(y) * width]; }
+		inline const XMFLOAT4& At(unsigned int x, unsigned int y) const { return texels[x + static_cast<size_t>(y) * width]; }
+	};
+
+	// a symmetric kernel of a centre fetch and one fetch each side, offsets in input texels
+	struct LinearTaps
+	{
+		float centerWeight;
+		float sideWeight;
+		float sideOffset;
+	};
+
+	// centre, 1 and 2 texels out
+	static const float GaussianWeights[3];
+
+public:
+	// pure static class
+	BloomReference() = delete;
+
+	// betweenTexels when the fetches are centred between two texels, which they are when the pass halves the size
+	static LinearTaps MergeTaps(bool betweenTexels);
+	// whether a pass from inputSize to outputSize texels can use MergeTaps: the same size, or exactly half
+	static bool CanMergeTaps(unsigned int inputSize, unsigned int outputSize);
+
+	// the bloom added to the final image: threshold, then levelCount levels each half the size of the last, from width x height down
+	static Image Run(const Image& input, unsigned int width, unsigned int height, unsigned int levelCount, float threshold, Mode mode);
+
+	// bilinear, clamped at the edges, with the texel centres at (x + 0.5) / width
+	static XMFLOAT4 Sample(const Image& image, float u, float v);
+
+	static const char* GetModeName(Mode mode);
+
+	// runs Gaussian and LinearGaussian on the same input at even and odd sizes, and checks they match to within MaxLinearError
+	static bool SelfTest();
+	static const float MaxLinearError;
+
+private:
+	static Image Brightpass(const Image& input, unsigned int width, unsigned int height, float threshold);
+	// direction is (1, 0) or (0, 1)
+	static Image Blur(const Image& input, unsigned int width, unsigned int height, float directionX, float directionY, bool linear);
+	static Image KawaseDown(const Image& input);
+	// adds the upsampled input to output
+	static void KawaseUp(const Image& input, Image& output);
+	static void Combine(const Image& input, Image& output);
+};
@@ -2,11 +2,17 @@
 
 #include <d3dcompiler.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "GPUMemoryTracker.h"
+
 #include "imGUI/imgui.h"
 
 
-BloomShader::BloomShader(ID3D11Device* device, unsigned int width, unsigned int height, unsigned int levels)
-	: m_Width(width), m_Height(height), m_LevelCount(levels)
+BloomShader::BloomShader(ID3D11Device* device, IGraphicsBackend* backend, unsigned int width, unsigned int height, unsigned int levels)
+	: m_Width(width), m_Height(height), m_LevelCount(levels), m_Backend(backend)
 {
 	assert(levels > 1 && "Must have at least 2 levels!");
 
@@ -15,6 +21,9 @@ BloomShader::BloomShader(ID3D11Device* device, unsigned int width, unsigned int
 	LoadCS(device, L"bloomcombine_cs.cso", &m_CombineShader);
 	LoadCS(device, L"horizontalguass_cs.cso", &m_HorizontalBlurShader);
 	LoadCS(device, L"verticalguass_cs.cso", &m_VerticalBlurShader);
+	LoadCS(device, L"bloomblur_cs.cso", &m_LinearBlurShader);
+	LoadCS(device, L"bloomkawasedown_cs.cso", &m_KawaseDownShader);
+	LoadCS(device, L"bloomkawaseup_cs.cso", &m_KawaseUpShader);
 
 	HRESULT hr;
 
@@ -47,6 +56,9 @@ BloomShader::BloomShader(ID3D11Device* device, unsigned int width, unsigned int
 		assert(hr == S_OK);
 		hr = device->CreateTexture2D(&texDesc, nullptr, &tex2);
 		assert(hr == S_OK);
+		std::string name = "Bloom level " + std::to_string(level);
+		GPUMemoryTracker::Track(tex1, GPUMemoryTracker::Category::PostProcessing, name);
+		GPUMemoryTracker::Track(tex2, GPUMemoryTracker::Category::PostProcessing, name);
 
 		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
 		srvDesc.Format = texDesc.Format;
@@ -113,33 +125,69 @@ BloomShader::~BloomShader()
 	m_CombineShader->Release();
 	m_HorizontalBlurShader->Release();
 	m_VerticalBlurShader->Release();
+	m_LinearBlurShader->Release();
+	m_KawaseDownShader->Release();
+	m_KawaseUpShader->Release();
 
 	m_CSBuffer->Release();
 	m_TrilinearSampler->Release();
 
 	for (auto& level : m_Levels)
+	{
+		GPUMemoryTracker::Untrack(level.srv1);
+		GPUMemoryTracker::Untrack(level.srv2);
 		level.Release();
+	}
 }
 
-void BloomShader::SettingsGUI()
+void BloomShader::SettingsGUI(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input)
 {
 	ImGui::DragFloat("Threshold", &m_Threshold, 0.005f);
+
+	int mode = static_cast<int>(m_Mode);
+	for (int m = 0; m < static_cast<int>(BloomReference::Mode::Count); m++)
+		ImGui::RadioButton(BloomReference::GetModeName(static_cast<BloomReference::Mode>(m)), &mode, m);
+	m_Mode = static_cast<BloomReference::Mode>(mode);
+
+	int passesPerLevel = m_Mode == BloomReference::Mode::DualKawase ? 2 : 3;
+	ImGui::Text("Passes: %d", 1 + (m_LevelCount - 1) * passesPerLevel);
+
+	if (ImGui::Button("Compare with CPU"))
+		Compare(deviceContext, input);
+	ImGui::Text("CPU difference: max %.6f, mean %.6f", m_LastComparison.maxError, m_LastComparison.meanError);
 }
 
 void BloomShader::Run(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input)
 {
 	// run brightpass filter on input
-	CSBufferType params{ {m_Threshold, 0.0f, 0.0f, 0.0f} };
+	CSBufferType params{ {m_Threshold, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f} };
 	RunCS(deviceContext, m_BrightpassShader, input, m_Levels[0].uav1, 0, &params, sizeof(params));
 
+	if (m_Mode == BloomReference::Mode::DualKawase)
+	{
+		// downsample, then upsample back up adding each level to the one above
+		for (int level = 1; level < m_LevelCount; level++)
+			RunCS(deviceContext, m_KawaseDownShader, m_Levels[level - 1].srv1, m_Levels[level].uav1, level, &params, sizeof(params));
+		for (int level = m_LevelCount - 1; level > 0; level--)
+			RunCS(deviceContext, m_KawaseUpShader, m_Levels[level].srv1, m_Levels[level - 1].uav1, level - 1, &params, sizeof(params));
+		return;
+	}
+
+	// the horizontal pass halves the size, so its fetches are between texels
+	BloomReference::LinearTaps horizontalTaps = BloomReference::MergeTaps(true);
+	BloomReference::LinearTaps verticalTaps = BloomReference::MergeTaps(false);
+	CSBufferType horizontal{ {1.0f, 0.0f, 0.0f, 0.0f}, {horizontalTaps.centerWeight, horizontalTaps.sideWeight, horizontalTaps.sideOffset, 0.0f} };
+	CSBufferType vertical{ {0.0f, 1.0f, 0.0f, 0.0f}, {verticalTaps.centerWeight, verticalTaps.sideWeight, verticalTaps.sideOffset, 0.0f} };
+	bool linear = m_Mode == BloomReference::Mode::LinearGaussian;
 
 	// blur and downscale
 	for (int level = 1; level < m_LevelCount; level++)
 	{
-		// horizontal blur
-		RunCS(deviceContext, m_HorizontalBlurShader, m_Levels[level - 1].srv1, m_Levels[level].uav2, level, &params, sizeof(params));
+		// horizontal blur, with all 5 taps when the level above has an odd width as the merged taps only fit an exact half
+		bool mergeHorizontal = linear && BloomReference::CanMergeTaps(m_Width >> (level - 1), m_Width >> level);
+		RunCS(deviceContext, mergeHorizontal ? m_LinearBlurShader : m_HorizontalBlurShader, m_Levels[level - 1].srv1, m_Levels[level].uav2, level, &horizontal, sizeof(horizontal));
 		// vertical blur
-		RunCS(deviceContext, m_VerticalBlurShader, m_Levels[level].srv2, m_Levels[level].uav1, level, &params, sizeof(params));
+		RunCS(deviceContext, linear ? m_LinearBlurShader : m_VerticalBlurShader, m_Levels[level].srv2, m_Levels[level].uav1, level, &vertical, sizeof(vertical));
 	}
 
 	// combine each level with the level below it
@@ -149,6 +197,30 @@ void BloomShader::Run(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceVi
 	}
 }
 
+BloomShader::Comparison BloomShader::Compare(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input)
+{
+	Run(deviceContext, input);
+	BloomReference::Image gpu = ReadBack(deviceContext, GetSRV());
+	BloomReference::Image cpu = BloomReference::Run(ReadBack(deviceContext, input), m_Width, m_Height, m_LevelCount, m_Threshold, m_Mode);
+	assert(gpu.width == cpu.width && gpu.height == cpu.height);
+
+	Comparison result;
+	double totalError = 0.0;
+	for (size_t i = 0; i < gpu.texels.size(); i++)
+	{
+		const XMFLOAT4& a = gpu.texels[i];
+		const XMFLOAT4& b = cpu.texels[i];
+		float error = (std::max)((std::max)(std::abs(a.x - b.x), std::abs(a.y - b.y)), std::abs(a.z - b.z));
+		result.maxError = (std::max)(result.maxError, error);
+		totalError += error;
+	}
+	if (!gpu.texels.empty())
+		result.meanError = static_cast<float>(totalError / gpu.texels.size());
+
+	m_LastComparison = result;
+	return result;
+}
+
 
 void BloomShader::LoadCS(ID3D11Device* device, const wchar_t* filename, ID3D11ComputeShader** ppCS)
 {
@@ -189,7 +261,7 @@ void BloomShader::RunCS(ID3D11DeviceContext* deviceContext, ID3D11ComputeShader*
 	unsigned int groupsY = static_cast<unsigned int>(ceilf(levelHeight / 8.0f));
 
 	// dispatch CS
-	deviceContext->Dispatch(groupsX, groupsY, 1);
+	m_Backend->Dispatch(groupsX, groupsY, 1);
 
 	// unbind resources
 	ID3D11Buffer* nullCB = nullptr;
@@ -199,3 +271,40 @@ void BloomShader::RunCS(ID3D11DeviceContext* deviceContext, ID3D11ComputeShader*
 	deviceContext->CSSetShaderResources(0, 1, &nullSRV);
 	deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
 }
+
+BloomReference::Image BloomShader::ReadBack(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* srv)
+{
+	ID3D11Resource* resource = nullptr;
+	srv->GetResource(&resource);
+	ID3D11Texture2D* texture = static_cast<ID3D11Texture2D*>(resource);
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	assert(desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT);
+	desc.MipLevels = 1;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+
+	ID3D11Device* device = nullptr;
+	deviceContext->GetDevice(&device);
+	ID3D11Texture2D* staging = nullptr;
+	HRESULT hr = device->CreateTexture2D(&desc, nullptr, &staging);
+	assert(hr == S_OK);
+	device->Release();
+
+	deviceContext->CopySubresourceRegion(staging, 0, 0, 0, 0, texture, 0, nullptr);
+
+	BloomReference::Image image(desc.Width, desc.Height);
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	hr = deviceContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+	for (unsigned int y = 0; y < desc.Height; y++)
+		memcpy(&image.At(0, y), static_cast<const unsigned char*>(mapped.pData) + y * mapped.RowPitch, desc.Width * sizeof(XMFLOAT4));
+	deviceContext->Unmap(staging, 0);
+
+	staging->Release();
+	texture->Release();
+	return image;
+}
@@ -7,6 +7,9 @@ using namespace DirectX;
 #include <cassert>
 #include <vector>
 
+#include "BloomReference.h"
+#include "GraphicsBackend.h"
+
 
 class BloomShader
 {
@@ -15,15 +18,27 @@ private:
 	struct CSBufferType
 	{
 		XMFLOAT4 params;
+		// centre weight, side weight and side offset of the linear blur
+		XMFLOAT4 taps;
+	};
+
+public:
+	struct Comparison
+	{
+		float maxError = 0.0f;
+		float meanError = 0.0f;
 	};
 
 public:
-	BloomShader(ID3D11Device* device, unsigned int width, unsigned int height, unsigned int levels);
+	BloomShader(ID3D11Device* device, IGraphicsBackend* backend, unsigned int width, unsigned int height, unsigned int levels);
 	~BloomShader();
 
-	void SettingsGUI();
+	// input is what the bloom is compared on
+	void SettingsGUI(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input);
 
 	void Run(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input);
+	// runs the bloom on input and checks the output against BloomReference, input has to be R32G32B32A32_FLOAT
+	Comparison Compare(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input);
 
 	inline ID3D11ShaderResourceView* GetSRV() const { return m_Levels[0].srv1; }
 	
@@ -32,11 +47,16 @@ private:
 
 	void RunCS(ID3D11DeviceContext* deviceContext, ID3D11ComputeShader* shader, ID3D11ShaderResourceView* input, ID3D11UnorderedAccessView* output, int outputLevel, void* csBufferData, size_t csBufferDataSize);
 
+	static BloomReference::Image ReadBack(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* srv);
+
 private:
 	ID3D11ComputeShader* m_BrightpassShader = nullptr;
 	ID3D11ComputeShader* m_CombineShader = nullptr;
 	ID3D11ComputeShader* m_HorizontalBlurShader = nullptr;
 	ID3D11ComputeShader* m_VerticalBlurShader = nullptr;
+	ID3D11ComputeShader* m_LinearBlurShader = nullptr;
+	ID3D11ComputeShader* m_KawaseDownShader = nullptr;
+	ID3D11ComputeShader* m_KawaseUpShader = nullptr;
 
 	unsigned int m_Width = -1;
 	unsigned int m_Height = -1;
@@ -45,6 +65,7 @@ private:
 	{
 		// a single bloom level contains 2 render textures
 		// 2-pass gaussian blur requires to have 2 render textures (one for vertical, another for horiztonal)
+		// dual kawase only uses the first
 		ID3D11ShaderResourceView* srv1 = nullptr;
 		ID3D11ShaderResourceView* srv2 = nullptr;
 		ID3D11UnorderedAccessView* uav1 = nullptr;
@@ -61,6 +82,8 @@ private:
 	std::vector<BloomLevel> m_Levels;
 	int m_LevelCount = -1;
 
+	IGraphicsBackend* m_Backend = nullptr;
+
 	// holds parameters for the compute shader
 	ID3D11Buffer* m_CSBuffer = nullptr;
 
@@ -68,4 +91,7 @@ private:
 
 	// params
 	float m_Threshold = 1.5f;
+	BloomReference::Mode m_Mode = BloomReference::Mode::LinearGaussian;
+
+	Comparison m_LastComparison;
 };
@@ -0,0 +1,121 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "SerializationHelper.h"
+
+
+namespace
+{
+	float CatmullRom(float p0, float p1, float p2, float p3, float t)
+	{
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+	}
+
+	// the equivalent of angle (in degrees) closest to reference
+	float Unwrap(float angle, float reference)
+	{
+		return reference + std::remainder(angle - reference, 360.0f);
+	}
+}
+
+
+void CameraPath::AddKeyframe(float time, const XMFLOAT3& position, const XMFLOAT3& rotation)
+{
+	Keyframe keyframe;
+	keyframe.time = time;
+	keyframe.position = position;
+	keyframe.rotation = rotation;
+
+	auto it = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), time,
+		[](float t, const Keyframe& k) { return t < k.time; });
+	m_Keyframes.insert(it, keyframe);
+}
+
+void CameraPath::Evaluate(float time, XMFLOAT3& position, XMFLOAT3& rotation) const
+{
+	if (m_Keyframes.empty()) return;
+
+	if (time <= m_Keyframes.front().time || m_Keyframes.size() == 1)
+	{
+		position = m_Keyframes.front().position;
+		rotation = m_Keyframes.front().rotation;
+		return;
+	}
+	if (time >= m_Keyframes.back().time)
+	{
+		position = m_Keyframes.back().position;
+		rotation = m_Keyframes.back().rotation;
+		return;
+	}
+
+	// find the segment k1 -> k2 containing time, the end keyframes are repeated to give the spline its outer control points
+	size_t i2 = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), time,
+		[](float t, const Keyframe& k) { return t < k.time; }) - m_Keyframes.begin();
+	size_t i1 = i2 - 1;
+	size_t i0 = i1 > 0 ? i1 - 1 : i1;
+	size_t i3 = i2 + 1 < m_Keyframes.size() ? i2 + 1 : i2;
+
+	const Keyframe& k0 = m_Keyframes[i0];
+	const Keyframe& k1 = m_Keyframes[i1];
+	const Keyframe& k2 = m_Keyframes[i2];
+	const Keyframe& k3 = m_Keyframes[i3];
+
+	float segment = k2.time - k1.time;
+	float t = segment > 0.0f ? (time - k1.time) / segment : 0.0f;
+
+	position.x = CatmullRom(k0.position.x, k1.position.x, k2.position.x, k3.position.x, t);
+	position.y = CatmullRom(k0.position.y, k1.position.y, k2.position.y, k3.position.y, t);
+	position.z = CatmullRom(k0.position.z, k1.position.z, k2.position.z, k3.position.z, t);
+
+	// unwrap each angle against its neighbour so that a turn through 180 degrees doesn't spin the long way
+	auto angle = [&](float a0, float a1, float a2, float a3)
+	{
+		a2 = Unwrap(a2, a1);
+		a0 = Unwrap(a0, a1);
+		a3 = Unwrap(a3, a2);
+		return CatmullRom(a0, a1, a2, a3, t);
+	};
+	rotation.x = angle(k0.rotation.x, k1.rotation.x, k2.rotation.x, k3.rotation.x);
+	rotation.y = angle(k0.rotation.y, k1.rotation.y, k2.rotation.y, k3.rotation.y);
+	rotation.z = angle(k0.rotation.z, k1.rotation.z, k2.rotation.z, k3.rotation.z);
+}
+
+float CameraPath::GetDuration() const
+{
+	if (m_Keyframes.empty()) return 0.0f;
+	return m_Keyframes.back().time - m_Keyframes.front().time;
+}
+
+nlohmann::json CameraPath::Serialize() const
+{
+	nlohmann::json serialized = nlohmann::json::array();
+	for (const Keyframe& keyframe : m_Keyframes)
+	{
+		nlohmann::json k;
+		k["time"] = keyframe.time;
+		k["position"] = SerializationHelper::SerializeFloat3(keyframe.position);
+		k["rotation"] = SerializationHelper::SerializeFloat3(keyframe.rotation);
+		serialized.push_back(k);
+	}
+	return serialized;
+}
+
+void CameraPath::LoadFromJson(const nlohmann::json& data)
+{
+	m_Keyframes.clear();
+	if (!data.is_array()) return;
+
+	for (const auto& k : data)
+	{
+		float time = 0.0f;
+		XMFLOAT3 position{ 0.0f, 0.0f, 0.0f }, rotation{ 0.0f, 0.0f, 0.0f };
+		if (k.contains("time")) time = k["time"];
+		if (k.contains("position")) SerializationHelper::LoadFloat3FromJson(&position, k["position"]);
+		if (k.contains("rotation")) SerializationHelper::LoadFloat3FromJson(&rotation, k["rotation"]);
+		AddKeyframe(time, position, rotation);
+	}
+}
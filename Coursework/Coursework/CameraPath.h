@@ -0,0 +1,45 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <nlohmann/json.hpp>
+
+#include <vector>
+
+using namespace DirectX;
+
+
+// A camera path made of timed keyframes, used to replay the same flythrough every run
+// Positions and rotations are interpolated with a Catmull-Rom spline, so the path passes through every keyframe
+// Rotations are pitch, yaw and roll in degrees as used by the camera, and always turn the short way round between keyframes
+
+class CameraPath
+{
+public:
+	struct Keyframe
+	{
+		float time = 0.0f;	// seconds from the start of the path
+		XMFLOAT3 position{ 0.0f, 0.0f, 0.0f };
+		XMFLOAT3 rotation{ 0.0f, 0.0f, 0.0f };
+	};
+
+public:
+	CameraPath() = default;
+	~CameraPath() = default;
+
+	// keyframes are kept sorted by time
+	void AddKeyframe(float time, const XMFLOAT3& position, const XMFLOAT3& rotation);
+	inline void Clear() { m_Keyframes.clear(); }
+
+	// times outside of the path are clamped to the first or last keyframe
+	void Evaluate(float time, XMFLOAT3& position, XMFLOAT3& rotation) const;
+
+	inline bool IsEmpty() const { return m_Keyframes.empty(); }
+	inline const std::vector<Keyframe>& GetKeyframes() const { return m_Keyframes; }
+	float GetDuration() const;
+
+	nlohmann::json Serialize() const;
+	void LoadFromJson(const nlohmann::json& data);
+
+private:
+	std::vector<Keyframe> m_Keyframes;
+};
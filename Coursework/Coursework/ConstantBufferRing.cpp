@@ -0,0 +1,251 @@
+#include "ConstantBufferRing.h"
+
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+#include "RecordingBackend.h"
+#include "imGUI/imgui.h"
+
+
+ConstantBufferRing::ConstantBufferRing(IGraphicsBackend* backend, unsigned int capacity)
+	: m_Backend(backend), m_Allocator(capacity, Alignment)
+{
+	if (m_Backend->SupportsConstantBufferOffsets())
+		m_Buffer = m_Backend->CreateConstantBuffer(capacity);
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	if (m_Buffer) m_Backend->ReleaseBuffer(m_Buffer);
+
+	for (auto fence : m_FrameFences)
+		m_Backend->ReleaseFence(fence);
+
+	for (auto& pool : m_FallbackPools)
+	{
+		for (auto buffer : pool.second.buffers)
+		{
+			if (buffer) m_Backend->ReleaseBuffer(buffer);
+		}
+	}
+}
+
+void ConstantBufferRing::BeginFrame()
+{
+	// give back the space used by any frames the GPU has finished with
+	while (!m_FrameFences.empty())
+	{
+		IGraphicsBackend::FenceHandle fence = m_FrameFences.front();
+		if (!m_Backend->IsFenceComplete(fence))
+			break;
+
+		m_Allocator.ReleaseFrame();
+		m_Backend->ReleaseFence(fence);
+		m_FrameFences.pop_front();
+	}
+
+	m_LastFrameAllocations = m_FrameAllocations;
+	m_LastFrameBytes = m_FrameBytes;
+	m_LastFrameDiscards = m_FrameDiscards;
+	m_FrameAllocations = 0;
+	m_FrameBytes = 0;
+	m_FrameDiscards = 0;
+}
+
+void ConstantBufferRing::EndFrame()
+{
+	if (!m_Buffer) return;
+
+	m_Allocator.EndFrame();
+	m_FrameFences.push_back(m_Backend->InsertFence());
+}
+
+ConstantBufferRing::Allocation ConstantBufferRing::Upload(const void* data, unsigned int size)
+{
+	assert(size % 16 == 0 && "Constant buffer byte width must be multiple of 16!");
+
+	m_FrameAllocations++;
+	m_FrameBytes += size;
+
+	if (!m_Buffer)
+		return UploadFallback(data, size);
+
+	IGraphicsBackend::UploadMode mode = IGraphicsBackend::UploadMode::NoOverwrite;
+
+	size_t offset = m_Allocator.Allocate(size);
+	if (offset == RingBufferAllocator::InvalidOffset)
+	{
+		// the ring is full of data the GPU may still be reading
+		// discarding gives the ring fresh memory, so every frame in flight can be forgotten
+		m_Allocator.Reset();
+		for (auto fence : m_FrameFences)
+			m_Backend->ReleaseFence(fence);
+		m_FrameFences.clear();
+
+		offset = m_Allocator.Allocate(size);
+		assert(offset != RingBufferAllocator::InvalidOffset && "Allocation is larger than the whole ring!");
+
+		m_NeedsDiscard = true;
+	}
+	if (m_NeedsDiscard)
+	{
+		mode = IGraphicsBackend::UploadMode::Discard;
+		m_NeedsDiscard = false;
+		m_FrameDiscards++;
+	}
+
+	m_Backend->UploadBuffer(m_Buffer, mode, offset, data, size);
+
+	Allocation allocation;
+	allocation.buffer = m_Buffer;
+	allocation.firstConstant = static_cast<unsigned int>(offset / 16);
+	allocation.numConstants = static_cast<unsigned int>(m_Allocator.Align(size) / 16);
+	return allocation;
+}
+
+ConstantBufferRing::Allocation ConstantBufferRing::UploadFallback(const void* data, unsigned int size)
+{
+	unsigned int alignedSize = static_cast<unsigned int>(m_Allocator.Align(size));
+	FallbackPool& pool = m_FallbackPools[alignedSize];
+
+	IGraphicsBackend::BufferHandle& buffer = pool.buffers[pool.next];
+	pool.next = (pool.next + 1) % pool.buffers.size();
+
+	if (!buffer)
+		buffer = m_Backend->CreateConstantBuffer(alignedSize);
+
+	m_Backend->UploadBuffer(buffer, IGraphicsBackend::UploadMode::Discard, 0, data, size);
+
+	m_FrameDiscards++;
+
+	return WholeBuffer(buffer);
+}
+
+ConstantBufferRing::Allocation ConstantBufferRing::WholeBuffer(IGraphicsBackend::BufferHandle buffer)
+{
+	Allocation allocation;
+	allocation.buffer = buffer;
+	allocation.firstConstant = 0;
+	allocation.numConstants = 0;
+	return allocation;
+}
+
+void ConstantBufferRing::BindVS(unsigned int startSlot, std::initializer_list<Allocation> allocations)
+{
+	Bind(ShaderStage::Vertex, startSlot, allocations);
+}
+void ConstantBufferRing::BindHS(unsigned int startSlot, std::initializer_list<Allocation> allocations)
+{
+	Bind(ShaderStage::Hull, startSlot, allocations);
+}
+void ConstantBufferRing::BindDS(unsigned int startSlot, std::initializer_list<Allocation> allocations)
+{
+	Bind(ShaderStage::Domain, startSlot, allocations);
+}
+void ConstantBufferRing::BindPS(unsigned int startSlot, std::initializer_list<Allocation> allocations)
+{
+	Bind(ShaderStage::Pixel, startSlot, allocations);
+}
+void ConstantBufferRing::BindCS(unsigned int startSlot, std::initializer_list<Allocation> allocations)
+{
+	Bind(ShaderStage::Compute, startSlot, allocations);
+}
+
+void ConstantBufferRing::Bind(ShaderStage stage, unsigned int startSlot, std::initializer_list<Allocation> allocations)
+{
+	// D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+	const unsigned int maxSlots = 14;
+	assert(startSlot + allocations.size() <= maxSlots);
+
+	IGraphicsBackend::BufferHandle buffers[maxSlots];
+	unsigned int firstConstants[maxSlots];
+	unsigned int numConstants[maxSlots];
+
+	unsigned int count = 0;
+	for (const Allocation& allocation : allocations)
+	{
+		buffers[count] = allocation.buffer;
+		firstConstants[count] = allocation.firstConstant;
+		numConstants[count] = allocation.numConstants;
+		count++;
+	}
+
+	m_Backend->BindConstantBuffers(stage, startSlot, count, buffers, firstConstants, numConstants);
+}
+
+void ConstantBufferRing::SettingsGUI()
+{
+	ImGui::Text("Offsetting supported: %s", IsOffsettingSupported() ? "yes" : "no");
+	ImGui::Text("Ring usage: %d / %d KB", static_cast<int>(m_Allocator.GetUsed() / 1024), static_cast<int>(m_Allocator.GetCapacity() / 1024));
+	ImGui::Text("Frames in flight: %d", static_cast<int>(m_FrameFences.size()));
+	ImGui::Text("Allocations: %d (%d bytes)", m_LastFrameAllocations, m_LastFrameBytes);
+	ImGui::Text("Discards: %d", m_LastFrameDiscards);
+}
+
+bool ConstantBufferRing::SelfTest()
+{
+	bool passed = true;
+	auto check = [&passed](bool condition) { passed = passed && condition; };
+
+	struct Constants
+	{
+		unsigned int frame, draw, padding[14];
+	};
+	const unsigned int drawsPerFrame = 5;
+
+	for (bool offsets : { true, false })
+	{
+		RecordingBackend backend(nullptr, offsets);
+		backend.SetLogging(true);
+		{
+			// room for a little over a frame, which is enough while fences complete immediately
+			ConstantBufferRing ring(&backend, 12 * Alignment);
+			check(ring.IsOffsettingSupported() == offsets);
+			unsigned int buffersCreated = 0;
+
+			for (unsigned int frame = 0; frame < 50; frame++)
+			{
+				ring.BeginFrame();
+				backend.ClearLog();
+				backend.ResetStats();
+
+				for (unsigned int draw = 0; draw < drawsPerFrame; draw++)
+				{
+					Constants vs = { frame, draw }, ps = { frame, draw + drawsPerFrame };
+					Allocation vsAllocation = ring.Upload(vs);
+					Allocation psAllocation = ring.Upload(ps);
+					ring.BindVS(0, { vsAllocation });
+					ring.BindPS(1, { psAllocation });
+					backend.DrawIndexed(36, 0, 0);
+
+					// both are still there once the draw has been sent
+					for (const std::pair<Allocation, Constants>& allocation : { std::make_pair(vsAllocation, vs), std::make_pair(psAllocation, ps) })
+					{
+						const unsigned char* data = static_cast<const unsigned char*>(backend.GetBufferData(allocation.first.buffer));
+						check(data && memcmp(data + allocation.first.firstConstant * 16, &allocation.second, sizeof(Constants)) == 0);
+						check(offsets ? allocation.first.numConstants == Alignment / 16 : allocation.first.numConstants == 0);
+					}
+					check(vsAllocation.buffer != psAllocation.buffer || vsAllocation.firstConstant != psAllocation.firstConstant);
+				}
+				ring.EndFrame();
+
+				// fences complete immediately, so the ring never has to be discarded after the first upload
+				check(ring.m_FrameDiscards == (offsets ? (frame == 0 ? 1u : 0u) : 2 * drawsPerFrame));
+
+				const RecordingBackend::Stats& stats = backend.GetStats();
+				check(stats.uploads == 2 * drawsPerFrame && stats.bytesUploaded == 2 * drawsPerFrame * sizeof(Constants));
+				check(stats.constantBufferBinds == 2 * drawsPerFrame && stats.draws == drawsPerFrame);
+				// one fence a frame with offsetting
+				check(backend.GetLog().back().type == (offsets ? RecordingBackend::CommandType::InsertFence : RecordingBackend::CommandType::DrawIndexed));
+				buffersCreated += stats.buffersCreated;
+			}
+			// the ring's buffer was made before the first frame, the fallback makes one pool of buffers and reuses it
+			check(buffersCreated == (offsets ? 0 : 16));
+		}
+		// the null backend asserts if the ring left any buffers behind
+		check(backend.GetLog().back().type == RecordingBackend::CommandType::ReleaseBuffer);
+	}
+
+	return passed;
+}
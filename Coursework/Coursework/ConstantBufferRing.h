@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <unordered_map>
+#include <initializer_list>
+
+#include "GraphicsBackend.h"
+#include "RingBufferAllocator.h"
+
+
+// One large dynamic constant buffer that per-draw constants are sub-allocated from
+// Each allocation is written with a no-overwrite upload, so the driver never has to rename the buffer,
+// and bound with a constant offset
+// Fences track when the GPU has finished with a frame's allocations
+//
+// If the backend doesn't support constant buffer offsetting, allocations fall back to
+// small pools of regular dynamic buffers
+
+class ConstantBufferRing
+{
+public:
+	// constant buffer offsets must be multiples of 16 constants (256 bytes)
+	static const unsigned int Alignment = 256;
+
+	struct Allocation
+	{
+		IGraphicsBackend::BufferHandle buffer = nullptr;
+		unsigned int firstConstant = 0;
+		unsigned int numConstants = 0;	// 0 binds the whole buffer
+	};
+
+public:
+	ConstantBufferRing(IGraphicsBackend* backend, unsigned int capacity = 4 * 1024 * 1024);
+	~ConstantBufferRing();
+
+	void BeginFrame();
+	void EndFrame();
+
+	Allocation Upload(const void* data, unsigned int size);
+	template<typename T>
+	inline Allocation Upload(const T& data)
+	{
+		static_assert(sizeof(T) % 16 == 0, "Constant buffer byte width must be multiple of 16!");
+		return Upload(&data, sizeof(T));
+	}
+
+	// binds a buffer that doesn't come from the ring
+	static Allocation WholeBuffer(IGraphicsBackend::BufferHandle buffer);
+
+	void BindVS(unsigned int startSlot, std::initializer_list<Allocation> allocations);
+	void BindHS(unsigned int startSlot, std::initializer_list<Allocation> allocations);
+	void BindDS(unsigned int startSlot, std::initializer_list<Allocation> allocations);
+	void BindPS(unsigned int startSlot, std::initializer_list<Allocation> allocations);
+	void BindCS(unsigned int startSlot, std::initializer_list<Allocation> allocations);
+
+	inline bool IsOffsettingSupported() const { return m_Buffer != nullptr; }
+	inline IGraphicsBackend* GetBackend() const { return m_Backend; }
+
+	void SettingsGUI();
+
+	// runs frames of uploads, binds and draws on a null recording backend, with and without offsetting,
+	// and checks the commands sent and what ends up in the buffers, no GPU needed
+	static bool SelfTest();
+
+private:
+	void Bind(ShaderStage stage, unsigned int startSlot, std::initializer_list<Allocation> allocations);
+
+	Allocation UploadFallback(const void* data, unsigned int size);
+
+private:
+	IGraphicsBackend* m_Backend = nullptr;
+
+	IGraphicsBackend::BufferHandle m_Buffer = nullptr;
+	RingBufferAllocator m_Allocator;
+	bool m_NeedsDiscard = true;
+
+	// one fence per frame still in flight, oldest first
+	std::deque<IGraphicsBackend::FenceHandle> m_FrameFences;
+
+	// fallback when offsetting is unsupported, pools are keyed by aligned size
+	// buffers within a pool are cycled through so that several allocations for one draw never share a buffer
+	struct FallbackPool
+	{
+		std::array<IGraphicsBackend::BufferHandle, 16> buffers{};
+		size_t next = 0;
+	};
+	std::unordered_map<unsigned int, FallbackPool> m_FallbackPools;
+
+	// stats
+	unsigned int m_FrameAllocations = 0;
+	unsigned int m_FrameBytes = 0;
+	unsigned int m_FrameDiscards = 0;
+	unsigned int m_LastFrameAllocations = 0;
+	unsigned int m_LastFrameBytes = 0;
+	unsigned int m_LastFrameDiscards = 0;
+};
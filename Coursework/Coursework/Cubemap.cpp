@@ -1,7 +1,12 @@
 #include "Cubemap.h"
 
+#include <algorithm>
+
 #include "stb_image.h"
 
+#include "GPUMemoryTracker.h"
+#include "MipGenerator.h"
+
 
 XMFLOAT3 Cubemap::s_FaceNormals[6] = {
 		{ 1.0f, 0.0f, 0.0f },
@@ -29,9 +34,10 @@ XMFLOAT3 Cubemap::s_FaceBitangents[6] = {
 };
 
 
-Cubemap::Cubemap(ID3D11Device* device, unsigned int size, bool readOnly, unsigned int mipLevels, DXGI_FORMAT format, DXGI_FORMAT srvFormat, UINT bindFlags)
+Cubemap::Cubemap(ID3D11Device* device, unsigned int size, bool readOnly, unsigned int mipLevels, DXGI_FORMAT format, DXGI_FORMAT srvFormat, UINT bindFlags,
+	const D3D11_SUBRESOURCE_DATA* initialData)
 {
-	// this constructor creates an empty cubemap that will be written to on the gpu
+	// this constructor creates a cubemap that will be written to on the gpu, or filled from data that was already processed
 
 	m_ReadOnly = readOnly;
 	m_HasMips = mipLevels != 1;
@@ -59,8 +65,10 @@ Cubemap::Cubemap(ID3D11Device* device, unsigned int size, bool readOnly, unsigne
 	srvDesc.TextureCube.MipLevels = m_HasMips ? -1 : texDesc.MipLevels;
 	srvDesc.TextureCube.MostDetailedMip = 0;
 
-	HRESULT hr = device->CreateTexture2D(&texDesc, nullptr, &m_CubemapTexture);
+	HRESULT hr = device->CreateTexture2D(&texDesc, initialData, &m_CubemapTexture);
 	assert(hr == S_OK);
+	// owners that aren't environment maps register it again under their own category
+	GPUMemoryTracker::Track(m_CubemapTexture, GPUMemoryTracker::Category::Environment, "Cubemap");
 
 	hr = device->CreateShaderResourceView(m_CubemapTexture, &srvDesc, &m_SRV);
 	assert(hr == S_OK);
@@ -93,8 +101,16 @@ Cubemap::Cubemap(ID3D11Device* device, const char* faces[6])
 	Load(device, faces);
 }
 
+Cubemap::Cubemap(ID3D11Device* device, const unsigned char* const faceData[6], unsigned int size, const std::vector<std::string>& sourceFiles, ThreadPool* threadPool)
+{
+	// this constructor creates a cubemap from faces that have already been loaded, e.g. on another thread
+	Create(device, faceData, size, sourceFiles.empty() ? "Cubemap" : sourceFiles[0].c_str(), threadPool);
+	m_SourceFiles = sourceFiles;
+}
+
 Cubemap::~Cubemap()
 {
+	GPUMemoryTracker::Untrack(m_CubemapTexture);
 	m_CubemapTexture->Release();
 	m_SRV->Release();
 	for (auto& srv : m_FaceSRVs)
@@ -148,45 +164,8 @@ void Cubemap::Load(ID3D11Device* device, const char* faces[6])
 
 	if (success)
 	{
-		// create texture
-		D3D11_TEXTURE2D_DESC texDesc;
-		texDesc.Width = width;
-		texDesc.Height = height;
-		texDesc.MipLevels = 1;
-		texDesc.ArraySize = 6;
-		texDesc.Format = m_TextureFormat;
-		texDesc.SampleDesc.Count = 1;
-		texDesc.SampleDesc.Quality = 0;
-		texDesc.Usage = D3D11_USAGE_DEFAULT;
-		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		texDesc.CPUAccessFlags = 0;
-		texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-		
-		// setup data to initialise texture with
-		D3D11_SUBRESOURCE_DATA pData[6];
-		for (int i = 0; i < 6; i++)
-		{
-			pData[i].pSysMem = faceData[i];
-			// each row takes up (4 * width) bytes, 'width' pixels of 4 channels at 1 byte per channel
-			pData[i].SysMemPitch = width * channels;
-			pData[i].SysMemSlicePitch = 0;
-		}
-
-		HRESULT hr = device->CreateTexture2D(&texDesc, &pData[0], &m_CubemapTexture);
-		assert(hr == S_OK);
-
-		// create srv for the cubemap
-		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-		srvDesc.Format = m_SRVFormat;
-		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-		srvDesc.TextureCube.MipLevels = texDesc.MipLevels;
-		srvDesc.TextureCube.MostDetailedMip = 0;
-
-		hr = device->CreateShaderResourceView(m_CubemapTexture, &srvDesc, &m_SRV);
-		assert(hr == S_OK);
-
-		// create srv for each face
-		CreateFaceSRVs(device);
+		Create(device, faceData, width, faces[0]);
+		m_SourceFiles.assign(faces, faces + 6);
 
 		// free loaded image data
 		for (int i = 0; i < 6; i++)
@@ -199,6 +178,61 @@ void Cubemap::Load(ID3D11Device* device, const char* faces[6])
 	}
 }
 
+void Cubemap::Create(ID3D11Device* device, const unsigned char* const faceData[6], unsigned int size, const char* name, ThreadPool* threadPool)
+{
+	// the faces are sRGB colour, filtered across their seams so the skybox doesn't alias when minified
+	MipGenerator::Settings mipSettings;
+	mipSettings.srgb = true;
+	MipGenerator::MipChain faceMips[6];
+	MipGenerator::GenerateCube(faceData, size, mipSettings, faceMips, threadPool);
+
+	// create texture
+	D3D11_TEXTURE2D_DESC texDesc;
+	texDesc.Width = size;
+	texDesc.Height = size;
+	texDesc.MipLevels = MipGenerator::CountMipLevels(size, size);
+	texDesc.ArraySize = 6;
+	texDesc.Format = m_TextureFormat;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	
+	// setup data to initialise texture with, face major then mip
+	std::vector<D3D11_SUBRESOURCE_DATA> pData(6 * texDesc.MipLevels);
+	for (int i = 0; i < 6; i++)
+	{
+		for (unsigned int mip = 0; mip < texDesc.MipLevels; mip++)
+		{
+			D3D11_SUBRESOURCE_DATA& data = pData[i * texDesc.MipLevels + mip];
+			data.pSysMem = mip == 0 ? faceData[i] : faceMips[i][mip - 1].data();
+			// each row takes up (4 * width) bytes, 'width' pixels of 4 channels at 1 byte per channel
+			data.SysMemPitch = (std::max)(size >> mip, 1u) * 4;
+			data.SysMemSlicePitch = 0;
+		}
+	}
+
+	HRESULT hr = device->CreateTexture2D(&texDesc, pData.data(), &m_CubemapTexture);
+	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_CubemapTexture, GPUMemoryTracker::Category::Environment, name);
+	m_HasMips = texDesc.MipLevels != 1;
+
+	// create srv for the cubemap
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	srvDesc.Format = m_SRVFormat;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MipLevels = texDesc.MipLevels;
+	srvDesc.TextureCube.MostDetailedMip = 0;
+
+	hr = device->CreateShaderResourceView(m_CubemapTexture, &srvDesc, &m_SRV);
+	assert(hr == S_OK);
+
+	// create srv for each face
+	CreateFaceSRVs(device);
+}
+
 void Cubemap::CreateUAVs(ID3D11Device* device, unsigned int mipSlice)
 {
 	for (int i = 0; i < 6; i++)
@@ -3,10 +3,13 @@
 #include <d3d11.h>
 #include <DirectXMath.h>
 #include <cassert>
+#include <string>
 #include <vector>
 
 using namespace DirectX;
 
+class ThreadPool;
+
 /*
 Convention for order of faces in memory:
 - +X -> Right		-> 0
@@ -22,15 +25,24 @@ Convention for order of faces in memory:
 class Cubemap
 {
 public:
-	Cubemap(ID3D11Device* device, unsigned int size, bool readOnly, unsigned int mipLevels = 1, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT srvFormat = DXGI_FORMAT_R8G8B8A8_UNORM, UINT bindFlags = 0);
+	// initialData has one entry per subresource (face major, then mip), or null for an empty cubemap
+	Cubemap(ID3D11Device* device, unsigned int size, bool readOnly, unsigned int mipLevels = 1, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT srvFormat = DXGI_FORMAT_R8G8B8A8_UNORM, UINT bindFlags = 0,
+		const D3D11_SUBRESOURCE_DATA* initialData = nullptr);
 	Cubemap(ID3D11Device* device, const char* right, const char* left, const char* top, const char* bottom, const char* front, const char* back);
 	Cubemap(ID3D11Device* device, const char* faces[6]);
+	// RGBA8 faces of size x size texels, tightly packed
+	// the mips are generated on the thread pool if there is one, or the calling thread
+	Cubemap(ID3D11Device* device, const unsigned char* const faceData[6], unsigned int size, const std::vector<std::string>& sourceFiles, ThreadPool* threadPool = nullptr);
 	~Cubemap();
 
+	inline ID3D11Texture2D* GetTexture() const { return m_CubemapTexture; }
 	inline ID3D11ShaderResourceView* GetSRV() const { return m_SRV; }
 	inline ID3D11ShaderResourceView* GetSRV(int face) const { return m_FaceSRVs[face]; }
 	ID3D11UnorderedAccessView* GetUAV(int face, int mip = 0) const;
 
+	// the files the faces were loaded from, empty if it wasn't loaded
+	inline const std::vector<std::string>& GetSourceFiles() const { return m_SourceFiles; }
+
 public:
 	static const XMFLOAT3& GetFaceNormal(int face) { return s_FaceNormals[face]; }
 	static const XMFLOAT3& GetFaceTangent(int face) { return s_FaceTangents[face]; }
@@ -39,6 +51,7 @@ public:
 protected:
 
 	void Load(ID3D11Device* device, const char* faces[6]);
+	void Create(ID3D11Device* device, const unsigned char* const faceData[6], unsigned int size, const char* name, ThreadPool* threadPool = nullptr);
 
 	void CreateUAVs(ID3D11Device* device, unsigned int mipSlice = 0);
 	void CreateFaceSRVs(ID3D11Device* device);
@@ -54,6 +67,8 @@ protected:
 	ID3D11ShaderResourceView* m_SRV = nullptr;
 	ID3D11ShaderResourceView* m_FaceSRVs[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
 
+	std::vector<std::string> m_SourceFiles;
+
 	// for rendering to the cubemap
 	std::vector<ID3D11UnorderedAccessView*> m_UAVs;
 
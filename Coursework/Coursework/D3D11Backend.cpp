@@ -0,0 +1,261 @@
+#include "D3D11Backend.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "GPUMemoryTracker.h"
+
+
+D3D11Backend::D3D11Backend(ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+	: m_Device(device), m_DeviceContext(deviceContext)
+{
+	// constant buffer offsets and no-overwrite maps of constant buffers are both optional in D3D11.1
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	HRESULT hr = m_Device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (hr == S_OK && options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		hr = m_DeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&m_Context1));
+		if (hr != S_OK) m_Context1 = nullptr;
+	}
+}
+
+D3D11Backend::~D3D11Backend()
+{
+	if (m_Context1) m_Context1->Release();
+
+	for (auto query : m_FreeQueries)
+		query->Release();
+	for (auto query : m_FreeTimestampQueries)
+		query->Release();
+	for (auto query : m_FreeDisjointQueries)
+		query->Release();
+}
+
+IGraphicsBackend::BufferHandle D3D11Backend::CreateConstantBuffer(unsigned int byteWidth)
+{
+	assert(byteWidth % 16 == 0 && "Constant buffer byte width must be multiple of 16!");
+
+	D3D11_BUFFER_DESC desc;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = byteWidth;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	ID3D11Buffer* buffer = nullptr;
+	HRESULT hr = m_Device->CreateBuffer(&desc, nullptr, &buffer);
+	assert(hr == S_OK);
+	GPUMemoryTracker::Track(buffer, GPUMemoryTracker::Category::Buffers, "Constant buffer");
+	return buffer;
+}
+
+void D3D11Backend::ReleaseBuffer(BufferHandle buffer)
+{
+	GPUMemoryTracker::Untrack(ToBuffer(buffer));
+	if (buffer) ToBuffer(buffer)->Release();
+}
+
+void D3D11Backend::UploadBuffer(BufferHandle buffer, UploadMode mode, size_t offset, const void* data, size_t size)
+{
+	D3D11_MAP mapType = mode == UploadMode::NoOverwrite ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	HRESULT hr = m_DeviceContext->Map(ToBuffer(buffer), 0, mapType, 0, &mappedResource);
+	assert(hr == S_OK);
+	memcpy(static_cast<char*>(mappedResource.pData) + offset, data, size);
+	m_DeviceContext->Unmap(ToBuffer(buffer), 0);
+}
+
+void D3D11Backend::BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count,
+	const BufferHandle* buffers, const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	const UINT maxSlots = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	assert(startSlot + count <= maxSlots);
+
+	ID3D11Buffer* d3dBuffers[maxSlots];
+	for (UINT i = 0; i < count; i++)
+		d3dBuffers[i] = ToBuffer(buffers[i]);
+
+	if (m_Context1 && firstConstants && numConstants)
+	{
+		UINT first[maxSlots];
+		UINT num[maxSlots];
+		for (UINT i = 0; i < count; i++)
+		{
+			first[i] = firstConstants[i];
+			num[i] = numConstants[i];
+
+			if (num[i] == 0 && d3dBuffers[i])
+			{
+				// whole buffer: the constant count must be a multiple of 16, reads past the end of the buffer return 0
+				D3D11_BUFFER_DESC desc;
+				d3dBuffers[i]->GetDesc(&desc);
+				num[i] = ((desc.ByteWidth / 16) + 15) & ~15u;
+			}
+		}
+
+		switch (stage)
+		{
+		case ShaderStage::Vertex:	m_Context1->VSSetConstantBuffers1(startSlot, count, d3dBuffers, first, num); break;
+		case ShaderStage::Hull:		m_Context1->HSSetConstantBuffers1(startSlot, count, d3dBuffers, first, num); break;
+		case ShaderStage::Domain:	m_Context1->DSSetConstantBuffers1(startSlot, count, d3dBuffers, first, num); break;
+		case ShaderStage::Pixel:	m_Context1->PSSetConstantBuffers1(startSlot, count, d3dBuffers, first, num); break;
+		case ShaderStage::Compute:	m_Context1->CSSetConstantBuffers1(startSlot, count, d3dBuffers, first, num); break;
+		}
+	}
+	else
+	{
+		switch (stage)
+		{
+		case ShaderStage::Vertex:	m_DeviceContext->VSSetConstantBuffers(startSlot, count, d3dBuffers); break;
+		case ShaderStage::Hull:		m_DeviceContext->HSSetConstantBuffers(startSlot, count, d3dBuffers); break;
+		case ShaderStage::Domain:	m_DeviceContext->DSSetConstantBuffers(startSlot, count, d3dBuffers); break;
+		case ShaderStage::Pixel:	m_DeviceContext->PSSetConstantBuffers(startSlot, count, d3dBuffers); break;
+		case ShaderStage::Compute:	m_DeviceContext->CSSetConstantBuffers(startSlot, count, d3dBuffers); break;
+		}
+	}
+}
+
+void D3D11Backend::BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ViewHandle* views)
+{
+	const UINT maxSlots = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	assert(startSlot + count <= maxSlots);
+
+	ID3D11ShaderResourceView* srvs[maxSlots];
+	for (UINT i = 0; i < count; i++)
+		srvs[i] = ToView(views[i]);
+
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	m_DeviceContext->VSSetShaderResources(startSlot, count, srvs); break;
+	case ShaderStage::Hull:		m_DeviceContext->HSSetShaderResources(startSlot, count, srvs); break;
+	case ShaderStage::Domain:	m_DeviceContext->DSSetShaderResources(startSlot, count, srvs); break;
+	case ShaderStage::Pixel:	m_DeviceContext->PSSetShaderResources(startSlot, count, srvs); break;
+	case ShaderStage::Compute:	m_DeviceContext->CSSetShaderResources(startSlot, count, srvs); break;
+	}
+}
+
+void D3D11Backend::BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const SamplerHandle* samplers)
+{
+	const UINT maxSlots = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	assert(startSlot + count <= maxSlots);
+
+	ID3D11SamplerState* states[maxSlots];
+	for (UINT i = 0; i < count; i++)
+		states[i] = ToSampler(samplers[i]);
+
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	m_DeviceContext->VSSetSamplers(startSlot, count, states); break;
+	case ShaderStage::Hull:		m_DeviceContext->HSSetSamplers(startSlot, count, states); break;
+	case ShaderStage::Domain:	m_DeviceContext->DSSetSamplers(startSlot, count, states); break;
+	case ShaderStage::Pixel:	m_DeviceContext->PSSetSamplers(startSlot, count, states); break;
+	case ShaderStage::Compute:	m_DeviceContext->CSSetSamplers(startSlot, count, states); break;
+	}
+}
+
+void D3D11Backend::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	m_DeviceContext->Draw(vertexCount, startVertex);
+}
+
+void D3D11Backend::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	m_DeviceContext->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11Backend::Dispatch(unsigned int x, unsigned int y, unsigned int z)
+{
+	m_DeviceContext->Dispatch(x, y, z);
+}
+
+IGraphicsBackend::FenceHandle D3D11Backend::InsertFence()
+{
+	ID3D11Query* query = AllocateQuery(D3D11_QUERY_EVENT, m_FreeQueries);
+	m_DeviceContext->End(query);
+	return query;
+}
+
+bool D3D11Backend::IsFenceComplete(FenceHandle fence)
+{
+	return m_DeviceContext->GetData(static_cast<ID3D11Query*>(fence), nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+}
+
+void D3D11Backend::ReleaseFence(FenceHandle fence)
+{
+	// queries are recycled rather than released
+	if (fence) m_FreeQueries.push_back(static_cast<ID3D11Query*>(fence));
+}
+
+IGraphicsBackend::QueryHandle D3D11Backend::BeginTimingRange()
+{
+	ID3D11Query* query = AllocateQuery(D3D11_QUERY_TIMESTAMP_DISJOINT, m_FreeDisjointQueries);
+	m_DeviceContext->Begin(query);
+	return query;
+}
+
+void D3D11Backend::EndTimingRange(QueryHandle range)
+{
+	m_DeviceContext->End(static_cast<ID3D11Query*>(range));
+}
+
+IGraphicsBackend::QueryHandle D3D11Backend::InsertTimestamp()
+{
+	ID3D11Query* query = AllocateQuery(D3D11_QUERY_TIMESTAMP, m_FreeTimestampQueries);
+	m_DeviceContext->End(query);
+	return query;
+}
+
+bool D3D11Backend::GetTimingRangeData(QueryHandle range, uint64_t* frequency, bool* disjoint)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT data;
+	if (m_DeviceContext->GetData(static_cast<ID3D11Query*>(range), &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	*frequency = data.Frequency;
+	*disjoint = data.Disjoint != FALSE;
+	return true;
+}
+
+bool D3D11Backend::GetTimestampData(QueryHandle timestamp, uint64_t* ticks)
+{
+	UINT64 data = 0;
+	if (m_DeviceContext->GetData(static_cast<ID3D11Query*>(timestamp), &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	*ticks = data;
+	return true;
+}
+
+void D3D11Backend::ReleaseQuery(QueryHandle query)
+{
+	if (!query) return;
+
+	// recycled into the free list for its type
+	ID3D11Query* d3dQuery = static_cast<ID3D11Query*>(query);
+	D3D11_QUERY_DESC desc;
+	d3dQuery->GetDesc(&desc);
+	if (desc.Query == D3D11_QUERY_TIMESTAMP_DISJOINT)
+		m_FreeDisjointQueries.push_back(d3dQuery);
+	else
+		m_FreeTimestampQueries.push_back(d3dQuery);
+}
+
+ID3D11Query* D3D11Backend::AllocateQuery(D3D11_QUERY type, std::vector<ID3D11Query*>& freeList)
+{
+	if (!freeList.empty())
+	{
+		ID3D11Query* query = freeList.back();
+		freeList.pop_back();
+		return query;
+	}
+
+	ID3D11Query* query = nullptr;
+	D3D11_QUERY_DESC desc;
+	desc.Query = type;
+	desc.MiscFlags = 0;
+	HRESULT hr = m_Device->CreateQuery(&desc, &query);
+	assert(hr == S_OK);
+	return query;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <d3d11_1.h>
+
+#include <vector>
+
+#include "GraphicsBackend.h"
+
+
+// Graphics backend that forwards to a D3D11 device and immediate context
+// Handles are the D3D11 interfaces themselves, so resources created elsewhere can be passed straight in
+
+class D3D11Backend : public IGraphicsBackend
+{
+public:
+	D3D11Backend(ID3D11Device* device, ID3D11DeviceContext* deviceContext);
+	virtual ~D3D11Backend();
+
+	virtual bool SupportsConstantBufferOffsets() const override { return m_Context1 != nullptr; }
+
+	virtual BufferHandle CreateConstantBuffer(unsigned int byteWidth) override;
+	virtual void ReleaseBuffer(BufferHandle buffer) override;
+	virtual void UploadBuffer(BufferHandle buffer, UploadMode mode, size_t offset, const void* data, size_t size) override;
+
+	virtual void BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count,
+		const BufferHandle* buffers, const unsigned int* firstConstants, const unsigned int* numConstants) override;
+	virtual void BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ViewHandle* views) override;
+	virtual void BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const SamplerHandle* samplers) override;
+
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+	virtual void Dispatch(unsigned int x, unsigned int y, unsigned int z) override;
+
+	virtual FenceHandle InsertFence() override;
+	virtual bool IsFenceComplete(FenceHandle fence) override;
+	virtual void ReleaseFence(FenceHandle fence) override;
+
+	virtual QueryHandle BeginTimingRange() override;
+	virtual void EndTimingRange(QueryHandle range) override;
+	virtual QueryHandle InsertTimestamp() override;
+	virtual bool GetTimingRangeData(QueryHandle range, uint64_t* frequency, bool* disjoint) override;
+	virtual bool GetTimestampData(QueryHandle timestamp, uint64_t* ticks) override;
+	virtual void ReleaseQuery(QueryHandle query) override;
+
+	static inline ID3D11Buffer* ToBuffer(BufferHandle buffer) { return static_cast<ID3D11Buffer*>(buffer); }
+	static inline ID3D11ShaderResourceView* ToView(ViewHandle view) { return static_cast<ID3D11ShaderResourceView*>(view); }
+	static inline ID3D11SamplerState* ToSampler(SamplerHandle sampler) { return static_cast<ID3D11SamplerState*>(sampler); }
+
+private:
+	// takes a query of the given type from its free list, or creates a new one
+	ID3D11Query* AllocateQuery(D3D11_QUERY type, std::vector<ID3D11Query*>& freeList);
+
+private:
+	ID3D11Device* m_Device = nullptr;
+	ID3D11DeviceContext* m_DeviceContext = nullptr;
+	// only valid if the device supports constant buffer offsetting
+	ID3D11DeviceContext1* m_Context1 = nullptr;
+
+	std::vector<ID3D11Query*> m_FreeQueries;
+	std::vector<ID3D11Query*> m_FreeTimestampQueries;
+	std::vector<ID3D11Query*> m_FreeDisjointQueries;
+};
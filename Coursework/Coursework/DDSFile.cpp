@@ -0,0 +1,215 @@
+#include "DDSFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
+#include "GPUMemoryTracker.h"
+
+
+namespace
+{
+	const uint32_t DDSMagic = 0x20534444;	// "DDS "
+	const uint32_t DX10FourCC = 0x30315844;	// "DX10"
+
+	// flags, see the DDS_HEADER documentation
+	const uint32_t DDSD_CAPS = 0x1;
+	const uint32_t DDSD_HEIGHT = 0x2;
+	const uint32_t DDSD_WIDTH = 0x4;
+	const uint32_t DDSD_PITCH = 0x8;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8;
+	const uint32_t DDSCAPS_TEXTURE = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP = 0x400000;
+	const uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xFE00;
+	const uint32_t DDS_RESOURCE_DIMENSION_TEXTURE2D = 3;
+	const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+	struct DDSPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+}
+
+
+std::vector<D3D11_SUBRESOURCE_DATA> DDSFile::Image::GetSubresources() const
+{
+	std::vector<D3D11_SUBRESOURCE_DATA> subresources;
+
+	const unsigned char* ptr = data.data();
+	for (unsigned int slice = 0; slice < arraySize; slice++)
+	{
+		for (unsigned int mip = 0; mip < mipLevels; mip++)
+		{
+			size_t rowPitch, rowCount;
+			CalculatePitch(format, (std::max)(width >> mip, 1u), (std::max)(height >> mip, 1u), &rowPitch, &rowCount);
+
+			D3D11_SUBRESOURCE_DATA subresource;
+			subresource.pSysMem = ptr;
+			subresource.SysMemPitch = static_cast<UINT>(rowPitch);
+			subresource.SysMemSlicePitch = static_cast<UINT>(rowPitch * rowCount);
+			subresources.push_back(subresource);
+
+			ptr += subresource.SysMemSlicePitch;
+		}
+	}
+	return subresources;
+}
+
+bool DDSFile::Write(const std::string& file, const Image& image)
+{
+	unsigned int bitsPerPixel = GPUMemoryTracker::BitsPerPixel(image.format);
+	if (bitsPerPixel == 0 || image.data.size() != CalculateDataSize(image.format, image.width, image.height, image.mipLevels, image.arraySize))
+		return false;
+
+	size_t rowPitch, rowCount;
+	CalculatePitch(image.format, image.width, image.height, &rowPitch, &rowCount);
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | (image.mipLevels > 1 ? DDSD_MIPMAPCOUNT : 0);
+	header.height = image.height;
+	header.width = image.width;
+	// the top mip's pitch, or its whole size when block compressed
+	bool blockCompressed = GPUMemoryTracker::IsBlockCompressed(image.format);
+	header.flags |= blockCompressed ? DDSD_LINEARSIZE : DDSD_PITCH;
+	header.pitchOrLinearSize = static_cast<uint32_t>(blockCompressed ? rowPitch * rowCount : rowPitch);
+	header.depth = 1;
+	header.mipMapCount = image.mipLevels;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DX10FourCC;
+	header.caps = DDSCAPS_TEXTURE | (image.mipLevels > 1 ? DDSCAPS_MIPMAP | DDSCAPS_COMPLEX : 0) | (image.cube ? DDSCAPS_COMPLEX : 0);
+	header.caps2 = image.cube ? DDSCAPS2_CUBEMAP_ALLFACES : 0;
+
+	// a cubemap's array size counts cubes, not faces
+	DDSHeaderDX10 dx10 = {};
+	dx10.dxgiFormat = image.format;
+	dx10.resourceDimension = DDS_RESOURCE_DIMENSION_TEXTURE2D;
+	dx10.miscFlag = image.cube ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+	dx10.arraySize = image.cube ? image.arraySize / 6 : image.arraySize;
+
+	std::ofstream outfile(file, std::ios::binary | std::ios::trunc);
+	if (!outfile.is_open()) return false;
+
+	outfile.write(reinterpret_cast<const char*>(&DDSMagic), sizeof(DDSMagic));
+	outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	outfile.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+	outfile.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+	return outfile.good();
+}
+
+bool DDSFile::Read(const std::string& file, Image* image)
+{
+	std::ifstream infile(file, std::ios::binary);
+	if (!infile.is_open()) return false;
+
+	uint32_t magic = 0;
+	DDSHeader header;
+	DDSHeaderDX10 dx10;
+	infile.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	infile.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!infile || magic != DDSMagic || header.size != sizeof(DDSHeader))
+		return false;
+
+	// only files written with a DX10 header
+	if (!(header.pixelFormat.flags & DDPF_FOURCC) || header.pixelFormat.fourCC != DX10FourCC)
+		return false;
+	infile.read(reinterpret_cast<char*>(&dx10), sizeof(dx10));
+	// a corrupt header is a failed read, not a bug, so nothing below may assert, overflow or shift past the width
+	if (!infile || dx10.resourceDimension != DDS_RESOURCE_DIMENSION_TEXTURE2D || dx10.arraySize > D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+		|| header.width > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION || header.height > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION || header.mipMapCount > D3D11_REQ_MIP_LEVELS)
+		return false;
+
+	image->format = static_cast<DXGI_FORMAT>(dx10.dxgiFormat);
+	image->width = header.width;
+	image->height = header.height;
+	image->mipLevels = (std::max)(header.mipMapCount, 1u);
+	image->cube = (dx10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+	image->arraySize = (std::max)(dx10.arraySize, 1u) * (image->cube ? 6 : 1);
+
+	if (!GPUMemoryTracker::IsKnownFormat(image->format) || image->width == 0 || image->height == 0)
+		return false;
+	for (unsigned int mip = 1; mip < image->mipLevels; mip++)
+	{
+		if ((image->width >> mip) == 0 && (image->height >> mip) == 0) return false;
+	}
+
+	// don't allocate more than the file could hold
+	std::streamoff dataStart = infile.tellg();
+	infile.seekg(0, std::ios::end);
+	std::streamoff remaining = infile.tellg() - dataStart;
+	infile.seekg(dataStart);
+	size_t dataSize = CalculateDataSize(image->format, image->width, image->height, image->mipLevels, image->arraySize);
+	if (!infile || remaining < 0 || dataSize > static_cast<size_t>(remaining))
+		return false;
+
+	image->data.resize(dataSize);
+	infile.read(reinterpret_cast<char*>(image->data.data()), image->data.size());
+	return static_cast<size_t>(infile.gcount()) == image->data.size();
+}
+
+size_t DDSFile::CalculateDataSize(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int mipLevels, unsigned int arraySize)
+{
+	size_t size = 0;
+	for (unsigned int mip = 0; mip < mipLevels; mip++)
+	{
+		size_t rowPitch, rowCount;
+		CalculatePitch(format, (std::max)(width >> mip, 1u), (std::max)(height >> mip, 1u), &rowPitch, &rowCount);
+		size += rowPitch * rowCount;
+	}
+	return size * arraySize;
+}
+
+void DDSFile::CalculatePitch(DXGI_FORMAT format, unsigned int width, unsigned int height, size_t* rowPitch, size_t* rowCount)
+{
+	size_t bitsPerPixel = GPUMemoryTracker::BitsPerPixel(format);
+	if (GPUMemoryTracker::IsBlockCompressed(format))
+	{
+		// 16 pixels to a block
+		*rowPitch = ((width + 3) / 4) * bitsPerPixel * 2;
+		*rowCount = (height + 3) / 4;
+	}
+	else
+	{
+		*rowPitch = width * bitsPerPixel / 8;
+		*rowCount = height;
+	}
+}
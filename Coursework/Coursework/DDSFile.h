@@ -0,0 +1,43 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <vector>
+
+
+// Reading and writing textures as DDS files with a DX10 header
+// Uncompressed and block compressed formats are supported, and the data of every subresource is tightly packed in D3D11 subresource order
+
+class DDSFile
+{
+public:
+	struct Image
+	{
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+		unsigned int width = 0;
+		unsigned int height = 0;
+		unsigned int mipLevels = 1;
+		unsigned int arraySize = 1;
+		bool cube = false;
+
+		std::vector<unsigned char> data;
+
+		// initial data for CreateTexture2D, pointing into data
+		std::vector<D3D11_SUBRESOURCE_DATA> GetSubresources() const;
+	};
+
+public:
+	// pure static class
+	DDSFile() = delete;
+
+	static bool Write(const std::string& file, const Image& image);
+	static bool Read(const std::string& file, Image* image);
+
+	// tightly packed size of every subresource
+	static size_t CalculateDataSize(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int mipLevels, unsigned int arraySize);
+
+private:
+	// block compressed formats are laid out in rows of 4x4 blocks
+	static void CalculatePitch(DXGI_FORMAT format, unsigned int width, unsigned int height, size_t* rowPitch, size_t* rowCount);
+};
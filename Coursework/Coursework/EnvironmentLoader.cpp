@@ -0,0 +1,176 @@
+#include "EnvironmentLoader.h"
+
+#include <algorithm>
+
+#include "stb_image.h"
+
+#include "Cubemap.h"
+#include "TextureCache.h"
+
+#include "imGUI/imgui.h"
+
+
+EnvironmentLoader::EnvironmentLoader(ID3D11Device* device, GlobalLighting* globalLighting, TextureCache* textureCache)
+	: m_Device(device), m_GlobalLighting(globalLighting), m_TextureCache(textureCache),
+	// half of the hardware threads (the loader's thread being one of them), leaving the rest to keep rendering
+	m_ThreadPool((std::max)(std::thread::hardware_concurrency() / 2, 2u) - 1)
+{
+	m_Worker = std::thread(&EnvironmentLoader::WorkerLoop, this);
+}
+
+EnvironmentLoader::~EnvironmentLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Wake.notify_one();
+
+	// a bake that is running is finished first
+	m_Worker.join();
+
+	if (m_HasResult) Discard(m_Result);
+}
+
+void EnvironmentLoader::Load(const char* const faces[6])
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Request.faces.assign(faces, faces + 6);
+		// settings are read here, on the render thread
+		m_Request.settings = m_GlobalLighting->GetBackgroundBakeSettings();
+		m_Request.id = ++m_LatestId;
+		m_HasRequest = true;
+		m_LastError.clear();
+	}
+	m_Wake.notify_one();
+}
+
+Cubemap* EnvironmentLoader::Update()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_HasResult) return nullptr;
+	m_HasResult = false;
+
+	// finished before another environment was picked, but not taken until after
+	if (m_Result.id != m_LatestId)
+	{
+		Discard(m_Result);
+		return nullptr;
+	}
+
+	m_GlobalLighting->SetBakedEnvironment(m_Result.environment, m_Result.bake);
+	Cubemap* environment = m_Result.environment;
+	m_Result = Result();
+	return environment;
+}
+
+bool EnvironmentLoader::IsBusy() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_HasRequest || m_Working || m_HasResult;
+}
+
+void EnvironmentLoader::ProgressGUI()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_HasRequest || m_Working)
+	{
+		// loading the faces is roughly the first third of the work
+		int facesLoaded = m_FacesLoaded;
+		if (facesLoaded < 6)
+			ImGui::ProgressBar(facesLoaded / 6.0f * 0.3f, ImVec2(-1.0f, 0.0f), "Loading faces");
+		else
+			ImGui::ProgressBar(0.3f + 0.7f * m_BakeProgress, ImVec2(-1.0f, 0.0f), "Baking");
+	}
+	if (!m_LastError.empty())
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", m_LastError.c_str());
+}
+
+void EnvironmentLoader::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_Wake.wait(lock, [this] { return m_Quit || m_HasRequest; });
+		if (m_Quit) return;
+
+		Request request = m_Request;
+		m_HasRequest = false;
+		m_Working = true;
+		m_FacesLoaded = 0;
+		m_BakeProgress = 0.0f;
+		lock.unlock();
+
+		Result result;
+		result.id = request.id;
+		std::string error;
+		result.environment = LoadAndBake(request, &result.bake, &error);
+
+		lock.lock();
+		m_Working = false;
+		if (!result.environment)
+		{
+			// the bake may have finished even though the cubemap couldn't be made
+			Discard(result);
+			if (request.id == m_LatestId) m_LastError = error;
+			continue;
+		}
+
+		// another environment was picked while this one was being made
+		if (request.id != m_LatestId)
+		{
+			Discard(result);
+			continue;
+		}
+
+		if (m_HasResult) Discard(m_Result);
+		m_Result = result;
+		m_HasResult = true;
+	}
+}
+
+Cubemap* EnvironmentLoader::LoadAndBake(const Request& request, GlobalLighting::EnvironmentBake* bake, std::string* error)
+{
+	unsigned char* faceData[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+	int size = 0;
+	bool success = true;
+	for (int i = 0; i < 6 && success; i++)
+	{
+		int width, height, channels;
+		faceData[i] = stbi_load(request.faces[i].c_str(), &width, &height, &channels, 4);
+		success = faceData[i] && width == height && (i == 0 || width == size);
+		if (!success)
+		{
+			*error = "Failed to load environment face " + request.faces[i];
+			break;
+		}
+
+		size = width;
+		m_FacesLoaded = i + 1;
+	}
+
+	Cubemap* environment = nullptr;
+	if (success)
+	{
+		// the device is free threaded, so the textures can be made here
+		environment = m_TextureCache->AcquireCubemap(request.faces, [&]() { return new Cubemap(m_Device, faceData, size, request.faces, &m_ThreadPool); });
+		if (environment)
+			m_GlobalLighting->BakeEnvironment(request.settings, request.faces, faceData, size, size * 4, &m_ThreadPool, bake, &m_BakeProgress);
+		else
+			*error = "Failed to create environment cubemap";
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (faceData[i]) stbi_image_free(faceData[i]);
+	}
+	return environment;
+}
+
+void EnvironmentLoader::Discard(Result& result)
+{
+	m_TextureCache->Release(result.environment);
+	if (result.bake.prefilteredMap) delete result.bake.prefilteredMap;
+	result = Result();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GlobalLighting.h"
+#include "ThreadPool.h"
+
+class Cubemap;
+class TextureCache;
+
+
+// Loads an environment's faces and bakes its image based lighting on a background thread
+// The current environment keeps being rendered while this runs, then Update swaps the new cubemap and its bake in together
+//
+// Only the latest request matters: one that hasn't started is replaced, and one that is running is finished and thrown away.
+// The bake uses a thread pool of its own, so it never waits on (or holds up) the render thread's pool
+
+class EnvironmentLoader
+{
+public:
+	// cubemaps come from the texture cache, so going back to an environment doesn't make it again
+	EnvironmentLoader(ID3D11Device* device, GlobalLighting* globalLighting, TextureCache* textureCache);
+	~EnvironmentLoader();
+
+	EnvironmentLoader(const EnvironmentLoader&) = delete;
+	EnvironmentLoader& operator=(const EnvironmentLoader&) = delete;
+
+	// faces in the Cubemap face order
+	void Load(const char* const faces[6]);
+
+	// call once a frame on the render thread
+	// returns the new environment once it has been swapped into global lighting
+	// the caller holds a reference to it from the texture cache, and should release the old one
+	Cubemap* Update();
+
+	// true from Load until the environment has been swapped in
+	bool IsBusy() const;
+
+	void ProgressGUI();
+
+private:
+	struct Request
+	{
+		std::vector<std::string> faces;
+		GlobalLighting::BakeSettings settings;
+		unsigned long long id = 0;
+	};
+
+	struct Result
+	{
+		Cubemap* environment = nullptr;
+		GlobalLighting::EnvironmentBake bake;
+		unsigned long long id = 0;
+	};
+
+	void WorkerLoop();
+	// null if any face failed to load or the cubemap couldn't be made
+	Cubemap* LoadAndBake(const Request& request, GlobalLighting::EnvironmentBake* bake, std::string* error);
+	void Discard(Result& result);
+
+private:
+	ID3D11Device* m_Device = nullptr;
+	GlobalLighting* m_GlobalLighting = nullptr;
+	TextureCache* m_TextureCache = nullptr;
+
+	ThreadPool m_ThreadPool;
+	std::thread m_Worker;
+
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	bool m_Quit = false;
+	bool m_HasRequest = false;
+	Request m_Request;
+	bool m_Working = false;
+	bool m_HasResult = false;
+	Result m_Result;
+	// the id of the latest request, anything older is stale when it finishes
+	unsigned long long m_LatestId = 0;
+
+	std::string m_LastError;
+
+	// progress of the request being worked on
+	std::atomic<int> m_FacesLoaded{ 0 };
+	std::atomic<float> m_BakeProgress{ 0.0f };
+};
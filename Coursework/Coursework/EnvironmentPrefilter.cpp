@@ -0,0 +1,373 @@
+#include "EnvironmentPrefilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "stb_image.h"
+
+#include "Cubemap.h"
+#include "DDSFile.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	// an importance sampled light direction around a normal of +z, and the mip of the environment it is read from
+	struct Sample
+	{
+		XMFLOAT3 direction;
+		float NdotL;
+		float lod;
+	};
+
+	float RadicalInverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return static_cast<float>(bits) * 2.3283064365386963e-10f;
+	}
+
+	std::vector<Sample> MakeSamples(float roughness, unsigned int sampleCount, unsigned int environmentSize, unsigned int maxLod)
+	{
+		std::vector<Sample> samples;
+		samples.reserve(sampleCount);
+
+		float a = roughness * roughness;
+		float a2 = a * a;
+		// solid angle covered by a texel of the top mip
+		float texelSolidAngle = 4.0f * XM_PI / (6.0f * environmentSize * environmentSize);
+
+		for (unsigned int i = 0; i < sampleCount; i++)
+		{
+			// the same Hammersley GGX sampling as ImportanceSampleGGX in lighting.hlsli
+			float xi0 = static_cast<float>(i) / sampleCount;
+			float xi1 = RadicalInverse(i);
+			float phi = 2.0f * XM_PI * xi0;
+			float cosTheta = std::sqrt((1.0f - xi1) / (1.0f + (a2 - 1.0f) * xi1));
+			float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+			// reflect V = N = +z about H
+			float NdotL = 2.0f * cosTheta * cosTheta - 1.0f;
+			if (NdotL <= 0.0f) continue;
+
+			Sample sample;
+			sample.direction = XMFLOAT3(2.0f * cosTheta * sinTheta * std::cos(phi), 2.0f * cosTheta * sinTheta * std::sin(phi), NdotL);
+			sample.NdotL = NdotL;
+
+			// with V = N the pdf of L is D / 4, pick the mip whose texels cover the solid angle of the sample
+			float d = (a2 - 1.0f) * cosTheta * cosTheta + 1.0f;
+			float D = a2 / (XM_PI * d * d);
+			float sampleSolidAngle = 1.0f / (sampleCount * D * 0.25f + 1e-6f);
+			// no bias, a level up blurs away more than the extra samples would have gained
+			float lod = 0.5f * std::log2(sampleSolidAngle / texelSolidAngle);
+			sample.lod = (std::min)((std::max)(lod, 0.0f), static_cast<float>(maxLod));
+
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+
+	inline float Dot(const XMFLOAT3& a, const XMFLOAT3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	inline XMFLOAT3 Normalize(const XMFLOAT3& v)
+	{
+		float invLength = 1.0f / std::sqrt(Dot(v, v));
+		return XMFLOAT3(v.x * invLength, v.y * invLength, v.z * invLength);
+	}
+}
+
+
+EnvironmentPrefilter::Environment EnvironmentPrefilter::FromRGBA8(const unsigned char* const faces[6], unsigned int size, unsigned int rowPitch)
+{
+	Environment environment;
+	environment.size = size;
+	for (int face = 0; face < 6; face++)
+	{
+		environment.faces[face].resize(static_cast<size_t>(size) * size);
+		for (unsigned int y = 0; y < size; y++)
+		{
+			const unsigned char* row = faces[face] + static_cast<size_t>(y) * rowPitch;
+			XMFLOAT3* dst = environment.faces[face].data() + static_cast<size_t>(y) * size;
+			for (unsigned int x = 0; x < size; x++)
+				dst[x] = XMFLOAT3(row[4 * x] / 255.0f, row[4 * x + 1] / 255.0f, row[4 * x + 2] / 255.0f);
+		}
+	}
+	return environment;
+}
+
+bool EnvironmentPrefilter::LoadFaces(const std::string files[6], Environment* environment)
+{
+	for (int face = 0; face < 6; face++)
+	{
+		int width, height, channels;
+		bool hdr = stbi_is_hdr(files[face].c_str()) != 0;
+		// stbi_loadf would linearise LDR images, but the renderer samples them as they are
+		float* hdrData = hdr ? stbi_loadf(files[face].c_str(), &width, &height, &channels, 3) : nullptr;
+		unsigned char* ldrData = hdr ? nullptr : stbi_load(files[face].c_str(), &width, &height, &channels, 3);
+		if ((!hdrData && !ldrData) || width != height || (face > 0 && static_cast<unsigned int>(width) != environment->size))
+		{
+			stbi_image_free(hdrData);
+			stbi_image_free(ldrData);
+			return false;
+		}
+
+		environment->size = width;
+		std::vector<XMFLOAT3>& texels = environment->faces[face];
+		texels.resize(static_cast<size_t>(width) * height);
+		for (size_t i = 0; i < texels.size(); i++)
+		{
+			if (hdr)
+				texels[i] = XMFLOAT3(hdrData[3 * i], hdrData[3 * i + 1], hdrData[3 * i + 2]);
+			else
+				texels[i] = XMFLOAT3(ldrData[3 * i] / 255.0f, ldrData[3 * i + 1] / 255.0f, ldrData[3 * i + 2] / 255.0f);
+		}
+
+		stbi_image_free(hdrData);
+		stbi_image_free(ldrData);
+	}
+	return true;
+}
+
+EnvironmentPrefilter::Result EnvironmentPrefilter::Prefilter(const Environment& environment, unsigned int size, unsigned int mipLevels,
+	unsigned int sampleCount, ThreadPool* threadPool)
+{
+	MipChain chain;
+	BuildMipChain(environment, chain);
+	unsigned int maxLod = static_cast<unsigned int>(chain.sizes.size()) - 1;
+
+	Result result;
+	result.size = size;
+	result.mipLevels = mipLevels;
+	result.subresources.resize(6 * mipLevels);
+
+	// the samples only depend on roughness, so they are shared by every texel of a mip
+	std::vector<std::vector<Sample>> mipSamples(mipLevels);
+	std::vector<float> mipWeights(mipLevels, 0.0f);
+	for (unsigned int mip = 0; mip < mipLevels; mip++)
+	{
+		float roughness = mipLevels > 1 ? static_cast<float>(mip) / (mipLevels - 1) : 0.0f;
+		if (roughness > 0.0f)
+			mipSamples[mip] = MakeSamples(roughness, sampleCount, environment.size, maxLod);
+		else
+		{
+			// a perfect mirror is just a copy, the GGX pdf is a delta so read the mip that matches the output's texels
+			float lod = std::log2(static_cast<float>(environment.size) / (std::max)(size >> mip, 1u));
+			mipSamples[mip].push_back({ XMFLOAT3(0.0f, 0.0f, 1.0f), 1.0f, (std::min)((std::max)(lod, 0.0f), static_cast<float>(maxLod)) });
+		}
+		for (const Sample& sample : mipSamples[mip])
+			mipWeights[mip] += sample.NdotL;
+	}
+
+	// every row of every face and mip is a job, the low mips are too small to balance the work as whole faces
+	struct Row
+	{
+		unsigned int face, mip, y;
+	};
+	std::vector<Row> rows;
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		for (unsigned int mip = 0; mip < mipLevels; mip++)
+		{
+			unsigned int mipSize = (std::max)(size >> mip, 1u);
+			result.subresources[face * mipLevels + mip].resize(static_cast<size_t>(mipSize) * mipSize);
+			for (unsigned int y = 0; y < mipSize; y++)
+				rows.push_back({ face, mip, y });
+		}
+	}
+
+	threadPool->ParallelFor(rows.size(), 4, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const Row& row = rows[i];
+			unsigned int mipSize = (std::max)(size >> row.mip, 1u);
+			const std::vector<Sample>& samples = mipSamples[row.mip];
+			float invWeight = mipWeights[row.mip] > 0.0f ? 1.0f / mipWeights[row.mip] : 0.0f;
+
+			const XMFLOAT3& faceNormal = Cubemap::GetFaceNormal(row.face);
+			const XMFLOAT3& faceTangent = Cubemap::GetFaceTangent(row.face);
+			const XMFLOAT3& faceBitangent = Cubemap::GetFaceBitangent(row.face);
+
+			XMFLOAT3* dst = result.subresources[row.face * mipLevels + row.mip].data() + static_cast<size_t>(row.y) * mipSize;
+			float v = (row.y + 0.5f) / mipSize * 2.0f - 1.0f;
+			for (unsigned int x = 0; x < mipSize; x++)
+			{
+				float u = (x + 0.5f) / mipSize * 2.0f - 1.0f;
+				XMFLOAT3 N = Normalize(XMFLOAT3(faceNormal.x + u * faceTangent.x + v * faceBitangent.x,
+					faceNormal.y + u * faceTangent.y + v * faceBitangent.y,
+					faceNormal.z + u * faceTangent.z + v * faceBitangent.z));
+
+				// the same tangent frame as ImportanceSampleGGX
+				XMFLOAT3 up = std::abs(N.z) < 0.999f ? XMFLOAT3(0.0f, 0.0f, 1.0f) : XMFLOAT3(1.0f, 0.0f, 0.0f);
+				XMFLOAT3 T = Normalize(Cross(up, N));
+				XMFLOAT3 B = Cross(N, T);
+
+				XMFLOAT3 colour(0.0f, 0.0f, 0.0f);
+				for (const Sample& sample : samples)
+				{
+					const XMFLOAT3& l = sample.direction;
+					XMFLOAT3 L(T.x * l.x + B.x * l.y + N.x * l.z, T.y * l.x + B.y * l.y + N.y * l.z, T.z * l.x + B.z * l.y + N.z * l.z);
+
+					XMFLOAT3 radiance = SampleLevel(chain, L, sample.lod);
+					colour.x += radiance.x * sample.NdotL;
+					colour.y += radiance.y * sample.NdotL;
+					colour.z += radiance.z * sample.NdotL;
+				}
+				dst[x] = XMFLOAT3(colour.x * invWeight, colour.y * invWeight, colour.z * invWeight);
+			}
+		}
+	});
+
+	return result;
+}
+
+std::vector<unsigned char> EnvironmentPrefilter::ToRGBA8(const std::vector<XMFLOAT3>& texels)
+{
+	auto toUNorm = [](float v) { return static_cast<unsigned char>((std::min)((std::max)(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+
+	std::vector<unsigned char> rgba(texels.size() * 4);
+	for (size_t i = 0; i < texels.size(); i++)
+	{
+		rgba[4 * i] = toUNorm(texels[i].x);
+		rgba[4 * i + 1] = toUNorm(texels[i].y);
+		rgba[4 * i + 2] = toUNorm(texels[i].z);
+		rgba[4 * i + 3] = 255;
+	}
+	return rgba;
+}
+
+bool EnvironmentPrefilter::Bake(const std::string files[6], const std::string& output, unsigned int size, unsigned int mipLevels)
+{
+	if (size == 0 || mipLevels == 0) return false;
+
+	Environment environment;
+	if (!LoadFaces(files, &environment)) return false;
+
+	ThreadPool threadPool;
+	Result result = Prefilter(environment, size, mipLevels, DefaultSampleCount, &threadPool);
+
+	bool hdr = false;
+	for (int face = 0; face < 6; face++)
+		hdr |= stbi_is_hdr(files[face].c_str()) != 0;
+
+	DDSFile::Image image;
+	image.format = hdr ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R8G8B8A8_UNORM;
+	image.width = size;
+	image.height = size;
+	image.mipLevels = mipLevels;
+	image.arraySize = 6;
+	image.cube = true;
+	for (const std::vector<XMFLOAT3>& texels : result.subresources)
+	{
+		if (hdr)
+		{
+			size_t offset = image.data.size();
+			image.data.resize(offset + texels.size() * sizeof(XMFLOAT4));
+			XMFLOAT4* dst = reinterpret_cast<XMFLOAT4*>(image.data.data() + offset);
+			for (size_t i = 0; i < texels.size(); i++)
+				dst[i] = XMFLOAT4(texels[i].x, texels[i].y, texels[i].z, 1.0f);
+		}
+		else
+		{
+			std::vector<unsigned char> rgba = ToRGBA8(texels);
+			image.data.insert(image.data.end(), rgba.begin(), rgba.end());
+		}
+	}
+	return DDSFile::Write(output, image);
+}
+
+void EnvironmentPrefilter::BuildMipChain(const Environment& environment, MipChain& chain)
+{
+	chain.sizes.clear();
+	for (unsigned int s = environment.size; ; s = (std::max)(s / 2, 1u))
+	{
+		chain.sizes.push_back(s);
+		if (s == 1) break;
+	}
+
+	for (int face = 0; face < 6; face++)
+	{
+		std::vector<std::vector<XMFLOAT3>>& levels = chain.levels[face];
+		levels.resize(chain.sizes.size());
+		levels[0] = environment.faces[face];
+
+		for (size_t mip = 1; mip < chain.sizes.size(); mip++)
+		{
+			unsigned int srcSize = chain.sizes[mip - 1];
+			unsigned int dstSize = chain.sizes[mip];
+			const std::vector<XMFLOAT3>& src = levels[mip - 1];
+			std::vector<XMFLOAT3>& dst = levels[mip];
+			dst.resize(static_cast<size_t>(dstSize) * dstSize);
+
+			for (unsigned int y = 0; y < dstSize; y++)
+			{
+				// odd sizes drop the last row and column
+				unsigned int y0 = 2 * y, y1 = (std::min)(2 * y + 1, srcSize - 1);
+				for (unsigned int x = 0; x < dstSize; x++)
+				{
+					unsigned int x0 = 2 * x, x1 = (std::min)(2 * x + 1, srcSize - 1);
+					const XMFLOAT3& a = src[x0 + y0 * srcSize];
+					const XMFLOAT3& b = src[x1 + y0 * srcSize];
+					const XMFLOAT3& c = src[x0 + y1 * srcSize];
+					const XMFLOAT3& d = src[x1 + y1 * srcSize];
+					dst[x + y * dstSize] = XMFLOAT3((a.x + b.x + c.x + d.x) * 0.25f, (a.y + b.y + c.y + d.y) * 0.25f, (a.z + b.z + c.z + d.z) * 0.25f);
+				}
+			}
+		}
+	}
+}
+
+XMFLOAT3 EnvironmentPrefilter::SampleLevel(const MipChain& chain, const XMFLOAT3& direction, float lod)
+{
+	// the face of the major axis, then project onto its tangent and bitangent
+	float ax = std::abs(direction.x), ay = std::abs(direction.y), az = std::abs(direction.z);
+	int face;
+	if (ax >= ay && ax >= az) face = direction.x >= 0.0f ? 0 : 1;
+	else if (ay >= az) face = direction.y >= 0.0f ? 2 : 3;
+	else face = direction.z >= 0.0f ? 4 : 5;
+
+	float major = Dot(direction, Cubemap::GetFaceNormal(face));
+	float u = Dot(direction, Cubemap::GetFaceTangent(face)) / major;
+	float v = Dot(direction, Cubemap::GetFaceBitangent(face)) / major;
+
+	unsigned int mip0 = static_cast<unsigned int>(lod);
+	float t = lod - mip0;
+	XMFLOAT3 a = SampleBilinear(chain, face, mip0, u, v);
+	if (t <= 0.0f || mip0 + 1 >= chain.sizes.size()) return a;
+
+	XMFLOAT3 b = SampleBilinear(chain, face, mip0 + 1, u, v);
+	return XMFLOAT3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+XMFLOAT3 EnvironmentPrefilter::SampleBilinear(const MipChain& chain, int face, unsigned int mip, float u, float v)
+{
+	// clamped at the edge of the face, the seams are blurred away at any roughness that reads the low mips
+	int size = static_cast<int>(chain.sizes[mip]);
+	const std::vector<XMFLOAT3>& texels = chain.levels[face][mip];
+
+	float fx = (u * 0.5f + 0.5f) * size - 0.5f;
+	float fy = (v * 0.5f + 0.5f) * size - 0.5f;
+	float floorX = std::floor(fx), floorY = std::floor(fy);
+	float tx = fx - floorX, ty = fy - floorY;
+
+	int x0 = (std::min)((std::max)(static_cast<int>(floorX), 0), size - 1);
+	int y0 = (std::min)((std::max)(static_cast<int>(floorY), 0), size - 1);
+	int x1 = (std::min)(x0 + 1, size - 1);
+	int y1 = (std::min)(y0 + 1, size - 1);
+	if (floorX < 0.0f) x1 = x0;
+	if (floorY < 0.0f) y1 = y0;
+
+	const XMFLOAT3& a = texels[x0 + y0 * size];
+	const XMFLOAT3& b = texels[x1 + y0 * size];
+	const XMFLOAT3& c = texels[x0 + y1 * size];
+	const XMFLOAT3& d = texels[x1 + y1 * size];
+
+	float wa = (1.0f - tx) * (1.0f - ty), wb = tx * (1.0f - ty), wc = (1.0f - tx) * ty, wd = tx * ty;
+	return XMFLOAT3(a.x * wa + b.x * wb + c.x * wc + d.x * wd,
+		a.y * wa + b.y * wb + c.y * wc + d.y * wd,
+		a.z * wa + b.z * wb + c.z * wc + d.z * wd);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+class ThreadPool;
+
+
+// CPU port of prefilteredenvironment_cs.hlsl, so prefiltered environment maps can be baked without a GPU
+// Each mip of the output is the environment convolved with the GGX lobe for a roughness of mip / (mipLevels - 1)
+//
+// Uses filtered importance sampling: every sample is taken from the mip of the environment whose texels cover about
+// the same solid angle as the sample, so 128 samples per texel are as close to the converged result as the 1024 the shader takes
+
+class EnvironmentPrefilter
+{
+public:
+	static const unsigned int DefaultSampleCount = 128;
+
+	// linear colour, faces in the Cubemap face order
+	struct Environment
+	{
+		unsigned int size = 0;
+		std::vector<XMFLOAT3> faces[6];
+	};
+
+	// every subresource of the output cubemap in D3D11 subresource order (face major, then mip)
+	struct Result
+	{
+		unsigned int size = 0;
+		unsigned int mipLevels = 0;
+		std::vector<std::vector<XMFLOAT3>> subresources;
+	};
+
+public:
+	// pure static class
+	EnvironmentPrefilter() = delete;
+
+	static Environment FromRGBA8(const unsigned char* const faces[6], unsigned int size, unsigned int rowPitch);
+	// LDR or HDR (.hdr) images, LDR values are used as they are, like the RGBA8 environment map is sampled
+	static bool LoadFaces(const std::string files[6], Environment* environment);
+
+	static Result Prefilter(const Environment& environment, unsigned int size, unsigned int mipLevels, unsigned int sampleCount, ThreadPool* threadPool);
+
+	// clamped to [0, 1], tightly packed
+	static std::vector<unsigned char> ToRGBA8(const std::vector<XMFLOAT3>& texels);
+
+	// prefilter the faces and write a cubemap DDS, for the command line
+	// the output is RGBA8 unless any face is HDR, then it is RGBA32F
+	static bool Bake(const std::string files[6], const std::string& output, unsigned int size, unsigned int mipLevels);
+
+private:
+	// a box filtered mip chain of each face, sampled trilinearly
+	struct MipChain
+	{
+		std::vector<unsigned int> sizes;
+		// [mip][face]
+		std::vector<std::vector<XMFLOAT3>> levels[6];
+	};
+
+	static void BuildMipChain(const Environment& environment, MipChain& chain);
+	static XMFLOAT3 SampleLevel(const MipChain& chain, const XMFLOAT3& direction, float lod);
+	static XMFLOAT3 SampleBilinear(const MipChain& chain, int face, unsigned int mip, float u, float v);
+};
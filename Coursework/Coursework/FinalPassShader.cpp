@@ -1,10 +1,14 @@
 #include "FinalPassShader.h"
 
+#include <chrono>
+
+#include "GPUMemoryTracker.h"
+
 #include "imGUI/imgui.h"
 
 
-FinalPassShader::FinalPassShader(ID3D11Device* device)
-	: BaseFullScreenShader(device)
+FinalPassShader::FinalPassShader(ID3D11Device* device, IGraphicsBackend* backend)
+	: BaseFullScreenShader(device, backend)
 {
 	Init(L"finalpass_ps.cso");
 
@@ -14,11 +18,19 @@ FinalPassShader::FinalPassShader(ID3D11Device* device)
 FinalPassShader::~FinalPassShader()
 {
 	m_ParamsBuffer->Release();
+
+	GPUMemoryTracker::Untrack(m_TonemapLUT);
+	m_TonemapLUTSRV->Release();
+	m_TonemapLUT->Release();
 }
 
 void FinalPassShader::setShaderParameters(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* renderTextureColour, ID3D11ShaderResourceView* renderTextureDepth,
 	ID3D11ShaderResourceView* luminance, unsigned int w, unsigned int h, ID3D11ShaderResourceView* bloom)
 {
+	// the settings have changed the curve
+	if (!m_TonemapLUTBaked || m_Curve != m_BakedCurve)
+		BakeTonemapLUT(deviceContext);
+
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
 	deviceContext->Map(m_ParamsBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
 	ParamsBufferType* data = (ParamsBufferType*)mappedResource.pData;
@@ -26,13 +38,10 @@ void FinalPassShader::setShaderParameters(ID3D11DeviceContext* deviceContext, ID
 	data->enableTonemapping = m_EnableTonemapping;
 	data->avgLumFactor = 1.0f / (w * h);
 
-	data->hdrMax = m_HDRMax;
-	data->contrast = m_Contrast;
-	data->shoulder = m_Shoulder;
-	data->midIn = m_MidIn;
-	data->midOut = m_MidOut;
-	data->crosstalk = m_Crosstalk;
-	data->white = m_White;
+	data->ratioScale = m_TonemapTable.ratioShaper.scale;
+	data->ratioBias = m_TonemapTable.ratioShaper.bias;
+	data->peakScale = m_TonemapTable.peakShaper.scale;
+	data->peakBias = m_TonemapTable.peakShaper.bias;
 
 	data->enableBloom = m_EnableBloom;
 	data->bloomStrength = m_BloomStrength;
@@ -40,8 +49,8 @@ void FinalPassShader::setShaderParameters(ID3D11DeviceContext* deviceContext, ID
 	deviceContext->Unmap(m_ParamsBuffer, 0);
 	deviceContext->PSSetConstantBuffers(0, 1, &m_ParamsBuffer);
 
-	ID3D11ShaderResourceView* psSRVs[4] = { renderTextureColour, renderTextureDepth, luminance, bloom };
-	deviceContext->PSSetShaderResources(0, 4, psSRVs);
+	ID3D11ShaderResourceView* psSRVs[5] = { renderTextureColour, renderTextureDepth, luminance, bloom, m_TonemapLUTSRV };
+	deviceContext->PSSetShaderResources(0, 5, psSRVs);
 
 	deviceContext->PSSetSamplers(0, 1, &m_TrilinearSampler);
 }
@@ -50,13 +59,17 @@ void FinalPassShader::SettingsGUI()
 {
 	ImGui::Checkbox("Enable Tonemapping", &m_EnableTonemapping);
 
-	ImGui::DragFloat("HDR Max", &m_HDRMax, 0.01f);
-	ImGui::DragFloat("Contrast", &m_Contrast, 0.005f);
-	ImGui::DragFloat("Shoulder", &m_Shoulder, 0.001f);
-	ImGui::DragFloat("Mid In", &m_MidIn, 0.001f);
-	ImGui::DragFloat("Mid Out", &m_MidOut, 0.001f);
-	ImGui::DragFloat("Crosstalk", &m_Crosstalk, 0.005f);
-	ImGui::DragFloat("White", &m_White, 0.005f);
+	ImGui::DragFloat("HDR Max", &m_Curve.hdrMax, 0.01f);
+	ImGui::DragFloat("Contrast", &m_Curve.contrast, 0.005f);
+	ImGui::DragFloat("Shoulder", &m_Curve.shoulder, 0.001f);
+	ImGui::DragFloat("Mid In", &m_Curve.midIn, 0.001f);
+	ImGui::DragFloat("Mid Out", &m_Curve.midOut, 0.001f);
+	ImGui::DragFloat("Crosstalk", &m_Curve.crosstalk, 0.005f);
+	ImGui::DragFloat("White", &m_Curve.white, 0.005f);
+	ImGui::Text("Table baked in %.3f ms", m_BakeTime);
+	if (ImGui::Button("Compare with reference"))
+		m_LastComparison = TonemapLUT::Compare(m_BakedCurve, m_TonemapTable);
+	ImGui::Text("Reference difference: max %.6f, mean %.6f", m_LastComparison.maxError, m_LastComparison.meanError);
 
 	ImGui::Separator();
 
@@ -93,6 +106,40 @@ void FinalPassShader::CreateShaderResources()
 
 	hr = m_Device->CreateSamplerState(&samplerDesc, &m_TrilinearSampler);
 	assert(hr == S_OK);
+
+	// tonemapping table, filled in by BakeTonemapLUT
+	D3D11_TEXTURE2D_DESC lutDesc;
+	lutDesc.Width = TonemapLUT::DefaultRatioSize;
+	lutDesc.Height = TonemapLUT::DefaultPeakSize;
+	lutDesc.MipLevels = 1;
+	lutDesc.ArraySize = 1;
+	lutDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	lutDesc.SampleDesc.Count = 1;
+	lutDesc.SampleDesc.Quality = 0;
+	lutDesc.Usage = D3D11_USAGE_DEFAULT;
+	lutDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	lutDesc.CPUAccessFlags = 0;
+	lutDesc.MiscFlags = 0;
+
+	hr = m_Device->CreateTexture2D(&lutDesc, nullptr, &m_TonemapLUT);
+	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_TonemapLUT, GPUMemoryTracker::Category::PostProcessing, "Tonemapping LUT");
+
+	hr = m_Device->CreateShaderResourceView(m_TonemapLUT, nullptr, &m_TonemapLUTSRV);
+	assert(hr == S_OK);
+}
+
+void FinalPassShader::BakeTonemapLUT(ID3D11DeviceContext* deviceContext)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	m_TonemapTable = TonemapLUT::Bake(m_Curve);
+	auto end = std::chrono::high_resolution_clock::now();
+	m_BakeTime = std::chrono::duration<float, std::milli>(end - start).count();
+
+	deviceContext->UpdateSubresource(m_TonemapLUT, 0, nullptr, m_TonemapTable.texels.data(), m_TonemapTable.ratioSize * sizeof(float), 0);
+
+	m_BakedCurve = m_Curve;
+	m_TonemapLUTBaked = true;
 }
 
 void FinalPassShader::UnbindShaderResources(ID3D11DeviceContext* deviceContext)
@@ -2,6 +2,7 @@
 
 #include "DXF.h"
 #include "BaseFullScreenShader.h"
+#include "TonemapLUT.h"
 
 using namespace DirectX;
 
@@ -14,23 +15,19 @@ private:
 		int enableTonemapping;
 		float avgLumFactor;
 
-		float hdrMax; 
-		float contrast;
-		float shoulder;
-		float midIn; 
-		float midOut;
-		float crosstalk;
-		float white;
+		// into the tonemapping table
+		float ratioScale;
+		float ratioBias;
+		float peakScale;
+		float peakBias;
 
 		// bloom
 		int enableBloom;
 		float bloomStrength;
-
-		float padding;
 	};
 
 public:
-	FinalPassShader(ID3D11Device* device);
+	FinalPassShader(ID3D11Device* device, IGraphicsBackend* backend);
 	~FinalPassShader();
 
 	void setShaderParameters(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* renderTextureColour, ID3D11ShaderResourceView* renderTextureDepth,
@@ -46,19 +43,24 @@ protected:
 	virtual void CreateShaderResources() override;
 	virtual void UnbindShaderResources(ID3D11DeviceContext* deviceContext) override;
 
+private:
+	void BakeTonemapLUT(ID3D11DeviceContext* deviceContext);
+
 private:
 	ID3D11Buffer* m_ParamsBuffer = nullptr;
 	ID3D11SamplerState* m_TrilinearSampler = nullptr;
 
 	bool m_EnableTonemapping = true;
-
-	float m_HDRMax = 16.0f;
-	float m_Contrast = 2.0f;
-	float m_Shoulder = 0.97f;
-	float m_MidIn = 0.26f;
-	float m_MidOut = 0.1f;
-	float m_Crosstalk = 4.0f;
-	float m_White = 1.0f;
+	TonemapLUT::Curve m_Curve;
+
+	// the curve baked into a table the pixel shader reads, rebaked when the curve changes
+	ID3D11Texture2D* m_TonemapLUT = nullptr;
+	ID3D11ShaderResourceView* m_TonemapLUTSRV = nullptr;
+	TonemapLUT::Table m_TonemapTable;
+	TonemapLUT::Curve m_BakedCurve;
+	bool m_TonemapLUTBaked = false;
+	float m_BakeTime = 0.0f;
+	TonemapLUT::Comparison m_LastComparison;
 
 	bool m_EnableBloom = true;
 	float m_BloomStrength = 1.0f;
@@ -0,0 +1,477 @@
+#include "GPUMemoryTracker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <vector>
+
+#include "imGUI/imgui.h"
+
+
+std::mutex GPUMemoryTracker::s_Mutex;
+std::unordered_map<ID3D11Resource*, GPUMemoryTracker::Allocation> GPUMemoryTracker::s_Allocations;
+
+std::array<size_t, GPUMemoryTracker::CategoryCount> GPUMemoryTracker::s_Totals{};
+std::array<size_t, GPUMemoryTracker::CategoryCount> GPUMemoryTracker::s_Peaks{};
+std::array<size_t, GPUMemoryTracker::CategoryCount> GPUMemoryTracker::s_Budgets{};
+size_t GPUMemoryTracker::s_TotalPeak = 0;
+size_t GPUMemoryTracker::s_TotalBudget = 0;
+
+char GPUMemoryTracker::s_DumpFile[128] = "gpu_memory.json";
+std::string GPUMemoryTracker::s_DumpStatus;
+
+
+namespace
+{
+	const char* s_CategoryNames[] = {
+		"Terrain", "Render Targets", "Post Processing", "Environment", "Shadows", "Materials", "Material Arrays", "Textures", "Buffers"
+	};
+
+	const float BytesPerMB = 1024.0f * 1024.0f;
+}
+
+
+void GPUMemoryTracker::Track(ID3D11Resource* resource, Category category, const std::string& name)
+{
+	if (!resource) return;
+
+	Allocation allocation;
+	allocation.category = category;
+	allocation.name = name;
+	allocation.bytes = CalculateSize(resource);
+
+	std::lock_guard<std::mutex> lock(s_Mutex);
+
+	auto it = s_Allocations.find(resource);
+	if (it != s_Allocations.end())
+	{
+		s_Totals[static_cast<size_t>(it->second.category)] -= it->second.bytes;
+		it->second = allocation;
+	}
+	else
+		s_Allocations.insert({ resource, allocation });
+
+	size_t c = static_cast<size_t>(category);
+	s_Totals[c] += allocation.bytes;
+	s_Peaks[c] = (std::max)(s_Peaks[c], s_Totals[c]);
+
+	size_t total = 0;
+	for (size_t t : s_Totals) total += t;
+	s_TotalPeak = (std::max)(s_TotalPeak, total);
+}
+
+void GPUMemoryTracker::Track(ID3D11View* view, Category category, const std::string& name)
+{
+	if (!view) return;
+
+	// GetResource adds a reference
+	ID3D11Resource* resource = nullptr;
+	view->GetResource(&resource);
+	Track(resource, category, name);
+	if (resource) resource->Release();
+}
+
+void GPUMemoryTracker::Untrack(ID3D11Resource* resource)
+{
+	if (!resource) return;
+
+	std::lock_guard<std::mutex> lock(s_Mutex);
+
+	auto it = s_Allocations.find(resource);
+	if (it == s_Allocations.end()) return;
+
+	s_Totals[static_cast<size_t>(it->second.category)] -= it->second.bytes;
+	s_Allocations.erase(it);
+}
+
+void GPUMemoryTracker::Untrack(ID3D11View* view)
+{
+	if (!view) return;
+
+	ID3D11Resource* resource = nullptr;
+	view->GetResource(&resource);
+	Untrack(resource);
+	if (resource) resource->Release();
+}
+
+size_t GPUMemoryTracker::CalculateSize(ID3D11Resource* resource)
+{
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+
+	switch (dimension)
+	{
+	case D3D11_RESOURCE_DIMENSION_BUFFER:
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		return desc.ByteWidth;
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+	{
+		D3D11_TEXTURE1D_DESC desc;
+		static_cast<ID3D11Texture1D*>(resource)->GetDesc(&desc);
+		return CalculateTextureSize(desc.Format, desc.Width, 1, 1, desc.MipLevels, desc.ArraySize, 1);
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+		return CalculateTextureSize(desc.Format, desc.Width, desc.Height, 1, desc.MipLevels, desc.ArraySize, desc.SampleDesc.Count);
+	}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+	{
+		D3D11_TEXTURE3D_DESC desc;
+		static_cast<ID3D11Texture3D*>(resource)->GetDesc(&desc);
+		return CalculateTextureSize(desc.Format, desc.Width, desc.Height, desc.Depth, desc.MipLevels, 1, 1);
+	}
+	default:
+		return 0;
+	}
+}
+
+const char* GPUMemoryTracker::GetCategoryName(Category category)
+{
+	return s_CategoryNames[static_cast<size_t>(category)];
+}
+
+size_t GPUMemoryTracker::GetTotal()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	size_t total = 0;
+	for (size_t t : s_Totals) total += t;
+	return total;
+}
+
+size_t GPUMemoryTracker::GetTotal(Category category)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	return s_Totals[static_cast<size_t>(category)];
+}
+
+void GPUMemoryTracker::SetBudget(Category category, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	s_Budgets[static_cast<size_t>(category)] = bytes;
+}
+
+size_t GPUMemoryTracker::GetBudget(Category category)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	return s_Budgets[static_cast<size_t>(category)];
+}
+
+void GPUMemoryTracker::SetTotalBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	s_TotalBudget = bytes;
+}
+
+bool GPUMemoryTracker::IsOverBudget()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	size_t total = 0;
+	for (size_t c = 0; c < CategoryCount; c++)
+	{
+		if (s_Budgets[c] > 0 && s_Totals[c] > s_Budgets[c]) return true;
+		total += s_Totals[c];
+	}
+	return s_TotalBudget > 0 && total > s_TotalBudget;
+}
+
+bool GPUMemoryTracker::LoadBudgets(const std::string& file)
+{
+	std::ifstream infile(file);
+	if (!infile.is_open()) return false;
+
+	nlohmann::json data = nlohmann::json::parse(infile, nullptr, false);
+	if (data.is_discarded()) return false;
+
+	auto toBytes = [](float mb) { return static_cast<size_t>(mb * BytesPerMB); };
+	for (size_t c = 0; c < CategoryCount; c++)
+	{
+		if (data.contains(s_CategoryNames[c])) SetBudget(static_cast<Category>(c), toBytes(data[s_CategoryNames[c]]));
+	}
+	if (data.contains("Total")) SetTotalBudget(toBytes(data["Total"]));
+	return true;
+}
+
+nlohmann::json GPUMemoryTracker::Serialize()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+
+	nlohmann::json serialized;
+	size_t total = 0;
+
+	nlohmann::json categories = nlohmann::json::array();
+	for (size_t c = 0; c < CategoryCount; c++)
+	{
+		nlohmann::json category;
+		category["name"] = s_CategoryNames[c];
+		category["bytes"] = s_Totals[c];
+		category["peakBytes"] = s_Peaks[c];
+		category["budgetBytes"] = s_Budgets[c];
+
+		nlohmann::json allocations = nlohmann::json::array();
+		for (const auto& entry : s_Allocations)
+		{
+			if (static_cast<size_t>(entry.second.category) != c) continue;
+			allocations.push_back({ { "name", entry.second.name }, { "bytes", entry.second.bytes } });
+		}
+		category["allocations"] = allocations;
+
+		categories.push_back(category);
+		total += s_Totals[c];
+	}
+
+	serialized["totalBytes"] = total;
+	serialized["peakBytes"] = s_TotalPeak;
+	serialized["budgetBytes"] = s_TotalBudget;
+	serialized["categories"] = categories;
+	return serialized;
+}
+
+bool GPUMemoryTracker::WriteJSON(const std::string& file)
+{
+	std::ofstream outfile(file);
+	if (!outfile.is_open()) return false;
+	outfile << Serialize().dump(4);
+	return outfile.good();
+}
+
+void GPUMemoryTracker::SettingsGUI()
+{
+	{
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		AllocationsGUI();
+	}
+
+	ImGui::InputText("Dump file", s_DumpFile, sizeof(s_DumpFile));
+	if (ImGui::Button("Write JSON"))
+		s_DumpStatus = WriteJSON(s_DumpFile) ? "Wrote " + std::string(s_DumpFile) : "Failed to write!";
+	if (!s_DumpStatus.empty())
+		ImGui::Text("%s", s_DumpStatus.c_str());
+}
+
+void GPUMemoryTracker::AllocationsGUI()
+{
+	const ImVec4 overBudgetColour{ 1.0f, 0.3f, 0.3f, 1.0f };
+
+	ImGui::Columns(4, "gpu_memory_columns");
+	ImGui::Text("Category"); ImGui::NextColumn();
+	ImGui::Text("Size (MB)"); ImGui::NextColumn();
+	ImGui::Text("Peak (MB)"); ImGui::NextColumn();
+	ImGui::Text("Budget (MB)"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	auto row = [&](const char* name, size_t bytes, size_t peak, size_t& budget)
+	{
+		ImGui::Text("%s", name);
+		ImGui::NextColumn();
+		if (budget > 0 && bytes > budget)
+			ImGui::TextColored(overBudgetColour, "%.2f", bytes / BytesPerMB);
+		else
+			ImGui::Text("%.2f", bytes / BytesPerMB);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", peak / BytesPerMB);
+		ImGui::NextColumn();
+
+		float budgetMB = budget / BytesPerMB;
+		ImGui::PushID(name);
+		if (ImGui::DragFloat("##budget", &budgetMB, 1.0f, 0.0f, 16384.0f, budgetMB > 0.0f ? "%.0f" : "none"))
+			budget = static_cast<size_t>(budgetMB * BytesPerMB);
+		ImGui::PopID();
+		ImGui::NextColumn();
+	};
+
+	size_t total = 0;
+	for (size_t c = 0; c < CategoryCount; c++)
+	{
+		row(s_CategoryNames[c], s_Totals[c], s_Peaks[c], s_Budgets[c]);
+		total += s_Totals[c];
+	}
+	ImGui::Separator();
+	row("Total", total, s_TotalPeak, s_TotalBudget);
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+
+	if (ImGui::TreeNode("Allocations"))
+	{
+		// largest first
+		std::vector<const std::pair<ID3D11Resource* const, Allocation>*> sorted;
+		sorted.reserve(s_Allocations.size());
+		for (const auto& entry : s_Allocations) sorted.push_back(&entry);
+		std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->second.bytes > b->second.bytes; });
+
+		for (const auto* entry : sorted)
+		{
+			ImGui::Text("%8.2f MB  %-16s %s", entry->second.bytes / BytesPerMB,
+				s_CategoryNames[static_cast<size_t>(entry->second.category)], entry->second.name.c_str());
+		}
+		ImGui::TreePop();
+	}
+}
+
+size_t GPUMemoryTracker::CalculateTextureSize(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int depth,
+	unsigned int mipLevels, unsigned int arraySize, unsigned int sampleCount)
+{
+	bool blockCompressed = IsBlockCompressed(format);
+	size_t bitsPerPixel = BitsPerPixel(format);
+
+	size_t bytes = 0;
+	for (unsigned int mip = 0; mip < (std::max)(mipLevels, 1u); mip++)
+	{
+		size_t w = (std::max)(width >> mip, 1u);
+		size_t h = (std::max)(height >> mip, 1u);
+		size_t d = (std::max)(depth >> mip, 1u);
+
+		// block compressed formats are stored in whole 4x4 blocks
+		if (blockCompressed)
+		{
+			w = (w + 3) & ~static_cast<size_t>(3);
+			h = (h + 3) & ~static_cast<size_t>(3);
+		}
+		bytes += (w * h * d * bitsPerPixel + 7) / 8;
+	}
+	return bytes * arraySize * (std::max)(sampleCount, 1u);
+}
+
+unsigned int GPUMemoryTracker::BitsPerPixel(DXGI_FORMAT format)
+{
+	unsigned int bitsPerPixel = LookupBitsPerPixel(format);
+	assert(bitsPerPixel != 0 && "Unknown format size!");
+	return bitsPerPixel;
+}
+
+bool GPUMemoryTracker::IsKnownFormat(DXGI_FORMAT format)
+{
+	return LookupBitsPerPixel(format) != 0;
+}
+
+unsigned int GPUMemoryTracker::LookupBitsPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+	case DXGI_FORMAT_R32G32B32A32_SINT:
+		return 128;
+
+	case DXGI_FORMAT_R32G32B32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:
+	case DXGI_FORMAT_R32G32B32_SINT:
+		return 96;
+
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+	case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:
+	case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:
+	case DXGI_FORMAT_R32G32_SINT:
+	case DXGI_FORMAT_R32G8X24_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+	case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+	case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+		return 64;
+
+	case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UINT:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R8G8B8A8_UINT:
+	case DXGI_FORMAT_R8G8B8A8_SNORM:
+	case DXGI_FORMAT_R8G8B8A8_SINT:
+	case DXGI_FORMAT_R16G16_TYPELESS:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R16G16_UINT:
+	case DXGI_FORMAT_R16G16_SNORM:
+	case DXGI_FORMAT_R16G16_SINT:
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_UINT:
+	case DXGI_FORMAT_R32_SINT:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+	case DXGI_FORMAT_D24_UNORM_S8_UINT:
+	case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+	case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+	case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		return 32;
+
+	case DXGI_FORMAT_R8G8_TYPELESS:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:
+	case DXGI_FORMAT_R8G8_SINT:
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:
+	case DXGI_FORMAT_R16_SINT:
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		return 16;
+
+	case DXGI_FORMAT_R8_TYPELESS:
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:
+	case DXGI_FORMAT_R8_SINT:
+	case DXGI_FORMAT_A8_UNORM:
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	case DXGI_FORMAT_R1_UNORM:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+bool GPUMemoryTracker::IsBlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM)
+		|| (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
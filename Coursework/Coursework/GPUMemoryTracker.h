@@ -0,0 +1,102 @@
+#pragma once
+
+#include <d3d11.h>
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+// Central record of the video memory used by each subsystem
+// Every code path that creates a texture or buffer registers it here with a category and a name,
+// and unregisters it before it is released. Sizes are calculated from the resource description
+// (every mip, array slice and sample), so they are what the resource needs, not what the driver actually allocates
+//
+// Budgets can be set per category and for the total, to catch scenes that won't fit on smaller machines
+
+class GPUMemoryTracker
+{
+public:
+	enum class Category
+	{
+		Terrain,
+		RenderTargets,
+		PostProcessing,
+		Environment,	// environment cubemaps and the IBL maps made from them
+		Shadows,
+		Materials,		// material maps, kept within its budget by the texture streamer
+		MaterialArrays,	// the terrain's layer arrays, which aren't streamed
+		Textures,		// loaded through the texture manager
+		Buffers,
+		Count
+	};
+
+	struct Allocation
+	{
+		Category category = Category::Textures;
+		std::string name;
+		size_t bytes = 0;
+	};
+
+public:
+	// pure static class
+	GPUMemoryTracker() = delete;
+
+	// registering a resource that is already tracked replaces its category and name
+	static void Track(ID3D11Resource* resource, Category category, const std::string& name);
+	// tracks the resource the view was created from
+	static void Track(ID3D11View* view, Category category, const std::string& name);
+	static void Untrack(ID3D11Resource* resource);
+	static void Untrack(ID3D11View* view);
+
+	static size_t CalculateSize(ID3D11Resource* resource);
+	// for uncompressed formats, also used when laying out texture data on the CPU
+	static unsigned int BitsPerPixel(DXGI_FORMAT format);
+	// for validating formats read from files, where an unknown one isn't a bug
+	static bool IsKnownFormat(DXGI_FORMAT format);
+	static bool IsBlockCompressed(DXGI_FORMAT format);
+	static const char* GetCategoryName(Category category);
+
+	static size_t GetTotal();
+	static size_t GetTotal(Category category);
+
+	// a budget of 0 is unlimited
+	static void SetBudget(Category category, size_t bytes);
+	static size_t GetBudget(Category category);
+	static void SetTotalBudget(size_t bytes);
+	static bool IsOverBudget();
+	// budgets are given in MB, by category name and "Total"
+	static bool LoadBudgets(const std::string& file);
+
+	static nlohmann::json Serialize();
+	static bool WriteJSON(const std::string& file);
+
+	static void SettingsGUI();
+
+private:
+	// with the lock held
+	static void AllocationsGUI();
+
+	static size_t CalculateTextureSize(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int depth,
+		unsigned int mipLevels, unsigned int arraySize, unsigned int sampleCount);
+	// 0 for unknown formats
+	static unsigned int LookupBitsPerPixel(DXGI_FORMAT format);
+
+private:
+	static const size_t CategoryCount = static_cast<size_t>(Category::Count);
+
+	static std::mutex s_Mutex;
+	static std::unordered_map<ID3D11Resource*, Allocation> s_Allocations;
+
+	static std::array<size_t, CategoryCount> s_Totals;
+	static std::array<size_t, CategoryCount> s_Peaks;
+	static std::array<size_t, CategoryCount> s_Budgets;
+	static size_t s_TotalPeak;
+	static size_t s_TotalBudget;
+
+	// gui
+	static char s_DumpFile[128];
+	static std::string s_DumpStatus;
+};
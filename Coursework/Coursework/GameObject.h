@@ -6,6 +6,8 @@
 #include "MaterialLibrary.h"
 #include "TerrainMesh.h"
 #include "ShaderUtility.h"
+#include "SceneGraph.h"
+#include "LightingCache.h"
 
 #include "imGUI/imgui.h"
 
@@ -19,6 +21,7 @@ struct GameObject
 	};
 
 	Transform transform;
+	SceneGraph::NodeID node = SceneGraph::InvalidNode;
 	MeshType meshType = MeshType::Regular;
 	union
 	{
@@ -27,8 +30,12 @@ struct GameObject
 	} mesh;
 
 	std::vector<Material*> materials;
+	// registered with the lighting cache when it is first drawn, and again after the materials change
+	LightingCache::MaterialSetID materialSet = LightingCache::InvalidMaterialSet;
 
 	bool castsShadows = true;
+	// rasterized into the occlusion buffer to hide the objects behind it
+	bool occluder = false;
 
 	GameObject() = default;
 	GameObject(BaseMesh* mesh, Material* mat)
@@ -58,6 +65,7 @@ struct GameObject
 	void AddMaterial(Material* mat)
 	{
 		materials.push_back(mat);
+		materialSet = LightingCache::InvalidMaterialSet;
 	}
 
 	void SettingsGUI(const MaterialLibrary* materialLibrary)
@@ -68,6 +76,9 @@ struct GameObject
 		ImGui::Separator();
 
 		ImGui::Text("Materials");
+		std::vector<Material*> selected = materials;
 		materialLibrary->MaterialSelectGUI(materials);
+		if (materials != selected)
+			materialSet = LightingCache::InvalidMaterialSet;
 	}
 };
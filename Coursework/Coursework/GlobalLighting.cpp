@@ -2,21 +2,56 @@
 
 #include <d3dcompiler.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+
+#include "BRDFIntegration.h"
+#include "GPUMemoryTracker.h"
+#include "ThreadPool.h"
 
 #include "imGUI/imgui.h"
 
 
-GlobalLighting::GlobalLighting(ID3D11Device* device)
-	: m_Device(device)
+GlobalLighting::GlobalLighting(ID3D11Device* device, IGraphicsBackend* backend, ThreadPool* threadPool)
+	: m_Device(device), m_Backend(backend), m_ThreadPool(threadPool), m_BakeCache("iblcache")
 {
-	LoadShader(L"irradiance_cs.cso", &m_IrradianceMapShader);
-	CreateBuffer(sizeof(IrradianceMapBufferType), &m_IrradianceMapShaderBuffer);
+	for (auto& c : m_IrradianceSH)
+		c = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	LoadShader(L"shprojection_cs.cso", &m_SHProjectionShader);
+
+	// partial sums written by each group of the SH projection shader, and a copy to read them back
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = 6 * SHProjectionRowGroups * SHProjectionOutputsPerGroup * sizeof(XMFLOAT4);
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(XMFLOAT4);
+	HRESULT hr = m_Device->CreateBuffer(&bufferDesc, nullptr, &m_SHPartialSums);
+	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_SHPartialSums, GPUMemoryTracker::Category::Environment, "SH projection sums");
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = 6 * SHProjectionRowGroups * SHProjectionOutputsPerGroup;
+	uavDesc.Buffer.Flags = 0;
+	hr = m_Device->CreateUnorderedAccessView(m_SHPartialSums, &uavDesc, &m_SHPartialSumsUAV);
+	assert(hr == S_OK);
+
+	bufferDesc.Usage = D3D11_USAGE_STAGING;
+	bufferDesc.BindFlags = 0;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	hr = m_Device->CreateBuffer(&bufferDesc, nullptr, &m_SHPartialSumsStaging);
+	assert(hr == S_OK);
 
 	LoadShader(L"prefilteredenvironment_cs.cso", &m_PEMShader);
 	CreateBuffer(sizeof(PEMBufferType), &m_PEMShaderBuffer);
 
-	LoadShader(L"brdfintegration_cs.cso", &m_BRDFIntegrationShader);
 
 	D3D11_SAMPLER_DESC samplerDesc;
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
@@ -35,39 +70,226 @@ GlobalLighting::GlobalLighting(ID3D11Device* device)
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
 	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
 	m_Device->CreateSamplerState(&samplerDesc, &m_BRDFIntegrationSampler);
+
+	// doesn't depend on the environment, so it is only made once
+	CreateBRDFIntegrationMap();
 }
 
 GlobalLighting::~GlobalLighting()
 {
-	m_IrradianceMapShader->Release();
-	m_IrradianceMapShaderBuffer->Release();
+	m_SHProjectionShader->Release();
+	GPUMemoryTracker::Untrack(m_SHPartialSums);
+	m_SHPartialSums->Release();
+	m_SHPartialSumsUAV->Release();
+	m_SHPartialSumsStaging->Release();
 	m_PEMShader->Release();
 	m_PEMShaderBuffer->Release();
-	m_BRDFIntegrationShader->Release();
 
-	if (m_IrradianceMap) delete m_IrradianceMap;
 	m_CubemapSampler->Release();
 	m_BRDFIntegrationSampler->Release();
 
+	GPUMemoryTracker::Untrack(m_BRDFIntegrationMap);
 	if (m_BRDFIntegrationMap) m_BRDFIntegrationMap->Release();
 	if (m_BRDFIntegrationMapSRV) m_BRDFIntegrationMapSRV->Release();
-	if (m_BRDFIntegrationMapUAV) m_BRDFIntegrationMapUAV->Release();
 
 	if (m_PrefilteredEnvironmentMap) delete m_PrefilteredEnvironmentMap;
 }
 
-void GlobalLighting::SettingsGUI()
+void GlobalLighting::SettingsGUI(ID3D11DeviceContext* deviceContext)
 {
 	ImGui::Checkbox("Enable IBL", &m_EnableIBL);
+
+	ImGui::Checkbox("Use bake cache", &m_UseBakeCache);
+	ImGui::Text("Environment processed in %.3f ms (%s)", m_EnvironmentProcessTime, m_LastBakeCached ? "cached" : "baked");
+	ImGui::Text("Cache hits: %d, misses: %d", m_BakeCacheHits, m_BakeCacheMisses);
+	ImGui::Text("BRDF LUT %s in %.3f ms", m_BRDFIntegrationMapGenerated ? "generated" : "loaded", m_BRDFIntegrationMapTime);
+	if (m_BakeCacheWriteFailures > 0)
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Failed to write %d cache entries to %s", m_BakeCacheWriteFailures, m_BakeCache.GetDirectory().c_str());
+
+	int method = static_cast<int>(m_SHProjectionMethod);
+	ImGui::Text("SH projection:");
+	ImGui::SameLine();
+	ImGui::RadioButton("CPU", &method, static_cast<int>(SHProjectionMethod::CPU));
+	ImGui::SameLine();
+	ImGui::RadioButton("GPU", &method, static_cast<int>(SHProjectionMethod::GPU));
+	if (method != static_cast<int>(m_SHProjectionMethod))
+	{
+		m_SHProjectionMethod = static_cast<SHProjectionMethod>(method);
+		if (m_EnvironmentMap) ProjectEnvironmentSH(deviceContext);
+	}
+	ImGui::Text("Last projection: %.3f ms", m_SHProjectionTime);
+	if (ImGui::Button("Compare CPU and GPU"))
+		CompareSHProjections(deviceContext);
+	if (m_SHCompareDifference >= 0.0f)
+		ImGui::Text("CPU/GPU max difference: %.6f", m_SHCompareDifference);
+
+	int prefilterMethod = static_cast<int>(m_PrefilterMethod);
+	ImGui::Text("Prefiltering:");
+	ImGui::SameLine();
+	ImGui::RadioButton("CPU##prefilter", &prefilterMethod, static_cast<int>(PrefilterMethod::CPU));
+	ImGui::SameLine();
+	ImGui::RadioButton("GPU##prefilter", &prefilterMethod, static_cast<int>(PrefilterMethod::GPU));
+	if (m_PrefilterMethod == PrefilterMethod::CPU)
+		ImGui::SliderInt("Samples per texel", &m_PrefilterSampleCount, 16, 1024);
+	if (prefilterMethod != static_cast<int>(m_PrefilterMethod) || ImGui::Button("Prefilter again"))
+	{
+		m_PrefilterMethod = static_cast<PrefilterMethod>(prefilterMethod);
+		if (m_EnvironmentMap) CreatePrefilteredEnvironmentMap(deviceContext);
+	}
+	ImGui::Text("Last prefilter: %.3f ms", m_PrefilterTime);
+}
+
+void GlobalLighting::CompareSHProjections(ID3D11DeviceContext* deviceContext)
+{
+	if (!m_EnvironmentMap) return;
+
+	XMFLOAT4 cpu[9], gpu[9];
+	SphericalHarmonics::ToIrradianceConstants(ProjectEnvironmentCPU(deviceContext), cpu);
+	SphericalHarmonics::ToIrradianceConstants(ProjectEnvironmentGPU(deviceContext), gpu);
+
+	m_SHCompareDifference = 0.0f;
+	for (int k = 0; k < 9; k++)
+	{
+		m_SHCompareDifference = (std::max)(m_SHCompareDifference, std::abs(cpu[k].x - gpu[k].x));
+		m_SHCompareDifference = (std::max)(m_SHCompareDifference, std::abs(cpu[k].y - gpu[k].y));
+		m_SHCompareDifference = (std::max)(m_SHCompareDifference, std::abs(cpu[k].z - gpu[k].z));
+	}
 }
 
 void GlobalLighting::SetAndProcessEnvironmentMap(ID3D11DeviceContext* deviceContext, Cubemap* environment)
 {
+	auto start = std::chrono::high_resolution_clock::now();
+
 	m_EnvironmentMap = environment;
 
-	CreateIrradianceMap(deviceContext);
-	CreateBRDFIntegrationMap(deviceContext);
-	CreatePrefilteredEnvironmentMap(deviceContext);
+	uint64_t key = 0;
+	BakeSettings settings = GetBakeSettings();
+	bool cacheable = settings.useCache && GetEnvironmentBakeKey(environment->GetSourceFiles(), settings, &key);
+
+	EnvironmentBake bake;
+	m_LastBakeCached = cacheable && LoadEnvironmentFromCache(key, settings, &bake);
+	if (m_LastBakeCached)
+	{
+		m_BakeCacheHits++;
+		memcpy(m_IrradianceSH, bake.irradianceSH, sizeof(m_IrradianceSH));
+		SetPrefilteredEnvironmentMap(bake.prefilteredMap);
+	}
+	else
+	{
+		ProjectEnvironmentSH(deviceContext);
+		CreatePrefilteredEnvironmentMap(deviceContext);
+
+		if (cacheable)
+		{
+			m_BakeCacheMisses++;
+			WriteEnvironmentToCache(deviceContext, key);
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_EnvironmentProcessTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+GlobalLighting::BakeSettings GlobalLighting::GetBackgroundBakeSettings() const
+{
+	BakeSettings settings = GetBakeSettings();
+	settings.prefilterMethod = PrefilterMethod::CPU;
+	return settings;
+}
+
+void GlobalLighting::BakeEnvironment(const BakeSettings& settings, const std::vector<std::string>& sourceFiles, const unsigned char* const faces[6], unsigned int size, unsigned int rowPitch,
+	ThreadPool* threadPool, EnvironmentBake* bake, std::atomic<float>* progress) const
+{
+	assert(settings.prefilterMethod == PrefilterMethod::CPU && "Only the CPU can bake away from the render thread!");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint64_t key = 0;
+	bool cacheable = settings.useCache && GetEnvironmentBakeKey(sourceFiles, settings, &key);
+	bake->cached = cacheable && LoadEnvironmentFromCache(key, settings, bake);
+	if (!bake->cached)
+	{
+		SphericalHarmonics::ToIrradianceConstants(SphericalHarmonics::ProjectCubemap(faces, size, rowPitch, threadPool), bake->irradianceSH);
+		*progress = 0.1f;
+
+		EnvironmentPrefilter::Result result = EnvironmentPrefilter::Prefilter(EnvironmentPrefilter::FromRGBA8(faces, size, rowPitch),
+			settings.pemResolution, settings.pemRoughnessBins, settings.prefilterSampleCount, threadPool);
+		*progress = 0.9f;
+
+		std::vector<std::vector<unsigned char>> texels;
+		IBLCache::Texture texture;
+		PackPrefilteredEnvironment(result, texels, texture);
+		bake->prefilteredMap = new Cubemap(m_Device, settings.pemResolution, true, settings.pemRoughnessBins, texture.format, texture.format, 0, texture.subresources.data());
+
+		if (cacheable)
+		{
+			bake->cacheMissed = true;
+			bake->cacheWriteFailed = !m_BakeCache.Write(key, { texture }, bake->irradianceSH, sizeof(bake->irradianceSH));
+		}
+	}
+	*progress = 1.0f;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	bake->time = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void GlobalLighting::SetBakedEnvironment(Cubemap* environment, EnvironmentBake& bake)
+{
+	m_EnvironmentMap = environment;
+
+	memcpy(m_IrradianceSH, bake.irradianceSH, sizeof(m_IrradianceSH));
+	SetPrefilteredEnvironmentMap(bake.prefilteredMap);
+	bake.prefilteredMap = nullptr;
+	m_SHCompareDifference = -1.0f;
+
+	m_LastBakeCached = bake.cached;
+	if (bake.cached) m_BakeCacheHits++;
+	if (bake.cacheMissed) m_BakeCacheMisses++;
+	if (bake.cacheWriteFailed) m_BakeCacheWriteFailures++;
+	m_EnvironmentProcessTime = bake.time;
+}
+
+GlobalLighting::BakeSettings GlobalLighting::GetBakeSettings() const
+{
+	BakeSettings settings;
+	settings.useCache = m_UseBakeCache;
+	settings.prefilterMethod = m_PrefilterMethod;
+	settings.prefilterSampleCount = m_PrefilterSampleCount;
+	settings.pemResolution = m_PEMResolution;
+	settings.pemRoughnessBins = m_PEMRoughnessBins;
+	return settings;
+}
+
+bool GlobalLighting::GetEnvironmentBakeKey(const std::vector<std::string>& sourceFiles, const BakeSettings& settings, uint64_t* key) const
+{
+	if (sourceFiles.empty()) return false;
+
+	// everything that changes the baked results
+	uint32_t values[] = { BakeVersion, settings.pemResolution, settings.pemRoughnessBins, static_cast<uint32_t>(settings.prefilterMethod), static_cast<uint32_t>(settings.prefilterSampleCount) };
+	return IBLCache::HashFiles(sourceFiles, IBLCache::Hash(values, sizeof(values)), key);
+}
+
+bool GlobalLighting::LoadEnvironmentFromCache(uint64_t key, const BakeSettings& settings, EnvironmentBake* bake) const
+{
+	IBLCache::MappedEntry entry;
+	if (!m_BakeCache.Open(key, entry)) return false;
+
+	// anything that doesn't match what would be baked now is a miss
+	if (entry.textures.size() != 1 || entry.extraSize != sizeof(bake->irradianceSH)) return false;
+	const IBLCache::Texture& pem = entry.textures[0];
+	if (!pem.cube || pem.arraySize != 6 || pem.width != settings.pemResolution || pem.mipLevels != settings.pemRoughnessBins) return false;
+
+	memcpy(bake->irradianceSH, entry.extra, sizeof(bake->irradianceSH));
+
+	// uploaded straight from the mapped file
+	bake->prefilteredMap = new Cubemap(m_Device, pem.width, true, pem.mipLevels, pem.format, pem.format, 0, pem.subresources.data());
+	return true;
+}
+
+void GlobalLighting::WriteEnvironmentToCache(ID3D11DeviceContext* deviceContext, uint64_t key)
+{
+	// a failed write only means baking again next time
+	if (!m_BakeCache.Write(key, m_Device, deviceContext, { m_PrefilteredEnvironmentMap->GetTexture() }, m_IrradianceSH, sizeof(m_IrradianceSH)))
+		m_BakeCacheWriteFailures++;
 }
 
 void GlobalLighting::LoadShader(const wchar_t* file, ID3D11ComputeShader** shader)
@@ -99,37 +321,40 @@ void GlobalLighting::CreateBuffer(UINT byteWidth, ID3D11Buffer** ppBuffer)
 	m_Device->CreateBuffer(&desc, NULL, ppBuffer);
 }
 
-void GlobalLighting::CreateIrradianceMap(ID3D11DeviceContext* deviceContext)
+void GlobalLighting::ProjectEnvironmentSH(ID3D11DeviceContext* deviceContext)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	SH9 radiance = m_SHProjectionMethod == SHProjectionMethod::CPU ? ProjectEnvironmentCPU(deviceContext) : ProjectEnvironmentGPU(deviceContext);
+	SphericalHarmonics::ToIrradianceConstants(radiance, m_IrradianceSH);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_SHProjectionTime = std::chrono::duration<float, std::milli>(end - start).count();
+	m_SHCompareDifference = -1.0f;
+}
+
+SH9 GlobalLighting::ProjectEnvironmentCPU(ID3D11DeviceContext* deviceContext)
 {
-	// create irradiance map
-	if (m_IrradianceMap) delete m_IrradianceMap;
-	m_IrradianceMap = new Cubemap(m_Device, m_IrradianceMapResolutuion, false);
+	const unsigned char* faces[6];
+	unsigned int size = 0, rowPitch = 0;
+	ID3D11Texture2D* staging = MapEnvironmentFaces(deviceContext, faces, &size, &rowPitch);
 
+	SH9 result = SphericalHarmonics::ProjectCubemap(faces, size, rowPitch, m_ThreadPool);
+
+	UnmapEnvironmentFaces(deviceContext, staging);
+	return result;
+}
+
+SH9 GlobalLighting::ProjectEnvironmentGPU(ID3D11DeviceContext* deviceContext)
+{
 	ID3D11ShaderResourceView* environmentMapSRV = m_EnvironmentMap->GetSRV();
 	deviceContext->CSSetShaderResources(0, 1, &environmentMapSRV);
 	deviceContext->CSSetSamplers(0, 1, &m_CubemapSampler);
-	deviceContext->CSSetConstantBuffers(0, 1, &m_IrradianceMapShaderBuffer);
-	deviceContext->CSSetShader(m_IrradianceMapShader, nullptr, 0);
+	deviceContext->CSSetUnorderedAccessViews(0, 1, &m_SHPartialSumsUAV, nullptr);
+	deviceContext->CSSetShader(m_SHProjectionShader, nullptr, 0);
 
-	// assume thread groups consist of 8x8x1 threads
-	unsigned int groupCount = (m_IrradianceMapResolutuion + 7) / 8; // (fast ceiling of integer division)
+	m_Backend->Dispatch(SHProjectionRowGroups, 1, 6);
 
-	for (int face = 0; face < 6; face++)
-	{
-		// render irradiance map for this face of the cubemap
-		D3D11_MAPPED_SUBRESOURCE mappedResource;
-		deviceContext->Map(m_IrradianceMapShaderBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		IrradianceMapBufferType* data = (IrradianceMapBufferType*)mappedResource.pData;
-		data->faceNormal = Cubemap::GetFaceNormal(face);
-		data->faceTangent = Cubemap::GetFaceTangent(face);
-		data->faceBitangent = Cubemap::GetFaceBitangent(face);
-		deviceContext->Unmap(m_IrradianceMapShaderBuffer, 0);
-
-		ID3D11UnorderedAccessView* uav = m_IrradianceMap->GetUAV(face);
-		deviceContext->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
-
-		deviceContext->Dispatch(groupCount, groupCount, 1);
-	}
 	// unbind resources
 	deviceContext->CSSetShader(nullptr, nullptr, 0);
 
@@ -139,32 +364,80 @@ void GlobalLighting::CreateIrradianceMap(ID3D11DeviceContext* deviceContext)
 	deviceContext->CSSetShaderResources(0, 1, &nullSRV);
 	ID3D11SamplerState* nullSampler = nullptr;
 	deviceContext->CSSetSamplers(0, 1, &nullSampler);
-	ID3D11Buffer* nullBuffer = nullptr;
-	deviceContext->CSSetConstantBuffers(0, 1, &nullBuffer);
+
+	// read back and add up the sums from each group
+	deviceContext->CopyResource(m_SHPartialSumsStaging, m_SHPartialSums);
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = deviceContext->Map(m_SHPartialSumsStaging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+	const XMFLOAT4* partialSums = static_cast<const XMFLOAT4*>(mapped.pData);
+
+	double totals[9][3] = {};
+	double totalWeight = 0.0;
+	for (unsigned int group = 0; group < 6 * SHProjectionRowGroups; group++)
+	{
+		const XMFLOAT4* sums = partialSums + group * SHProjectionOutputsPerGroup;
+		for (int k = 0; k < 9; k++)
+		{
+			totals[k][0] += sums[k].x;
+			totals[k][1] += sums[k].y;
+			totals[k][2] += sums[k].z;
+		}
+		totalWeight += sums[9].x;
+	}
+	deviceContext->Unmap(m_SHPartialSumsStaging, 0);
+
+	// the weights sum to the area of the sphere, 4pi
+	SH9 result;
+	double normalisation = totalWeight > 0.0 ? 4.0 * XM_PI / totalWeight : 0.0;
+	for (int k = 0; k < 9; k++)
+	{
+		result.coefficients[k].x = static_cast<float>(totals[k][0] * normalisation);
+		result.coefficients[k].y = static_cast<float>(totals[k][1] * normalisation);
+		result.coefficients[k].z = static_cast<float>(totals[k][2] * normalisation);
+	}
+	return result;
 }
 
-void GlobalLighting::CreateBRDFIntegrationMap(ID3D11DeviceContext* deviceContext)
+void GlobalLighting::CreateBRDFIntegrationMap()
 {
-	if (m_BRDFIntegrationMap) m_BRDFIntegrationMap->Release();
-	if (m_BRDFIntegrationMapSRV) m_BRDFIntegrationMapSRV->Release();
-	if (m_BRDFIntegrationMapUAV) m_BRDFIntegrationMapUAV->Release();
+	const char* file = "res/brdf_lut.dds";
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<uint16_t> lut;
+	unsigned int resolution = 0;
+	m_BRDFIntegrationMapGenerated = !BRDFIntegration::Load(file, &lut, &resolution);
+	if (m_BRDFIntegrationMapGenerated)
+	{
+		// the build should have made it, save it so that this only happens once
+		resolution = BRDFIntegration::DefaultResolution;
+		lut = BRDFIntegration::Generate(resolution, BRDFIntegration::DefaultSampleCount, m_ThreadPool);
+		BRDFIntegration::Save(file, lut, resolution);
+	}
 
 	// create texture
 	D3D11_TEXTURE2D_DESC texDesc;
-	texDesc.Width =  m_BRDFIntegrationMapResolution;
-	texDesc.Height = m_BRDFIntegrationMapResolution;
+	texDesc.Width = resolution;
+	texDesc.Height = resolution;
 	texDesc.MipLevels = 1;
 	texDesc.ArraySize = 1;
-	texDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	texDesc.Format = DXGI_FORMAT_R16G16_UNORM;
 	texDesc.SampleDesc.Count = 1;
 	texDesc.SampleDesc.Quality = 0;
-	texDesc.Usage = D3D11_USAGE_DEFAULT;
-	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 	texDesc.CPUAccessFlags = 0;
 	texDesc.MiscFlags = 0;
-	
-	HRESULT hr = m_Device->CreateTexture2D(&texDesc, nullptr, &m_BRDFIntegrationMap);
+
+	D3D11_SUBRESOURCE_DATA data;
+	data.pSysMem = lut.data();
+	data.SysMemPitch = resolution * 2 * sizeof(uint16_t);
+	data.SysMemSlicePitch = 0;
+
+	HRESULT hr = m_Device->CreateTexture2D(&texDesc, &data, &m_BRDFIntegrationMap);
 	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_BRDFIntegrationMap, GPUMemoryTracker::Category::Environment, "BRDF integration map");
 
 	// create srv
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -176,34 +449,117 @@ void GlobalLighting::CreateBRDFIntegrationMap(ID3D11DeviceContext* deviceContext
 	hr = m_Device->CreateShaderResourceView(m_BRDFIntegrationMap, &srvDesc, &m_BRDFIntegrationMapSRV);
 	assert(hr == S_OK);
 
-	// create uav
-	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
-	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
-	uavDesc.Texture2D.MipSlice = 0;
+	auto end = std::chrono::high_resolution_clock::now();
+	m_BRDFIntegrationMapTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
 
-	hr = m_Device->CreateUnorderedAccessView(m_BRDFIntegrationMap, &uavDesc, &m_BRDFIntegrationMapUAV);
+ID3D11Texture2D* GlobalLighting::MapEnvironmentFaces(ID3D11DeviceContext* deviceContext, const unsigned char* faces[6], unsigned int* size, unsigned int* rowPitch)
+{
+	// the face data isn't kept after loading, so copy the top mip of each face back from the GPU
+	ID3D11Texture2D* environment = m_EnvironmentMap->GetTexture();
+	D3D11_TEXTURE2D_DESC envDesc;
+	environment->GetDesc(&envDesc);
+	assert((envDesc.Format == DXGI_FORMAT_R8G8B8A8_UNORM || envDesc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) && "Expected an RGBA8 environment map!");
+
+	D3D11_TEXTURE2D_DESC stagingDesc = envDesc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+
+	ID3D11Texture2D* staging = nullptr;
+	HRESULT hr = m_Device->CreateTexture2D(&stagingDesc, nullptr, &staging);
 	assert(hr == S_OK);
 
-	// set cs resources
-	deviceContext->CSSetShader(m_BRDFIntegrationShader, nullptr, 0);
-	deviceContext->CSSetUnorderedAccessViews(0, 1, &m_BRDFIntegrationMapUAV, nullptr);
+	for (unsigned int face = 0; face < 6; face++)
+		deviceContext->CopySubresourceRegion(staging, face, 0, 0, 0, environment, D3D11CalcSubresource(0, face, envDesc.MipLevels), nullptr);
 
-	unsigned int groupCount = (m_BRDFIntegrationMapResolution + 7) / 8; // (fast ceiling of integer division)
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		hr = deviceContext->Map(staging, face, D3D11_MAP_READ, 0, &mapped);
+		assert(hr == S_OK);
+		faces[face] = static_cast<const unsigned char*>(mapped.pData);
+		// the pitch is the same for every face of the same size
+		*rowPitch = mapped.RowPitch;
+	}
+	*size = envDesc.Width;
 
-	// run cs
-	deviceContext->Dispatch(groupCount, groupCount, 1);
+	return staging;
+}
 
-	deviceContext->CSSetShader(nullptr, nullptr, 0);
-	ID3D11UnorderedAccessView* nullUAV = nullptr;
-	deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+void GlobalLighting::UnmapEnvironmentFaces(ID3D11DeviceContext* deviceContext, ID3D11Texture2D* staging)
+{
+	for (unsigned int face = 0; face < 6; face++)
+		deviceContext->Unmap(staging, face);
+	staging->Release();
 }
 
 void GlobalLighting::CreatePrefilteredEnvironmentMap(ID3D11DeviceContext* deviceContext)
 {
-	// create prefiltered environment map
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (m_PrefilterMethod == PrefilterMethod::CPU)
+		PrefilterEnvironmentCPU(deviceContext);
+	else
+		PrefilterEnvironmentGPU(deviceContext);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_PrefilterTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void GlobalLighting::PrefilterEnvironmentCPU(ID3D11DeviceContext* deviceContext)
+{
+	const unsigned char* faces[6];
+	unsigned int size = 0, rowPitch = 0;
+	ID3D11Texture2D* staging = MapEnvironmentFaces(deviceContext, faces, &size, &rowPitch);
+	EnvironmentPrefilter::Environment environment = EnvironmentPrefilter::FromRGBA8(faces, size, rowPitch);
+	UnmapEnvironmentFaces(deviceContext, staging);
+
+	EnvironmentPrefilter::Result result = EnvironmentPrefilter::Prefilter(environment, m_PEMResolution, m_PEMRoughnessBins, m_PrefilterSampleCount, m_ThreadPool);
+
+	std::vector<std::vector<unsigned char>> texels;
+	IBLCache::Texture texture;
+	PackPrefilteredEnvironment(result, texels, texture);
+	SetPrefilteredEnvironmentMap(new Cubemap(m_Device, m_PEMResolution, true, m_PEMRoughnessBins, texture.format, texture.format, 0, texture.subresources.data()));
+}
+
+void GlobalLighting::PackPrefilteredEnvironment(const EnvironmentPrefilter::Result& result, std::vector<std::vector<unsigned char>>& texels, IBLCache::Texture& texture)
+{
+	texture.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	texture.width = result.size;
+	texture.height = result.size;
+	texture.mipLevels = result.mipLevels;
+	texture.arraySize = 6;
+	texture.cube = true;
+
+	texels.clear();
+	texture.subresources.clear();
+	for (unsigned int i = 0; i < result.subresources.size(); i++)
+		texels.push_back(EnvironmentPrefilter::ToRGBA8(result.subresources[i]));
+
+	for (unsigned int i = 0; i < result.subresources.size(); i++)
+	{
+		D3D11_SUBRESOURCE_DATA data;
+		data.pSysMem = texels[i].data();
+		data.SysMemPitch = (std::max)(result.size >> (i % result.mipLevels), 1u) * 4;
+		data.SysMemSlicePitch = 0;
+		texture.subresources.push_back(data);
+	}
+}
+
+void GlobalLighting::SetPrefilteredEnvironmentMap(Cubemap* map)
+{
 	if (m_PrefilteredEnvironmentMap) delete m_PrefilteredEnvironmentMap;
-	m_PrefilteredEnvironmentMap = new Cubemap(m_Device, m_PEMResolution, false, m_PEMRoughnessBins);
+	m_PrefilteredEnvironmentMap = map;
+	GPUMemoryTracker::Track(m_PrefilteredEnvironmentMap->GetSRV(), GPUMemoryTracker::Category::Environment, "Prefiltered environment map");
+}
+
+void GlobalLighting::PrefilterEnvironmentGPU(ID3D11DeviceContext* deviceContext)
+{
+	// create prefiltered environment map
+	SetPrefilteredEnvironmentMap(new Cubemap(m_Device, m_PEMResolution, false, m_PEMRoughnessBins));
 
 	// set shader and shader resources that are constant for all faces and mips
 	ID3D11ShaderResourceView* environmentMapSRV = m_EnvironmentMap->GetSRV();
@@ -239,7 +595,7 @@ void GlobalLighting::CreatePrefilteredEnvironmentMap(ID3D11DeviceContext* device
 			ID3D11UnorderedAccessView* uav = m_PrefilteredEnvironmentMap->GetUAV(face, mip);
 			deviceContext->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
 
-			deviceContext->Dispatch(groupCount, groupCount, 1);
+			m_Backend->Dispatch(groupCount, groupCount, 1);
 		}
 	}
 	// unbind resources
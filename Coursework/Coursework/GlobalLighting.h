@@ -4,21 +4,75 @@
 #include <DirectXMath.h>
 using namespace DirectX;
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include "Cubemap.h"
+#include "GraphicsBackend.h"
+#include "EnvironmentPrefilter.h"
+#include "IBLCache.h"
+#include "SphericalHarmonics.h"
+
+class ThreadPool;
+
 
+// Image based lighting from an environment cubemap
+// Diffuse lighting comes from an order 2 spherical harmonic projection of the environment, made on the CPU or in compute,
+// specular from a prefiltered environment map, made on the CPU or in compute, and a BRDF integration map
+//
+// Baked results are kept in an on-disk cache keyed by a hash of the environment's face files, so switching to an environment
+// that has been seen before (or starting up again) skips all of the precomputation
+//
+// BakeEnvironment does all of the baking with the device and the CPU methods, so it can run away from the render thread
+// while the current maps keep being used, then SetBakedEnvironment swaps the results in
 
 class GlobalLighting
 {
 public:
-	GlobalLighting(ID3D11Device* device);
+	enum class SHProjectionMethod
+	{
+		CPU,
+		GPU
+	};
+
+	enum class PrefilterMethod
+	{
+		CPU,
+		GPU
+	};
+
+	// the settings a bake depends on, copied on the render thread so a bake running elsewhere doesn't see them change
+	struct BakeSettings
+	{
+		bool useCache = true;
+		PrefilterMethod prefilterMethod = PrefilterMethod::CPU;
+		int prefilterSampleCount = EnvironmentPrefilter::DefaultSampleCount;
+		unsigned int pemResolution = 0;
+		unsigned int pemRoughnessBins = 0;
+	};
+
+	struct EnvironmentBake
+	{
+		Cubemap* prefilteredMap = nullptr;
+		XMFLOAT4 irradianceSH[9];
+		bool cached = false;
+		bool cacheMissed = false;
+		bool cacheWriteFailed = false;
+		float time = 0.0f;	// ms
+	};
+
+public:
+	GlobalLighting(ID3D11Device* device, IGraphicsBackend* backend, ThreadPool* threadPool);
 	~GlobalLighting();
 
-	void SettingsGUI();
+	void SettingsGUI(ID3D11DeviceContext* deviceContext);
 
 	inline bool IsIBLEnabled() const { return m_EnableIBL; }
 	inline void SetIBLEnabled(bool e) { m_EnableIBL = e; }
 
-	inline ID3D11ShaderResourceView* GetIrradianceMap() const { return m_IrradianceMap->GetSRV(); }
+	// constants for evaluating the diffuse irradiance (divided by pi) in the shader
+	inline const XMFLOAT4* GetIrradianceSH() const { return m_IrradianceSH; }
 	inline ID3D11ShaderResourceView* GetPrefilterMap() const { return m_PrefilteredEnvironmentMap->GetSRV(); }
 	inline ID3D11ShaderResourceView* GetBRDFIntegrationMap() const { return m_BRDFIntegrationMapSRV; }
 
@@ -27,48 +81,93 @@ public:
 
 	void SetAndProcessEnvironmentMap(ID3D11DeviceContext* deviceContext, Cubemap* environment);
 
+	// the current settings, but always prefiltering on the CPU
+	BakeSettings GetBackgroundBakeSettings() const;
+	// faces are RGBA8 in the Cubemap face order, loaded from sourceFiles, and progress goes from 0 to 1
+	// only uses the device, the bake cache and the thread pool it is given, so it can be called from any thread
+	void BakeEnvironment(const BakeSettings& settings, const std::vector<std::string>& sourceFiles, const unsigned char* const faces[6], unsigned int size, unsigned int rowPitch,
+		ThreadPool* threadPool, EnvironmentBake* bake, std::atomic<float>* progress) const;
+	// swap in an environment and its bake from BakeEnvironment, this takes ownership of the prefiltered map
+	void SetBakedEnvironment(Cubemap* environment, EnvironmentBake& bake);
+
 private:
 	void LoadShader(const wchar_t* cs, ID3D11ComputeShader** shader);
 	void CreateBuffer(UINT byteWidth, ID3D11Buffer** ppBuffer);
 
-	void CreateIrradianceMap(ID3D11DeviceContext* deviceContext);
-	void CreateBRDFIntegrationMap(ID3D11DeviceContext* deviceContext);
+	void ProjectEnvironmentSH(ID3D11DeviceContext* deviceContext);
+	SH9 ProjectEnvironmentCPU(ID3D11DeviceContext* deviceContext);
+	SH9 ProjectEnvironmentGPU(ID3D11DeviceContext* deviceContext);
+	// largest difference between the irradiance constants from each method
+	void CompareSHProjections(ID3D11DeviceContext* deviceContext);
+	// loaded from the baked asset, or generated on the CPU if it is missing
+	void CreateBRDFIntegrationMap();
 	void CreatePrefilteredEnvironmentMap(ID3D11DeviceContext* deviceContext);
+	void SetPrefilteredEnvironmentMap(Cubemap* map);
+	void PrefilterEnvironmentCPU(ID3D11DeviceContext* deviceContext);
+	// RGBA8 copies of every mip, and a description of them pointing into texels
+	static void PackPrefilteredEnvironment(const EnvironmentPrefilter::Result& result, std::vector<std::vector<unsigned char>>& texels, IBLCache::Texture& texture);
+	void PrefilterEnvironmentGPU(ID3D11DeviceContext* deviceContext);
+
+	// copies the top mip of each face of the environment to the CPU, unmap with UnmapEnvironmentFaces
+	ID3D11Texture2D* MapEnvironmentFaces(ID3D11DeviceContext* deviceContext, const unsigned char* faces[6], unsigned int* size, unsigned int* rowPitch);
+	void UnmapEnvironmentFaces(ID3D11DeviceContext* deviceContext, ID3D11Texture2D* staging);
+
+	BakeSettings GetBakeSettings() const;
+	// false if the environment wasn't loaded from files
+	bool GetEnvironmentBakeKey(const std::vector<std::string>& sourceFiles, const BakeSettings& settings, uint64_t* key) const;
+	bool LoadEnvironmentFromCache(uint64_t key, const BakeSettings& settings, EnvironmentBake* bake) const;
+	void WriteEnvironmentToCache(ID3D11DeviceContext* deviceContext, uint64_t key);
 
 private:
 	ID3D11Device* m_Device = nullptr;
+	IGraphicsBackend* m_Backend = nullptr;
+	ThreadPool* m_ThreadPool = nullptr;
 
 	bool m_EnableIBL = true;
 	Cubemap* m_EnvironmentMap = nullptr;
 
-	// pre-processed maps for IBL
-	const unsigned int m_IrradianceMapResolutuion = 32;
-	Cubemap* m_IrradianceMap = nullptr;
+	// diffuse IBL
+	SHProjectionMethod m_SHProjectionMethod = SHProjectionMethod::CPU;
+	XMFLOAT4 m_IrradianceSH[9];
+	float m_SHProjectionTime = 0.0f;	// ms
+	float m_SHCompareDifference = -1.0f;
+
+	// pre-processed maps for specular IBL
 
-	const unsigned int m_BRDFIntegrationMapResolution = 512;
 	ID3D11Texture2D* m_BRDFIntegrationMap = nullptr;
 	ID3D11ShaderResourceView* m_BRDFIntegrationMapSRV = nullptr;
-	ID3D11UnorderedAccessView* m_BRDFIntegrationMapUAV = nullptr;
+	bool m_BRDFIntegrationMapGenerated = false;
+	float m_BRDFIntegrationMapTime = 0.0f;	// ms
 
 	const unsigned int m_PEMResolution = 128;
 	const unsigned int m_PEMRoughnessBins = 5;
 	Cubemap* m_PrefilteredEnvironmentMap = nullptr;
+	PrefilterMethod m_PrefilterMethod = PrefilterMethod::GPU;
+	int m_PrefilterSampleCount = EnvironmentPrefilter::DefaultSampleCount;
+	float m_PrefilterTime = 0.0f;	// ms
 
 	ID3D11SamplerState* m_CubemapSampler = nullptr;
 	ID3D11SamplerState* m_BRDFIntegrationSampler = nullptr;
 
+	// increase when a bake shader or the layout of the cached data changes, to miss everything cached before
+	static const uint32_t BakeVersion = 1;
+	IBLCache m_BakeCache;
+	bool m_UseBakeCache = true;
+	int m_BakeCacheHits = 0;
+	int m_BakeCacheMisses = 0;
+	int m_BakeCacheWriteFailures = 0;
+	bool m_LastBakeCached = false;
+	float m_EnvironmentProcessTime = 0.0f;	// ms
 
-	// pre-processing compute shaders
-	ID3D11ComputeShader* m_IrradianceMapShader = nullptr;
-	ID3D11Buffer* m_IrradianceMapShaderBuffer = nullptr;
-	struct IrradianceMapBufferType
-	{
-		XMFLOAT3 faceNormal; float padding0;
-		XMFLOAT3 faceTangent; float padding1;
-		XMFLOAT3 faceBitangent; float padding2;
-	};
 
-	ID3D11ComputeShader* m_BRDFIntegrationShader = nullptr;
+	// pre-processing compute shaders
+	// must match ROW_GROUPS in shprojection_cs.hlsl
+	static const unsigned int SHProjectionRowGroups = 32;
+	static const unsigned int SHProjectionOutputsPerGroup = 10;
+	ID3D11ComputeShader* m_SHProjectionShader = nullptr;
+	ID3D11Buffer* m_SHPartialSums = nullptr;
+	ID3D11UnorderedAccessView* m_SHPartialSumsUAV = nullptr;
+	ID3D11Buffer* m_SHPartialSumsStaging = nullptr;
 
 	ID3D11ComputeShader* m_PEMShader = nullptr;
 	ID3D11Buffer* m_PEMShaderBuffer = nullptr;
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Thin interface over the graphics API calls made by the frame logic
+// Handles are opaque to callers, so code written against this interface has no dependency on D3D
+// and can be run headless with the recording backend
+// The app submits every draw and dispatch through it, apart from ImGui. Textures, shaders and pipeline state are still
+// created and set on the device directly, so App1::render as a whole needs a GPU. What runs headless is the code written
+// only against this interface, the constant buffer ring and resource bindings, which -self-test runs on the null backend
+//
+// D3D11Backend forwards to a device context
+// RecordingBackend counts and logs every command, and can either forward to another backend or run on its own
+
+enum class ShaderStage { Vertex, Hull, Domain, Pixel, Compute };
+
+class IGraphicsBackend
+{
+public:
+	typedef void* BufferHandle;
+	typedef void* ViewHandle;
+	typedef void* SamplerHandle;
+	typedef void* FenceHandle;
+	typedef void* QueryHandle;
+
+	enum class UploadMode
+	{
+		Discard,		// the previous contents of the buffer are thrown away
+		NoOverwrite		// the caller guarantees the GPU is not using the range being written
+	};
+
+public:
+	virtual ~IGraphicsBackend() = default;
+
+	virtual bool SupportsConstantBufferOffsets() const = 0;
+
+	// buffers
+	virtual BufferHandle CreateConstantBuffer(unsigned int byteWidth) = 0;
+	virtual void ReleaseBuffer(BufferHandle buffer) = 0;
+	virtual void UploadBuffer(BufferHandle buffer, UploadMode mode, size_t offset, const void* data, size_t size) = 0;
+
+	// binds
+	// firstConstants and numConstants may be null to bind whole buffers
+	// a numConstants of 0 also binds the whole buffer
+	virtual void BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count,
+		const BufferHandle* buffers, const unsigned int* firstConstants, const unsigned int* numConstants) = 0;
+	virtual void BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ViewHandle* views) = 0;
+	virtual void BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const SamplerHandle* samplers) = 0;
+
+	// work
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) = 0;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+	virtual void Dispatch(unsigned int x, unsigned int y, unsigned int z) = 0;
+
+	// fences are signalled once the GPU has finished all work submitted before them
+	virtual FenceHandle InsertFence() = 0;
+	virtual bool IsFenceComplete(FenceHandle fence) = 0;
+	virtual void ReleaseFence(FenceHandle fence) = 0;
+
+	// GPU timing
+	// timestamps are in ticks of the frequency reported by the timing range they were written in,
+	// and are only valid if that range was not disjoint
+	// the Get functions return false until the GPU has reached the query, and never stall
+	virtual QueryHandle BeginTimingRange() = 0;
+	virtual void EndTimingRange(QueryHandle range) = 0;
+	virtual QueryHandle InsertTimestamp() = 0;
+	virtual bool GetTimingRangeData(QueryHandle range, uint64_t* frequency, bool* disjoint) = 0;
+	virtual bool GetTimestampData(QueryHandle timestamp, uint64_t* ticks) = 0;
+	virtual void ReleaseQuery(QueryHandle query) = 0;
+};
@@ -0,0 +1,387 @@
+#include "IBLCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "GPUMemoryTracker.h"
+
+
+namespace
+{
+	const uint32_t Magic = 0x43424949;	// "IIBC"
+	const uint32_t Version = 1;
+	// texture data starts on this boundary
+	const uint64_t DataAlignment = 16;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t textureCount;
+		uint32_t padding;
+		uint64_t extraOffset;
+		uint64_t extraSize;
+	};
+
+	// the fields of a DDS DX10 header, plus where the data is
+	struct TextureHeader
+	{
+		uint32_t dxgiFormat;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		uint32_t arraySize;
+		uint32_t miscFlag;	// D3D11_RESOURCE_MISC_TEXTURECUBE for cubemaps
+		uint64_t dataOffset;
+		uint64_t dataSize;
+	};
+
+	uint64_t Align(uint64_t offset)
+	{
+		return (offset + DataAlignment - 1) & ~(DataAlignment - 1);
+	}
+
+	// a full chain down to 1x1, anything longer would shift past the width
+	unsigned int MaxMipLevels(unsigned int width, unsigned int height)
+	{
+		unsigned int levels = 1;
+		for (unsigned int size = (std::max)(width, height); size > 1; size >>= 1) levels++;
+		return levels;
+	}
+
+	// tightly packed size of every subresource
+	uint64_t CalculateDataSize(unsigned int bitsPerPixel, unsigned int width, unsigned int height, unsigned int mipLevels, unsigned int arraySize)
+	{
+		uint64_t size = 0;
+		for (unsigned int mip = 0; mip < mipLevels; mip++)
+		{
+			uint64_t w = (std::max)(width >> mip, 1u);
+			uint64_t h = (std::max)(height >> mip, 1u);
+			size += w * h * bitsPerPixel / 8;
+		}
+		return size * arraySize;
+	}
+}
+
+
+IBLCache::MappedEntry::~MappedEntry()
+{
+	Close();
+}
+
+void IBLCache::MappedEntry::Close()
+{
+	textures.clear();
+	extra = nullptr;
+	extraSize = 0;
+
+	if (m_View) UnmapViewOfFile(m_View);
+	if (m_Mapping) CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+	m_View = nullptr;
+	m_Mapping = nullptr;
+	m_File = INVALID_HANDLE_VALUE;
+}
+
+
+IBLCache::IBLCache(const std::string& directory)
+	: m_Directory(directory)
+{
+	// fails harmlessly if it already exists
+	CreateDirectoryA(m_Directory.c_str(), nullptr);
+}
+
+uint64_t IBLCache::Hash(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+bool IBLCache::HashFiles(const std::vector<std::string>& files, uint64_t seed, uint64_t* hash)
+{
+	uint64_t h = Hash(&seed, sizeof(seed));
+
+	std::vector<char> buffer(1 << 16);
+	for (const std::string& file : files)
+	{
+		std::ifstream infile(file, std::ios::binary);
+		if (!infile.is_open()) return false;
+
+		// the size separates files, so moving bytes from one face to the next changes the hash
+		uint64_t fileSize = 0;
+		while (infile)
+		{
+			infile.read(buffer.data(), buffer.size());
+			std::streamsize count = infile.gcount();
+			h = Hash(buffer.data(), static_cast<size_t>(count), h);
+			fileSize += count;
+		}
+		h = Hash(&fileSize, sizeof(fileSize), h);
+	}
+
+	*hash = h;
+	return true;
+}
+
+bool IBLCache::Open(uint64_t key, MappedEntry& entry) const
+{
+	entry.Close();
+
+	std::string path = GetPath(key);
+	entry.m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (entry.m_File == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(entry.m_File, &fileSize) || static_cast<uint64_t>(fileSize.QuadPart) < sizeof(FileHeader))
+	{
+		entry.Close();
+		return false;
+	}
+	uint64_t size = static_cast<uint64_t>(fileSize.QuadPart);
+
+	entry.m_Mapping = CreateFileMappingA(entry.m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (entry.m_Mapping) entry.m_View = MapViewOfFile(entry.m_Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!entry.m_View)
+	{
+		entry.Close();
+		return false;
+	}
+
+	// validate everything before trusting any offsets, a half written or stale file is just a miss
+	const unsigned char* base = static_cast<const unsigned char*>(entry.m_View);
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+	uint64_t headersEnd = sizeof(FileHeader) + static_cast<uint64_t>(header->textureCount) * sizeof(TextureHeader);
+	if (header->magic != Magic || header->version != Version || header->key != key || headersEnd > size
+		|| header->extraOffset > size || header->extraSize > size - header->extraOffset)
+	{
+		entry.Close();
+		return false;
+	}
+
+	const TextureHeader* textureHeaders = reinterpret_cast<const TextureHeader*>(base + sizeof(FileHeader));
+	for (uint32_t i = 0; i < header->textureCount; i++)
+	{
+		const TextureHeader& th = textureHeaders[i];
+		DXGI_FORMAT format = static_cast<DXGI_FORMAT>(th.dxgiFormat);
+		if (!GPUMemoryTracker::IsKnownFormat(format) || GPUMemoryTracker::IsBlockCompressed(format))
+		{
+			entry.Close();
+			return false;
+		}
+		unsigned int bitsPerPixel = GPUMemoryTracker::BitsPerPixel(format);
+
+		if (th.width == 0 || th.height == 0 || th.width > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION || th.height > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION
+			|| th.mipLevels == 0 || th.mipLevels > MaxMipLevels(th.width, th.height)
+			|| th.arraySize == 0 || th.arraySize > D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+			|| th.dataOffset > size || th.dataSize > size - th.dataOffset
+			|| th.dataSize != CalculateDataSize(bitsPerPixel, th.width, th.height, th.mipLevels, th.arraySize))
+		{
+			entry.Close();
+			return false;
+		}
+
+		Texture texture;
+		texture.format = format;
+		texture.width = th.width;
+		texture.height = th.height;
+		texture.mipLevels = th.mipLevels;
+		texture.arraySize = th.arraySize;
+		texture.cube = (th.miscFlag & D3D11_RESOURCE_MISC_TEXTURECUBE) != 0;
+
+		const unsigned char* data = base + th.dataOffset;
+		for (unsigned int slice = 0; slice < th.arraySize; slice++)
+		{
+			for (unsigned int mip = 0; mip < th.mipLevels; mip++)
+			{
+				unsigned int w = (std::max)(th.width >> mip, 1u);
+				unsigned int h = (std::max)(th.height >> mip, 1u);
+
+				D3D11_SUBRESOURCE_DATA subresource;
+				subresource.pSysMem = data;
+				subresource.SysMemPitch = w * bitsPerPixel / 8;
+				subresource.SysMemSlicePitch = subresource.SysMemPitch * h;
+				texture.subresources.push_back(subresource);
+
+				data += subresource.SysMemSlicePitch;
+			}
+		}
+		entry.textures.push_back(std::move(texture));
+	}
+
+	entry.extra = base + header->extraOffset;
+	entry.extraSize = static_cast<size_t>(header->extraSize);
+	return true;
+}
+
+bool IBLCache::Write(uint64_t key, ID3D11Device* device, ID3D11DeviceContext* deviceContext,
+	const std::vector<ID3D11Texture2D*>& textures, const void* extra, size_t extraSize) const
+{
+	// copy back through plain texture arrays, staging textures can't be cubemaps
+	std::vector<ID3D11Texture2D*> stagingTextures;
+	std::vector<Texture> descriptions(textures.size());
+	bool success = true;
+	for (size_t i = 0; i < textures.size() && success; i++)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		textures[i]->GetDesc(&desc);
+
+		Texture& texture = descriptions[i];
+		texture.format = desc.Format;
+		texture.width = desc.Width;
+		texture.height = desc.Height;
+		texture.mipLevels = desc.MipLevels;
+		texture.arraySize = desc.ArraySize;
+		texture.cube = (desc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE) != 0;
+
+		D3D11_TEXTURE2D_DESC stagingDesc = desc;
+		stagingDesc.Usage = D3D11_USAGE_STAGING;
+		stagingDesc.BindFlags = 0;
+		stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		stagingDesc.MiscFlags = 0;
+
+		ID3D11Texture2D* staging = nullptr;
+		HRESULT hr = device->CreateTexture2D(&stagingDesc, nullptr, &staging);
+		assert(hr == S_OK);
+		if (hr != S_OK)
+		{
+			success = false;
+			break;
+		}
+		stagingTextures.push_back(staging);
+
+		unsigned int subresourceCount = desc.MipLevels * desc.ArraySize;
+		for (unsigned int subresource = 0; subresource < subresourceCount; subresource++)
+			deviceContext->CopySubresourceRegion(staging, subresource, 0, 0, 0, textures[i], subresource, nullptr);
+
+		// stays mapped until the file has been written
+		for (unsigned int subresource = 0; subresource < subresourceCount; subresource++)
+		{
+			D3D11_MAPPED_SUBRESOURCE mapped;
+			hr = deviceContext->Map(staging, subresource, D3D11_MAP_READ, 0, &mapped);
+			// a lost device only means this bake isn't cached, only the subresources that mapped are unmapped below
+			if (hr != S_OK)
+			{
+				success = false;
+				break;
+			}
+
+			D3D11_SUBRESOURCE_DATA data;
+			data.pSysMem = mapped.pData;
+			data.SysMemPitch = mapped.RowPitch;
+			data.SysMemSlicePitch = 0;
+			texture.subresources.push_back(data);
+		}
+	}
+
+	success = success && Write(key, descriptions, extra, extraSize);
+
+	for (size_t i = 0; i < stagingTextures.size(); i++)
+	{
+		for (unsigned int subresource = 0; subresource < descriptions[i].subresources.size(); subresource++)
+			deviceContext->Unmap(stagingTextures[i], subresource);
+		stagingTextures[i]->Release();
+	}
+	return success;
+}
+
+bool IBLCache::Write(uint64_t key, const std::vector<Texture>& textures, const void* extra, size_t extraSize) const
+{
+	// lay out the file
+	FileHeader header;
+	header.magic = Magic;
+	header.version = Version;
+	header.key = key;
+	header.textureCount = static_cast<uint32_t>(textures.size());
+	header.padding = 0;
+
+	std::vector<TextureHeader> textureHeaders(textures.size());
+	uint64_t offset = Align(sizeof(FileHeader) + textures.size() * sizeof(TextureHeader));
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const Texture& texture = textures[i];
+
+		unsigned int bitsPerPixel = GPUMemoryTracker::BitsPerPixel(texture.format);
+		assert(bitsPerPixel != 0 && "IBL cache only stores uncompressed formats!");
+		if (bitsPerPixel == 0 || texture.subresources.size() != texture.mipLevels * texture.arraySize) return false;
+
+		TextureHeader& th = textureHeaders[i];
+		th.dxgiFormat = texture.format;
+		th.width = texture.width;
+		th.height = texture.height;
+		th.mipLevels = texture.mipLevels;
+		th.arraySize = texture.arraySize;
+		th.miscFlag = texture.cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+		th.dataOffset = offset;
+		th.dataSize = CalculateDataSize(bitsPerPixel, texture.width, texture.height, texture.mipLevels, texture.arraySize);
+		offset = Align(offset + th.dataSize);
+	}
+	header.extraOffset = offset;
+	header.extraSize = extraSize;
+
+	// write to a temporary file first, so a failed write never leaves a file that looks valid
+	std::string path = GetPath(key);
+	std::string tempPath = path + ".tmp";
+	std::ofstream outfile(tempPath, std::ios::binary | std::ios::trunc);
+	if (!outfile.is_open()) return false;
+
+	outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	outfile.write(reinterpret_cast<const char*>(textureHeaders.data()), textureHeaders.size() * sizeof(TextureHeader));
+
+	const char zeros[DataAlignment] = {};
+	auto padTo = [&](uint64_t target)
+	{
+		uint64_t position = static_cast<uint64_t>(outfile.tellp());
+		if (target > position) outfile.write(zeros, static_cast<std::streamsize>(target - position));
+	};
+
+	for (size_t i = 0; i < textures.size() && outfile.good(); i++)
+	{
+		const TextureHeader& th = textureHeaders[i];
+		unsigned int bitsPerPixel = GPUMemoryTracker::BitsPerPixel(static_cast<DXGI_FORMAT>(th.dxgiFormat));
+		padTo(th.dataOffset);
+
+		for (unsigned int slice = 0; slice < th.arraySize; slice++)
+		{
+			for (unsigned int mip = 0; mip < th.mipLevels; mip++)
+			{
+				unsigned int w = (std::max)(th.width >> mip, 1u);
+				unsigned int h = (std::max)(th.height >> mip, 1u);
+				unsigned int rowSize = w * bitsPerPixel / 8;
+
+				// rows may be padded, so copy them one at a time
+				const D3D11_SUBRESOURCE_DATA& data = textures[i].subresources[D3D11CalcSubresource(mip, slice, th.mipLevels)];
+				const char* row = static_cast<const char*>(data.pSysMem);
+				for (unsigned int y = 0; y < h; y++, row += data.SysMemPitch)
+					outfile.write(row, rowSize);
+			}
+		}
+	}
+
+	padTo(header.extraOffset);
+	if (extraSize > 0) outfile.write(static_cast<const char*>(extra), extraSize);
+
+	bool success = outfile.good();
+	outfile.close();
+	if (!success || !MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+std::string IBLCache::GetPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ibl", static_cast<unsigned long long>(key));
+	return m_Directory + "/" + name;
+}
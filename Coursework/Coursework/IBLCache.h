@@ -0,0 +1,81 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// On-disk cache of baked image based lighting data
+// Entries are keyed by a 64 bit hash, e.g. of the contents of an environment's face files and the bake settings,
+// so editing a face or changing a setting just misses the cache
+//
+// Each entry is a DDS-like container: a header, then a description of each texture with the fields of a DDS DX10 header,
+// then the texture data with every subresource tightly packed in D3D11 subresource order, then a block of extra data.
+// On a hit the file is memory mapped and the textures are created straight from the mapping
+
+class IBLCache
+{
+public:
+	struct Texture
+	{
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+		unsigned int width = 0;
+		unsigned int height = 0;
+		unsigned int mipLevels = 0;
+		unsigned int arraySize = 0;
+		bool cube = false;
+
+		// initial data for CreateTexture2D, pointing into the mapped file when opened
+		std::vector<D3D11_SUBRESOURCE_DATA> subresources;
+	};
+
+	// a cache entry mapped into memory, the texture and extra data are only valid while this is alive
+	class MappedEntry
+	{
+	public:
+		MappedEntry() = default;
+		~MappedEntry();
+
+		MappedEntry(const MappedEntry&) = delete;
+		MappedEntry& operator=(const MappedEntry&) = delete;
+
+		void Close();
+
+		std::vector<Texture> textures;
+		const void* extra = nullptr;
+		size_t extraSize = 0;
+
+	private:
+		friend class IBLCache;
+		HANDLE m_File = INVALID_HANDLE_VALUE;
+		HANDLE m_Mapping = nullptr;
+		const void* m_View = nullptr;
+	};
+
+public:
+	// the directory is created if it doesn't exist
+	IBLCache(const std::string& directory);
+
+	// FNV-1a, chain calls by passing the previous hash
+	static uint64_t Hash(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+	// hash of the contents of every file, false if any can't be read
+	static bool HashFiles(const std::vector<std::string>& files, uint64_t seed, uint64_t* hash);
+
+	// false on a miss, or if the file is invalid
+	bool Open(uint64_t key, MappedEntry& entry) const;
+	// reads the textures back from the GPU, so this stalls until they have been baked
+	bool Write(uint64_t key, ID3D11Device* device, ID3D11DeviceContext* deviceContext,
+		const std::vector<ID3D11Texture2D*>& textures, const void* extra, size_t extraSize) const;
+	// from data on the CPU, so it can be called from any thread
+	bool Write(uint64_t key, const std::vector<Texture>& textures, const void* extra, size_t extraSize) const;
+
+	inline const std::string& GetDirectory() const { return m_Directory; }
+
+private:
+	std::string GetPath(uint64_t key) const;
+
+private:
+	std::string m_Directory;
+};
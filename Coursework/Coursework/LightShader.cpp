@@ -1,14 +1,15 @@
 #include "LightShader.h"
 
-#include "SceneLight.h"
 #include "Material.h"
 #include "GlobalLighting.h"
-#include "ShadowCubemap.h"
+#include "LightingCache.h"
+#include "ConstantBufferRing.h"
 
 #include "imGUI/imgui.h"
 
 
-LightShader::LightShader(ID3D11Device* device, HWND hwnd, GlobalLighting* globalLighting) : BaseShader(device, hwnd), m_GlobalLighting(globalLighting)
+LightShader::LightShader(ID3D11Device* device, HWND hwnd, GlobalLighting* globalLighting, ConstantBufferRing* constantBufferRing)
+	: BaseShader(device, hwnd), m_GlobalLighting(globalLighting), m_ConstantBufferRing(constantBufferRing)
 {
 	initShader(L"lighting_vs.cso", L"lighting_ps.cso");
 }
@@ -16,11 +17,6 @@ LightShader::LightShader(ID3D11Device* device, HWND hwnd, GlobalLighting* global
 
 LightShader::~LightShader()
 {
-	m_MatrixBuffer->Release();
-	m_VSLightBuffer->Release();
-	m_PSLightBuffer->Release();
-	m_MaterialBuffer->Release();
-
 	m_MaterialSampler->Release();
 	m_ShadowSampler->Release();
 }
@@ -31,11 +27,6 @@ void LightShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilenam
 	loadVertexShader(vsFilename);
 	loadPixelShader(psFilename);
 
-	ShaderUtility::CreateBuffer(renderer, sizeof(MatrixBufferType), &m_MatrixBuffer);
-	ShaderUtility::CreateBuffer(renderer, sizeof(ShaderUtility::VSLightBufferType), &m_VSLightBuffer);
-	ShaderUtility::CreateBuffer(renderer, sizeof(ShaderUtility::PSLightBufferType), &m_PSLightBuffer);
-	ShaderUtility::CreateBuffer(renderer, sizeof(ShaderUtility::MaterialBufferType), &m_MaterialBuffer);
-
 	D3D11_SAMPLER_DESC samplerDesc;
 	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
@@ -69,36 +60,30 @@ void LightShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilenam
 
 
 void LightShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix,
-									size_t lightCount, SceneLight** lights, Camera* camera, Material* mat)
+									LightingCache* lighting, LightingCache::MaterialSetID materialSet)
 {
-	HRESULT result;
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-
-	ResourceBuffer tex2DBuffer, texCubeBuffer;
-
-	{
-		result = deviceContext->Map(m_MatrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		MatrixBufferType* dataPtr = (MatrixBufferType*)mappedResource.pData;
-		dataPtr->world = XMMatrixTranspose(worldMatrix);
-		dataPtr->view = XMMatrixTranspose(viewMatrix);
-		dataPtr->projection = XMMatrixTranspose(projectionMatrix);
-		deviceContext->Unmap(m_MatrixBuffer, 0);
-	}
-	
-	ShaderUtility::ConstructVSLightBuffer(deviceContext, m_VSLightBuffer, lights, lightCount, camera);
-	ShaderUtility::ConstructPSLightBuffer(deviceContext, m_PSLightBuffer, lights, lightCount, m_GlobalLighting, &tex2DBuffer, &texCubeBuffer);
-	ShaderUtility::ConstructMaterialBuffer(deviceContext, m_MaterialBuffer, &mat, 1, &tex2DBuffer);
+	// light textures have already been placed into the frame's resource buffers
+	ResourceBuffer tex2DBuffer = lighting->GetTex2DResources();
+	ResourceBuffer texCubeBuffer = lighting->GetTexCubeResources();
 
+	MatrixBufferType matrices;
+	matrices.world = XMMatrixTranspose(worldMatrix);
+	matrices.view = XMMatrixTranspose(viewMatrix);
+	matrices.projection = XMMatrixTranspose(projectionMatrix);
+	ConstantBufferRing::Allocation matrixBuffer = m_ConstantBufferRing->Upload(matrices);
 
-	ID3D11Buffer* vsBuffers[] = { m_MatrixBuffer, m_VSLightBuffer };
-	deviceContext->VSSetConstantBuffers(0, 2, vsBuffers);
+	ID3D11Buffer* materialBuffer = lighting->GetMaterialBuffer(deviceContext, materialSet, &tex2DBuffer);
 
-	ID3D11Buffer* psBuffers[] = { m_PSLightBuffer, m_MaterialBuffer };
-	deviceContext->PSSetConstantBuffers(0, 2, psBuffers);
+	m_ConstantBufferRing->BindVS(0, { matrixBuffer, ConstantBufferRing::WholeBuffer(lighting->GetVSLightBuffer()) });
+	m_ConstantBufferRing->BindPS(0, { ConstantBufferRing::WholeBuffer(lighting->GetPSLightBuffer()), ConstantBufferRing::WholeBuffer(materialBuffer) });
 	
-	deviceContext->PSSetShaderResources(0, RESOURCE_BUFFER_SIZE, tex2DBuffer.GetResourcePtr());
-	deviceContext->PSSetShaderResources(RESOURCE_BUFFER_SIZE, RESOURCE_BUFFER_SIZE, texCubeBuffer.GetResourcePtr());
+	lighting->BindPSResources(tex2DBuffer, texCubeBuffer);
 
 	ID3D11SamplerState* samplers[] = { m_GlobalLighting->GetBRDFIntegrationSampler(), m_GlobalLighting->GetCubemapSampler(), m_MaterialSampler, m_ShadowSampler };
 	deviceContext->PSSetSamplers(0, 4, samplers);
 }
+
+void LightShader::draw(ID3D11DeviceContext* deviceContext, int indexCount)
+{
+	m_ConstantBufferRing->GetBackend()->DrawIndexed(indexCount, 0, 0);
+}
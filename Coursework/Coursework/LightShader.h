@@ -5,33 +5,30 @@
 using namespace DirectX;
 
 #include "ShaderUtility.h"
+#include "LightingCache.h"
 
 
-class SceneLight;
-class Material;
 class GlobalLighting;
+class ConstantBufferRing;
 
 
 class LightShader : public BaseShader
 {
 public:
-	LightShader(ID3D11Device* device, HWND hwnd, GlobalLighting* globalLighing);
+	LightShader(ID3D11Device* device, HWND hwnd, GlobalLighting* globalLighing, ConstantBufferRing* constantBufferRing);
 	~LightShader();
 
-	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, size_t lightCount, SceneLight** lights, Camera* camera, Material* mat);
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, LightingCache* lighting, LightingCache::MaterialSetID materialSet);
 
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
+	virtual void draw(ID3D11DeviceContext* deviceContext, int indexCount) override;
 
 private:
-	ID3D11Buffer* m_MatrixBuffer = nullptr;
-	ID3D11Buffer* m_VSLightBuffer = nullptr;
-	ID3D11Buffer* m_PSLightBuffer = nullptr;
-	ID3D11Buffer* m_MaterialBuffer = nullptr;
-
 	ID3D11SamplerState* m_MaterialSampler = nullptr;
 	ID3D11SamplerState* m_ShadowSampler = nullptr;
 
 	GlobalLighting* m_GlobalLighting = nullptr;
+	ConstantBufferRing* m_ConstantBufferRing = nullptr;
 };
 
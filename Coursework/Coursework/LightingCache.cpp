@@ -0,0 +1,123 @@
+#include "LightingCache.h"
+
+#include "Material.h"
+#include "SceneLight.h"
+#include "GlobalLighting.h"
+
+#include "imGUI/imgui.h"
+
+
+LightingCache::LightingCache(ID3D11Device* device, IGraphicsBackend* backend, GlobalLighting* globalLighting)
+	: m_Device(device), m_Backend(backend), m_GlobalLighting(globalLighting)
+{
+	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::VSLightBufferType), &m_VSLightBuffer);
+	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::PSLightBufferType), &m_PSLightBuffer);
+}
+
+LightingCache::~LightingCache()
+{
+	if (m_VSLightBuffer) m_VSLightBuffer->Release();
+	if (m_PSLightBuffer) m_PSLightBuffer->Release();
+
+	for (CachedMaterialBuffer& cached : m_MaterialBuffers)
+	{
+		if (cached.buffer) cached.buffer->Release();
+	}
+}
+
+void LightingCache::BeginFrame(ID3D11DeviceContext* deviceContext, SceneLight** lights, size_t lightCount, Camera* camera)
+{
+	m_Tex2DResources = ResourceBuffer();
+	m_TexCubeResources = ResourceBuffer();
+
+	ShaderUtility::ConstructVSLightBuffer(deviceContext, m_VSLightBuffer, lights, lightCount, camera);
+	ShaderUtility::ConstructPSLightBuffer(deviceContext, m_PSLightBuffer, lights, lightCount, m_GlobalLighting, &m_Tex2DResources, &m_TexCubeResources);
+
+	m_LastMaterialRequests = m_MaterialRequests;
+	m_LastMaterialUploads = m_MaterialUploads;
+	m_MaterialRequests = 0;
+	m_MaterialUploads = 0;
+
+	// other passes will have bound their own resources since last frame
+	m_ResourceBindings.Invalidate();
+	m_LastSlotsSent = m_ResourceBindings.GetSlotsSent();
+	m_LastBindCalls = m_ResourceBindings.GetBindCalls();
+	m_ResourceBindings.ResetStats();
+}
+
+LightingCache::MaterialSetID LightingCache::GetMaterialSet(Material* const* mats, size_t matCount)
+{
+	std::vector<Material*> key(mats, mats + matCount);
+	auto it = m_MaterialSets.find(key);
+	if (it != m_MaterialSets.end()) return it->second;
+
+	CachedMaterialBuffer cached;
+	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::MaterialBufferType), &cached.buffer);
+	cached.materials = key;
+
+	MaterialSetID materialSet = static_cast<MaterialSetID>(m_MaterialBuffers.size());
+	m_MaterialBuffers.push_back(cached);
+	m_MaterialSets[key] = materialSet;
+	return materialSet;
+}
+
+ID3D11Buffer* LightingCache::GetMaterialBuffer(ID3D11DeviceContext* deviceContext, MaterialSetID materialSet, ResourceBuffer* tex2DBuffer)
+{
+	assert(materialSet < m_MaterialBuffers.size() && "Invalid material set!");
+	m_MaterialRequests++;
+
+	CachedMaterialBuffer& cached = m_MaterialBuffers[materialSet];
+	bool changed = cached.versions.size() != cached.materials.size();
+	for (size_t i = 0; i < cached.versions.size() && !changed; i++)
+		changed = cached.materials[i]->GetVersion() != cached.versions[i];
+
+	// the maps go in the draw's resource buffer either way, the indices in the buffer depend on what was there before them
+	for (size_t i = 0; i < cached.textures.size() && !changed; i++)
+		changed = tex2DBuffer->AddResource(cached.textures[i]) != cached.textureIndices[i];
+
+	if (changed)
+	{
+		// also appends the material textures to the resource buffer
+		ShaderUtility::MaterialBufferType data;
+		ShaderUtility::FillMaterialBuffer(&data, cached.materials.data(), cached.materials.size(), tex2DBuffer);
+
+		cached.versions.clear();
+		for (Material* material : cached.materials)
+			cached.versions.push_back(material->GetVersion());
+
+		cached.textures.clear();
+		cached.textureIndices.clear();
+		for (size_t i = 0; i < cached.materials.size() && i < MAX_MATERIALS; i++)
+		{
+			const ShaderUtility::MaterialDataType& material = data.materials[i];
+			for (int index : { material.albedoMapIndex, material.roughnessMapIndex, material.normalMapIndex, material.metalnessMapIndex, material.ormMapIndex })
+			{
+				if (index < 0) continue;
+				cached.textures.push_back(tex2DBuffer->GetResourcePtr()[index]);
+				cached.textureIndices.push_back(index);
+			}
+		}
+
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT hr = deviceContext->Map(cached.buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		assert(hr == S_OK);
+		memcpy(mappedResource.pData, &data, sizeof(ShaderUtility::MaterialBufferType));
+		deviceContext->Unmap(cached.buffer, 0);
+
+		m_MaterialUploads++;
+	}
+
+	return cached.buffer;
+}
+
+void LightingCache::BindPSResources(const ResourceBuffer& tex2DBuffer, const ResourceBuffer& texCubeBuffer)
+{
+	m_ResourceBindings.BindPS(m_Backend, tex2DBuffer, texCubeBuffer);
+}
+
+void LightingCache::SettingsGUI()
+{
+	ImGui::Text("Cached material buffers: %d", static_cast<int>(m_MaterialBuffers.size()));
+	ImGui::Text("Material uploads: %d / %d", m_LastMaterialUploads, m_LastMaterialRequests);
+	ImGui::Text("Resource slots sent: %d (%d calls)", m_LastSlotsSent, m_LastBindCalls);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "DXF.h"
+#include "ShaderUtility.h"
+
+#include <climits>
+#include <map>
+#include <vector>
+
+class SceneLight;
+class Material;
+class GlobalLighting;
+
+
+// Lighting data is identical for every draw within a frame
+// so the light constant buffers are built and uploaded once per frame, and then only rebound by each shader
+// Material buffers are cached per set of materials, registered once by whatever draws with them, and are only refilled
+// when one of the materials has changed since (its version is bumped) or its maps land in different resource slots
+
+class LightingCache
+{
+public:
+	typedef unsigned int MaterialSetID;
+	static const MaterialSetID InvalidMaterialSet = UINT_MAX;
+
+	LightingCache(ID3D11Device* device, IGraphicsBackend* backend, GlobalLighting* globalLighting);
+	~LightingCache();
+
+	// build and upload the light buffers for this frame
+	// must be called after the shadow passes, as they generate the light view matrices
+	void BeginFrame(ID3D11DeviceContext* deviceContext, SceneLight** lights, size_t lightCount, Camera* camera);
+
+	inline ID3D11Buffer* GetVSLightBuffer() const { return m_VSLightBuffer; }
+	inline ID3D11Buffer* GetPSLightBuffer() const { return m_PSLightBuffer; }
+
+	// the textures referenced by the PS light buffer
+	// a draw should start from a copy of these and append its own resources
+	inline const ResourceBuffer& GetTex2DResources() const { return m_Tex2DResources; }
+	inline const ResourceBuffer& GetTexCubeResources() const { return m_TexCubeResources; }
+
+	// the same materials in the same order always give the same ID, call when the materials being drawn with change
+	MaterialSetID GetMaterialSet(Material* const* mats, size_t matCount);
+	// material textures are appended to tex2DBuffer
+	ID3D11Buffer* GetMaterialBuffer(ID3D11DeviceContext* deviceContext, MaterialSetID materialSet, ResourceBuffer* tex2DBuffer);
+
+	// bind a draw's resource buffers to the pixel shader, only re-sending registers that changed since the last draw
+	void BindPSResources(const ResourceBuffer& tex2DBuffer, const ResourceBuffer& texCubeBuffer);
+	// call after anything else has bound pixel shader resources
+	inline void InvalidatePSResources() { m_ResourceBindings.Invalidate(); }
+
+	void SettingsGUI();
+
+private:
+	struct CachedMaterialBuffer
+	{
+		ID3D11Buffer* buffer = nullptr;
+		std::vector<Material*> materials;
+		// the material versions the buffer was filled from, none to begin with
+		std::vector<unsigned int> versions;
+		// the maps it references and the resource buffer indices it was filled with
+		std::vector<ID3D11ShaderResourceView*> textures;
+		std::vector<int> textureIndices;
+	};
+
+private:
+	ID3D11Device* m_Device = nullptr;
+	IGraphicsBackend* m_Backend = nullptr;
+	GlobalLighting* m_GlobalLighting = nullptr;
+
+	ID3D11Buffer* m_VSLightBuffer = nullptr;
+	ID3D11Buffer* m_PSLightBuffer = nullptr;
+	ResourceBuffer m_Tex2DResources;
+	ResourceBuffer m_TexCubeResources;
+	ResourceBindings m_ResourceBindings;
+
+	std::map<std::vector<Material*>, MaterialSetID> m_MaterialSets;
+	std::vector<CachedMaterialBuffer> m_MaterialBuffers;
+
+	// stats for the last frame
+	unsigned int m_MaterialRequests = 0;
+	unsigned int m_MaterialUploads = 0;
+	unsigned int m_LastMaterialRequests = 0;
+	unsigned int m_LastMaterialUploads = 0;
+	unsigned int m_LastSlotsSent = 0;
+	unsigned int m_LastBindCalls = 0;
+};
@@ -1,15 +1,130 @@
 // Main.cpp
 #include "System.h"
 #include "App1.h"
+#include "BRDFIntegration.h"
+#include "EnvironmentPrefilter.h"
+#include "TextureCompressor.h"
+#include "MaterialArrays.h"
+#include "RingBufferAllocator.h"
+#include "ConstantBufferRing.h"
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+#include "BloomReference.h"
+#include "TonemapLUT.h"
 #include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pScmdline, int iCmdshow)
 {
-	App1* app = new App1();
+	// "-benchmark [config]" runs a benchmark on startup and exits when it finishes, returning 1 if it couldn't be loaded or written
+	// "-bake-brdf [file]" writes the BRDF integration map and exits without opening a window, this is run by the build
+	// "-bake-pem size mipLevels output right left top bottom front back" prefilters an environment on the CPU to a DDS cubemap and exits
+	// "-compress-pbr dir" block compresses the maps of a material directory that are out of date and exits, this is run by the build for each material
+	// "-build-material-arrays dir" assembles the texture arrays of the materials listed in dir/layers.txt and exits, this is run by the build for the terrain
+	// "-self-test" runs the checks of the CPU-side code that needs no device and exits, returning 1 if any fail
+	std::string benchmarkConfig;
+	std::string brdfFile;
+	std::string pemFiles[6], pemOutput;
+	unsigned int pemSize = 0, pemMipLevels = 0;
+	bool bakePEM = false;
+	std::vector<std::string> materialDirectories;
+	std::string arrayDirectory;
+	bool selfTest = false;
+	std::istringstream args(pScmdline ? pScmdline : "");
+	std::string arg;
+
+	// the build passes quoted paths, which may have spaces in them
+	auto readPath = [&args](std::string& path)
+	{
+		if (!(args >> path)) return false;
+		if (path[0] != '"') return true;
+
+		std::string next;
+		while (path.size() == 1 || path.back() != '"')
+		{
+			if (!(args >> next)) return false;
+			path += " " + next;
+		}
+		path = path.substr(1, path.size() - 2);
+		return true;
+	};
+
+	// an optional value is left in the stream when the next argument is another flag
+	auto readOptionalPath = [&args, &readPath](std::string& path)
+	{
+		args >> std::ws;
+		if (args.peek() == std::char_traits<char>::eof() || args.peek() == '-') return false;
+		return readPath(path);
+	};
+
+	while (args >> arg)
+	{
+		if (arg == "-benchmark")
+		{
+			if (!readOptionalPath(benchmarkConfig))
+				benchmarkConfig = "res/benchmark/flythrough.json";
+		}
+		else if (arg == "-bake-brdf")
+		{
+			if (!readOptionalPath(brdfFile))
+				brdfFile = "res/brdf_lut.dds";
+		}
+		else if (arg == "-bake-pem")
+		{
+			bakePEM = static_cast<bool>(args >> pemSize >> pemMipLevels >> pemOutput);
+			for (std::string& face : pemFiles)
+				bakePEM = bakePEM && static_cast<bool>(args >> face);
+			if (!bakePEM) return 1;
+		}
+		else if (arg == "-compress-pbr")
+		{
+			std::string directory;
+			if (!readPath(directory)) return 1;
+			materialDirectories.push_back(directory);
+		}
+		else if (arg == "-build-material-arrays")
+		{
+			if (!readPath(arrayDirectory)) return 1;
+		}
+		else if (arg == "-self-test")
+		{
+			selfTest = true;
+		}
+	}
+
+	if (selfTest)
+	{
+		ThreadPool threadPool;
+		bool success = RingBufferAllocator::SelfTest();
+		success = TextureCompressor::SelfTest() && success;
+		success = SceneGraph::SelfTest(&threadPool) && success;
+		success = ConstantBufferRing::SelfTest() && success;
+	success = BloomReference::SelfTest() && success;
+	success = TonemapLUT::SelfTest() && success;
+		return success ? 0 : 1;
+	}
+	if (!brdfFile.empty())
+		return BRDFIntegration::Bake(brdfFile) ? 0 : 1;
+	if (bakePEM)
+		return EnvironmentPrefilter::Bake(pemFiles, pemOutput, pemSize, pemMipLevels) ? 0 : 1;
+	if (!materialDirectories.empty())
+	{
+		bool success = true;
+		for (const std::string& directory : materialDirectories)
+			success = TextureCompressor::CompressMaterialDirectory(directory) && success;
+		return success ? 0 : 1;
+	}
+	if (!arrayDirectory.empty())
+		return MaterialArrays::Build(arrayDirectory) ? 0 : 1;
+
+	App1* app = new App1(benchmarkConfig);
 	std::unique_ptr<System> system = std::make_unique<System>(app, 1920, 1080, true, true);
 
 	// Initialize and run the system object.
 	system->run();
 
-	return 0;
+	// the system deletes the app when it goes out of scope
+	return app->BenchmarkSucceeded() ? 0 : 1;
 }
\ No newline at end of file
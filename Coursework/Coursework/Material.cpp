@@ -1,52 +1,81 @@
 #include "Material.h"
 
 #include "imGUI/imgui.h"
-#include "DTK/include/DDSTextureLoader.h"
-#include "DTK/include/WICTextureLoader.h"
 
 #include <fstream>
 
+#include "GPUMemoryTracker.h"
+#include "AssetLoader.h"
+#include "TextureCache.h"
+
 
 Material::~Material()
 {
-	if (m_AlbedoMap) m_AlbedoMap->Release();
-	if (m_RoughnessMap) m_RoughnessMap->Release();
-	if (m_NormalMap) m_NormalMap->Release();
-	if (m_MetalnessMap) m_MetalnessMap->Release();
+	// the maps may be shared with other materials
+	if (m_TextureCache)
+	{
+		m_TextureCache->Release(m_AlbedoMap);
+		m_TextureCache->Release(m_RoughnessMap);
+		m_TextureCache->Release(m_NormalMap);
+		m_TextureCache->Release(m_MetalnessMap);
+		m_TextureCache->Release(m_ORMMap);
+	}
 }
 
 void Material::SettingsGUI()
 {
+	bool changed = false;
+
 	if (m_AlbedoMap)
-		ImGui::Checkbox("Use Albedo Map", &m_UseAlbedoMap);
+		changed |= ImGui::Checkbox("Use Albedo Map", &m_UseAlbedoMap);
 	if (!m_UseAlbedoMap || !m_AlbedoMap)
-		ImGui::ColorEdit3("Albedo", &m_Albedo.x);
+		changed |= ImGui::ColorEdit3("Albedo", &m_Albedo.x);
+
+	if (m_ORMMap)
+		changed |= ImGui::Checkbox("Use ORM Map", &m_UseORMMap);
+	bool packed = UseORMMap();
 
 	if (m_RoughnessMap)
-		ImGui::Checkbox("Use Roughness Map", &m_UseRoughnessMap);
-	if (!m_UseRoughnessMap || !m_RoughnessMap)
-		ImGui::SliderFloat("Roughness", &m_Roughness, 0.001f, 1.0f);
+		changed |= ImGui::Checkbox("Use Roughness Map", &m_UseRoughnessMap);
+	if (packed ? m_ORMMapMask.y == 0.0f : !UseRoughnessMap())
+		changed |= ImGui::SliderFloat("Roughness", &m_Roughness, 0.001f, 1.0f);
 
 	if (m_NormalMap)
-		ImGui::Checkbox("Use Normal Map", &m_UseNormalMap);
+		changed |= ImGui::Checkbox("Use Normal Map", &m_UseNormalMap);
 
 	if (m_MetalnessMap)
-		ImGui::Checkbox("Use Metalness Map", &m_UseMetalnessMap);
-	if (!m_UseMetalnessMap || !m_MetalnessMap)
-		ImGui::SliderFloat("Metalness", &m_Metalness, 0.0f, 1.0f);
+		changed |= ImGui::Checkbox("Use Metalness Map", &m_UseMetalnessMap);
+	if (packed ? m_ORMMapMask.z == 0.0f : !UseMetalnessMap())
+		changed |= ImGui::SliderFloat("Metalness", &m_Metalness, 0.0f, 1.0f);
+
+	if (changed) m_Version++;
 }
 
-void Material::LoadPBRFromDir(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const std::wstring& dir)
+void Material::LoadPBRFromDir(AssetLoader* loader, const std::wstring& dir, unsigned int residentMip)
 {
-	std::wstring albedoPath = dir + L"/albedo.png";
-	std::wstring normalPath = dir + L"/normal.png";
-	std::wstring roughnessPath = dir + L"/roughness.png";
-	std::wstring metalnessPath = dir + L"/metalness.png";
+	m_TextureCache = loader->GetTextureCache();
+	m_Directory = dir;
+	m_ResidentMip = residentMip;
+	m_Version++;
+
+	auto load = [&](Map map, const std::wstring& path)
+	{
+		m_MapFiles[static_cast<int>(map)] = path;
+		// a map that fails to load is left null, so the material's constants are used instead
+		loader->AddTexture(path, GetMapSlot(map), GPUMemoryTracker::Category::Materials, GetMipSettings(map), residentMip, {}, AssetLoader::TextureFallback::None);
+	};
+
+	std::wstring albedoPath = GetMapPath(dir, L"albedo");
+	std::wstring normalPath = GetMapPath(dir, L"normal");
+	std::wstring roughnessPath = GetMapPath(dir, L"roughness");
+	std::wstring metalnessPath = GetMapPath(dir, L"metalness");
+	// only made by -compress-pbr, there is no PNG to fall back to
+	std::wstring ormPath = dir + L"/orm.dds";
 
 	if (DoesFileExist(albedoPath.c_str()))
 	{
 		m_UseAlbedoMap = true;
-		LoadTexture(device, deviceContext, albedoPath.c_str(), &m_AlbedoMap);
+		load(Map::Albedo, albedoPath);
 	}
 	else
 		m_UseAlbedoMap = false;
@@ -54,15 +83,37 @@ void Material::LoadPBRFromDir(ID3D11Device* device, ID3D11DeviceContext* deviceC
 	if (DoesFileExist(normalPath.c_str()))
 	{
 		m_UseNormalMap = true;
-		LoadTexture(device, deviceContext, normalPath.c_str(), &m_NormalMap);
+		load(Map::Normal, normalPath);
 	}
 	else
 		m_UseNormalMap = false;
 
+	// the packed map has the roughness and metalness in it, so their own maps aren't loaded
+	if (DoesFileExist(ormPath.c_str()))
+	{
+		m_UseORMMap = true;
+		load(Map::ORM, ormPath);
+
+		// PackORM fills the channels it has no PNG for with defaults, which the material's own values replace
+		// without any of the PNGs there is no telling, so the whole map is used
+		bool occlusion = DoesFileExist((dir + L"/occlusion.png").c_str());
+		bool roughness = DoesFileExist((dir + L"/roughness.png").c_str());
+		bool metalness = DoesFileExist((dir + L"/metalness.png").c_str());
+		if (occlusion || roughness || metalness)
+			m_ORMMapMask = { occlusion ? 1.0f : 0.0f, roughness ? 1.0f : 0.0f, metalness ? 1.0f : 0.0f };
+		else
+			m_ORMMapMask = { 1.0f, 1.0f, 1.0f };
+
+		m_UseRoughnessMap = false;
+		m_UseMetalnessMap = false;
+		return;
+	}
+	m_UseORMMap = false;
+
 	if (DoesFileExist(roughnessPath.c_str()))
 	{
 		m_UseRoughnessMap = true;
-		LoadTexture(device, deviceContext, roughnessPath.c_str(), &m_RoughnessMap);
+		load(Map::Roughness, roughnessPath);
 	}
 	else
 		m_UseRoughnessMap = false;
@@ -70,34 +121,58 @@ void Material::LoadPBRFromDir(ID3D11Device* device, ID3D11DeviceContext* deviceC
 	if (DoesFileExist(metalnessPath.c_str()))
 	{
 		m_UseMetalnessMap = true;
-		LoadTexture(device, deviceContext, metalnessPath.c_str(), &m_MetalnessMap);
+		load(Map::Metalness, metalnessPath);
 	}
 	else
 		m_UseMetalnessMap = false;
 }
 
-bool Material::DoesFileExist(const wchar_t* filename) const
+MipGenerator::Settings Material::GetMipSettings(Map map)
 {
-	std::ifstream infile(filename);
-	return infile.good();
+	// only the albedo is colour, the mips of the other maps are filtered as they are stored
+	MipGenerator::Settings mipSettings;
+	mipSettings.srgb = map == Map::Albedo;
+	mipSettings.normalMap = map == Map::Normal;
+	return mipSettings;
 }
 
-void Material::LoadTexture(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const wchar_t* filename, ID3D11ShaderResourceView** srv)
+ID3D11ShaderResourceView* Material::GetMap(Map map) const
 {
-	HRESULT hr;
+	return *const_cast<Material*>(this)->GetMapSlot(map);
+}
 
-	// check file extension for correct loading function.
-	std::wstring fn(filename);
-	auto idx = fn.rfind('.');
+ID3D11ShaderResourceView* Material::SwapMap(Map map, ID3D11ShaderResourceView* texture)
+{
+	ID3D11ShaderResourceView** slot = GetMapSlot(map);
+	ID3D11ShaderResourceView* old = *slot;
+	*slot = texture;
+	m_Version++;
+	return old;
+}
 
-	assert(idx != std::string::npos && "File extension not found");
-	std::wstring extension = fn.substr(idx + 1);
+ID3D11ShaderResourceView** Material::GetMapSlot(Map map)
+{
+	switch (map)
+	{
+	case Map::Albedo: return &m_AlbedoMap;
+	case Map::Normal: return &m_NormalMap;
+	case Map::Roughness: return &m_RoughnessMap;
+	case Map::Metalness: return &m_MetalnessMap;
+	default: return &m_ORMMap;
+	}
+}
 
-	// Load the texture in.
-	if (extension == L"dds")
-		hr = CreateDDSTextureFromFile(device, deviceContext, filename, NULL, srv);
-	else
-		hr = CreateWICTextureFromFile(device, deviceContext, filename, NULL, srv, 0);
+std::wstring Material::GetMapPath(const std::wstring& dir, const wchar_t* map) const
+{
+	// block compressed maps from -compress-pbr are used over the PNGs they were made from
+	std::wstring compressed = dir + L"/" + map + L".dds";
+	if (DoesFileExist(compressed.c_str()))
+		return compressed;
+	return dir + L"/" + map + L".png";
+}
 
-	assert(hr == S_OK && "Texture failed to load");
+bool Material::DoesFileExist(const wchar_t* filename) const
+{
+	std::ifstream infile(filename);
+	return infile.good();
 }
@@ -6,43 +6,83 @@ using namespace DirectX;
 
 #include <string>
 
+#include "MipGenerator.h"
+
+class AssetLoader;
+class TextureCache;
+
 
 class Material
 {
+public:
+	enum class Map { Albedo, Normal, Roughness, Metalness, ORM, Count };
+
 public:
 	Material() = default;
 	~Material();
 
 	void SettingsGUI();
 
-	void LoadPBRFromDir(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const std::wstring& dir);
+	// the maps are queued on the loader, and are set once it has run
+	// they come from the loader's texture cache, and are released back to it
+	// residentMip is how many of their largest mips are left out to start with
+	void LoadPBRFromDir(AssetLoader* loader, const std::wstring& dir, unsigned int residentMip = 0);
+	// the directory the maps were loaded from, empty if they weren't
+	inline const std::wstring& GetDirectory() const { return m_Directory; }
+
+	// bumped whenever anything the shaders read from the material changes, so cached constant buffers know to refill
+	inline unsigned int GetVersion() const { return m_Version; }
 
 	// getters and setters
-	inline void SetAlbedo(const XMFLOAT3& albedo) { m_Albedo = albedo; }
+	inline void SetAlbedo(const XMFLOAT3& albedo) { m_Albedo = albedo; m_Version++; }
 	inline const XMFLOAT3 GetAlbedo() const { return m_Albedo; }
 	inline bool UseAlbedoMap() const { return m_UseAlbedoMap && m_AlbedoMap; }
 	inline ID3D11ShaderResourceView* GetAlbedoMap() const { return m_AlbedoMap; }
 
 	inline bool UseMetalnessMap() const { return m_UseMetalnessMap && m_MetalnessMap; }
 	inline ID3D11ShaderResourceView* GetMetalnessMap() const { return m_MetalnessMap; }
-	inline void SetMetalness(float m) { m_Metalness = m; }
+	inline void SetMetalness(float m) { m_Metalness = m; m_Version++; }
 	inline float GetMetalness() const { return m_Metalness; }
 
 	inline bool UseRoughnessMap() const { return m_UseRoughnessMap && m_RoughnessMap; }
 	inline ID3D11ShaderResourceView* GetRoughnessMap() const { return m_RoughnessMap; }
-	inline void SetRoughness(float r) { m_Roughness = r; }
+	inline void SetRoughness(float r) { m_Roughness = r; m_Version++; }
 	inline float GetRoughness() const { return m_Roughness; }
 
 	inline bool UseNormalMap() const { return m_UseNormalMap && m_NormalMap; }
 	inline ID3D11ShaderResourceView* GetNormalMap() const { return m_NormalMap; }
 
+	// occlusion, roughness and metalness packed into RGB, used instead of the roughness and metalness maps
+	inline bool UseORMMap() const { return m_UseORMMap && m_ORMMap; }
+	inline ID3D11ShaderResourceView* GetORMMap() const { return m_ORMMap; }
+	// 1 for the channels of the ORM map that were packed from a map, the others are defaults and the values above are used
+	inline const XMFLOAT3& GetORMMapMask() const { return m_ORMMapMask; }
+
+	// for the texture streamer
+	// the file a map was loaded from, empty if the material doesn't have it
+	inline const std::wstring& GetMapFile(Map map) const { return m_MapFiles[static_cast<int>(map)]; }
+	static MipGenerator::Settings GetMipSettings(Map map);
+	ID3D11ShaderResourceView* GetMap(Map map) const;
+	// on the render thread, returns the map that was replaced, which should be released to the texture cache
+	ID3D11ShaderResourceView* SwapMap(Map map, ID3D11ShaderResourceView* texture);
+	// how many of the maps' largest mips have been left out
+	inline unsigned int GetResidentMip() const { return m_ResidentMip; }
+	inline void SetResidentMip(unsigned int mip) { m_ResidentMip = mip; }
+
 private:
 
+	ID3D11ShaderResourceView** GetMapSlot(Map map);
+
 	bool DoesFileExist(const wchar_t* filename) const;
-	// loads texture at filename and stores a pointer to it in srv
-	void LoadTexture(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const wchar_t* filename, ID3D11ShaderResourceView** srv);
+	std::wstring GetMapPath(const std::wstring& dir, const wchar_t* map) const;
 
 private:
+	TextureCache* m_TextureCache = nullptr;
+	std::wstring m_Directory;
+	std::wstring m_MapFiles[static_cast<int>(Map::Count)];
+	unsigned int m_ResidentMip = 0;
+	unsigned int m_Version = 0;
+
 	XMFLOAT3 m_Albedo{ 1.0f, 1.0f, 1.0f };
 	ID3D11ShaderResourceView* m_AlbedoMap = nullptr;
 	bool m_UseAlbedoMap = true;
@@ -57,4 +97,8 @@ private:
 	float m_Metalness = 0.0f;
 	ID3D11ShaderResourceView* m_MetalnessMap = nullptr;
 	bool m_UseMetalnessMap = true;
+
+	ID3D11ShaderResourceView* m_ORMMap = nullptr;
+	bool m_UseORMMap = true;
+	XMFLOAT3 m_ORMMapMask{ 1.0f, 1.0f, 1.0f };
 };
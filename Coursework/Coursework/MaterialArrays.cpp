@@ -0,0 +1,236 @@
+#include "MaterialArrays.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+
+#include "stb_image.h"
+
+#include "AssetLoader.h"
+#include "DDSFile.h"
+#include "Material.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	// the array files, which are also the names TextureCompressor formats them by
+	const char* ArrayNames[] = { "albedo", "normal", "orm" };
+
+	// what a slice is filled with when its material doesn't have the map, the same as the material defaults
+	const unsigned char DefaultAlbedo[4] = { 255, 255, 255, 255 };
+	const unsigned char DefaultNormal[4] = { 128, 128, 255, 255 };
+	const unsigned char DefaultORM[4] = { 255, 128, 0, 255 };
+
+	time_t GetModifiedTime(const std::string& file)
+	{
+		struct stat info;
+		return stat(file.c_str(), &info) == 0 ? info.st_mtime : 0;
+	}
+
+	// the PNGs a slice is made from, the three ORM maps are one channel each
+	std::vector<std::string> GetSourceNames(MaterialArrays::Map map)
+	{
+		switch (map)
+		{
+		case MaterialArrays::Map::Albedo: return { "albedo" };
+		case MaterialArrays::Map::Normal: return { "normal" };
+		default: return { "occlusion", "roughness", "metalness" };
+		}
+	}
+
+	struct SourceMap
+	{
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+	};
+}
+
+
+MaterialArrays::~MaterialArrays()
+{
+	if (m_TextureCache)
+	{
+		for (ID3D11ShaderResourceView* array : m_Arrays)
+			m_TextureCache->Release(array);
+	}
+}
+
+void MaterialArrays::Load(AssetLoader* loader, const std::wstring& directory)
+{
+	std::string narrowDirectory(directory.begin(), directory.end());
+	std::vector<std::string> layers = ReadLayers(narrowDirectory);
+	if (layers.empty())
+		return;
+
+	for (const char* name : ArrayNames)
+	{
+		if (GetModifiedTime(narrowDirectory + "/" + name + ".dds") == 0)
+			return;
+	}
+
+	for (const std::string& layer : layers)
+		m_Layers.push_back(TextureCache::NormalisePath(directory + L"/" + std::wstring(layer.begin(), layer.end())));
+
+	m_TextureCache = loader->GetTextureCache();
+	for (int i = 0; i < static_cast<int>(Map::Count); i++)
+	{
+		std::string name = ArrayNames[i];
+		// a 2D fallback can't stand in for an array, and the terrain uses the materials' own maps when one is missing
+		loader->AddTexture(directory + L"/" + std::wstring(name.begin(), name.end()) + L".dds", &m_Arrays[i], GPUMemoryTracker::Category::MaterialArrays,
+			MipGenerator::Settings(), 0, {}, AssetLoader::TextureFallback::None);
+	}
+}
+
+bool MaterialArrays::IsLoaded() const
+{
+	return m_Arrays[0] && m_Arrays[1] && m_Arrays[2];
+}
+
+int MaterialArrays::GetSlice(const Material* material) const
+{
+	auto layer = std::find(m_Layers.begin(), m_Layers.end(), TextureCache::NormalisePath(material->GetDirectory()));
+	return layer == m_Layers.end() ? -1 : static_cast<int>(layer - m_Layers.begin());
+}
+
+bool MaterialArrays::Build(const std::string& directory)
+{
+	std::vector<std::string> layers = ReadLayers(directory);
+	if (layers.empty())
+		return false;
+
+	ThreadPool threadPool;
+
+	bool success = true;
+	for (int i = 0; i < static_cast<int>(Map::Count); i++)
+	{
+		// up to date if it is newer than the layer list and every map in it
+		time_t newest = GetModifiedTime(directory + "/layers.txt");
+		for (const std::string& layer : layers)
+		{
+			for (const std::string& source : GetSourceNames(static_cast<Map>(i)))
+				newest = (std::max)(newest, GetModifiedTime(directory + "/" + layer + "/" + source + ".png"));
+		}
+		if (GetModifiedTime(directory + "/" + ArrayNames[i] + ".dds") >= newest)
+			continue;
+
+		success = BuildArray(directory, layers, static_cast<Map>(i), &threadPool) && success;
+	}
+	return success;
+}
+
+std::vector<std::string> MaterialArrays::ReadLayers(const std::string& directory)
+{
+	std::vector<std::string> layers;
+	std::ifstream file(directory + "/layers.txt");
+	std::string line;
+	while (std::getline(file, line))
+	{
+		// one directory per line, # starts a comment
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		line.erase(0, line.find_first_not_of(" \t"));
+		if (!line.empty() && line[0] != '#')
+			layers.push_back(line);
+	}
+	return layers;
+}
+
+bool MaterialArrays::BuildArray(const std::string& directory, const std::vector<std::string>& layers, Map map, ThreadPool* threadPool)
+{
+	std::string name = ArrayNames[static_cast<int>(map)];
+	std::vector<std::string> sourceNames = GetSourceNames(map);
+	int channels = map == Map::ORM ? 1 : 4;
+	MipGenerator::Settings mipSettings = TextureCompressor::GetMipSettings(name);
+
+	// sources[layer * sourceNames.size() + source]
+	std::vector<SourceMap> sources(layers.size() * sourceNames.size());
+	unsigned int width = UINT_MAX, height = UINT_MAX;
+	bool success = true;
+	for (size_t layer = 0; layer < layers.size(); layer++)
+	{
+		for (size_t s = 0; s < sourceNames.size(); s++)
+		{
+			std::string file = directory + "/" + layers[layer] + "/" + sourceNames[s] + ".png";
+			if (GetModifiedTime(file) == 0)
+				continue;
+
+			SourceMap& source = sources[layer * sourceNames.size() + s];
+			int fileChannels;
+			source.pixels = stbi_load(file.c_str(), &source.width, &source.height, &fileChannels, channels);
+			if (!source.pixels)
+			{
+				success = false;
+				continue;
+			}
+			width = (std::min)(width, static_cast<unsigned int>(source.width));
+			height = (std::min)(height, static_cast<unsigned int>(source.height));
+		}
+	}
+	// no layer has the map, the slices are all defaults
+	if (width == UINT_MAX)
+		width = height = 4;
+
+	DDSFile::Image array;
+	array.arraySize = static_cast<unsigned int>(layers.size());
+
+	const unsigned char* defaults = map == Map::Albedo ? DefaultAlbedo : map == Map::Normal ? DefaultNormal : DefaultORM;
+	std::vector<unsigned char> slice(static_cast<size_t>(width) * height * 4);
+	for (size_t layer = 0; layer < layers.size() && success; layer++)
+	{
+		for (size_t i = 0; i < slice.size(); i++)
+			slice[i] = defaults[i & 3];
+
+		for (size_t s = 0; s < sourceNames.size(); s++)
+		{
+			const SourceMap& source = sources[layer * sourceNames.size() + s];
+			if (!source.pixels)
+				continue;
+
+			// a larger map is used at the mip that is the array's size, so the sizes can only differ by powers of two
+			unsigned int level = 0;
+			while ((static_cast<unsigned int>(source.width) >> level) > width) level++;
+			if ((static_cast<unsigned int>(source.width) >> level) != width || (static_cast<unsigned int>(source.height) >> level) != height)
+			{
+				success = false;
+				break;
+			}
+
+			MipGenerator::MipChain mips;
+			if (level > 0)
+				mips = MipGenerator::Generate(source.pixels, source.width, source.height, channels, mipSettings, threadPool);
+			const unsigned char* pixels = level > 0 ? mips[level - 1].data() : source.pixels;
+
+			if (channels == 4)
+				memcpy(slice.data(), pixels, slice.size());
+			else
+			{
+				for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+					slice[i * 4 + s] = pixels[i];
+			}
+		}
+		if (!success)
+			break;
+
+		DDSFile::Image compressed = TextureCompressor::Compress(slice.data(), width, height, TextureCompressor::GetMapFormat(name), mipSettings, threadPool);
+		array.format = compressed.format;
+		array.width = compressed.width;
+		array.height = compressed.height;
+		array.mipLevels = compressed.mipLevels;
+		// subresources are ordered by slice, then by mip, so the slices' chains are appended as they are
+		array.data.insert(array.data.end(), compressed.data.begin(), compressed.data.end());
+	}
+
+	for (SourceMap& source : sources)
+	{
+		if (source.pixels) stbi_image_free(source.pixels);
+	}
+
+	return success && DDSFile::Write(directory + "/" + name + ".dds", array);
+}
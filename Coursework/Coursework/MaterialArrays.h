@@ -0,0 +1,58 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <vector>
+
+class AssetLoader;
+class Material;
+class TextureCache;
+class ThreadPool;
+
+
+// The maps of a set of materials as slices of Texture2DArrays, so a shader can blend between any of them without each
+// map taking a slot of the resource buffer, and without the MAX_MATERIALS limit of the material constant buffer
+//
+// A directory holds layers.txt, which lists the material directories (relative to it) that are slices, in slice order.
+// The build runs the application with "-build-material-arrays dir" to assemble albedo.dds (BC7), normal.dds (BC5) and
+// orm.dds (BC7, occlusion, roughness and metalness) from the materials' PNGs. Maps of different sizes are brought down
+// to the smallest one through their mips, and a material that is missing a map gets the material defaults in its slice
+
+class MaterialArrays
+{
+public:
+	enum class Map { Albedo, Normal, ORM, Count };
+
+public:
+	MaterialArrays() = default;
+	~MaterialArrays();
+
+	MaterialArrays(const MaterialArrays&) = delete;
+	MaterialArrays& operator=(const MaterialArrays&) = delete;
+
+	// reads the layer list and queues the arrays on the loader, they are set once it has run
+	// does nothing if the arrays haven't been built
+	void Load(AssetLoader* loader, const std::wstring& directory);
+
+	// all three arrays are loaded
+	bool IsLoaded() const;
+	inline ID3D11ShaderResourceView* GetArray(Map map) const { return m_Arrays[static_cast<int>(map)]; }
+	inline size_t GetLayerCount() const { return m_Layers.size(); }
+	// the slice of a material loaded from one of the listed directories, -1 if it isn't one
+	int GetSlice(const Material* material) const;
+
+	// for the command line, rebuilds the arrays of a directory if any of the maps are newer
+	static bool Build(const std::string& directory);
+
+private:
+	static std::vector<std::string> ReadLayers(const std::string& directory);
+	// every layer's map of one kind as one mip mapped, block compressed array
+	static bool BuildArray(const std::string& directory, const std::vector<std::string>& layers, Map map, ThreadPool* threadPool);
+
+private:
+	TextureCache* m_TextureCache = nullptr;
+	ID3D11ShaderResourceView* m_Arrays[static_cast<int>(Map::Count)] = { nullptr, nullptr, nullptr };
+	// normalised material directories in slice order
+	std::vector<std::wstring> m_Layers;
+};
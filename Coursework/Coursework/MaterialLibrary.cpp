@@ -5,9 +5,15 @@
 
 
 MaterialLibrary::~MaterialLibrary()
+{
+	Clear();
+}
+
+void MaterialLibrary::Clear()
 {
 	for (auto& mat : m_Materials)
 		delete mat.second;
+	m_Materials.clear();
 }
 
 Material* MaterialLibrary::CreateMaterial(const std::string& name)
@@ -38,6 +44,14 @@ const std::string MaterialLibrary::GetName(Material* mat) const
 	return std::string();
 }
 
+std::vector<Material*> MaterialLibrary::GetMaterials() const
+{
+	std::vector<Material*> materials;
+	for (auto& m : m_Materials)
+		materials.push_back(m.second);
+	return materials;
+}
+
 void MaterialLibrary::MaterialSettingsGUI()
 {
 	for (auto& material : m_Materials)
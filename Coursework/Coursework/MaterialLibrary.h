@@ -2,6 +2,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class Material;
 
@@ -13,8 +14,11 @@ public:
 	~MaterialLibrary();
 
 	Material* CreateMaterial(const std::string& name);
+	// deletes every material, e.g. before the texture cache their maps came from
+	void Clear();
 	Material* GetMaterial(const std::string& matName) const;
 	const std::string GetName(Material* mat) const;
+	std::vector<Material*> GetMaterials() const;
 
 	void MaterialSettingsGUI();
 	void MaterialSelectGUI(Material** mat) const;
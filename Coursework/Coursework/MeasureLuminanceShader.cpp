@@ -6,8 +6,11 @@
 
 #include <d3dcompiler.h>
 
+#include "GPUMemoryTracker.h"
 
-MeasureLuminanceShader::MeasureLuminanceShader(ID3D11Device* device, unsigned int backBufferW, unsigned int backBufferH)
+
+MeasureLuminanceShader::MeasureLuminanceShader(ID3D11Device* device, IGraphicsBackend* backend, unsigned int backBufferW, unsigned int backBufferH)
+	: m_Backend(backend)
 {
 	LoadCS(device, L"reduceto1d_cs.cso", &m_ReduceTo1DShader);
 	LoadCS(device, L"reducetosingle_cs.cso", &m_ReduceToSingleShader);
@@ -39,6 +42,8 @@ MeasureLuminanceShader::MeasureLuminanceShader(ID3D11Device* device, unsigned in
 	assert(hr == S_OK);
 	hr = device->CreateBuffer(&bufferDesc, nullptr, &m_ReductionBuffer1);
 	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_ReductionBuffer0, GPUMemoryTracker::Category::PostProcessing, "Luminance reduction");
+	GPUMemoryTracker::Track(m_ReductionBuffer1, GPUMemoryTracker::Category::PostProcessing, "Luminance reduction");
 
 	// create uav and srv for each buffer
 
@@ -74,6 +79,8 @@ MeasureLuminanceShader::~MeasureLuminanceShader()
 	m_ReduceToSingleShader->Release();
 	m_CSBuffer->Release();
 
+	GPUMemoryTracker::Untrack(m_ReductionBuffer0);
+	GPUMemoryTracker::Untrack(m_ReductionBuffer1);
 	m_ReductionBuffer0->Release();
 	m_ReductionBuffer1->Release();
 
@@ -168,7 +175,7 @@ void MeasureLuminanceShader::RunCS(	ID3D11DeviceContext* deviceContext, ID3D11Co
 	deviceContext->CSSetConstantBuffers(0, 1, &m_CSBuffer);
 
 	// dispatch
-	deviceContext->Dispatch(groupCount.x, groupCount.y, 1);
+	m_Backend->Dispatch(groupCount.x, groupCount.y, 1);
 
 	// unbind resources
 	// (to prevent attempting to bind same resource as input and output simutaneously)
@@ -2,6 +2,8 @@
 
 #include <d3d11.h>
 #include <DirectXMath.h>
+
+#include "GraphicsBackend.h"
 using namespace DirectX;
 
 
@@ -15,7 +17,7 @@ private:
 	};
 
 public:
-	MeasureLuminanceShader(ID3D11Device* device, unsigned int backBufferW, unsigned int backBufferH);
+	MeasureLuminanceShader(ID3D11Device* device, IGraphicsBackend* backend, unsigned int backBufferW, unsigned int backBufferH);
 	~MeasureLuminanceShader();
 
 	void Run(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* input, unsigned int inputW, unsigned int inputH);
@@ -28,6 +30,8 @@ private:
 	void RunCS(ID3D11DeviceContext* deviceContext, ID3D11ComputeShader* cs, ID3D11ShaderResourceView** input, ID3D11UnorderedAccessView** output, XMUINT2 inputDims, XMUINT2 groupCount);
 
 private:
+	IGraphicsBackend* m_Backend = nullptr;
+
 	ID3D11ComputeShader* m_ReduceTo1DShader = nullptr;
 	ID3D11ComputeShader* m_ReduceToSingleShader = nullptr;
 	ID3D11Buffer* m_CSBuffer = nullptr;
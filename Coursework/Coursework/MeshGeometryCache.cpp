@@ -0,0 +1,94 @@
+#include "MeshGeometryCache.h"
+
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+
+MeshGeometryCache::MeshGeometryCache(ID3D11Device* device)
+	: m_Device(device)
+{
+}
+
+const MeshGeometryCache::Entry& MeshGeometryCache::Get(ID3D11DeviceContext* deviceContext, BaseMesh* mesh)
+{
+	auto it = m_Cache.find(mesh);
+	if (it != m_Cache.end()) return it->second;
+
+	Entry& entry = m_Cache[mesh];
+	SoftwareRasterizer::Mesh& geometry = entry.geometry;
+
+	// bind the mesh and read back whatever buffers end up bound
+	mesh->sendData(deviceContext);
+
+	ID3D11Buffer* vertexBuffer = nullptr;
+	UINT stride = 0, offset = 0;
+	deviceContext->IAGetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	ID3D11Buffer* indexBuffer = nullptr;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_UNKNOWN;
+	UINT indexOffset = 0;
+	deviceContext->IAGetIndexBuffer(&indexBuffer, &indexFormat, &indexOffset);
+
+	std::vector<uint8_t> vertexData, indexData;
+	ReadBuffer(deviceContext, vertexBuffer, vertexData);
+	ReadBuffer(deviceContext, indexBuffer, indexData);
+	vertexBuffer->Release();
+	indexBuffer->Release();
+
+	// every vertex type in the framework starts with the position
+	size_t vertexCount = (vertexData.size() - offset) / stride;
+	geometry.positions.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		memcpy(&geometry.positions[i], vertexData.data() + offset + i * stride, sizeof(XMFLOAT3));
+
+	size_t indexCount = static_cast<size_t>(mesh->getIndexCount());
+	geometry.indices.resize(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		if (indexFormat == DXGI_FORMAT_R16_UINT)
+		{
+			uint16_t index;
+			memcpy(&index, indexData.data() + indexOffset + i * sizeof(uint16_t), sizeof(uint16_t));
+			geometry.indices[i] = index;
+		}
+		else
+			memcpy(&geometry.indices[i], indexData.data() + indexOffset + i * sizeof(uint32_t), sizeof(uint32_t));
+	}
+
+	// bounds of the referenced vertices
+	entry.boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+	entry.boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t index : geometry.indices)
+	{
+		const XMFLOAT3& p = geometry.positions[index];
+		entry.boundsMin = { (std::min)(entry.boundsMin.x, p.x), (std::min)(entry.boundsMin.y, p.y), (std::min)(entry.boundsMin.z, p.z) };
+		entry.boundsMax = { (std::max)(entry.boundsMax.x, p.x), (std::max)(entry.boundsMax.y, p.y), (std::max)(entry.boundsMax.z, p.z) };
+	}
+
+	return entry;
+}
+
+void MeshGeometryCache::ReadBuffer(ID3D11DeviceContext* deviceContext, ID3D11Buffer* buffer, std::vector<uint8_t>& out)
+{
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	ID3D11Buffer* staging = nullptr;
+	HRESULT hr = m_Device->CreateBuffer(&desc, nullptr, &staging);
+	assert(hr == S_OK);
+	deviceContext->CopyResource(staging, buffer);
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	hr = deviceContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+	out.resize(desc.ByteWidth);
+	memcpy(out.data(), mapped.pData, desc.ByteWidth);
+	deviceContext->Unmap(staging, 0);
+
+	staging->Release();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "DXF.h"
+
+#include <map>
+#include <vector>
+
+#include "SoftwareRasterizer.h"
+
+
+// CPU copies of mesh geometry for the software rasterizer
+// Framework meshes only keep their vertex and index buffers on the GPU, so each mesh is read back once on first use
+
+class MeshGeometryCache
+{
+public:
+	struct Entry
+	{
+		SoftwareRasterizer::Mesh geometry;
+		// local space bounding box
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+	};
+
+public:
+	MeshGeometryCache(ID3D11Device* device);
+	~MeshGeometryCache() = default;
+
+	const Entry& Get(ID3D11DeviceContext* deviceContext, BaseMesh* mesh);
+
+	// forget cached geometry, required if a mesh is rebuilt
+	inline void Clear() { m_Cache.clear(); }
+
+private:
+	void ReadBuffer(ID3D11DeviceContext* deviceContext, ID3D11Buffer* buffer, std::vector<uint8_t>& out);
+
+private:
+	ID3D11Device* m_Device = nullptr;
+	std::map<BaseMesh*, Entry> m_Cache;
+};
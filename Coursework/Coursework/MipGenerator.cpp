@@ -0,0 +1,380 @@
+#include "MipGenerator.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "Cubemap.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	const float Pi = 3.14159265358979f;
+
+	// in texels of the level being made
+	const float KaiserRadius = 3.0f;
+	const float KaiserAlpha = 4.0f;
+
+	// a cube face is read with this many texels of its neighbours around it, enough for the Kaiser filter when halving
+	const int CubePadding = 8;
+
+	// rows of a level that are made together, the rows they read are filtered along x once per band
+	const unsigned int BandHeight = 32;
+
+	struct ColourTables
+	{
+		float unormToFloat[256];
+		float srgbToLinear[256];
+		// srgbThresholds[i] is the linear value halfway between sRGB values i and i + 1
+		float srgbThresholds[255];
+
+		ColourTables()
+		{
+			auto toLinear = [](float c) { return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f); };
+			for (int i = 0; i < 256; i++)
+			{
+				unormToFloat[i] = i / 255.0f;
+				srgbToLinear[i] = toLinear(i / 255.0f);
+			}
+			for (int i = 0; i < 255; i++)
+				srgbThresholds[i] = toLinear((i + 0.5f) / 255.0f);
+		}
+	};
+
+	const ColourTables& GetColourTables()
+	{
+		static const ColourTables tables;
+		return tables;
+	}
+
+	// a level being filtered, either the pixels that were passed in or the float texels of a level made from them
+	struct SourceLevel
+	{
+		const unsigned char* pixels = nullptr;
+		const float* texels = nullptr;
+		unsigned int channels = 4;
+		const float* rgbTable = nullptr;
+		const float* alphaTable = nullptr;
+
+		inline __m128 Load(size_t index) const
+		{
+			if (texels) return _mm_loadu_ps(texels + index * 4);
+
+			const unsigned char* pixel = pixels + index * channels;
+			if (channels == 1) return _mm_set_ps(1.0f, 0.0f, 0.0f, rgbTable[pixel[0]]);
+			return _mm_set_ps(alphaTable[pixel[3]], rgbTable[pixel[2]], rgbTable[pixel[1]], rgbTable[pixel[0]]);
+		}
+	};
+
+	// the taps along one axis for each texel of the level being made
+	struct AxisFilter
+	{
+		// the taps of texel i are [tapStart[i], tapStart[i + 1])
+		std::vector<unsigned int> tapStart;
+		std::vector<int> indices;
+		std::vector<float> weights;
+	};
+
+	float BesselI0(float x)
+	{
+		// the power series converges quickly for the arguments used here
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			float factor = x * 0.5f / k;
+			term *= factor * factor;
+			sum += term;
+		}
+		return sum;
+	}
+
+	float Kaiser(float t)
+	{
+		if (std::abs(t) >= KaiserRadius) return 0.0f;
+
+		float sinc = t == 0.0f ? 1.0f : std::sin(Pi * t) / (Pi * t);
+		float window = t / KaiserRadius;
+		return sinc * BesselI0(KaiserAlpha * std::sqrt(1.0f - window * window)) / BesselI0(KaiserAlpha);
+	}
+
+	// source texels outside [0, sourceSize) either wrap around, or are read from padding either side of the source
+	AxisFilter BuildAxisFilter(unsigned int sourceSize, unsigned int size, MipGenerator::Filter filter, bool wrap, int padding = 0)
+	{
+		AxisFilter axis;
+		float scale = static_cast<float>(sourceSize) / size;
+		float radius = filter == MipGenerator::Filter::Box ? 0.5f * scale : KaiserRadius * scale;
+		int n = static_cast<int>(sourceSize);
+
+		for (unsigned int i = 0; i < size; i++)
+		{
+			axis.tapStart.push_back(static_cast<unsigned int>(axis.indices.size()));
+			size_t firstTap = axis.weights.size();
+			float centre = (i + 0.5f) * scale;
+			float total = 0.0f;
+
+			for (int s = static_cast<int>(std::floor(centre - radius)); s <= static_cast<int>(std::ceil(centre + radius)); s++)
+			{
+				// how much of the texel is inside the box, or the windowed sinc (which has negative lobes) at its centre
+				float weight = filter == MipGenerator::Filter::Box
+					? (std::max)((std::min)(s + 1.0f, centre + radius) - (std::max)(static_cast<float>(s), centre - radius), 0.0f)
+					: Kaiser((s + 0.5f - centre) / scale);
+				if (weight == 0.0f) continue;
+
+				int index = wrap ? ((s % n) + n) % n : s + padding;
+				assert(index >= 0 && index < n + 2 * padding && "Filter reaches past the padding!");
+				axis.indices.push_back(index);
+				axis.weights.push_back(weight);
+				total += weight;
+			}
+
+			for (size_t t = firstTap; t < axis.weights.size(); t++)
+				axis.weights[t] /= total;
+		}
+		axis.tapStart.push_back(static_cast<unsigned int>(axis.indices.size()));
+
+		return axis;
+	}
+
+	// the texel that (x, y), past the edge of a face, lands on when the face is extended out onto the cube
+	void FindNeighbourTexel(int face, int x, int y, int size, int* neighbourFace, int* neighbourX, int* neighbourY)
+	{
+		float u = 2.0f * (x + 0.5f) / size - 1.0f;
+		float v = 2.0f * (y + 0.5f) / size - 1.0f;
+		const XMFLOAT3& n = Cubemap::GetFaceNormal(face);
+		const XMFLOAT3& t = Cubemap::GetFaceTangent(face);
+		const XMFLOAT3& b = Cubemap::GetFaceBitangent(face);
+		float direction[3] = { n.x + u * t.x + v * b.x, n.y + u * t.y + v * b.y, n.z + u * t.z + v * b.z };
+
+		// the face the direction points at most
+		int axis = 0;
+		for (int i = 1; i < 3; i++)
+		{
+			if (std::abs(direction[i]) > std::abs(direction[axis])) axis = i;
+		}
+		*neighbourFace = axis * 2 + (direction[axis] < 0.0f ? 1 : 0);
+
+		const XMFLOAT3& tangent = Cubemap::GetFaceTangent(*neighbourFace);
+		const XMFLOAT3& bitangent = Cubemap::GetFaceBitangent(*neighbourFace);
+		float major = std::abs(direction[axis]);
+		float neighbourU = (direction[0] * tangent.x + direction[1] * tangent.y + direction[2] * tangent.z) / major;
+		float neighbourV = (direction[0] * bitangent.x + direction[1] * bitangent.y + direction[2] * bitangent.z) / major;
+		*neighbourX = (std::min)((std::max)(static_cast<int>(std::floor((neighbourU + 1.0f) * 0.5f * size)), 0), size - 1);
+		*neighbourY = (std::min)((std::max)(static_cast<int>(std::floor((neighbourV + 1.0f) * 0.5f * size)), 0), size - 1);
+	}
+
+	void FilterRow(const float* row, const AxisFilter& axis, unsigned int width, float* destination)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (unsigned int t = axis.tapStart[x]; t < axis.tapStart[x + 1]; t++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(axis.weights[t]), _mm_loadu_ps(row + axis.indices[t] * 4)));
+			_mm_storeu_ps(destination + x * 4, sum);
+		}
+	}
+
+	// clamps away the Kaiser filter's ringing, renormalises normals and writes the row out
+	// the texels are kept as they are written, for making the next level
+	void StoreRow(float* texels, unsigned int width, unsigned int channels, const MipGenerator::Settings& settings, unsigned char* pixels)
+	{
+		const ColourTables& tables = GetColourTables();
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float* texel = texels + x * 4;
+			_mm_storeu_ps(texel, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(texel), zero), one));
+
+			// averaged normals are shorter than 1
+			if (settings.normalMap)
+			{
+				float n[3] = { texel[0] * 2.0f - 1.0f, texel[1] * 2.0f - 1.0f, texel[2] * 2.0f - 1.0f };
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 1e-6f)
+				{
+					for (int c = 0; c < 3; c++)
+						texel[c] = n[c] / length * 0.5f + 0.5f;
+				}
+			}
+
+			unsigned char* pixel = pixels + x * channels;
+			for (unsigned int c = 0; c < channels; c++)
+			{
+				if (settings.srgb && c < 3)
+					pixel[c] = static_cast<unsigned char>(std::upper_bound(tables.srgbThresholds, tables.srgbThresholds + 255, texel[c]) - tables.srgbThresholds);
+				else
+					pixel[c] = static_cast<unsigned char>(texel[c] * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	// makes rows [begin, end) of a level, the source rows they read are filtered along x first and then down the columns
+	// loadRow(y, row) fills row with the source texels that horizontal indexes into
+	template <typename LoadRow>
+	void FilterBand(unsigned int begin, unsigned int end, unsigned int width, unsigned int channels, const MipGenerator::Settings& settings,
+		const AxisFilter& horizontal, const AxisFilter& vertical, unsigned int sourceRowLength, const LoadRow& loadRow, float* texels, unsigned char* pixels)
+	{
+		std::vector<int> rows(vertical.indices.begin() + vertical.tapStart[begin], vertical.indices.begin() + vertical.tapStart[end]);
+		std::sort(rows.begin(), rows.end());
+		rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+		std::vector<float> sourceRow(static_cast<size_t>(sourceRowLength) * 4);
+		std::vector<float> filteredRows(rows.size() * width * 4);
+		for (size_t r = 0; r < rows.size(); r++)
+		{
+			loadRow(rows[r], sourceRow.data());
+			FilterRow(sourceRow.data(), horizontal, width, filteredRows.data() + r * width * 4);
+		}
+
+		for (unsigned int y = begin; y < end; y++)
+		{
+			float* row = texels + static_cast<size_t>(y) * width * 4;
+			for (unsigned int x = 0; x < width; x++)
+				_mm_storeu_ps(row + x * 4, _mm_setzero_ps());
+
+			for (unsigned int t = vertical.tapStart[y]; t < vertical.tapStart[y + 1]; t++)
+			{
+				size_t slot = std::lower_bound(rows.begin(), rows.end(), vertical.indices[t]) - rows.begin();
+				const float* source = filteredRows.data() + slot * width * 4;
+				__m128 weight = _mm_set1_ps(vertical.weights[t]);
+				for (unsigned int x = 0; x < width; x++)
+					_mm_storeu_ps(row + x * 4, _mm_add_ps(_mm_loadu_ps(row + x * 4), _mm_mul_ps(weight, _mm_loadu_ps(source + x * 4))));
+			}
+
+			StoreRow(row, width, channels, settings, pixels + static_cast<size_t>(y) * width * channels);
+		}
+	}
+
+	void ForEachBand(ThreadPool* threadPool, size_t bandCount, const ThreadPool::Task& task)
+	{
+		if (threadPool)
+			threadPool->ParallelFor(bandCount, 1, task);
+		else
+			task(0, bandCount);
+	}
+}
+
+
+unsigned int MipGenerator::CountMipLevels(unsigned int width, unsigned int height)
+{
+	unsigned int levels = 1;
+	while ((std::max)(width, height) >> levels) levels++;
+	return levels;
+}
+
+MipGenerator::MipChain MipGenerator::Generate(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels, const Settings& settings, ThreadPool* threadPool)
+{
+	assert((channels == 1 || channels == 4) && "Unsupported channel count!");
+
+	const ColourTables& tables = GetColourTables();
+	SourceLevel source;
+	source.pixels = pixels;
+	source.channels = channels;
+	source.rgbTable = settings.srgb ? tables.srgbToLinear : tables.unormToFloat;
+	source.alphaTable = tables.unormToFloat;
+
+	MipChain chain;
+	std::vector<float> texels, nextTexels;
+	unsigned int levels = CountMipLevels(width, height);
+	for (unsigned int mip = 1; mip < levels; mip++)
+	{
+		unsigned int w = (std::max)(width / 2, 1u);
+		unsigned int h = (std::max)(height / 2, 1u);
+		AxisFilter horizontal = BuildAxisFilter(width, w, settings.filter, true);
+		AxisFilter vertical = BuildAxisFilter(height, h, settings.filter, true);
+
+		nextTexels.resize(static_cast<size_t>(w) * h * 4);
+		chain.emplace_back(static_cast<size_t>(w) * h * channels);
+		unsigned char* levelPixels = chain.back().data();
+
+		unsigned int sourceWidth = width;
+		auto loadRow = [&source, sourceWidth](int y, float* row)
+		{
+			for (unsigned int x = 0; x < sourceWidth; x++)
+				_mm_storeu_ps(row + x * 4, source.Load(static_cast<size_t>(y) * sourceWidth + x));
+		};
+
+		ForEachBand(threadPool, (h + BandHeight - 1) / BandHeight, [&](size_t begin, size_t end)
+		{
+			for (size_t band = begin; band < end; band++)
+			{
+				unsigned int firstRow = static_cast<unsigned int>(band) * BandHeight;
+				FilterBand(firstRow, (std::min)(firstRow + BandHeight, h), w, channels, settings, horizontal, vertical, sourceWidth, loadRow, nextTexels.data(), levelPixels);
+			}
+		});
+
+		// levels after the first are made from the float texels of the one before, not the rounded pixels
+		texels.swap(nextTexels);
+		source.texels = texels.data();
+		width = w;
+		height = h;
+	}
+
+	return chain;
+}
+
+void MipGenerator::GenerateCube(const unsigned char* const faces[6], unsigned int size, const Settings& settings, MipChain faceMips[6], ThreadPool* threadPool)
+{
+	const ColourTables& tables = GetColourTables();
+	SourceLevel sources[6];
+	for (int face = 0; face < 6; face++)
+	{
+		sources[face].pixels = faces[face];
+		sources[face].rgbTable = settings.srgb ? tables.srgbToLinear : tables.unormToFloat;
+		sources[face].alphaTable = tables.unormToFloat;
+		faceMips[face].clear();
+	}
+
+	std::vector<float> texels[6], nextTexels[6];
+	unsigned int levels = CountMipLevels(size, size);
+	for (unsigned int mip = 1; mip < levels; mip++)
+	{
+		unsigned int faceSize = size / 2;
+		// the same filter for both axes, reading the padding around the face
+		AxisFilter filter = BuildAxisFilter(size, faceSize, settings.filter, false, CubePadding);
+
+		for (int face = 0; face < 6; face++)
+		{
+			nextTexels[face].resize(static_cast<size_t>(faceSize) * faceSize * 4);
+			faceMips[face].emplace_back(static_cast<size_t>(faceSize) * faceSize * 4);
+		}
+
+		// every face of the level above has to be there before any are filtered, as they read each other
+		int sourceSize = static_cast<int>(size);
+		unsigned int bandsPerFace = (faceSize + BandHeight - 1) / BandHeight;
+		ForEachBand(threadPool, bandsPerFace * 6, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				int face = static_cast<int>(i / bandsPerFace);
+				auto loadRow = [&sources, face, sourceSize](int paddedY, float* row)
+				{
+					int y = paddedY - CubePadding;
+					for (int paddedX = 0; paddedX < sourceSize + 2 * CubePadding; paddedX++)
+					{
+						int x = paddedX - CubePadding;
+						int sourceFace = face, sourceX = x, sourceY = y;
+						if (x < 0 || y < 0 || x >= sourceSize || y >= sourceSize)
+							FindNeighbourTexel(face, x, y, sourceSize, &sourceFace, &sourceX, &sourceY);
+						_mm_storeu_ps(row + paddedX * 4, sources[sourceFace].Load(static_cast<size_t>(sourceY) * sourceSize + sourceX));
+					}
+				};
+
+				unsigned int firstRow = static_cast<unsigned int>(i % bandsPerFace) * BandHeight;
+				FilterBand(firstRow, (std::min)(firstRow + BandHeight, faceSize), faceSize, 4, settings, filter, filter, sourceSize + 2 * CubePadding, loadRow,
+					nextTexels[face].data(), faceMips[face].back().data());
+			}
+		});
+
+		for (int face = 0; face < 6; face++)
+		{
+			texels[face].swap(nextTexels[face]);
+			sources[face].texels = texels[face].data();
+		}
+		size = faceSize;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+class ThreadPool;
+
+
+// Builds mip chains on the CPU for textures that are loaded without them, so they can be created with every level at once
+// Each level is filtered from the one above it in float, with a separable box or Kaiser windowed sinc filter
+// 4 channels at a time with SSE. Colour data stored as sRGB is averaged in linear space, and normal maps are renormalised
+//
+// Levels are split into bands of rows that are filtered in parallel, each band filtering the rows above it that it needs.
+// Cubemap faces are filtered as one surface: texels that a filter reaches past the edge of a face come from the
+// face next to it, so neighbouring faces agree along their seams at every level
+
+class MipGenerator
+{
+public:
+	enum class Filter { Box, Kaiser };
+
+	struct Settings
+	{
+		Filter filter = Filter::Kaiser;
+		// rgb is stored as sRGB, alpha is always linear
+		bool srgb = false;
+		// rgb is a tangent space normal
+		bool normalMap = false;
+	};
+
+	// the levels after the first, each tightly packed with the channels of the source
+	typedef std::vector<std::vector<unsigned char>> MipChain;
+
+public:
+	// pure static class
+	MipGenerator() = delete;
+
+	// down to and including 1x1
+	static unsigned int CountMipLevels(unsigned int width, unsigned int height);
+
+	// pixels have 1 or 4 channels, tightly packed, and the texture is assumed to tile so the filter wraps around the edges
+	// without a thread pool it all runs on the calling thread, e.g. when called from a job already running on one
+	static MipChain Generate(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels, const Settings& settings, ThreadPool* threadPool = nullptr);
+	// RGBA8 faces of size x size texels, in the Cubemap face order
+	static void GenerateCube(const unsigned char* const faces[6], unsigned int size, const Settings& settings, MipChain faceMips[6], ThreadPool* threadPool = nullptr);
+};
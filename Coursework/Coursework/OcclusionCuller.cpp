@@ -0,0 +1,237 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+#include "TerrainMesh.h"
+
+#include "imGUI/imgui.h"
+
+
+OcclusionCuller::OcclusionCuller(ThreadPool* threadPool, unsigned int width, unsigned int height)
+	: m_Rasterizer(threadPool)
+{
+	m_DepthBuffer.Resize(width, height);
+	m_DepthBuffer.Clear(1.0f);
+	m_TestDepth.resize(static_cast<size_t>(width) * height, 1.0f);
+}
+
+void OcclusionCuller::BeginFrame(const XMMATRIX& view, const XMMATRIX& projection)
+{
+	XMStoreFloat4x4(&m_ViewProjection, view * projection);
+
+	m_Occluders.clear();
+	m_TerrainOccluderCount = 0;
+
+	m_Stats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const SoftwareRasterizer::Mesh* mesh, const XMMATRIX& world)
+{
+	if (!m_Enabled) return;
+
+	SoftwareRasterizer::DrawItem item;
+	item.mesh = mesh;
+	XMStoreFloat4x4(&item.worldViewProjection, world * XMLoadFloat4x4(&m_ViewProjection));
+	m_Occluders.push_back(item);
+}
+
+void OcclusionCuller::AddTerrainOccluder(const TerrainMesh* terrain, const XMMATRIX& world)
+{
+	if (!m_Enabled) return;
+	// nothing to build from until the heightmap has been preprocessed
+	if (terrain->GetPatchMinMax().empty()) return;
+
+	if (m_TerrainOccluderCount == m_TerrainOccluders.size())
+		m_TerrainOccluders.emplace_back();
+
+	SoftwareRasterizer::Mesh& occluder = m_TerrainOccluders[m_TerrainOccluderCount++];
+	BuildTerrainOccluder(terrain, occluder);
+	AddOccluder(&occluder, world);
+}
+
+void OcclusionCuller::RasterizeOccluders()
+{
+	if (!m_Enabled) return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// occluders are closed meshes or a heightfield, so no culling is needed
+	SoftwareRasterizer::RasterizerState state;
+	state.cullMode = SoftwareRasterizer::CullMode::None;
+	state.format = SoftwareRasterizer::DepthFormat::Float32;
+
+	m_DepthBuffer.Clear(1.0f);
+	m_Rasterizer.Render(m_DepthBuffer, m_Occluders, state);
+	DilateDepth();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_Stats.rasterTime = std::chrono::duration<float, std::milli>(end - start).count();
+	m_Stats.occluders = static_cast<int>(m_Occluders.size());
+	m_Stats.occluderTriangles = m_Rasterizer.GetStats().trianglesIn;
+}
+
+bool OcclusionCuller::IsVisible(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMMATRIX& world)
+{
+	if (!m_Enabled) return true;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	m_Stats.tested++;
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, world * XMLoadFloat4x4(&m_ViewProjection));
+
+	// screen space rectangle and nearest depth of the box
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearestDepth = FLT_MAX;
+	bool visible = false;
+	for (int i = 0; i < 8; i++)
+	{
+		float x = (i & 1) ? boundsMax.x : boundsMin.x;
+		float y = (i & 2) ? boundsMax.y : boundsMin.y;
+		float z = (i & 4) ? boundsMax.z : boundsMin.z;
+
+		float cx = x * m._11 + y * m._21 + z * m._31 + m._41;
+		float cy = x * m._12 + y * m._22 + z * m._32 + m._42;
+		float cz = x * m._13 + y * m._23 + z * m._33 + m._43;
+		float cw = x * m._14 + y * m._24 + z * m._34 + m._44;
+
+		// the box crosses the near plane, so it may cover the whole screen
+		if (cz < 0.0f || cw <= 1e-6f)
+		{
+			visible = true;
+			break;
+		}
+
+		float invW = 1.0f / cw;
+		float sx = (cx * invW * 0.5f + 0.5f) * m_DepthBuffer.width;
+		float sy = (0.5f - cy * invW * 0.5f) * m_DepthBuffer.height;
+		minX = (std::min)(minX, sx); maxX = (std::max)(maxX, sx);
+		minY = (std::min)(minY, sy); maxY = (std::max)(maxY, sy);
+		nearestDepth = (std::min)(nearestDepth, cz * invW);
+	}
+
+	if (!visible)
+	{
+		if (maxX < 0.0f || maxY < 0.0f || minX >= m_DepthBuffer.width || minY >= m_DepthBuffer.height || nearestDepth > 1.0f)
+		{
+			m_Stats.outsideView++;
+		}
+		else
+		{
+			// every pixel the rectangle touches
+			int x0 = (std::max)(0, static_cast<int>(std::floor(minX)));
+			int y0 = (std::max)(0, static_cast<int>(std::floor(minY)));
+			int x1 = (std::min)(static_cast<int>(m_DepthBuffer.width) - 1, static_cast<int>(std::floor(maxX)));
+			int y1 = (std::min)(static_cast<int>(m_DepthBuffer.height) - 1, static_cast<int>(std::floor(maxY)));
+
+			for (int y = y0; y <= y1 && !visible; y++)
+			{
+				const float* row = m_TestDepth.data() + static_cast<size_t>(y) * m_DepthBuffer.width;
+				for (int x = x0; x <= x1; x++)
+				{
+					if (nearestDepth <= row[x])
+					{
+						visible = true;
+						break;
+					}
+				}
+			}
+
+			if (!visible) m_Stats.occluded++;
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_Stats.testTime += std::chrono::duration<float, std::milli>(end - start).count();
+	return visible;
+}
+
+void OcclusionCuller::SettingsGUI()
+{
+	ImGui::Checkbox("Enabled", &m_Enabled);
+	ImGui::SliderInt("Terrain patch step", &m_TerrainPatchStep, 1, 8);
+	ImGui::Text("Resolution: %dx%d, AVX2: %s", m_DepthBuffer.width, m_DepthBuffer.height, m_Rasterizer.IsUsingAVX2() ? "yes" : "no");
+	ImGui::Text("Occluders: %d (%d triangles)", m_Stats.occluders, static_cast<int>(m_Stats.occluderTriangles));
+	ImGui::Text("Tested: %d, Occluded: %d, Outside view: %d", m_Stats.tested, m_Stats.occluded, m_Stats.outsideView);
+	ImGui::Text("Raster: %.3f ms, Tests: %.3f ms", m_Stats.rasterTime, m_Stats.testTime);
+}
+
+void OcclusionCuller::BuildTerrainOccluder(const TerrainMesh* terrain, SoftwareRasterizer::Mesh& out)
+{
+	const std::vector<XMFLOAT2>& patches = terrain->GetPatchMinMax();
+	int patchRes = static_cast<int>(terrain->GetPatchResolution());
+	int step = (std::max)(1, (std::min)(m_TerrainPatchStep, patchRes));
+	int n = (patchRes + step - 1) / step;
+	float size = terrain->GetSize();
+
+	// each vertex takes the lowest height of every patch in the quads around it,
+	// so the occluder never rises above the real surface
+	out.positions.resize(static_cast<size_t>(n + 1) * (n + 1));
+	for (int z = 0; z <= n; z++)
+	{
+		int pz0 = (std::max)(0, (z - 1) * step);
+		int pz1 = (std::min)(patchRes, (z + 1) * step);
+		for (int x = 0; x <= n; x++)
+		{
+			int px0 = (std::max)(0, (x - 1) * step);
+			int px1 = (std::min)(patchRes, (x + 1) * step);
+
+			float height = FLT_MAX;
+			for (int pz = pz0; pz < pz1; pz++)
+			{
+				for (int px = px0; px < px1; px++)
+					height = (std::min)(height, patches[px + pz * patchRes].x);
+			}
+
+			float u = (std::min)(1.0f, static_cast<float>(x * step) / patchRes);
+			float v = (std::min)(1.0f, static_cast<float>(z * step) / patchRes);
+			out.positions[x + z * (n + 1)] = { size * (u - 0.5f), height, size * (v - 0.5f) };
+		}
+	}
+
+	out.indices.clear();
+	out.indices.reserve(static_cast<size_t>(n) * n * 6);
+	for (int z = 0; z < n; z++)
+	{
+		for (int x = 0; x < n; x++)
+		{
+			uint32_t i00 = x + z * (n + 1);
+			uint32_t i10 = i00 + 1;
+			uint32_t i01 = i00 + (n + 1);
+			uint32_t i11 = i01 + 1;
+			out.indices.insert(out.indices.end(), { i00, i10, i01, i10, i11, i01 });
+		}
+	}
+}
+
+void OcclusionCuller::DilateDepth()
+{
+	// the occluders are sampled at pixel centres, so take the farthest depth of the neighbouring pixels
+	// to avoid culling objects that are only visible through the edge of a pixel
+	unsigned int w = m_DepthBuffer.width, h = m_DepthBuffer.height;
+	std::vector<float> horizontal(m_DepthBuffer.depth.size());
+	for (unsigned int y = 0; y < h; y++)
+	{
+		const float* src = m_DepthBuffer.depth.data() + y * w;
+		float* dst = horizontal.data() + y * w;
+		for (unsigned int x = 0; x < w; x++)
+		{
+			float d = src[x];
+			if (x > 0) d = (std::max)(d, src[x - 1]);
+			if (x + 1 < w) d = (std::max)(d, src[x + 1]);
+			dst[x] = d;
+		}
+	}
+	for (unsigned int y = 0; y < h; y++)
+	{
+		const float* above = horizontal.data() + (y > 0 ? y - 1 : y) * w;
+		const float* centre = horizontal.data() + y * w;
+		const float* below = horizontal.data() + (y + 1 < h ? y + 1 : y) * w;
+		float* dst = m_TestDepth.data() + y * w;
+		for (unsigned int x = 0; x < w; x++)
+			dst[x] = (std::max)(centre[x], (std::max)(above[x], below[x]));
+	}
+}
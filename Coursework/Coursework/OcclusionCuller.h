@@ -0,0 +1,78 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <vector>
+
+#include "SoftwareRasterizer.h"
+
+using namespace DirectX;
+
+class TerrainMesh;
+class ThreadPool;
+
+
+// Software occlusion culling against a low resolution depth buffer
+// Each frame the occluders (a coarse version of the terrain built from the patch height ranges, plus any meshes marked as occluders)
+// are rasterized from the camera, then object bounds are tested against the result before they are drawn
+//
+// The test is conservative: the occluder depth is dilated by a pixel in every direction before testing,
+// and bounds that cross the near plane are always visible
+
+class OcclusionCuller
+{
+public:
+	struct Stats
+	{
+		int occluders = 0;
+		size_t occluderTriangles = 0;
+		int tested = 0;
+		int occluded = 0;
+		int outsideView = 0;
+		float rasterTime = 0.0f;	// ms
+		float testTime = 0.0f;		// ms
+	};
+
+public:
+	OcclusionCuller(ThreadPool* threadPool, unsigned int width = 320, unsigned int height = 180);
+	~OcclusionCuller() = default;
+
+	// start collecting occluders for the view
+	void BeginFrame(const XMMATRIX& view, const XMMATRIX& projection);
+
+	// occluders must stay alive until RasterizeOccluders
+	void AddOccluder(const SoftwareRasterizer::Mesh* mesh, const XMMATRIX& world);
+	void AddTerrainOccluder(const TerrainMesh* terrain, const XMMATRIX& world);
+
+	void RasterizeOccluders();
+
+	// test a local space bounding box, always true if culling is disabled
+	bool IsVisible(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMMATRIX& world);
+
+	inline bool IsEnabled() const { return m_Enabled; }
+	inline const Stats& GetStats() const { return m_Stats; }
+	inline const SoftwareRasterizer::DepthBuffer& GetDepthBuffer() const { return m_DepthBuffer; }
+
+	void SettingsGUI();
+
+private:
+	void BuildTerrainOccluder(const TerrainMesh* terrain, SoftwareRasterizer::Mesh& out);
+	void DilateDepth();
+
+private:
+	SoftwareRasterizer m_Rasterizer;
+	SoftwareRasterizer::DepthBuffer m_DepthBuffer;
+	// farthest depth in the 3x3 neighbourhood of each pixel, what bounds are tested against
+	std::vector<float> m_TestDepth;
+
+	XMFLOAT4X4 m_ViewProjection;
+	std::vector<SoftwareRasterizer::DrawItem> m_Occluders;
+	std::vector<SoftwareRasterizer::Mesh> m_TerrainOccluders;
+	size_t m_TerrainOccluderCount = 0;
+
+	bool m_Enabled = true;
+	// number of terrain patches along the edge of each occluder quad
+	int m_TerrainPatchStep = 2;
+
+	Stats m_Stats;
+};
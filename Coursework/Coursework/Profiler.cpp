@@ -0,0 +1,323 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <map>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+#include "imGUI/imgui.h"
+
+
+Profiler::Profiler(IGraphicsBackend* backend, size_t historySize)
+	: m_Backend(backend), m_Epoch(std::chrono::steady_clock::now()), m_HistorySize(historySize)
+{
+}
+
+Profiler::~Profiler()
+{
+	for (auto& frame : m_InFlight)
+		ReleaseQueries(frame);
+	ReleaseQueries(m_Current);
+}
+
+void Profiler::BeginFrame()
+{
+	assert(!m_FrameActive && "Profiler frame was not ended!");
+
+	ResolveFrames();
+
+	m_FrameActive = m_Enabled;
+	m_FrameGPU = m_Enabled && m_GPUTiming && m_Backend;
+	if (!m_FrameActive) return;
+
+	m_Current = InFlightFrame();
+	m_Current.timing.frameIndex = m_FrameIndex++;
+	m_Current.timing.cpuStart = Now();
+	m_ScopeStack.clear();
+
+	if (m_FrameGPU)
+	{
+		m_Current.range = m_Backend->BeginTimingRange();
+		m_Current.timestamps.push_back(m_Backend->InsertTimestamp());
+		m_Current.timestamps.push_back(nullptr);	// frame end
+	}
+}
+
+void Profiler::EndFrame()
+{
+	if (!m_FrameActive) return;
+	assert(m_ScopeStack.empty() && "Profiler scopes were not ended!");
+
+	if (m_FrameGPU)
+	{
+		m_Current.timestamps[1] = m_Backend->InsertTimestamp();
+		m_Backend->EndTimingRange(m_Current.range);
+	}
+	m_Current.timing.cpuEnd = Now();
+
+	if (m_FrameGPU)
+	{
+		m_InFlight.push_back(std::move(m_Current));
+
+		// don't let frames pile up if the GPU results never arrive
+		while (m_InFlight.size() > MaxFramesInFlight)
+		{
+			InFlightFrame& oldest = m_InFlight.front();
+			ReleaseQueries(oldest);
+			AddToHistory(std::move(oldest.timing));
+			m_InFlight.pop_front();
+			m_DroppedFrames++;
+		}
+	}
+	else
+		AddToHistory(std::move(m_Current.timing));
+
+	m_Current = InFlightFrame();
+	m_FrameActive = false;
+}
+
+void Profiler::BeginScope(const char* name, int index)
+{
+	if (!m_FrameActive) return;
+
+	ScopeTiming scope;
+	scope.name = name;
+	scope.index = index;
+	scope.depth = static_cast<int>(m_ScopeStack.size());
+
+	m_ScopeStack.push_back(m_Current.timing.scopes.size());
+	if (m_FrameGPU)
+	{
+		m_Current.timestamps.push_back(m_Backend->InsertTimestamp());
+		m_Current.timestamps.push_back(nullptr);
+	}
+
+	// taken last so that inserting the query isn't timed
+	scope.cpuStart = Now();
+	m_Current.timing.scopes.push_back(scope);
+}
+
+void Profiler::EndScope()
+{
+	if (!m_FrameActive) return;
+	assert(!m_ScopeStack.empty() && "Profiler scope ended without being started!");
+
+	size_t scopeIndex = m_ScopeStack.back();
+	m_ScopeStack.pop_back();
+
+	m_Current.timing.scopes[scopeIndex].cpuEnd = Now();
+	if (m_FrameGPU)
+		m_Current.timestamps[3 + 2 * scopeIndex] = m_Backend->InsertTimestamp();
+}
+
+bool Profiler::WriteChromeTrace(const std::string& filename) const
+{
+	// complete events ("X") with times in microseconds
+	// GPU scopes are placed relative to the CPU start of their frame, since the two clocks are not related
+	nlohmann::json events = nlohmann::json::array();
+
+	auto scopeName = [](const ScopeTiming& scope)
+	{
+		std::string name = scope.name;
+		if (scope.index >= 0) name += " " + std::to_string(scope.index);
+		return name;
+	};
+
+	const int cpuThread = 1, gpuThread = 2;
+	events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", cpuThread }, { "args", { { "name", "CPU" } } } });
+	events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", gpuThread }, { "args", { { "name", "GPU" } } } });
+
+	for (const FrameTiming& frame : m_History)
+	{
+		std::string frameName = "Frame " + std::to_string(frame.frameIndex);
+		events.push_back({ { "name", frameName }, { "cat", "CPU" }, { "ph", "X" }, { "pid", 1 }, { "tid", cpuThread },
+			{ "ts", frame.cpuStart * 1000.0 }, { "dur", (frame.cpuEnd - frame.cpuStart) * 1000.0 } });
+		if (frame.gpuValid)
+		{
+			events.push_back({ { "name", frameName }, { "cat", "GPU" }, { "ph", "X" }, { "pid", 1 }, { "tid", gpuThread },
+				{ "ts", frame.cpuStart * 1000.0 }, { "dur", frame.gpuDuration * 1000.0 } });
+		}
+
+		for (const ScopeTiming& scope : frame.scopes)
+		{
+			std::string name = scopeName(scope);
+			events.push_back({ { "name", name }, { "cat", "CPU" }, { "ph", "X" }, { "pid", 1 }, { "tid", cpuThread },
+				{ "ts", scope.cpuStart * 1000.0 }, { "dur", (scope.cpuEnd - scope.cpuStart) * 1000.0 } });
+			if (frame.gpuValid)
+			{
+				events.push_back({ { "name", name }, { "cat", "GPU" }, { "ph", "X" }, { "pid", 1 }, { "tid", gpuThread },
+					{ "ts", (frame.cpuStart + scope.gpuStart) * 1000.0 }, { "dur", (scope.gpuEnd - scope.gpuStart) * 1000.0 } });
+			}
+		}
+	}
+
+	nlohmann::json trace;
+	trace["traceEvents"] = events;
+	trace["displayTimeUnit"] = "ms";
+
+	std::ofstream file(filename);
+	if (!file.is_open()) return false;
+	file << trace.dump();
+	return file.good();
+}
+
+void Profiler::SettingsGUI()
+{
+	ImGui::Checkbox("Enabled", &m_Enabled);
+	ImGui::SameLine();
+	ImGui::Checkbox("GPU timing", &m_GPUTiming);
+	ImGui::SliderInt("Average frames", &m_AverageFrames, 1, static_cast<int>(m_HistorySize));
+
+	ImGui::InputText("Trace file", m_TraceFile, sizeof(m_TraceFile));
+	if (ImGui::Button("Write Chrome trace"))
+	{
+		m_TraceStatus = WriteChromeTrace(m_TraceFile)
+			? "Wrote " + std::to_string(m_History.size()) + " frames"
+			: "Failed to write trace!";
+	}
+	if (!m_TraceStatus.empty())
+		ImGui::Text("%s", m_TraceStatus.c_str());
+	ImGui::Text("Frames in flight: %d, dropped: %d", static_cast<int>(m_InFlight.size()), static_cast<int>(m_DroppedFrames));
+
+	if (m_History.empty()) return;
+
+	// the latest resolved frame decides the rows, times are averaged over the most recent frames
+	// scopes are matched across frames by name, index and depth
+	const FrameTiming& latest = m_History.back();
+	size_t frameCount = std::min(static_cast<size_t>(m_AverageFrames), m_History.size());
+
+	struct Totals { double cpu = 0.0; double gpu = 0.0; int gpuFrames = 0; };
+	typedef std::pair<std::pair<const char*, int>, int> ScopeKey;
+	std::map<ScopeKey, Totals> totals;
+	Totals frameTotals;
+
+	for (size_t i = m_History.size() - frameCount; i < m_History.size(); i++)
+	{
+		const FrameTiming& frame = m_History[i];
+		frameTotals.cpu += frame.cpuEnd - frame.cpuStart;
+		if (frame.gpuValid)
+		{
+			frameTotals.gpu += frame.gpuDuration;
+			frameTotals.gpuFrames++;
+		}
+
+		for (const ScopeTiming& scope : frame.scopes)
+		{
+			Totals& t = totals[{ { scope.name, scope.index }, scope.depth }];
+			t.cpu += scope.cpuEnd - scope.cpuStart;
+			if (frame.gpuValid)
+			{
+				t.gpu += scope.gpuEnd - scope.gpuStart;
+				t.gpuFrames++;
+			}
+		}
+	}
+
+	auto row = [&](const char* name, int index, int depth, const Totals& t)
+	{
+		if (index >= 0)
+			ImGui::Text("%*s%s %d", depth * 2, "", name, index);
+		else
+			ImGui::Text("%*s%s", depth * 2, "", name);
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", t.cpu / frameCount);
+		ImGui::NextColumn();
+		if (t.gpuFrames > 0)
+			ImGui::Text("%.3f", t.gpu / t.gpuFrames);
+		else
+			ImGui::Text("-");
+		ImGui::NextColumn();
+	};
+
+	ImGui::Separator();
+	ImGui::Columns(3, "profiler_columns");
+	ImGui::Text("Scope"); ImGui::NextColumn();
+	ImGui::Text("CPU (ms)"); ImGui::NextColumn();
+	ImGui::Text("GPU (ms)"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	row("Frame", -1, 0, frameTotals);
+	for (const ScopeTiming& scope : latest.scopes)
+		row(scope.name, scope.index, scope.depth + 1, totals[{ { scope.name, scope.index }, scope.depth }]);
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+}
+
+double Profiler::Now() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Epoch).count();
+}
+
+void Profiler::ResolveFrames()
+{
+	// frames resolve in order, so stop at the first that isn't ready
+	while (!m_InFlight.empty())
+	{
+		InFlightFrame& frame = m_InFlight.front();
+		if (!TryResolve(frame)) break;
+
+		ReleaseQueries(frame);
+		AddToHistory(std::move(frame.timing));
+		m_InFlight.pop_front();
+	}
+}
+
+bool Profiler::TryResolve(InFlightFrame& frame)
+{
+	uint64_t frequency = 0;
+	bool disjoint = false;
+	if (!m_Backend->GetTimingRangeData(frame.range, &frequency, &disjoint))
+		return false;
+
+	// the clock changed frequency part way through, so none of the timestamps can be trusted
+	if (disjoint || frequency == 0)
+	{
+		frame.timing.gpuValid = false;
+		return true;
+	}
+
+	std::vector<uint64_t> ticks(frame.timestamps.size());
+	for (size_t i = 0; i < frame.timestamps.size(); i++)
+	{
+		if (!m_Backend->GetTimestampData(frame.timestamps[i], &ticks[i]))
+			return false;
+	}
+
+	auto toMs = [&](uint64_t t)
+	{
+		return static_cast<double>(t - ticks[0]) * 1000.0 / static_cast<double>(frequency);
+	};
+
+	frame.timing.gpuValid = true;
+	frame.timing.gpuDuration = toMs(ticks[1]);
+	for (size_t i = 0; i < frame.timing.scopes.size(); i++)
+	{
+		frame.timing.scopes[i].gpuStart = toMs(ticks[2 + 2 * i]);
+		frame.timing.scopes[i].gpuEnd = toMs(ticks[3 + 2 * i]);
+	}
+	return true;
+}
+
+void Profiler::ReleaseQueries(InFlightFrame& frame)
+{
+	if (!m_Backend) return;
+
+	if (frame.range) m_Backend->ReleaseQuery(frame.range);
+	for (auto query : frame.timestamps)
+	{
+		if (query) m_Backend->ReleaseQuery(query);
+	}
+	frame.range = nullptr;
+	frame.timestamps.clear();
+}
+
+void Profiler::AddToHistory(FrameTiming&& timing)
+{
+	m_History.push_back(std::move(timing));
+	while (m_History.size() > m_HistorySize)
+		m_History.pop_front();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "GraphicsBackend.h"
+
+
+// Hierarchical CPU/GPU frame profiler
+// Scopes are timed on the CPU with a steady clock, and on the GPU with timestamp queries sent through the graphics backend
+// GPU results arrive a few frames late, so each frame is kept in flight until all of its queries have resolved
+//
+// Resolved frames are kept in a history, shown as a table in the GUI, and can be written out as a Chrome trace
+// to be opened in about:tracing. Without a GPU (the null backend) timing ranges are disjoint and only CPU times are kept
+
+class Profiler
+{
+public:
+	struct ScopeTiming
+	{
+		const char* name = nullptr;		// must be a string literal, it is stored without copying
+		int index = -1;					// shown after the name if not -1, e.g. the light a shadow pass is for
+		int depth = 0;
+
+		// ms since the profiler was created
+		double cpuStart = 0.0;
+		double cpuEnd = 0.0;
+		// ms since the start of the frame on the GPU, only valid if the frame has GPU timings
+		double gpuStart = 0.0;
+		double gpuEnd = 0.0;
+	};
+
+	struct FrameTiming
+	{
+		uint64_t frameIndex = 0;
+		double cpuStart = 0.0;
+		double cpuEnd = 0.0;
+		bool gpuValid = false;
+		double gpuDuration = 0.0;
+		std::vector<ScopeTiming> scopes;
+	};
+
+	// times the enclosing block
+	class Scope
+	{
+	public:
+		Scope(Profiler* profiler, const char* name, int index = -1)
+			: m_Profiler(profiler)
+		{
+			m_Profiler->BeginScope(name, index);
+		}
+		~Scope() { m_Profiler->EndScope(); }
+
+	private:
+		Profiler* m_Profiler;
+	};
+
+public:
+	// backend may be null to only time the CPU
+	Profiler(IGraphicsBackend* backend, size_t historySize = 300);
+	~Profiler();
+
+	void BeginFrame();
+	void EndFrame();
+
+	void BeginScope(const char* name, int index = -1);
+	void EndScope();
+
+	// oldest first
+	inline const std::deque<FrameTiming>& GetHistory() const { return m_History; }
+	// the index the next profiled frame will be given
+	inline uint64_t GetNextFrameIndex() const { return m_FrameIndex; }
+
+	inline bool IsEnabled() const { return m_Enabled; }
+	inline void SetEnabled(bool enabled) { m_Enabled = enabled; }
+
+	bool WriteChromeTrace(const std::string& filename) const;
+
+	void SettingsGUI();
+
+private:
+	struct InFlightFrame
+	{
+		FrameTiming timing;
+		IGraphicsBackend::QueryHandle range = nullptr;
+		// frame begin and end, then the begin and end of each scope
+		std::vector<IGraphicsBackend::QueryHandle> timestamps;
+	};
+
+	double Now() const;
+
+	void ResolveFrames();
+	bool TryResolve(InFlightFrame& frame);
+	void ReleaseQueries(InFlightFrame& frame);
+	void AddToHistory(FrameTiming&& timing);
+
+private:
+	IGraphicsBackend* m_Backend = nullptr;
+	std::chrono::steady_clock::time_point m_Epoch;
+
+	// settings from the gui only take effect at the start of the next frame
+	bool m_Enabled = true;
+	bool m_GPUTiming = true;
+	bool m_FrameActive = false;
+	bool m_FrameGPU = false;
+	uint64_t m_FrameIndex = 0;
+
+	InFlightFrame m_Current;
+	std::vector<size_t> m_ScopeStack;
+
+	// frames waiting on GPU results, oldest first
+	std::deque<InFlightFrame> m_InFlight;
+	static const size_t MaxFramesInFlight = 8;
+	size_t m_DroppedFrames = 0;
+
+	std::deque<FrameTiming> m_History;
+	size_t m_HistorySize = 0;
+
+	// gui
+	int m_AverageFrames = 60;
+	char m_TraceFile[128] = "profile.json";
+	std::string m_TraceStatus;
+};
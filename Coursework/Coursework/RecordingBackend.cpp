@@ -0,0 +1,281 @@
+#include "RecordingBackend.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "imGUI/imgui.h"
+
+
+RecordingBackend::RecordingBackend(IGraphicsBackend* target, bool supportsOffsets)
+	: m_Target(target), m_SupportsOffsets(supportsOffsets)
+{
+}
+
+RecordingBackend::~RecordingBackend()
+{
+	// buffers belong to whoever created them, and should have been released already
+	assert(m_NullBufferCount == 0 && "Null backend buffers were not released!");
+}
+
+bool RecordingBackend::SupportsConstantBufferOffsets() const
+{
+	return m_Target ? m_Target->SupportsConstantBufferOffsets() : m_SupportsOffsets;
+}
+
+IGraphicsBackend::BufferHandle RecordingBackend::CreateConstantBuffer(unsigned int byteWidth)
+{
+	Record(CommandType::CreateBuffer, ShaderStage::Vertex, 0, 0, byteWidth);
+	m_Stats.buffersCreated++;
+
+	if (m_Target)
+		return m_Target->CreateConstantBuffer(byteWidth);
+
+	NullBuffer* buffer = new NullBuffer;
+	buffer->data.resize(byteWidth, 0);
+	m_NullBufferCount++;
+	return buffer;
+}
+
+void RecordingBackend::ReleaseBuffer(BufferHandle buffer)
+{
+	if (!buffer) return;
+	Record(CommandType::ReleaseBuffer, ShaderStage::Vertex, 0, 0, 0);
+
+	if (m_Target)
+	{
+		m_Target->ReleaseBuffer(buffer);
+		return;
+	}
+
+	delete static_cast<NullBuffer*>(buffer);
+	m_NullBufferCount--;
+}
+
+void RecordingBackend::UploadBuffer(BufferHandle buffer, UploadMode mode, size_t offset, const void* data, size_t size)
+{
+	Record(CommandType::UploadBuffer, ShaderStage::Vertex, static_cast<unsigned int>(offset), 0, size);
+	m_Stats.uploads++;
+	m_Stats.bytesUploaded += size;
+
+	if (m_Target)
+	{
+		m_Target->UploadBuffer(buffer, mode, offset, data, size);
+		return;
+	}
+
+	NullBuffer* nullBuffer = static_cast<NullBuffer*>(buffer);
+	assert(offset + size <= nullBuffer->data.size() && "Upload is out of the bounds of the buffer!");
+	memcpy(nullBuffer->data.data() + offset, data, size);
+}
+
+void RecordingBackend::BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count,
+	const BufferHandle* buffers, const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	Record(CommandType::BindConstantBuffers, stage, startSlot, count, 0);
+	m_Stats.bindCalls++;
+	m_Stats.constantBufferBinds += count;
+
+	if (m_Target) m_Target->BindConstantBuffers(stage, startSlot, count, buffers, firstConstants, numConstants);
+}
+
+void RecordingBackend::BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ViewHandle* views)
+{
+	Record(CommandType::BindShaderResources, stage, startSlot, count, 0);
+	m_Stats.bindCalls++;
+	m_Stats.shaderResourceBinds += count;
+
+	if (m_Target) m_Target->BindShaderResources(stage, startSlot, count, views);
+}
+
+void RecordingBackend::BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const SamplerHandle* samplers)
+{
+	Record(CommandType::BindSamplers, stage, startSlot, count, 0);
+	m_Stats.bindCalls++;
+	m_Stats.samplerBinds += count;
+
+	if (m_Target) m_Target->BindSamplers(stage, startSlot, count, samplers);
+}
+
+void RecordingBackend::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	Record(CommandType::Draw, ShaderStage::Vertex, startVertex, vertexCount, 0);
+	m_Stats.draws++;
+	m_Stats.primitiveVertices += vertexCount;
+
+	if (m_Target) m_Target->Draw(vertexCount, startVertex);
+}
+
+void RecordingBackend::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	Record(CommandType::DrawIndexed, ShaderStage::Vertex, startIndex, indexCount, 0);
+	m_Stats.draws++;
+	m_Stats.primitiveVertices += indexCount;
+
+	if (m_Target) m_Target->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void RecordingBackend::Dispatch(unsigned int x, unsigned int y, unsigned int z)
+{
+	Record(CommandType::Dispatch, ShaderStage::Compute, 0, x * y * z, 0);
+	m_Stats.dispatches++;
+
+	if (m_Target) m_Target->Dispatch(x, y, z);
+}
+
+IGraphicsBackend::FenceHandle RecordingBackend::InsertFence()
+{
+	Record(CommandType::InsertFence, ShaderStage::Vertex, 0, 0, 0);
+
+	if (m_Target) return m_Target->InsertFence();
+
+	// any non-null handle will do, there is no GPU to wait for
+	return this;
+}
+
+bool RecordingBackend::IsFenceComplete(FenceHandle fence)
+{
+	return m_Target ? m_Target->IsFenceComplete(fence) : true;
+}
+
+void RecordingBackend::ReleaseFence(FenceHandle fence)
+{
+	if (m_Target) m_Target->ReleaseFence(fence);
+}
+
+IGraphicsBackend::QueryHandle RecordingBackend::BeginTimingRange()
+{
+	Record(CommandType::BeginTimingRange, ShaderStage::Vertex, 0, 0, 0);
+
+	if (m_Target) return m_Target->BeginTimingRange();
+	return this;
+}
+
+void RecordingBackend::EndTimingRange(QueryHandle range)
+{
+	Record(CommandType::EndTimingRange, ShaderStage::Vertex, 0, 0, 0);
+
+	if (m_Target) m_Target->EndTimingRange(range);
+}
+
+IGraphicsBackend::QueryHandle RecordingBackend::InsertTimestamp()
+{
+	Record(CommandType::InsertTimestamp, ShaderStage::Vertex, 0, 0, 0);
+
+	if (m_Target) return m_Target->InsertTimestamp();
+	return this;
+}
+
+bool RecordingBackend::GetTimingRangeData(QueryHandle range, uint64_t* frequency, bool* disjoint)
+{
+	if (m_Target) return m_Target->GetTimingRangeData(range, frequency, disjoint);
+
+	// there is no GPU clock, so no timestamps are ever valid
+	*frequency = 1;
+	*disjoint = true;
+	return true;
+}
+
+bool RecordingBackend::GetTimestampData(QueryHandle timestamp, uint64_t* ticks)
+{
+	if (m_Target) return m_Target->GetTimestampData(timestamp, ticks);
+
+	*ticks = 0;
+	return true;
+}
+
+void RecordingBackend::ReleaseQuery(QueryHandle query)
+{
+	if (m_Target) m_Target->ReleaseQuery(query);
+}
+
+void RecordingBackend::ClearLog()
+{
+	m_Log.clear();
+}
+
+void RecordingBackend::WriteLog(std::ostream& out) const
+{
+	for (const Command& command : m_Log)
+	{
+		out << CommandTypeToString(command.type);
+		switch (command.type)
+		{
+		case CommandType::BindConstantBuffers:
+		case CommandType::BindShaderResources:
+		case CommandType::BindSamplers:
+			out << " " << ShaderStageToString(command.stage) << " slot=" << command.slot << " count=" << command.count;
+			break;
+		case CommandType::CreateBuffer:
+			out << " bytes=" << command.bytes;
+			break;
+		case CommandType::UploadBuffer:
+			out << " offset=" << command.slot << " bytes=" << command.bytes;
+			break;
+		case CommandType::Draw:
+		case CommandType::DrawIndexed:
+			out << " start=" << command.slot << " count=" << command.count;
+			break;
+		case CommandType::Dispatch:
+			out << " groups=" << command.count;
+			break;
+		default:
+			break;
+		}
+		out << "\n";
+	}
+}
+
+const void* RecordingBackend::GetBufferData(BufferHandle buffer) const
+{
+	assert(!m_Target && "Buffer data is only available without a target backend!");
+	return static_cast<const NullBuffer*>(buffer)->data.data();
+}
+
+const char* RecordingBackend::CommandTypeToString(CommandType type)
+{
+	switch (type)
+	{
+	case CommandType::CreateBuffer:			return "CreateBuffer";
+	case CommandType::ReleaseBuffer:		return "ReleaseBuffer";
+	case CommandType::UploadBuffer:			return "UploadBuffer";
+	case CommandType::BindConstantBuffers:	return "BindConstantBuffers";
+	case CommandType::BindShaderResources:	return "BindShaderResources";
+	case CommandType::BindSamplers:			return "BindSamplers";
+	case CommandType::Draw:					return "Draw";
+	case CommandType::DrawIndexed:			return "DrawIndexed";
+	case CommandType::Dispatch:				return "Dispatch";
+	case CommandType::InsertFence:			return "InsertFence";
+	case CommandType::BeginTimingRange:		return "BeginTimingRange";
+	case CommandType::EndTimingRange:		return "EndTimingRange";
+	case CommandType::InsertTimestamp:		return "InsertTimestamp";
+	default:								return "Unknown";
+	}
+}
+
+const char* RecordingBackend::ShaderStageToString(ShaderStage stage)
+{
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	return "VS";
+	case ShaderStage::Hull:		return "HS";
+	case ShaderStage::Domain:	return "DS";
+	case ShaderStage::Pixel:	return "PS";
+	case ShaderStage::Compute:	return "CS";
+	default:					return "??";
+	}
+}
+
+void RecordingBackend::SettingsGUI()
+{
+	ImGui::Text("Uploads: %d (%d bytes)", m_Stats.uploads, static_cast<int>(m_Stats.bytesUploaded));
+	ImGui::Text("Bind calls: %d", m_Stats.bindCalls);
+	ImGui::Text("Constant buffers: %d, Resources: %d, Samplers: %d", m_Stats.constantBufferBinds, m_Stats.shaderResourceBinds, m_Stats.samplerBinds);
+	ImGui::Text("Draws: %d, Dispatches: %d", m_Stats.draws, m_Stats.dispatches);
+	ImGui::Text("Buffers created: %d", m_Stats.buffersCreated);
+}
+
+void RecordingBackend::Record(CommandType type, ShaderStage stage, unsigned int slot, unsigned int count, size_t bytes)
+{
+	if (!m_Logging) return;
+	m_Log.push_back({ type, stage, slot, count, bytes });
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <ostream>
+
+#include "GraphicsBackend.h"
+
+
+// Graphics backend that counts every command, and optionally keeps a log of them
+//
+// With a target backend the commands are forwarded after being recorded, so it can sit on top of D3D11Backend in the app
+// Without one it is a null backend: buffers are plain system memory, fences complete immediately,
+// timing ranges always report as disjoint, and draws and dispatches do nothing. This lets frame logic run with no GPU at all
+
+class RecordingBackend : public IGraphicsBackend
+{
+public:
+	enum class CommandType
+	{
+		CreateBuffer,
+		ReleaseBuffer,
+		UploadBuffer,
+		BindConstantBuffers,
+		BindShaderResources,
+		BindSamplers,
+		Draw,
+		DrawIndexed,
+		Dispatch,
+		InsertFence,
+		BeginTimingRange,
+		EndTimingRange,
+		InsertTimestamp
+	};
+
+	struct Command
+	{
+		CommandType type;
+		ShaderStage stage;
+		unsigned int slot;		// start slot for binds, offset for uploads
+		unsigned int count;		// slots bound, or vertices/indices/thread groups for work
+		size_t bytes;			// bytes uploaded or created
+	};
+
+	struct Stats
+	{
+		unsigned int buffersCreated = 0;
+		unsigned int uploads = 0;
+		size_t bytesUploaded = 0;
+
+		unsigned int bindCalls = 0;
+		unsigned int constantBufferBinds = 0;
+		unsigned int shaderResourceBinds = 0;
+		unsigned int samplerBinds = 0;
+
+		unsigned int draws = 0;
+		unsigned int dispatches = 0;
+		size_t primitiveVertices = 0;
+	};
+
+public:
+	// target may be null
+	RecordingBackend(IGraphicsBackend* target = nullptr, bool supportsOffsets = true);
+	virtual ~RecordingBackend();
+
+	virtual bool SupportsConstantBufferOffsets() const override;
+
+	virtual BufferHandle CreateConstantBuffer(unsigned int byteWidth) override;
+	virtual void ReleaseBuffer(BufferHandle buffer) override;
+	virtual void UploadBuffer(BufferHandle buffer, UploadMode mode, size_t offset, const void* data, size_t size) override;
+
+	virtual void BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count,
+		const BufferHandle* buffers, const unsigned int* firstConstants, const unsigned int* numConstants) override;
+	virtual void BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ViewHandle* views) override;
+	virtual void BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const SamplerHandle* samplers) override;
+
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+	virtual void Dispatch(unsigned int x, unsigned int y, unsigned int z) override;
+
+	virtual FenceHandle InsertFence() override;
+	virtual bool IsFenceComplete(FenceHandle fence) override;
+	virtual void ReleaseFence(FenceHandle fence) override;
+
+	virtual QueryHandle BeginTimingRange() override;
+	virtual void EndTimingRange(QueryHandle range) override;
+	virtual QueryHandle InsertTimestamp() override;
+	virtual bool GetTimingRangeData(QueryHandle range, uint64_t* frequency, bool* disjoint) override;
+	virtual bool GetTimestampData(QueryHandle timestamp, uint64_t* ticks) override;
+	virtual void ReleaseQuery(QueryHandle query) override;
+
+	// logging is off by default, only the stats are kept
+	inline void SetLogging(bool logging) { m_Logging = logging; }
+	inline const std::vector<Command>& GetLog() const { return m_Log; }
+	void ClearLog();
+	void WriteLog(std::ostream& out) const;
+
+	inline const Stats& GetStats() const { return m_Stats; }
+	inline void ResetStats() { m_Stats = Stats(); }
+
+	// contents of a buffer created while running without a target
+	const void* GetBufferData(BufferHandle buffer) const;
+
+	static const char* CommandTypeToString(CommandType type);
+	static const char* ShaderStageToString(ShaderStage stage);
+
+	void SettingsGUI();
+
+private:
+	void Record(CommandType type, ShaderStage stage, unsigned int slot, unsigned int count, size_t bytes);
+
+private:
+	IGraphicsBackend* m_Target = nullptr;
+	bool m_SupportsOffsets = true;
+
+	bool m_Logging = false;
+	std::vector<Command> m_Log;
+	Stats m_Stats;
+
+	// system memory buffers when running without a target
+	struct NullBuffer
+	{
+		std::vector<uint8_t> data;
+	};
+	unsigned int m_NullBufferCount = 0;
+};
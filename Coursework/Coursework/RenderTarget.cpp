@@ -1,5 +1,7 @@
 #include "RenderTarget.h"
 
+#include "GPUMemoryTracker.h"
+
 RenderTarget::RenderTarget(ID3D11Device* device, unsigned int width, unsigned int height)
 	: m_Width(width), m_Height(height)
 {
@@ -23,6 +25,7 @@ RenderTarget::RenderTarget(ID3D11Device* device, unsigned int width, unsigned in
 	ID3D11Texture2D* colourBuffer;
 	hr = device->CreateTexture2D(&colourBufferDesc, NULL, &colourBuffer);
 	assert(hr == S_OK);
+	GPUMemoryTracker::Track(colourBuffer, GPUMemoryTracker::Category::RenderTargets, "Render target colour");
 
 	// create render target view
 	D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc;
@@ -69,6 +72,7 @@ RenderTarget::RenderTarget(ID3D11Device* device, unsigned int width, unsigned in
 	ID3D11Texture2D* depthStencilBuffer;
 	hr = device->CreateTexture2D(&depthBufferDesc, NULL, &depthStencilBuffer);
 	assert(hr == S_OK);
+	GPUMemoryTracker::Track(depthStencilBuffer, GPUMemoryTracker::Category::RenderTargets, "Render target depth");
 
 	// create depth/stencil vieww
 	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
@@ -96,6 +100,9 @@ RenderTarget::RenderTarget(ID3D11Device* device, unsigned int width, unsigned in
 
 RenderTarget::~RenderTarget()
 {
+	GPUMemoryTracker::Untrack(m_ColourSRV);
+	GPUMemoryTracker::Untrack(m_DepthSRV);
+
 	if (m_RenderTargetView) m_RenderTargetView->Release();
 	if (m_DepthStencilView) m_DepthStencilView->Release();
 	if (m_ColourSRV) m_ColourSRV->Release();
@@ -0,0 +1,199 @@
+#include "RingBufferAllocator.h"
+
+#include <cassert>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+RingBufferAllocator::RingBufferAllocator(size_t capacity, size_t alignment)
+	: m_Capacity(capacity), m_Alignment(alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of 2!");
+	assert(capacity % alignment == 0 && "Capacity must be a multiple of alignment!");
+}
+
+size_t RingBufferAllocator::Allocate(size_t size)
+{
+	size = Align(size);
+	if (size == 0 || size > m_Capacity - m_Used) return InvalidOffset;
+
+	if (m_Used == 0 && m_Frames.empty())
+	{
+		// ring is empty, so start again from the beginning to avoid fragmenting the end
+		// empty frames still in flight would move the tail back to their old head when released
+		m_Head = 0;
+		m_Tail = 0;
+	}
+
+	size_t offset = InvalidOffset;
+	if (m_Head >= m_Tail)
+	{
+		// free space is [head, capacity) and [0, tail)
+		if (m_Head + size <= m_Capacity)
+		{
+			offset = m_Head;
+		}
+		else if (size <= m_Tail)
+		{
+			// skip the space left at the end of the ring, it is counted as used until this frame is released
+			size_t wasted = m_Capacity - m_Head;
+			m_Used += wasted;
+			m_CurrentFrameSize += wasted;
+			offset = 0;
+		}
+	}
+	else
+	{
+		// free space is [head, tail)
+		if (m_Head + size <= m_Tail)
+			offset = m_Head;
+	}
+
+	if (offset == InvalidOffset) return InvalidOffset;
+
+	m_Head = offset + size;
+	if (m_Head == m_Capacity) m_Head = 0;
+	m_Used += size;
+	m_CurrentFrameSize += size;
+
+	return offset;
+}
+
+void RingBufferAllocator::EndFrame()
+{
+	m_Frames.push_back({ m_Head, m_CurrentFrameSize });
+	m_CurrentFrameSize = 0;
+}
+
+void RingBufferAllocator::ReleaseFrame()
+{
+	if (m_Frames.empty()) return;
+
+	const FrameMark& frame = m_Frames.front();
+	m_Tail = frame.end;
+	m_Used -= frame.size;
+	m_Frames.pop_front();
+}
+
+void RingBufferAllocator::Reset()
+{
+	m_Head = 0;
+	m_Tail = 0;
+	m_Used = 0;
+	m_CurrentFrameSize = 0;
+	m_Frames.clear();
+}
+
+bool RingBufferAllocator::SelfTest()
+{
+	const size_t alignment = 256;
+	bool passed = true;
+	auto check = [&passed](bool condition) { passed = passed && condition; };
+
+	// fill, wrap exactly at the end, and refuse more once full
+	{
+		RingBufferAllocator ring(4 * alignment, alignment);
+		check(ring.Allocate(100) == 0);
+		check(ring.Allocate(alignment) == alignment);
+		ring.EndFrame();
+		check(ring.Allocate(2 * alignment) == 2 * alignment);
+		ring.EndFrame();
+		check(ring.GetUsed() == 4 * alignment);
+		check(ring.Allocate(1) == InvalidOffset);
+
+		// releasing the first frame frees the start of the ring, but not enough for 3 blocks
+		ring.ReleaseFrame();
+		check(ring.GetUsed() == 2 * alignment);
+		check(ring.Allocate(3 * alignment) == InvalidOffset);
+		check(ring.Allocate(alignment) == 0);
+		check(ring.Allocate(alignment) == alignment);
+		check(ring.Allocate(alignment) == InvalidOffset);
+		ring.EndFrame();
+		check(ring.GetFramesInFlight() == 2);
+
+		ring.Reset();
+		check(ring.GetUsed() == 0 && ring.GetFramesInFlight() == 0);
+		check(ring.Allocate(4 * alignment) == 0);
+	}
+
+	// an allocation that doesn't fit before the end skips to the start, and the skipped space is freed with its frame
+	{
+		RingBufferAllocator ring(4 * alignment, alignment);
+		check(ring.Allocate(2 * alignment) == 0);
+		ring.EndFrame();
+		check(ring.Allocate(alignment) == 2 * alignment);
+		ring.EndFrame();
+		ring.ReleaseFrame();
+		check(ring.Allocate(2 * alignment) == 0);
+		check(ring.GetUsed() == 4 * alignment);
+		ring.EndFrame();
+		ring.ReleaseFrame();
+		check(ring.GetUsed() == 3 * alignment);
+		ring.ReleaseFrame();
+		check(ring.GetUsed() == 0 && ring.GetFramesInFlight() == 0);
+		check(ring.Allocate(4 * alignment) == 0);
+	}
+
+	// an empty ring with an empty frame in flight carries on from the head, as releasing that frame moves the tail back
+	// to where the head was. Starting again from 0 would leave the tail past the head and hide free space
+	{
+		RingBufferAllocator ring(4 * alignment, alignment);
+		check(ring.Allocate(3 * alignment) == 0);
+		ring.EndFrame();
+		ring.EndFrame();
+		ring.ReleaseFrame();
+		check(ring.GetUsed() == 0 && ring.GetFramesInFlight() == 1);
+		check(ring.Allocate(alignment) == 3 * alignment);
+		ring.EndFrame();
+		ring.ReleaseFrame();
+		check(ring.Allocate(3 * alignment) == 0);
+	}
+
+	// random frames, some of them empty, checked against which blocks are really in use
+	{
+		const size_t blocks = 16;
+		RingBufferAllocator ring(blocks * alignment, alignment);
+		std::vector<bool> inUse(blocks, false);
+		std::deque<std::vector<std::pair<size_t, size_t>>> frames(1);
+		std::mt19937 random(1);
+
+		for (int step = 0; step < 100000 && passed; step++)
+		{
+			unsigned int action = random() % 8;
+			if (action < 5)
+			{
+				size_t size = 1 + random() % (4 * alignment);
+				size_t offset = ring.Allocate(size);
+				if (offset == InvalidOffset)
+					continue;
+
+				size_t first = offset / alignment;
+				size_t count = ring.Align(size) / alignment;
+				check(offset % alignment == 0 && first + count <= blocks);
+				for (size_t block = first; block < first + count && passed; block++)
+				{
+					check(!inUse[block]);
+					inUse[block] = true;
+				}
+				frames.back().push_back({ first, count });
+			}
+			else if (action < 7)
+			{
+				ring.EndFrame();
+				frames.emplace_back();
+			}
+			else if (frames.size() > 1)
+			{
+				ring.ReleaseFrame();
+				for (const std::pair<size_t, size_t>& allocation : frames.front())
+					for (size_t block = allocation.first; block < allocation.first + allocation.second; block++)
+						inUse[block] = false;
+				frames.pop_front();
+			}
+			check(ring.GetFramesInFlight() == frames.size() - 1);
+		}
+	}
+
+	return passed;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+
+// Sub-allocates aligned ranges from a fixed size ring
+// Has no dependency on D3D, it only hands out offsets
+//
+// Allocations are grouped into frames. EndFrame closes the current frame,
+// and ReleaseFrame returns the oldest closed frame's space to the ring once it is no longer in use
+
+class RingBufferAllocator
+{
+public:
+	static const size_t InvalidOffset = static_cast<size_t>(-1);
+
+	// alignment must be a power of 2
+	RingBufferAllocator(size_t capacity, size_t alignment);
+	~RingBufferAllocator() = default;
+
+	// returns the offset of the allocation, or InvalidOffset if there is not enough free contiguous space
+	size_t Allocate(size_t size);
+
+	void EndFrame();
+	void ReleaseFrame();
+
+	// discard everything, including frames still in flight
+	void Reset();
+
+	inline size_t GetCapacity() const { return m_Capacity; }
+	inline size_t GetAlignment() const { return m_Alignment; }
+	inline size_t GetUsed() const { return m_Used; }
+	inline size_t GetFramesInFlight() const { return m_Frames.size(); }
+
+	inline size_t Align(size_t size) const { return (size + m_Alignment - 1) & ~(m_Alignment - 1); }
+
+	// runs allocators through filling, wrapping, releasing and resetting, and checks that nothing handed out overlaps
+	static bool SelfTest();
+
+private:
+	struct FrameMark
+	{
+		size_t end;		// head position when the frame was closed
+		size_t size;	// bytes consumed by the frame, including space wasted by wrapping
+	};
+
+	size_t m_Capacity;
+	size_t m_Alignment;
+
+	size_t m_Head = 0;		// next free byte
+	size_t m_Tail = 0;		// oldest byte still in use
+	size_t m_Used = 0;
+
+	size_t m_CurrentFrameSize = 0;
+	std::deque<FrameMark> m_Frames;
+};
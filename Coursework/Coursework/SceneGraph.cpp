@@ -0,0 +1,309 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <random>
+
+#include "ThreadPool.h"
+#include "imGUI/imgui.h"
+
+
+SceneGraph::SceneGraph(ThreadPool* threadPool)
+	: m_ThreadPool(threadPool)
+{
+}
+
+SceneGraph::NodeID SceneGraph::CreateNode(NodeID parent)
+{
+	assert((parent == InvalidNode || parent < GetNodeCount()) && "Invalid parent node!");
+
+	NodeID node = static_cast<NodeID>(GetNodeCount());
+
+	m_Parents.push_back(parent);
+	m_Children.emplace_back();
+	if (parent != InvalidNode)
+		m_Children[parent].push_back(node);
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	m_Local.push_back(identity);
+	m_World.push_back(identity);
+
+	m_LocalDirty.push_back(0);
+	m_Depths.push_back(0);
+	m_UpdatedIn.push_back(0);
+	MarkDirty(node);
+
+	m_HierarchyDirty = true;
+
+	return node;
+}
+
+void SceneGraph::SetParent(NodeID node, NodeID parent)
+{
+	assert(node < GetNodeCount() && "Invalid node!");
+	assert((parent == InvalidNode || parent < GetNodeCount()) && "Invalid parent node!");
+	assert(node != parent && !IsAncestor(node, parent) && "Parenting would create a cycle!");
+
+	NodeID oldParent = m_Parents[node];
+	if (oldParent == parent) return;
+
+	// unlink from old parent
+	if (oldParent != InvalidNode)
+	{
+		auto& siblings = m_Children[oldParent];
+		for (auto it = siblings.begin(); it != siblings.end(); it++)
+		{
+			if (*it == node)
+			{
+				siblings.erase(it);
+				break;
+			}
+		}
+	}
+
+	m_Parents[node] = parent;
+	if (parent != InvalidNode)
+		m_Children[parent].push_back(node);
+
+	// the whole subtree needs a new world matrix
+	MarkDirty(node);
+	m_HierarchyDirty = true;
+}
+
+bool SceneGraph::IsAncestor(NodeID ancestor, NodeID node) const
+{
+	if (ancestor == InvalidNode) return false;
+
+	NodeID current = node;
+	while (current != InvalidNode)
+	{
+		current = m_Parents[current];
+		if (current == ancestor) return true;
+	}
+	return false;
+}
+
+void SceneGraph::SetLocalMatrix(NodeID node, const XMMATRIX& local)
+{
+	assert(node < GetNodeCount() && "Invalid node!");
+
+	XMStoreFloat4x4(&m_Local[node], local);
+	MarkDirty(node);
+}
+
+void SceneGraph::UpdateTransforms()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (m_HierarchyDirty)
+		RebuildLevels();
+
+	m_LastUpdatedCount = 0;
+
+	// nothing has moved since last update
+	if (!m_DirtyNodes.empty())
+	{
+		m_Update++;
+
+		m_DirtyLevels.resize(m_LevelCount);
+		for (std::vector<NodeID>& level : m_DirtyLevels)
+			level.clear();
+		size_t deepest = 0;
+		for (NodeID node : m_DirtyNodes)
+		{
+			m_DirtyLevels[m_Depths[node]].push_back(node);
+			deepest = (std::max)(deepest, static_cast<size_t>(m_Depths[node]));
+		}
+		m_DirtyNodes.clear();
+
+		m_PreviousLevel.clear();
+		for (size_t level = 0; level <= deepest || !m_PreviousLevel.empty(); level++)
+		{
+			// the children of every node that moved, and the dirty nodes whose parent didn't (the rest are children already)
+			m_Level.clear();
+			for (NodeID parent : m_PreviousLevel)
+				m_Level.insert(m_Level.end(), m_Children[parent].begin(), m_Children[parent].end());
+			if (level <= deepest)
+			{
+				for (NodeID node : m_DirtyLevels[level])
+				{
+					NodeID parent = m_Parents[node];
+					if (parent == InvalidNode || m_UpdatedIn[parent] != m_Update)
+						m_Level.push_back(node);
+				}
+			}
+
+			// every node in a level only depends on the previous level, so the level can be split freely
+			m_ThreadPool->ParallelFor(m_Level.size(), m_BatchSize, [this](size_t begin, size_t end)
+				{
+					UpdateNodes(m_Level.data() + begin, end - begin);
+				});
+			m_LastUpdatedCount += m_Level.size();
+			m_Level.swap(m_PreviousLevel);
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_LastUpdateTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void SceneGraph::RebuildLevels()
+{
+	// breadth-first traversal from every root, recording the depth of each node
+	m_Level.clear();
+	for (NodeID node = 0; node < GetNodeCount(); node++)
+	{
+		if (m_Parents[node] == InvalidNode)
+			m_Level.push_back(node);
+	}
+
+	size_t visited = 0;
+	m_LevelCount = 0;
+	while (!m_Level.empty())
+	{
+		m_PreviousLevel.clear();
+		for (NodeID node : m_Level)
+		{
+			m_Depths[node] = static_cast<uint32_t>(m_LevelCount);
+			m_PreviousLevel.insert(m_PreviousLevel.end(), m_Children[node].begin(), m_Children[node].end());
+		}
+		visited += m_Level.size();
+		m_LevelCount++;
+		m_Level.swap(m_PreviousLevel);
+	}
+
+	assert(visited == GetNodeCount() && "Scene graph contains a cycle!");
+
+	m_HierarchyDirty = false;
+}
+
+void SceneGraph::MarkDirty(NodeID node)
+{
+	if (!m_LocalDirty[node])
+	{
+		m_LocalDirty[node] = 1;
+		m_DirtyNodes.push_back(node);
+	}
+}
+
+void SceneGraph::UpdateNodes(const NodeID* nodes, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		NodeID node = nodes[i];
+		NodeID parent = m_Parents[node];
+
+		XMMATRIX world = XMLoadFloat4x4(&m_Local[node]);
+		if (parent != InvalidNode)
+			world = world * XMLoadFloat4x4(&m_World[parent]);
+		XMStoreFloat4x4(&m_World[node], world);
+
+		m_LocalDirty[node] = 0;
+		m_UpdatedIn[node] = m_Update;
+	}
+}
+
+void SceneGraph::SettingsGUI()
+{
+	ImGui::Text("Nodes: %d", static_cast<int>(GetNodeCount()));
+	ImGui::Text("Depth: %d", static_cast<int>(m_LevelCount));
+	ImGui::Text("Updated: %d", static_cast<int>(m_LastUpdatedCount));
+	ImGui::Text("Update time: %.3fms", m_LastUpdateTime);
+
+	int batchSize = static_cast<int>(m_BatchSize);
+	if (ImGui::DragInt("Batch Size", &batchSize, 16.0f, 64, 16384))
+		m_BatchSize = static_cast<size_t>(batchSize);
+}
+
+bool SceneGraph::SelfTest(ThreadPool* threadPool)
+{
+	bool passed = true;
+	auto check = [&passed](bool condition) { passed = passed && condition; };
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI), offset(-10.0f, 10.0f);
+	auto randomMatrix = [&]()
+	{
+		return XMMatrixRotationRollPitchYaw(angle(random), angle(random), angle(random)) * XMMatrixTranslation(offset(random), offset(random), offset(random));
+	};
+
+	// 400 platforms, each with 31 props that have 3 attachments, 50k nodes in all
+	SceneGraph graph(threadPool);
+	std::vector<NodeID> roots, props;
+	for (int r = 0; r < 400; r++)
+	{
+		NodeID root = graph.CreateNode();
+		graph.SetLocalMatrix(root, randomMatrix());
+		roots.push_back(root);
+		for (int p = 0; p < 31; p++)
+		{
+			NodeID prop = graph.CreateNode(root);
+			graph.SetLocalMatrix(prop, randomMatrix());
+			props.push_back(prop);
+			for (int a = 0; a < 3; a++)
+				graph.SetLocalMatrix(graph.CreateNode(prop), randomMatrix());
+		}
+	}
+	check(graph.GetNodeCount() == 50000);
+
+	// every world matrix against the product of the local matrices up to its root
+	auto matches = [&graph]()
+	{
+		for (NodeID node = 0; node < graph.GetNodeCount(); node++)
+		{
+			XMMATRIX expected = XMLoadFloat4x4(&graph.m_Local[node]);
+			for (NodeID parent = graph.GetParent(node); parent != InvalidNode; parent = graph.GetParent(parent))
+				expected = expected * XMLoadFloat4x4(&graph.m_Local[parent]);
+
+			XMMATRIX world = graph.GetWorldMatrix(node);
+			for (int row = 0; row < 4; row++)
+			{
+				if (!XMVector4NearEqual(world.r[row], expected.r[row], XMVectorReplicate(1e-4f))) return false;
+			}
+		}
+		return true;
+	};
+
+	graph.UpdateTransforms();
+	check(graph.GetLastUpdatedCount() == 50000 && matches());
+
+	// nothing moved
+	graph.UpdateTransforms();
+	check(graph.GetLastUpdatedCount() == 0);
+
+	// a prop only updates itself and its attachments
+	graph.SetLocalMatrix(props[10], randomMatrix());
+	graph.UpdateTransforms();
+	check(graph.GetLastUpdatedCount() == 4 && matches());
+
+	// an attachment that moved along with its platform is only updated once
+	graph.SetLocalMatrix(graph.GetChildren(props[40])[0], randomMatrix());
+	graph.SetLocalMatrix(graph.GetParent(props[40]), randomMatrix());
+	graph.UpdateTransforms();
+	check(graph.GetLastUpdatedCount() == 125 && matches());
+
+	// moving a prop to another platform
+	graph.SetParent(props[100], roots[200]);
+	graph.UpdateTransforms();
+	check(graph.GetLastUpdatedCount() == 4 && matches());
+
+	// every platform moving, the median of a few updates so one slow frame doesn't fail it
+	std::vector<float> times;
+	for (int i = 0; i < 21; i++)
+	{
+		for (NodeID root : roots)
+			graph.SetLocalMatrix(root, randomMatrix());
+		graph.UpdateTransforms();
+		check(graph.GetLastUpdatedCount() == 50000);
+		times.push_back(graph.GetLastUpdateTime());
+	}
+	check(matches());
+	std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+#ifdef NDEBUG
+	check(times[times.size() / 2] < 1.0f);
+#endif
+
+	return passed;
+}
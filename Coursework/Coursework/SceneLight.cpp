@@ -3,6 +3,7 @@
 #include "imGUI/imgui.h"
 
 #include "ShadowCubemap.h"
+#include "GPUMemoryTracker.h"
 
 
 SceneLight::SceneLight(ID3D11Device* device)
@@ -18,6 +19,7 @@ SceneLight::SceneLight(ID3D11Device* device)
 
 SceneLight::~SceneLight()
 {
+	if (m_ShadowMap) GPUMemoryTracker::Untrack(m_ShadowMap->getDepthMapSRV());
 	if (m_ShadowMap) delete m_ShadowMap;
 	if (m_ShadowCubeMap) delete m_ShadowCubeMap;
 }
@@ -230,6 +232,9 @@ void SceneLight::CreateShadowMap()
 	else
 	{
 		if (!m_ShadowMap)
+		{
 			m_ShadowMap = new ShadowMap(m_Device, 1024, 1024);
+			GPUMemoryTracker::Track(m_ShadowMap->getDepthMapSRV(), GPUMemoryTracker::Category::Shadows, "Shadow map");
+		}
 	}
 }
@@ -6,6 +6,63 @@
 #include "GlobalLighting.h"
 
 
+void ResourceBindings::Invalidate()
+{
+	m_Bound.fill(nullptr);
+	m_Valid = false;
+}
+
+void ResourceBindings::BindPS(IGraphicsBackend* backend, const ResourceBuffer& tex2DBuffer, const ResourceBuffer& texCubeBuffer)
+{
+	std::array<IGraphicsBackend::ViewHandle, 2 * RESOURCE_BUFFER_SIZE> resources;
+	for (size_t i = 0; i < RESOURCE_BUFFER_SIZE; i++)
+	{
+		resources[i] = tex2DBuffer.GetResourcePtr()[i];
+		resources[RESOURCE_BUFFER_SIZE + i] = texCubeBuffer.GetResourcePtr()[i];
+	}
+
+	if (!m_Valid)
+	{
+		// state is unknown, send everything
+		backend->BindShaderResources(ShaderStage::Pixel, 0, 2 * RESOURCE_BUFFER_SIZE, resources.data());
+		m_Bound = resources;
+		m_Valid = true;
+
+		m_SlotsSent += 2 * RESOURCE_BUFFER_SIZE;
+		m_BindCalls++;
+		return;
+	}
+
+	// send each run of changed registers with a single call
+	UINT slot = 0;
+	while (slot < 2 * RESOURCE_BUFFER_SIZE)
+	{
+		if (resources[slot] == m_Bound[slot])
+		{
+			slot++;
+			continue;
+		}
+
+		UINT start = slot;
+		while (slot < 2 * RESOURCE_BUFFER_SIZE && resources[slot] != m_Bound[slot])
+		{
+			m_Bound[slot] = resources[slot];
+			slot++;
+		}
+		backend->BindShaderResources(ShaderStage::Pixel, start, slot - start, resources.data() + start);
+
+		m_SlotsSent += slot - start;
+		m_BindCalls++;
+	}
+}
+
+void ResourceBindings::ResetStats()
+{
+	m_SlotsSent = 0;
+	m_BindCalls = 0;
+}
+
+
 void ShaderUtility::CreateBuffer(ID3D11Device* device, UINT byteWidth, ID3D11Buffer** ppBuffer)
 {
 	assert(byteWidth % 16 == 0 && "Constant buffer byte width must be multiple of 16!");
@@ -79,7 +136,20 @@ void ShaderUtility::ConstructMaterialData(MaterialDataType* matData, const Mater
 	else
 		matData->metalnessMapIndex = -1;
 
-	matData->padding = { 0.0f, 0.0f, 0.0f };
+	matData->occlusion = 1.0f;
+	if (mat->UseORMMap())
+	{
+		matData->ormMapIndex = tex2DBuffer->AddResource(mat->GetORMMap());
+		matData->ormMapMask = mat->GetORMMapMask();
+	}
+	else
+	{
+		matData->ormMapIndex = -1;
+		matData->ormMapMask = { 0.0f, 0.0f, 0.0f };
+	}
+
+	matData->padding = 0.0f;
+	matData->padding2 = 0.0f;
 }
 
 
@@ -145,7 +215,7 @@ void ShaderUtility::ConstructPSLightBuffer(ID3D11DeviceContext* deviceContext, I
 	{
 		bufferPtr->enableEnvironmentalLighting = true;
 
-		bufferPtr->irradianceMapIndex = texCubeBuffer->AddResource(globalLighting->GetIrradianceMap());
+		memcpy(bufferPtr->irradianceSH, globalLighting->GetIrradianceSH(), sizeof(bufferPtr->irradianceSH));
 		bufferPtr->prefilterMapIndex = texCubeBuffer->AddResource(globalLighting->GetPrefilterMap());
 		bufferPtr->brdfIntegrationMapIndex = tex2DBuffer->AddResource(globalLighting->GetBRDFIntegrationMap());
 	}
@@ -155,6 +225,18 @@ void ShaderUtility::ConstructPSLightBuffer(ID3D11DeviceContext* deviceContext, I
 	deviceContext->Unmap(lightBuffer, 0);
 }
 
+void ShaderUtility::FillMaterialBuffer(MaterialBufferType* matBuffer, Material* const* mats, size_t matCount, ResourceBuffer* tex2DBuffer)
+{
+	// unused slots are zeroed so that filled buffers can be compared byte-for-byte
+	memset(matBuffer, 0, sizeof(MaterialBufferType));
+
+	for (size_t i = 0; i < min(matCount, MAX_MATERIALS); i++)
+		ConstructMaterialData(&matBuffer->materials[i], mats[i], tex2DBuffer);
+
+	matBuffer->materialCount = static_cast<int>(matCount);
+	matBuffer->padding = { 0.0f, 0.0f, 0.0f };
+}
+
 void ShaderUtility::ConstructMaterialBuffer(ID3D11DeviceContext* deviceContext, ID3D11Buffer* matBuffer, Material* const* mats, size_t matCount, ResourceBuffer* tex2DBuffer)
 {
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
@@ -162,11 +244,7 @@ void ShaderUtility::ConstructMaterialBuffer(ID3D11DeviceContext* deviceContext,
 	assert(hr == S_OK);
 	MaterialBufferType* bufferPtr = reinterpret_cast<MaterialBufferType*>(mappedResource.pData);
 
-	for (size_t i = 0; i < min(matCount, MAX_MATERIALS); i++)
-		ConstructMaterialData(&bufferPtr->materials[i], mats[i], tex2DBuffer);
-
-	bufferPtr->materialCount = static_cast<int>(matCount);
-	bufferPtr->padding = { 0.0f, 0.0f, 0.0f };
+	FillMaterialBuffer(bufferPtr, mats, matCount, tex2DBuffer);
 
 	deviceContext->Unmap(matBuffer, 0);
 }
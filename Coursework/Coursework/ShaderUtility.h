@@ -4,9 +4,12 @@
 #include <DirectXMath.h>
 #include "DXF.h"
 
+#include "GraphicsBackend.h"
+
 using namespace DirectX;
 
 #include <cassert>
+#include <cstdint>
 #include <array>
 
 class Material;
@@ -16,23 +19,40 @@ class GlobalLighting;
 // constants defining array sizes
 #define MAX_LIGHTS 4
 #define MAX_MATERIALS 8
-#define RESOURCE_BUFFER_SIZE 24
+#define MAX_TERRAIN_LAYERS 16
+#define RESOURCE_BUFFER_SIZE 32
+// must be a power of 2, and larger than RESOURCE_BUFFER_SIZE to keep probe sequences short
+#define RESOURCE_BUFFER_HASH_SIZE 64
 
 // a resource buffer is used to dynamically map textures to registers in shaders
 // the AddResource method gives an index through which the resource can be accessed in the shader
+// adding a resource that is already in the buffer gives back its existing index, so shared textures only take one register
 class ResourceBuffer
 {
 public:
 	ResourceBuffer()
 	{
 		m_Resources.fill(nullptr);
+		m_HashTable.fill(-1);
 	}
 	~ResourceBuffer() = default;
 
 	inline int AddResource(ID3D11ShaderResourceView* resource)
 	{ 
+		assert(resource && "Adding null resource to resource buffer!");
+
+		// open addressing with linear probing, keyed by the resource pointer
+		size_t h = Hash(resource);
+		while (m_HashTable[h] != -1)
+		{
+			if (m_Resources[m_HashTable[h]] == resource)
+				return m_HashTable[h];
+			h = (h + 1) & (RESOURCE_BUFFER_HASH_SIZE - 1);
+		}
+
 		assert(m_Count < RESOURCE_BUFFER_SIZE && "Overfilling resource buffer!");
 		m_Resources[m_Count] = resource; 
+		m_HashTable[h] = static_cast<int>(m_Count);
 		return static_cast<int>(m_Count++);
 	}
 
@@ -41,13 +61,52 @@ public:
 		ID3D11ShaderResourceView* const& srv = m_Resources.at(0); 
 		return &srv;
 	}
+	inline size_t GetCount() const { return m_Count; }
+
+private:
+	static inline size_t Hash(const ID3D11ShaderResourceView* resource)
+	{
+		// views are heap allocated, so the low bits carry little information
+		uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(resource));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return static_cast<size_t>(h) & (RESOURCE_BUFFER_HASH_SIZE - 1);
+	}
 
 private:
 	std::array<ID3D11ShaderResourceView*, RESOURCE_BUFFER_SIZE> m_Resources;
+	std::array<int, RESOURCE_BUFFER_HASH_SIZE> m_HashTable;
 	size_t m_Count = 0;
 };
 
 
+// tracks what is bound to the pixel shader resource buffer registers (tex2D then texCube)
+// so that consecutive draws only re-send the registers that changed
+class ResourceBindings
+{
+public:
+	ResourceBindings() { Invalidate(); }
+	~ResourceBindings() = default;
+
+	// must be called if anything else has bound pixel shader resources since the last Bind
+	void Invalidate();
+	void BindPS(IGraphicsBackend* backend, const ResourceBuffer& tex2DBuffer, const ResourceBuffer& texCubeBuffer);
+
+	// stats
+	inline unsigned int GetSlotsSent() const { return m_SlotsSent; }
+	inline unsigned int GetBindCalls() const { return m_BindCalls; }
+	void ResetStats();
+
+private:
+	std::array<IGraphicsBackend::ViewHandle, 2 * RESOURCE_BUFFER_SIZE> m_Bound;
+	bool m_Valid = false;
+
+	unsigned int m_SlotsSent = 0;
+	unsigned int m_BindCalls = 0;
+};
+
+
 class ShaderUtility
 {
 public:
@@ -84,7 +143,14 @@ public:
 
 		int normalMapIndex;
 
-		XMFLOAT3 padding;
+		// occlusion, roughness and metalness in one map, replaces the roughness and metalness maps
+		int ormMapIndex;
+		float occlusion;
+		float padding;
+
+		// 1 for the channels taken from the ORM map, the others use the values above
+		XMFLOAT3 ormMapMask;
+		float padding2;
 	};
 
 	struct VSLightBufferType
@@ -108,11 +174,11 @@ public:
 
 		int lightCount;
 		bool enableEnvironmentalLighting;
-		int irradianceMapIndex;
 		int prefilterMapIndex;
-
 		int brdfIntegrationMapIndex;
-		XMFLOAT3 padding;
+
+		// see GlobalLighting::GetIrradianceSH
+		XMFLOAT4 irradianceSH[9];
 	};
 
 	struct MaterialBufferType
@@ -143,6 +209,7 @@ public:
 		ResourceBuffer* tex2DBuffer, ResourceBuffer* texCubeBuffer);
 
 	// populate material constant buffers
+	static void FillMaterialBuffer(MaterialBufferType* matBuffer, Material* const* mats, size_t matCount, ResourceBuffer* tex2DBuffer);
 	static void ConstructMaterialBuffer(ID3D11DeviceContext* deviceContext, ID3D11Buffer* matBuffer,
 		Material* const* mats, size_t matCount,
 		ResourceBuffer* tex2DBuffer);
@@ -1,10 +1,14 @@
 #include "ShadowCubeMap.h"
 
+#include "GPUMemoryTracker.h"
+
 ShadowCubemap::ShadowCubemap(ID3D11Device* device, unsigned int resolution)
 	: Cubemap(device, resolution, true, 1, DXGI_FORMAT_R32_TYPELESS, DXGI_FORMAT_R32_FLOAT, D3D11_BIND_DEPTH_STENCIL)
 {
 	HRESULT hr;
 
+	GPUMemoryTracker::Track(m_CubemapTexture, GPUMemoryTracker::Category::Shadows, "Shadow cubemap");
+
 	// create a RTV for each face
 	for (int i = 0; i < 6; i++)
 	{
@@ -3,8 +3,8 @@
 #include "Cubemap.h"
 
 
-Skybox::Skybox(ID3D11Device* device, Cubemap* cubemap)
-	: m_Device(device), m_Cubemap(cubemap)
+Skybox::Skybox(ID3D11Device* device, IGraphicsBackend* backend, Cubemap* cubemap)
+	: m_Device(device), m_Backend(backend), m_Cubemap(cubemap)
 {
 	m_CubeMesh = new CubeMesh(device, nullptr, 1);
 
@@ -106,7 +106,7 @@ void Skybox::Render(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, c
 	deviceContext->VSSetShader(m_VS, nullptr, 0);
 	deviceContext->PSSetShader(m_PS, nullptr, 0);
 
-	deviceContext->DrawIndexed(m_CubeMesh->getIndexCount(), 0, 0);
+	m_Backend->DrawIndexed(m_CubeMesh->getIndexCount(), 0, 0);
 
 	deviceContext->VSSetShader(nullptr, nullptr, 0);
 	deviceContext->PSSetShader(nullptr, nullptr, 0);
@@ -6,6 +6,7 @@
 using namespace DirectX;
 
 #include "DXF.h"
+#include "GraphicsBackend.h"
 
 class Cubemap;
 
@@ -20,7 +21,7 @@ class Skybox
 	};
 
 public:
-	Skybox(ID3D11Device* device, Cubemap* cubemap);
+	Skybox(ID3D11Device* device, IGraphicsBackend* backend, Cubemap* cubemap);
 	~Skybox();
 
 	void Render(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection);
@@ -33,6 +34,7 @@ private:
 
 private:
 	ID3D11Device* m_Device = nullptr;
+	IGraphicsBackend* m_Backend = nullptr;
 
 	CubeMesh* m_CubeMesh = nullptr;
 	Cubemap* m_Cubemap = nullptr;
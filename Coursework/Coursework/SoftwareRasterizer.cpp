@@ -0,0 +1,462 @@
+#include "SoftwareRasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cassert>
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "ThreadPool.h"
+
+// the AVX2 path is compiled for every build and only selected at runtime
+#if defined(_MSC_VER)
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+
+namespace
+{
+	// clip space vertex with the plane distances needed for clipping
+	struct ClipVertex
+	{
+		float x, y, z, w;
+	};
+
+	ClipVertex LerpVertex(const ClipVertex& a, const ClipVertex& b, float t)
+	{
+		return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+	}
+
+	// Sutherland-Hodgman against a single plane, where distance(v) >= 0 is inside
+	template<typename DistanceFunc>
+	int ClipPolygon(const ClipVertex* in, int inCount, ClipVertex* out, DistanceFunc distance)
+	{
+		int outCount = 0;
+		for (int i = 0; i < inCount; i++)
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % inCount];
+			float da = distance(a);
+			float db = distance(b);
+
+			if (da >= 0.0f) out[outCount++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				out[outCount++] = LerpVertex(a, b, da / (da - db));
+		}
+		return outCount;
+	}
+
+	XMFLOAT4 Transform(const XMFLOAT3& p, const XMFLOAT4X4& m)
+	{
+		return {
+			p.x * m._11 + p.y * m._21 + p.z * m._31 + m._41,
+			p.x * m._12 + p.y * m._22 + p.z * m._32 + m._42,
+			p.x * m._13 + p.y * m._23 + p.z * m._33 + m._43,
+			p.x * m._14 + p.y * m._24 + p.z * m._34 + m._44
+		};
+	}
+
+	// D3D snaps vertex positions to 8 bits of sub-pixel precision
+	inline double Snap(double v)
+	{
+		return std::floor(v * 256.0 + 0.5) / 256.0;
+	}
+
+	const float Unorm24Max = 16777215.0f;
+}
+
+
+const bool SoftwareRasterizer::s_AVX2Supported = SoftwareRasterizer::DetectAVX2();
+
+
+void SoftwareRasterizer::DepthBuffer::Resize(unsigned int w, unsigned int h)
+{
+	width = w;
+	height = h;
+	depth.resize(static_cast<size_t>(w) * h);
+}
+
+void SoftwareRasterizer::DepthBuffer::Clear(float value)
+{
+	std::fill(depth.begin(), depth.end(), value);
+}
+
+
+SoftwareRasterizer::SoftwareRasterizer(ThreadPool* threadPool)
+	: m_ThreadPool(threadPool), m_UseAVX2(s_AVX2Supported)
+{
+}
+
+void SoftwareRasterizer::Render(DepthBuffer& target, const std::vector<DrawItem>& items, const RasterizerState& state)
+{
+	m_Stats = Stats();
+	if (target.width == 0 || target.height == 0) return;
+
+	auto setupStart = std::chrono::high_resolution_clock::now();
+
+	// triangles are numbered across all items, and batches are fixed size ranges of those numbers
+	m_ItemFirstTriangle.resize(items.size() + 1);
+	m_ItemFirstTriangle[0] = 0;
+	for (size_t i = 0; i < items.size(); i++)
+		m_ItemFirstTriangle[i + 1] = m_ItemFirstTriangle[i] + items[i].mesh->indices.size() / 3;
+	m_Stats.trianglesIn = m_ItemFirstTriangle.back();
+
+	m_TilesX = (target.width + TileSize - 1) / TileSize;
+	m_TilesY = (target.height + TileSize - 1) / TileSize;
+	size_t tileCount = static_cast<size_t>(m_TilesX) * m_TilesY;
+
+	size_t batchCount = (m_Stats.trianglesIn + BatchSize - 1) / BatchSize;
+	if (m_Batches.size() < batchCount) m_Batches.resize(batchCount);
+	for (size_t b = 0; b < batchCount; b++)
+	{
+		Batch& batch = m_Batches[b];
+		batch.triangles.clear();
+		batch.bins.resize(tileCount);
+		for (auto& bin : batch.bins)
+			bin.clear();
+		batch.culled = 0;
+		batch.clipped = 0;
+	}
+
+	// set up and bin triangles
+	auto setupTask = [&](size_t begin, size_t end)
+	{
+		for (size_t b = begin; b < end; b++)
+			SetupBatch(b, items, state, target.width, target.height);
+	};
+	if (m_ThreadPool)
+		m_ThreadPool->ParallelFor(batchCount, 1, setupTask);
+	else
+		setupTask(0, batchCount);
+
+	for (size_t b = 0; b < batchCount; b++)
+	{
+		const Batch& batch = m_Batches[b];
+		m_Stats.trianglesCulled += batch.culled;
+		m_Stats.trianglesClipped += batch.clipped;
+		m_Stats.trianglesBinned += batch.triangles.size();
+		for (const auto& bin : batch.bins)
+			m_Stats.binEntries += bin.size();
+	}
+
+	auto rasterStart = std::chrono::high_resolution_clock::now();
+
+	// rasterize tiles, each tile only touches its own pixels
+	bool quantize = state.format == DepthFormat::Unorm24;
+	m_BatchCount = batchCount;
+	auto rasterTask = [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+			RasterizeTile(t, target, quantize);
+	};
+	if (m_ThreadPool)
+		m_ThreadPool->ParallelFor(tileCount, 1, rasterTask);
+	else
+		rasterTask(0, tileCount);
+
+	auto rasterEnd = std::chrono::high_resolution_clock::now();
+	m_Stats.setupTime = std::chrono::duration<float, std::milli>(rasterStart - setupStart).count();
+	m_Stats.rasterTime = std::chrono::duration<float, std::milli>(rasterEnd - rasterStart).count();
+}
+
+void SoftwareRasterizer::SetupBatch(size_t batchIndex, const std::vector<DrawItem>& items, const RasterizerState& state, unsigned int width, unsigned int height)
+{
+	Batch& batch = m_Batches[batchIndex];
+
+	size_t first = batchIndex * BatchSize;
+	size_t last = std::min(first + BatchSize, m_ItemFirstTriangle.back());
+
+	// find the item containing the first triangle of the batch
+	size_t item = std::upper_bound(m_ItemFirstTriangle.begin(), m_ItemFirstTriangle.end(), first) - m_ItemFirstTriangle.begin() - 1;
+
+	for (size_t t = first; t < last; t++)
+	{
+		while (t >= m_ItemFirstTriangle[item + 1]) item++;
+
+		const Mesh& mesh = *items[item].mesh;
+		const XMFLOAT4X4& m = items[item].worldViewProjection;
+		size_t i = (t - m_ItemFirstTriangle[item]) * 3;
+
+		XMFLOAT4 clip[3] = {
+			Transform(mesh.positions[mesh.indices[i + 0]], m),
+			Transform(mesh.positions[mesh.indices[i + 1]], m),
+			Transform(mesh.positions[mesh.indices[i + 2]], m)
+		};
+		SetupTriangle(batch, clip, state, width, height);
+	}
+}
+
+void SoftwareRasterizer::SetupTriangle(Batch& batch, const XMFLOAT4* clip, const RasterizerState& state, unsigned int width, unsigned int height)
+{
+	ClipVertex polygon[2][8];
+	int count = 3;
+	for (int i = 0; i < 3; i++)
+		polygon[0][i] = { clip[i].x, clip[i].y, clip[i].z, clip[i].w };
+
+	bool needsClipping = false;
+	for (int i = 0; i < 3; i++)
+	{
+		const ClipVertex& v = polygon[0][i];
+		if (state.depthClipEnable ? (v.z < 0.0f || v.z > v.w) : (v.w <= 0.0f))
+			needsClipping = true;
+	}
+
+	int current = 0;
+	if (needsClipping)
+	{
+		batch.clipped++;
+		if (state.depthClipEnable)
+		{
+			count = ClipPolygon(polygon[0], count, polygon[1], [](const ClipVertex& v) { return v.z; });
+			count = ClipPolygon(polygon[1], count, polygon[0], [](const ClipVertex& v) { return v.w - v.z; });
+		}
+		else
+		{
+			count = ClipPolygon(polygon[0], count, polygon[1], [](const ClipVertex& v) { return v.w - 1e-6f; });
+			current = 1;
+		}
+		if (count < 3)
+		{
+			batch.culled++;
+			return;
+		}
+	}
+
+	// project to pixel space, y down, snapped to the sub-pixel grid
+	double sx[8], sy[8], sz[8];
+	for (int i = 0; i < count; i++)
+	{
+		const ClipVertex& v = polygon[current][i];
+		double invW = 1.0 / v.w;
+		sx[i] = Snap((v.x * invW * 0.5 + 0.5) * width);
+		sy[i] = Snap((0.5 - v.y * invW * 0.5) * height);
+		sz[i] = v.z * invW;
+		if (!state.depthClipEnable) sz[i] = std::min(std::max(sz[i], 0.0), 1.0);
+	}
+
+	// clipping can produce a convex polygon, which is drawn as a fan
+	for (int f = 1; f + 1 < count; f++)
+	{
+		int v0 = 0, v1 = f, v2 = f + 1;
+
+		// positive area is clockwise on screen
+		double area = (sx[v1] - sx[v0]) * (sy[v2] - sy[v0]) - (sy[v1] - sy[v0]) * (sx[v2] - sx[v0]);
+		if (area == 0.0)
+		{
+			batch.culled++;
+			continue;
+		}
+
+		bool frontFacing = state.frontCounterClockwise ? area < 0.0 : area > 0.0;
+		if ((state.cullMode == CullMode::Back && !frontFacing) || (state.cullMode == CullMode::Front && frontFacing))
+		{
+			batch.culled++;
+			continue;
+		}
+
+		// make the winding clockwise so that the edge functions are positive inside
+		if (area < 0.0)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		// pixels whose centres are inside the bounds
+		double minX = std::min({ sx[v0], sx[v1], sx[v2] });
+		double maxX = std::max({ sx[v0], sx[v1], sx[v2] });
+		double minY = std::min({ sy[v0], sy[v1], sy[v2] });
+		double maxY = std::max({ sy[v0], sy[v1], sy[v2] });
+
+		TriangleSetup tri;
+		tri.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5)));
+		tri.maxX = std::min(static_cast<int>(width) - 1, static_cast<int>(std::floor(maxX - 0.5)));
+		tri.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5)));
+		tri.maxY = std::min(static_cast<int>(height) - 1, static_cast<int>(std::floor(maxY - 0.5)));
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+		{
+			batch.culled++;
+			continue;
+		}
+
+		const int v[3] = { v0, v1, v2 };
+		for (int e = 0; e < 3; e++)
+		{
+			int a = v[e];
+			int b = v[(e + 1) % 3];
+			tri.a[e] = -(sy[b] - sy[a]);
+			tri.b[e] = sx[b] - sx[a];
+			tri.c[e] = (sy[b] - sy[a]) * sx[a] - (sx[b] - sx[a]) * sy[a];
+		}
+
+		double dz1 = sz[v1] - sz[v0];
+		double dz2 = sz[v2] - sz[v0];
+		tri.dzdx = (dz1 * (sy[v2] - sy[v0]) - dz2 * (sy[v1] - sy[v0])) / area;
+		tri.dzdy = (dz2 * (sx[v1] - sx[v0]) - dz1 * (sx[v2] - sx[v0])) / area;
+		tri.z0 = sz[v0] - tri.dzdx * sx[v0] - tri.dzdy * sy[v0];
+
+		// depth bias, as defined by the D3D11 functional spec
+		double maxDepthSlope = std::max(std::abs(tri.dzdx), std::abs(tri.dzdy));
+		double r;
+		if (state.format == DepthFormat::Unorm24)
+			r = 1.0 / 16777216.0;
+		else
+		{
+			// 2^(exponent(max z in primitive) - 23)
+			double maxZ = std::max({ std::abs(sz[v0]), std::abs(sz[v1]), std::abs(sz[v2]) });
+			int exponent = 0;
+			std::frexp(maxZ, &exponent);
+			r = maxZ > 0.0 ? std::ldexp(1.0, exponent - 1 - 23) : 0.0;
+		}
+		double bias = state.depthBias * r + state.slopeScaledDepthBias * maxDepthSlope;
+		if (state.depthBiasClamp > 0.0f) bias = std::min(bias, static_cast<double>(state.depthBiasClamp));
+		else if (state.depthBiasClamp < 0.0f) bias = std::max(bias, static_cast<double>(state.depthBiasClamp));
+		tri.z0 += bias;
+
+		uint32_t index = static_cast<uint32_t>(batch.triangles.size());
+		batch.triangles.push_back(tri);
+
+		// bin into every tile overlapped by the bounds
+		int tileMinX = tri.minX / TileSize, tileMaxX = tri.maxX / TileSize;
+		int tileMinY = tri.minY / TileSize, tileMaxY = tri.maxY / TileSize;
+		for (int ty = tileMinY; ty <= tileMaxY; ty++)
+		{
+			for (int tx = tileMinX; tx <= tileMaxX; tx++)
+				batch.bins[ty * m_TilesX + tx].push_back(index);
+		}
+	}
+}
+
+void SoftwareRasterizer::RasterizeTile(size_t tileIndex, DepthBuffer& target, bool quantize)
+{
+	int tileX = static_cast<int>(tileIndex % m_TilesX) * TileSize;
+	int tileY = static_cast<int>(tileIndex / m_TilesX) * TileSize;
+	int tileMaxX = std::min(tileX + static_cast<int>(TileSize), static_cast<int>(target.width)) - 1;
+	int tileMaxY = std::min(tileY + static_cast<int>(TileSize), static_cast<int>(target.height)) - 1;
+
+	for (size_t b = 0; b < m_BatchCount; b++)
+	{
+		const Batch& batch = m_Batches[b];
+		for (uint32_t index : batch.bins[tileIndex])
+		{
+			const TriangleSetup& tri = batch.triangles[index];
+			int x0 = std::max(tri.minX, tileX);
+			int y0 = std::max(tri.minY, tileY);
+			int x1 = std::min(tri.maxX, tileMaxX);
+			int y1 = std::min(tri.maxY, tileMaxY);
+
+			if (m_UseAVX2)
+				RasterizeAVX2(tri, x0, y0, x1, y1, target, quantize);
+			else
+				RasterizeScalar(tri, x0, y0, x1, y1, target, quantize);
+		}
+	}
+}
+
+void SoftwareRasterizer::RasterizeScalar(const TriangleSetup& tri, int x0, int y0, int x1, int y1, DepthBuffer& target, bool quantize)
+{
+	for (int y = y0; y <= y1; y++)
+	{
+		double py = y + 0.5;
+		float* row = target.depth.data() + static_cast<size_t>(y) * target.width;
+
+		for (int x = x0; x <= x1; x++)
+		{
+			double px = x + 0.5;
+			if (tri.a[0] * px + tri.b[0] * py + tri.c[0] < 0.0) continue;
+			if (tri.a[1] * px + tri.b[1] * py + tri.c[1] < 0.0) continue;
+			if (tri.a[2] * px + tri.b[2] * py + tri.c[2] < 0.0) continue;
+
+			float z = static_cast<float>(tri.z0 + tri.dzdx * px + tri.dzdy * py);
+			z = std::min(std::max(z, 0.0f), 1.0f);
+			if (quantize) z = std::floor(z * Unorm24Max + 0.5f) / Unorm24Max;
+
+			if (z < row[x]) row[x] = z;
+		}
+	}
+}
+
+AVX2_FUNCTION
+void SoftwareRasterizer::RasterizeAVX2(const TriangleSetup& tri, int x0, int y0, int x1, int y1, DepthBuffer& target, bool quantize)
+{
+	const __m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	const __m256i laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 unormMax = _mm256_set1_ps(Unorm24Max);
+	const __m256 invUnormMax = _mm256_set1_ps(1.0f / Unorm24Max);
+
+	// per-pixel steps are exact enough in float, the absolute values are evaluated in double for each block
+	const __m256 a0 = _mm256_set1_ps(static_cast<float>(tri.a[0]));
+	const __m256 a1 = _mm256_set1_ps(static_cast<float>(tri.a[1]));
+	const __m256 a2 = _mm256_set1_ps(static_cast<float>(tri.a[2]));
+	const __m256 dzdx = _mm256_set1_ps(static_cast<float>(tri.dzdx));
+	const __m256 stepA0 = _mm256_mul_ps(a0, laneOffsets);
+	const __m256 stepA1 = _mm256_mul_ps(a1, laneOffsets);
+	const __m256 stepA2 = _mm256_mul_ps(a2, laneOffsets);
+	const __m256 stepZ = _mm256_mul_ps(dzdx, laneOffsets);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		double py = y + 0.5;
+		float* row = target.depth.data() + static_cast<size_t>(y) * target.width;
+
+		double rowE0 = tri.b[0] * py + tri.c[0];
+		double rowE1 = tri.b[1] * py + tri.c[1];
+		double rowE2 = tri.b[2] * py + tri.c[2];
+		double rowZ = tri.z0 + tri.dzdy * py;
+
+		for (int x = x0; x <= x1; x += 8)
+		{
+			double px = x + 0.5;
+
+			__m256 e0 = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(tri.a[0] * px + rowE0)), stepA0);
+			__m256 e1 = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(tri.a[1] * px + rowE1)), stepA1);
+			__m256 e2 = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(tri.a[2] * px + rowE2)), stepA2);
+
+			__m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+
+			// lanes past the end of the span are masked off, so memory past the row is never touched
+			__m256i span = _mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x + 1), laneIndices);
+			__m256i mask = _mm256_and_si256(_mm256_castps_si256(inside), span);
+			if (_mm256_testz_si256(mask, mask)) continue;
+
+			__m256 z = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(tri.dzdx * px + rowZ)), stepZ);
+			z = _mm256_min_ps(_mm256_max_ps(z, zero), one);
+			if (quantize)
+				z = _mm256_mul_ps(_mm256_round_ps(_mm256_mul_ps(z, unormMax), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), invUnormMax);
+
+			__m256 old = _mm256_maskload_ps(row + x, mask);
+			__m256i pass = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(z, old, _CMP_LT_OQ)));
+			_mm256_maskstore_ps(row + x, pass, z);
+		}
+	}
+}
+
+bool SoftwareRasterizer::DetectAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	// the OS must also save the upper halves of the ymm registers
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+class ThreadPool;
+
+
+// Depth-only triangle rasterizer that runs on the CPU
+// It follows the D3D11 rasterization rules closely enough to be used as a reference for the GPU shadow passes:
+// near/far clipping in clip space, 1/256 sub-pixel snapping, culling with the same winding convention
+// and the D3D11 depth bias equations for both UNORM and float depth formats
+//
+// Triangles are set up and binned into screen tiles in parallel, then each tile is rasterized by a single thread
+// 8 pixels at a time with AVX2 when the CPU supports it
+//
+// Pixels exactly on a shared edge may be covered by both triangles, which makes no difference to a depth buffer
+
+class SoftwareRasterizer
+{
+public:
+	enum class CullMode { None, Front, Back };
+	enum class DepthFormat { Unorm24, Float32 };
+
+	// the parts of D3D11_RASTERIZER_DESC that affect depth
+	struct RasterizerState
+	{
+		CullMode cullMode = CullMode::Back;
+		bool frontCounterClockwise = false;
+		int depthBias = 0;
+		float depthBiasClamp = 0.0f;
+		float slopeScaledDepthBias = 0.0f;
+		bool depthClipEnable = true;
+		DepthFormat format = DepthFormat::Float32;
+	};
+
+	struct Mesh
+	{
+		std::vector<XMFLOAT3> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	struct DrawItem
+	{
+		const Mesh* mesh = nullptr;
+		// world * view * projection, row vector convention (not transposed)
+		XMFLOAT4X4 worldViewProjection;
+	};
+
+	// row-major, top row first, same layout as a ShadowMap or one face of a ShadowCubemap
+	struct DepthBuffer
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<float> depth;
+
+		void Resize(unsigned int w, unsigned int h);
+		void Clear(float value = 1.0f);
+		inline float At(unsigned int x, unsigned int y) const { return depth[y * width + x]; }
+	};
+
+	struct Stats
+	{
+		size_t trianglesIn = 0;
+		size_t trianglesCulled = 0;		// back facing, degenerate or off screen
+		size_t trianglesClipped = 0;	// crossed the near or far plane
+		size_t trianglesBinned = 0;
+		size_t binEntries = 0;
+		float setupTime = 0.0f;			// ms
+		float rasterTime = 0.0f;		// ms
+	};
+
+public:
+	// threadPool may be null to run on the calling thread
+	SoftwareRasterizer(ThreadPool* threadPool);
+	~SoftwareRasterizer() = default;
+
+	void Render(DepthBuffer& target, const std::vector<DrawItem>& items, const RasterizerState& state);
+
+	inline const Stats& GetStats() const { return m_Stats; }
+	inline bool IsUsingAVX2() const { return m_UseAVX2; }
+	// allows the scalar path to be forced, for comparison
+	inline void SetUseAVX2(bool use) { m_UseAVX2 = use && s_AVX2Supported; }
+
+	static const unsigned int TileSize = 64;
+	static const size_t BatchSize = 2048;
+
+private:
+	// edge functions E(x, y) = a * x + b * y + c are positive inside the triangle
+	// the depth plane is z(x, y) = z0 + dzdx * x + dzdy * y and already includes the depth bias
+	struct TriangleSetup
+	{
+		double a[3], b[3], c[3];
+		double z0, dzdx, dzdy;
+		int minX, minY, maxX, maxY;
+	};
+
+	// setup output for a contiguous range of input triangles
+	// each batch has its own bins, so binning needs no synchronization and keeps submission order
+	struct Batch
+	{
+		std::vector<TriangleSetup> triangles;
+		std::vector<std::vector<uint32_t>> bins;
+		size_t culled = 0;
+		size_t clipped = 0;
+	};
+
+	void SetupBatch(size_t batchIndex, const std::vector<DrawItem>& items, const RasterizerState& state, unsigned int width, unsigned int height);
+	void SetupTriangle(Batch& batch, const XMFLOAT4* clip, const RasterizerState& state, unsigned int width, unsigned int height);
+
+	void RasterizeTile(size_t tileIndex, DepthBuffer& target, bool quantize);
+	static void RasterizeScalar(const TriangleSetup& tri, int x0, int y0, int x1, int y1, DepthBuffer& target, bool quantize);
+	static void RasterizeAVX2(const TriangleSetup& tri, int x0, int y0, int x1, int y1, DepthBuffer& target, bool quantize);
+
+	static bool DetectAVX2();
+
+private:
+	ThreadPool* m_ThreadPool = nullptr;
+
+	std::vector<Batch> m_Batches;
+	size_t m_BatchCount = 0;
+	std::vector<size_t> m_ItemFirstTriangle;
+	unsigned int m_TilesX = 0;
+	unsigned int m_TilesY = 0;
+
+	static const bool s_AVX2Supported;
+	bool m_UseAVX2 = false;
+
+	Stats m_Stats;
+};
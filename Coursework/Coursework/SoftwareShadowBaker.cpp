@@ -0,0 +1,306 @@
+#include "SoftwareShadowBaker.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "MeshGeometryCache.h"
+#include "SceneLight.h"
+#include "ShadowCubemap.h"
+#include "TerrainMesh.h"
+
+#include "imGUI/imgui.h"
+
+
+SoftwareShadowBaker::SoftwareShadowBaker(ID3D11Device* device, ThreadPool* threadPool, MeshGeometryCache* meshCache)
+	: m_Device(device), m_Rasterizer(threadPool), m_MeshCache(meshCache)
+{
+}
+
+void SoftwareShadowBaker::Bake(ID3D11DeviceContext* deviceContext, SceneLight* light, const std::vector<Caster>& casters, const D3D11_RASTERIZER_DESC& rasterDesc)
+{
+	assert(light->IsShadowsEnabled() && "Light doesnt have a shadow map!");
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	bool pointLight = light->GetType() == SceneLight::LightType::Point;
+
+	// same views as App1::depthPass
+	XMMATRIX lightViewMatrices[6];
+	int viewCount = 0;
+	if (pointLight)
+	{
+		light->GetPointLightViewMatrices(lightViewMatrices);
+		viewCount = 6;
+	}
+	else
+	{
+		light->GenerateViewMatrix();
+		lightViewMatrices[0] = light->GetViewMatrix();
+		viewCount = 1;
+	}
+	XMMATRIX lightProjectionMatrix = light->GetProjectionMatrix();
+
+	// shadow maps are D24, shadow cubemaps are D32
+	SoftwareRasterizer::RasterizerState state;
+	switch (rasterDesc.CullMode)
+	{
+	case D3D11_CULL_NONE:	state.cullMode = SoftwareRasterizer::CullMode::None; break;
+	case D3D11_CULL_FRONT:	state.cullMode = SoftwareRasterizer::CullMode::Front; break;
+	default:				state.cullMode = SoftwareRasterizer::CullMode::Back; break;
+	}
+	state.frontCounterClockwise = rasterDesc.FrontCounterClockwise != FALSE;
+	state.depthBias = rasterDesc.DepthBias;
+	state.depthBiasClamp = rasterDesc.DepthBiasClamp;
+	state.slopeScaledDepthBias = rasterDesc.SlopeScaledDepthBias;
+	state.depthClipEnable = rasterDesc.DepthClipEnable != FALSE;
+	state.format = pointLight ? SoftwareRasterizer::DepthFormat::Float32 : SoftwareRasterizer::DepthFormat::Unorm24;
+
+	// gather caster geometry
+	m_TerrainMeshes.resize(std::count_if(casters.begin(), casters.end(), [](const Caster& c) { return c.terrain != nullptr; }));
+	std::vector<const SoftwareRasterizer::Mesh*> meshes;
+	size_t terrainIndex = 0;
+	for (const Caster& caster : casters)
+	{
+		if (caster.terrain)
+		{
+			BuildTerrainGeometry(deviceContext, caster.terrain, m_TerrainMeshes[terrainIndex]);
+			meshes.push_back(&m_TerrainMeshes[terrainIndex++]);
+		}
+		else
+			meshes.push_back(&m_MeshCache->Get(deviceContext, caster.mesh).geometry);
+	}
+
+	D3D11_TEXTURE2D_DESC shadowDesc;
+	GetShadowTexture(light)->GetDesc(&shadowDesc);
+
+	m_Views.resize(viewCount);
+	m_TrianglesIn = 0;
+	m_TrianglesBinned = 0;
+	for (int v = 0; v < viewCount; v++)
+	{
+		XMMATRIX viewProjection = lightViewMatrices[v] * lightProjectionMatrix;
+
+		std::vector<SoftwareRasterizer::DrawItem> items(casters.size());
+		for (size_t i = 0; i < casters.size(); i++)
+		{
+			items[i].mesh = meshes[i];
+			XMStoreFloat4x4(&items[i].worldViewProjection, XMLoadFloat4x4(&casters[i].world) * viewProjection);
+		}
+
+		m_Views[v].Resize(shadowDesc.Width, shadowDesc.Height);
+		m_Views[v].Clear(1.0f);
+		m_Rasterizer.Render(m_Views[v], items, state);
+
+		m_TrianglesIn += m_Rasterizer.GetStats().trianglesIn;
+		m_TrianglesBinned += m_Rasterizer.GetStats().trianglesBinned;
+	}
+
+	m_BakedLight = light;
+	m_BakedFormat = state.format;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_BakeTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void SoftwareShadowBaker::Upload(ID3D11DeviceContext* deviceContext, SceneLight* light)
+{
+	assert(light == m_BakedLight && "Uploading a bake for a different light!");
+
+	ID3D11Texture2D* shadowTexture = GetShadowTexture(light);
+	ID3D11Texture2D* staging = CreateStagingCopy(shadowTexture, D3D11_CPU_ACCESS_WRITE);
+
+	D3D11_TEXTURE2D_DESC desc;
+	shadowTexture->GetDesc(&desc);
+
+	for (size_t v = 0; v < m_Views.size(); v++)
+	{
+		const SoftwareRasterizer::DepthBuffer& view = m_Views[v];
+		UINT subresource = D3D11CalcSubresource(0, static_cast<UINT>(v), desc.MipLevels);
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HRESULT hr = deviceContext->Map(staging, subresource, D3D11_MAP_WRITE, 0, &mapped);
+		assert(hr == S_OK);
+		for (unsigned int y = 0; y < view.height; y++)
+		{
+			uint32_t* row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(mapped.pData) + y * mapped.RowPitch);
+			for (unsigned int x = 0; x < view.width; x++)
+			{
+				float depth = view.At(x, y);
+				if (m_BakedFormat == SoftwareRasterizer::DepthFormat::Unorm24)
+					row[x] = static_cast<uint32_t>(std::floor(depth * 16777215.0f + 0.5f)) & 0x00FFFFFF;	// stencil is left 0
+				else
+					memcpy(&row[x], &depth, sizeof(float));
+			}
+		}
+		deviceContext->Unmap(staging, subresource);
+
+		// depth resources can only be copied as whole subresources
+		deviceContext->CopySubresourceRegion(shadowTexture, subresource, 0, 0, 0, staging, subresource, nullptr);
+	}
+
+	staging->Release();
+	shadowTexture->Release();
+}
+
+SoftwareShadowBaker::Comparison SoftwareShadowBaker::Compare(ID3D11DeviceContext* deviceContext, SceneLight* light, float tolerance)
+{
+	assert(light == m_BakedLight && "Comparing a bake for a different light!");
+
+	ID3D11Texture2D* shadowTexture = GetShadowTexture(light);
+	ID3D11Texture2D* staging = CreateStagingCopy(shadowTexture, D3D11_CPU_ACCESS_READ);
+	deviceContext->CopyResource(staging, shadowTexture);
+
+	D3D11_TEXTURE2D_DESC desc;
+	shadowTexture->GetDesc(&desc);
+
+	Comparison result;
+	double totalError = 0.0;
+	size_t mismatched = 0;
+	size_t texelCount = 0;
+	for (size_t v = 0; v < m_Views.size(); v++)
+	{
+		const SoftwareRasterizer::DepthBuffer& view = m_Views[v];
+		UINT subresource = D3D11CalcSubresource(0, static_cast<UINT>(v), desc.MipLevels);
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HRESULT hr = deviceContext->Map(staging, subresource, D3D11_MAP_READ, 0, &mapped);
+		assert(hr == S_OK);
+		for (unsigned int y = 0; y < view.height; y++)
+		{
+			const uint32_t* row = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(mapped.pData) + y * mapped.RowPitch);
+			for (unsigned int x = 0; x < view.width; x++)
+			{
+				float gpuDepth;
+				if (m_BakedFormat == SoftwareRasterizer::DepthFormat::Unorm24)
+					gpuDepth = static_cast<float>(row[x] & 0x00FFFFFF) / 16777215.0f;
+				else
+					memcpy(&gpuDepth, &row[x], sizeof(float));
+
+				float error = std::abs(gpuDepth - view.At(x, y));
+				result.maxError = (std::max)(result.maxError, error);
+				totalError += error;
+				if (error > tolerance) mismatched++;
+			}
+		}
+		deviceContext->Unmap(staging, subresource);
+		texelCount += static_cast<size_t>(view.width) * view.height;
+	}
+
+	if (texelCount > 0)
+	{
+		result.meanError = static_cast<float>(totalError / texelCount);
+		result.mismatchedFraction = static_cast<float>(mismatched) / static_cast<float>(texelCount);
+	}
+	m_LastComparison = result;
+
+	staging->Release();
+	shadowTexture->Release();
+	return result;
+}
+
+void SoftwareShadowBaker::SettingsGUI()
+{
+	ImGui::SliderInt("Terrain tessellation", &m_TerrainTessellation, 16, 1024);
+	ImGui::Text("AVX2: %s", m_Rasterizer.IsUsingAVX2() ? "yes" : "no");
+	ImGui::Text("Last bake: %.2f ms, %d views", m_BakeTime, static_cast<int>(m_Views.size()));
+	ImGui::Text("Triangles: %d in, %d rasterized", static_cast<int>(m_TrianglesIn), static_cast<int>(m_TrianglesBinned));
+	ImGui::Text("GPU difference: max %.6f, mean %.6f", m_LastComparison.maxError, m_LastComparison.meanError);
+	ImGui::Text("Mismatched texels: %.2f%%", m_LastComparison.mismatchedFraction * 100.0f);
+}
+
+void SoftwareShadowBaker::BuildTerrainGeometry(ID3D11DeviceContext* deviceContext, TerrainMesh* terrain, SoftwareRasterizer::Mesh& out)
+{
+	// read back the heightmap, height is stored in the red channel
+	ID3D11Resource* resource = nullptr;
+	terrain->GetHeightmapSRV()->GetResource(&resource);
+	ID3D11Texture2D* heightmapTexture = static_cast<ID3D11Texture2D*>(resource);
+
+	ID3D11Texture2D* staging = CreateStagingCopy(heightmapTexture, D3D11_CPU_ACCESS_READ);
+	deviceContext->CopyResource(staging, heightmapTexture);
+
+	D3D11_TEXTURE2D_DESC desc;
+	heightmapTexture->GetDesc(&desc);
+
+	std::vector<float> heights(static_cast<size_t>(desc.Width) * desc.Height);
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = deviceContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+	for (unsigned int y = 0; y < desc.Height; y++)
+	{
+		const float* row = reinterpret_cast<const float*>(static_cast<const uint8_t*>(mapped.pData) + y * mapped.RowPitch);
+		for (unsigned int x = 0; x < desc.Width; x++)
+			heights[y * desc.Width + x] = row[x * 4];
+	}
+	deviceContext->Unmap(staging, 0);
+	staging->Release();
+	heightmapTexture->Release();
+
+	// bilinear, clamped to the edge
+	auto sampleHeight = [&](float u, float v)
+	{
+		float fx = (std::min)((std::max)(u * desc.Width - 0.5f, 0.0f), static_cast<float>(desc.Width - 1));
+		float fy = (std::min)((std::max)(v * desc.Height - 0.5f, 0.0f), static_cast<float>(desc.Height - 1));
+		unsigned int x0 = static_cast<unsigned int>(fx), y0 = static_cast<unsigned int>(fy);
+		unsigned int x1 = (std::min)(x0 + 1, desc.Width - 1), y1 = (std::min)(y0 + 1, desc.Height - 1);
+		float tx = fx - x0, ty = fy - y0;
+
+		float top = heights[y0 * desc.Width + x0] * (1.0f - tx) + heights[y0 * desc.Width + x1] * tx;
+		float bottom = heights[y1 * desc.Width + x0] * (1.0f - tx) + heights[y1 * desc.Width + x1] * tx;
+		return top * (1.0f - ty) + bottom * ty;
+	};
+
+	// same layout as TerrainMesh::BuildMesh, displaced along the up normal as in the domain shader
+	int n = m_TerrainTessellation;
+	float size = terrain->GetSize();
+	out.positions.resize(static_cast<size_t>(n + 1) * (n + 1));
+	for (int z = 0; z <= n; z++)
+	{
+		for (int x = 0; x <= n; x++)
+		{
+			float u = static_cast<float>(x) / n;
+			float v = static_cast<float>(z) / n;
+			out.positions[z * (n + 1) + x] = { size * (u - 0.5f), sampleHeight(u, v), size * (v - 0.5f) };
+		}
+	}
+
+	// wound to face up, the same as the tessellated terrain
+	out.indices.clear();
+	out.indices.reserve(static_cast<size_t>(n) * n * 6);
+	for (int z = 0; z < n; z++)
+	{
+		for (int x = 0; x < n; x++)
+		{
+			uint32_t i00 = z * (n + 1) + x;
+			uint32_t i10 = i00 + 1;
+			uint32_t i01 = i00 + (n + 1);
+			uint32_t i11 = i01 + 1;
+			out.indices.insert(out.indices.end(), { i00, i10, i01, i10, i11, i01 });
+		}
+	}
+}
+
+ID3D11Texture2D* SoftwareShadowBaker::GetShadowTexture(SceneLight* light)
+{
+	ID3D11ShaderResourceView* srv = light->GetType() == SceneLight::LightType::Point ? light->GetShadowCubemap()->GetSRV() : light->GetShadowMap()->getDepthMapSRV();
+
+	ID3D11Resource* resource = nullptr;
+	srv->GetResource(&resource);
+	return static_cast<ID3D11Texture2D*>(resource);
+}
+
+ID3D11Texture2D* SoftwareShadowBaker::CreateStagingCopy(ID3D11Texture2D* texture, D3D11_CPU_ACCESS_FLAG access)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = access;
+	desc.MiscFlags = 0;
+
+	ID3D11Texture2D* staging = nullptr;
+	HRESULT hr = m_Device->CreateTexture2D(&desc, nullptr, &staging);
+	assert(hr == S_OK);
+	return staging;
+}
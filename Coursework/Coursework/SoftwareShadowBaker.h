@@ -0,0 +1,80 @@
+#pragma once
+
+#include "DXF.h"
+
+#include <vector>
+
+#include "SoftwareRasterizer.h"
+
+class MeshGeometryCache;
+class SceneLight;
+class TerrainMesh;
+class ThreadPool;
+
+
+// Renders a light's shadow map on the CPU with the software rasterizer
+// Caster geometry comes from the mesh geometry cache, and the terrain is displaced at a fixed tessellation
+//
+// The result can be compared against what the GPU depth pass produced, to validate the shadow bias settings,
+// or uploaded into the light's shadow map so that static shadows only need to be rendered once
+
+class SoftwareShadowBaker
+{
+public:
+	// one shadow casting object, world matrix as used by the depth pass
+	struct Caster
+	{
+		BaseMesh* mesh = nullptr;
+		TerrainMesh* terrain = nullptr;
+		XMFLOAT4X4 world;
+	};
+
+	struct Comparison
+	{
+		float maxError = 0.0f;
+		float meanError = 0.0f;
+		float mismatchedFraction = 0.0f;	// texels that differ by more than the tolerance
+	};
+
+public:
+	SoftwareShadowBaker(ID3D11Device* device, ThreadPool* threadPool, MeshGeometryCache* meshCache);
+	~SoftwareShadowBaker() = default;
+
+	// render every view of the light: 1 for directional and spot lights, 6 cube faces for point lights
+	void Bake(ID3D11DeviceContext* deviceContext, SceneLight* light, const std::vector<Caster>& casters, const D3D11_RASTERIZER_DESC& rasterDesc);
+
+	// copy the baked depth into the light's shadow map or cubemap
+	void Upload(ID3D11DeviceContext* deviceContext, SceneLight* light);
+	// compare the baked depth against the light's shadow map or cubemap
+	Comparison Compare(ID3D11DeviceContext* deviceContext, SceneLight* light, float tolerance);
+
+	inline const std::vector<SoftwareRasterizer::DepthBuffer>& GetViews() const { return m_Views; }
+
+	void SettingsGUI();
+
+private:
+	void BuildTerrainGeometry(ID3D11DeviceContext* deviceContext, TerrainMesh* terrain, SoftwareRasterizer::Mesh& out);
+
+	ID3D11Texture2D* GetShadowTexture(SceneLight* light);
+	ID3D11Texture2D* CreateStagingCopy(ID3D11Texture2D* texture, D3D11_CPU_ACCESS_FLAG access);
+
+private:
+	ID3D11Device* m_Device = nullptr;
+	SoftwareRasterizer m_Rasterizer;
+	MeshGeometryCache* m_MeshCache = nullptr;
+
+	// the terrain is a heightmap on the GPU, so it is displaced with a fixed number of quads along each edge
+	int m_TerrainTessellation = 256;
+
+	std::vector<SoftwareRasterizer::Mesh> m_TerrainMeshes;
+
+	SceneLight* m_BakedLight = nullptr;
+	SoftwareRasterizer::DepthFormat m_BakedFormat = SoftwareRasterizer::DepthFormat::Unorm24;
+	std::vector<SoftwareRasterizer::DepthBuffer> m_Views;
+
+	// stats for the last bake
+	float m_BakeTime = 0.0f;
+	size_t m_TrianglesIn = 0;
+	size_t m_TrianglesBinned = 0;
+	Comparison m_LastComparison;
+};
@@ -0,0 +1,204 @@
+#include "SphericalHarmonics.h"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "Cubemap.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	// real SH basis normalisation constants
+	const float Y00 = 0.282095f;
+	const float Y1 = 0.488603f;
+	const float Y2 = 1.092548f;
+	const float Y20 = 0.315392f;
+	const float Y22 = 0.546274f;
+
+	// cosine lobe convolution per band, divided by pi
+	const float A0 = 1.0f;
+	const float A1 = 2.0f / 3.0f;
+	const float A2 = 1.0f / 4.0f;
+}
+
+
+SH9 SphericalHarmonics::ProjectCubemap(const unsigned char* const faces[6], unsigned int size, unsigned int rowPitch, ThreadPool* threadPool)
+{
+	// sums over all texels of colour * basis * solid angle, and of the solid angle itself
+	double totals[9][3] = {};
+	double totalWeight = 0.0;
+	std::mutex totalsMutex;
+
+	const float invSize = 2.0f / size;
+
+	// each task is a range of rows, indexed across all 6 faces
+	threadPool->ParallelFor(6 * static_cast<size_t>(size), 16, [&](size_t begin, size_t end)
+	{
+		// four texels are processed at once, one per lane
+		__m128 sums[9][3];
+		for (auto& s : sums)
+			s[0] = s[1] = s[2] = _mm_setzero_ps();
+		__m128 weightSum = _mm_setzero_ps();
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 three = _mm_set1_ps(3.0f);
+		const __m128 toUnit = _mm_set1_ps(1.0f / 255.0f);
+		const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+		for (size_t row = begin; row < end; row++)
+		{
+			unsigned int face = static_cast<unsigned int>(row / size);
+			unsigned int y = static_cast<unsigned int>(row % size);
+			const unsigned char* rowData = faces[face] + static_cast<size_t>(y) * rowPitch;
+
+			const XMFLOAT3& n = Cubemap::GetFaceNormal(face);
+			const XMFLOAT3& t = Cubemap::GetFaceTangent(face);
+			const XMFLOAT3& b = Cubemap::GetFaceBitangent(face);
+
+			// texel centres in [-1, 1]
+			float v = (y + 0.5f) * invSize - 1.0f;
+			__m128 baseX = _mm_set1_ps(n.x + v * b.x);
+			__m128 baseY = _mm_set1_ps(n.y + v * b.y);
+			__m128 baseZ = _mm_set1_ps(n.z + v * b.z);
+			__m128 tx = _mm_set1_ps(t.x), ty = _mm_set1_ps(t.y), tz = _mm_set1_ps(t.z);
+
+			for (unsigned int x = 0; x < size; x += 4)
+			{
+				__m128 u = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets), half), _mm_set1_ps(invSize)), one);
+
+				__m128 dx = _mm_add_ps(baseX, _mm_mul_ps(u, tx));
+				__m128 dy = _mm_add_ps(baseY, _mm_mul_ps(u, ty));
+				__m128 dz = _mm_add_ps(baseZ, _mm_mul_ps(u, tz));
+
+				// the solid angle of a texel is proportional to 1 / |d|^3
+				__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+				__m128 weight = _mm_mul_ps(invLength, _mm_mul_ps(invLength, invLength));
+				dx = _mm_mul_ps(dx, invLength);
+				dy = _mm_mul_ps(dy, invLength);
+				dz = _mm_mul_ps(dz, invLength);
+
+				// lanes past the end of the row don't count
+				if (x + 4 > size)
+				{
+					__m128 mask = _mm_cmplt_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets), _mm_set1_ps(static_cast<float>(size)));
+					weight = _mm_and_ps(weight, mask);
+				}
+
+				float r[4], g[4], bl[4];
+				for (unsigned int i = 0; i < 4; i++)
+				{
+					const unsigned char* texel = rowData + 4 * (std::min)(x + i, size - 1);
+					r[i] = texel[0];
+					g[i] = texel[1];
+					bl[i] = texel[2];
+				}
+				__m128 colour[3] = {
+					_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(r), toUnit), weight),
+					_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(g), toUnit), weight),
+					_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(bl), toUnit), weight)
+				};
+
+				__m128 basis[9];
+				basis[0] = _mm_set1_ps(Y00);
+				basis[1] = _mm_mul_ps(_mm_set1_ps(Y1), dy);
+				basis[2] = _mm_mul_ps(_mm_set1_ps(Y1), dz);
+				basis[3] = _mm_mul_ps(_mm_set1_ps(Y1), dx);
+				basis[4] = _mm_mul_ps(_mm_set1_ps(Y2), _mm_mul_ps(dx, dy));
+				basis[5] = _mm_mul_ps(_mm_set1_ps(Y2), _mm_mul_ps(dy, dz));
+				basis[6] = _mm_mul_ps(_mm_set1_ps(Y20), _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one));
+				basis[7] = _mm_mul_ps(_mm_set1_ps(Y2), _mm_mul_ps(dx, dz));
+				basis[8] = _mm_mul_ps(_mm_set1_ps(Y22), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+				for (int k = 0; k < 9; k++)
+				{
+					for (int c = 0; c < 3; c++)
+						sums[k][c] = _mm_add_ps(sums[k][c], _mm_mul_ps(basis[k], colour[c]));
+				}
+				weightSum = _mm_add_ps(weightSum, weight);
+			}
+		}
+
+		// horizontal sums, then merge into the totals
+		auto reduce = [](__m128 v)
+		{
+			float lanes[4];
+			_mm_storeu_ps(lanes, v);
+			return static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+		};
+
+		std::lock_guard<std::mutex> lock(totalsMutex);
+		for (int k = 0; k < 9; k++)
+		{
+			for (int c = 0; c < 3; c++)
+				totals[k][c] += reduce(sums[k][c]);
+		}
+		totalWeight += reduce(weightSum);
+	});
+
+	// the weights sum to the area of the sphere, 4pi
+	SH9 result;
+	double normalisation = totalWeight > 0.0 ? 4.0 * XM_PI / totalWeight : 0.0;
+	for (int k = 0; k < 9; k++)
+	{
+		result.coefficients[k].x = static_cast<float>(totals[k][0] * normalisation);
+		result.coefficients[k].y = static_cast<float>(totals[k][1] * normalisation);
+		result.coefficients[k].z = static_cast<float>(totals[k][2] * normalisation);
+	}
+	return result;
+}
+
+void SphericalHarmonics::ToIrradianceConstants(const SH9& radiance, XMFLOAT4 constants[9])
+{
+	// after this the irradiance is
+	// c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2)
+	const float scales[9] = {
+		A0 * Y00,
+		A1 * Y1, A1 * Y1, A1 * Y1,
+		A2 * Y2, A2 * Y2, A2 * Y20, A2 * Y2, A2 * Y22
+	};
+
+	for (int k = 0; k < 9; k++)
+	{
+		const XMFLOAT3& c = radiance.coefficients[k];
+		constants[k] = { c.x * scales[k], c.y * scales[k], c.z * scales[k], 0.0f };
+	}
+}
+
+XMFLOAT3 SphericalHarmonics::EvaluateIrradiance(const XMFLOAT4 constants[9], const XMFLOAT3& normal)
+{
+	const float x = normal.x, y = normal.y, z = normal.z;
+	const float terms[9] = { 1.0f, y, z, x, x * y, y * z, 3.0f * z * z - 1.0f, x * z, x * x - y * y };
+
+	XMFLOAT3 result{ 0.0f, 0.0f, 0.0f };
+	for (int k = 0; k < 9; k++)
+	{
+		result.x += constants[k].x * terms[k];
+		result.y += constants[k].y * terms[k];
+		result.z += constants[k].z * terms[k];
+	}
+	// ringing can take it slightly negative opposite very bright sources
+	result.x = (std::max)(result.x, 0.0f);
+	result.y = (std::max)(result.y, 0.0f);
+	result.z = (std::max)(result.z, 0.0f);
+	return result;
+}
+
+void SphericalHarmonics::EvaluateBasis(const XMFLOAT3& direction, float basis[9])
+{
+	const float x = direction.x, y = direction.y, z = direction.z;
+	basis[0] = Y00;
+	basis[1] = Y1 * y;
+	basis[2] = Y1 * z;
+	basis[3] = Y1 * x;
+	basis[4] = Y2 * x * y;
+	basis[5] = Y2 * y * z;
+	basis[6] = Y20 * (3.0f * z * z - 1.0f);
+	basis[7] = Y2 * x * z;
+	basis[8] = Y22 * (x * x - y * y);
+}
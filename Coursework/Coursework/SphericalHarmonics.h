@@ -0,0 +1,37 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+class ThreadPool;
+
+
+// Order 2 (9 coefficient) spherical harmonics, used for diffuse image based lighting
+// An environment cubemap is projected once when it is loaded, and the irradiance for any normal is then a quadratic
+// polynomial of the normal, so no irradiance cubemap is needed
+//
+// shprojection_cs.hlsl mirrors ProjectCubemap on the GPU
+
+struct SH9
+{
+	XMFLOAT3 coefficients[9];
+};
+
+class SphericalHarmonics
+{
+public:
+	// pure static class
+	SphericalHarmonics() = delete;
+
+	// project an RGBA8 cubemap (faces in the Cubemap face order), each texel is weighted by the solid angle it covers
+	static SH9 ProjectCubemap(const unsigned char* const faces[6], unsigned int size, unsigned int rowPitch, ThreadPool* threadPool);
+
+	// convolve radiance with the clamped cosine lobe and fold in the basis constants and 1/pi
+	// so that the shader only has to evaluate EvaluateIrradiance to get the diffuse term for an albedo of 1
+	static void ToIrradianceConstants(const SH9& radiance, XMFLOAT4 constants[9]);
+	// scalar reference of the shader evaluation
+	static XMFLOAT3 EvaluateIrradiance(const XMFLOAT4 constants[9], const XMFLOAT3& normal);
+
+	static void EvaluateBasis(const XMFLOAT3& direction, float basis[9]);
+};
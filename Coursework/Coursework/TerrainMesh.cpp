@@ -2,10 +2,13 @@
 
 #include <d3dcompiler.h>
 
+#include "GPUMemoryTracker.h"
+
 #define clamp(v, minimum, maximum) (max(min((v), (maximum)), (minimum)))
 
 
-TerrainMesh::TerrainMesh(ID3D11Device* device, float size)
+TerrainMesh::TerrainMesh(ID3D11Device* device, IGraphicsBackend* backend, float size)
+	: m_Backend(backend)
 {
 	BuildMesh(device, size);
 	
@@ -26,6 +29,13 @@ TerrainMesh::TerrainMesh(ID3D11Device* device, float size)
 
 TerrainMesh::~TerrainMesh()
 {
+	GPUMemoryTracker::Untrack(m_VertexBuffer);
+	GPUMemoryTracker::Untrack(m_IndexBuffer);
+	GPUMemoryTracker::Untrack(m_HeightmapSRV);
+	GPUMemoryTracker::Untrack(m_PreprocessSRV);
+	GPUMemoryTracker::Untrack(m_MinMaxTexture);
+	GPUMemoryTracker::Untrack(m_MinMaxStaging);
+
 	if (m_VertexBuffer) m_VertexBuffer->Release();
 	if (m_IndexBuffer) m_IndexBuffer->Release();
 
@@ -35,6 +45,11 @@ TerrainMesh::~TerrainMesh()
 	
 	if (m_PreprocessUAV) m_PreprocessUAV->Release();
 	if (m_PreprocessSRV) m_PreprocessSRV->Release();
+
+	if (m_MinMaxTexture) m_MinMaxTexture->Release();
+	if (m_MinMaxStaging) m_MinMaxStaging->Release();
+	if (m_MinMaxUAV) m_MinMaxUAV->Release();
+	if (m_MinMaxFence) m_Backend->ReleaseFence(m_MinMaxFence);
 }
 
 void TerrainMesh::SendData(ID3D11DeviceContext* deviceContext)
@@ -50,6 +65,8 @@ void TerrainMesh::SendData(ID3D11DeviceContext* deviceContext)
 
 void TerrainMesh::BuildMesh(ID3D11Device* device, float size)
 {
+	GPUMemoryTracker::Untrack(m_VertexBuffer);
+	GPUMemoryTracker::Untrack(m_IndexBuffer);
 	if (m_VertexBuffer) m_VertexBuffer->Release();
 	if (m_IndexBuffer) m_IndexBuffer->Release();
 
@@ -147,6 +164,9 @@ void TerrainMesh::BuildMesh(ID3D11Device* device, float size)
 	// Create the index buffer.
 	device->CreateBuffer(&indexBufferDesc, &indexData, &m_IndexBuffer);
 
+	GPUMemoryTracker::Track(m_VertexBuffer, GPUMemoryTracker::Category::Terrain, "Terrain vertex buffer");
+	GPUMemoryTracker::Track(m_IndexBuffer, GPUMemoryTracker::Category::Terrain, "Terrain index buffer");
+
 	// Release the arrays now that the buffers have been created and loaded.
 	delete[] vertices;
 	delete[] indices;
@@ -160,18 +180,45 @@ void TerrainMesh::PreprocessHeightmap(ID3D11DeviceContext* deviceContext)
 
 	// bind resources
 	deviceContext->CSSetShaderResources(0, 1, &m_HeightmapSRV);
-	deviceContext->CSSetUnorderedAccessViews(0, 1, &m_PreprocessUAV, nullptr);
+	ID3D11UnorderedAccessView* uavs[2] = { m_PreprocessUAV, m_MinMaxUAV };
+	deviceContext->CSSetUnorderedAccessViews(0, 2, uavs, nullptr);
 
 	// dispatch
-	deviceContext->Dispatch(m_HeightmapResolution / 16, m_HeightmapResolution / 16, 1);
+	m_Backend->Dispatch(m_HeightmapResolution / 16, m_HeightmapResolution / 16, 1);
 
 	// unbind resources
 	ID3D11ShaderResourceView* nullSRV = nullptr;
 	deviceContext->CSSetShaderResources(0, 1, &nullSRV);
-	ID3D11UnorderedAccessView* nullUAV = nullptr;
-	deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+	ID3D11UnorderedAccessView* nullUAVs[2] = { nullptr, nullptr };
+	deviceContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
 
 	deviceContext->CSSetShader(nullptr, nullptr, 0);
+
+	// the patch height ranges are read back once the GPU has got to the copy, mapping it now would stall until then
+	// a range from an earlier heightmap could hide objects that are now in view, so there are none until then
+	deviceContext->CopyResource(m_MinMaxStaging, m_MinMaxTexture);
+	if (m_MinMaxFence) m_Backend->ReleaseFence(m_MinMaxFence);
+	m_MinMaxFence = m_Backend->InsertFence();
+	m_PatchMinMax.clear();
+}
+
+void TerrainMesh::UpdatePatchMinMax(ID3D11DeviceContext* deviceContext)
+{
+	if (!m_MinMaxFence || !m_Backend->IsFenceComplete(m_MinMaxFence)) return;
+	m_Backend->ReleaseFence(m_MinMaxFence);
+	m_MinMaxFence = nullptr;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = deviceContext->Map(m_MinMaxStaging, 0, D3D11_MAP_READ, 0, &mapped);
+	assert(hr == S_OK);
+	m_PatchMinMax.resize(m_Resolution * m_Resolution);
+	for (unsigned int z = 0; z < m_Resolution; z++)
+	{
+		const DirectX::XMFLOAT2* row = reinterpret_cast<const DirectX::XMFLOAT2*>(static_cast<const char*>(mapped.pData) + z * mapped.RowPitch);
+		for (unsigned int x = 0; x < m_Resolution; x++)
+			m_PatchMinMax[x + z * m_Resolution] = row[x];
+	}
+	deviceContext->Unmap(m_MinMaxStaging, 0);
 }
 
 void TerrainMesh::CreateHeightmapTexture(ID3D11Device* device)
@@ -197,6 +244,7 @@ void TerrainMesh::CreateHeightmapTexture(ID3D11Device* device)
 	textureDesc.MiscFlags = 0;
 	hr = device->CreateTexture2D(&textureDesc, nullptr, &tex);
 	assert(hr == S_OK);
+	GPUMemoryTracker::Track(tex, GPUMemoryTracker::Category::Terrain, "Heightmap");
 
 	D3D11_UNORDERED_ACCESS_VIEW_DESC descUAV;
 	ZeroMemory(&descUAV, sizeof(descUAV));
@@ -239,6 +287,7 @@ void TerrainMesh::CreatePreprocessTexture(ID3D11Device* device)
 	textureDesc.MiscFlags = 0;
 	hr = device->CreateTexture2D(&textureDesc, nullptr, &tex);
 	assert(hr == S_OK);
+	GPUMemoryTracker::Track(tex, GPUMemoryTracker::Category::Terrain, "Heightmap preprocess map");
 
 	D3D11_UNORDERED_ACCESS_VIEW_DESC descUAV;
 	ZeroMemory(&descUAV, sizeof(descUAV));
@@ -255,4 +304,21 @@ void TerrainMesh::CreatePreprocessTexture(ID3D11Device* device)
 	descSRV.Texture2D.MipLevels = 1;
 	hr = device->CreateShaderResourceView(tex, &descSRV, &m_PreprocessSRV);
 	assert(hr == S_OK);
+
+	// create min/max texture, one texel per patch
+	textureDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	hr = device->CreateTexture2D(&textureDesc, nullptr, &m_MinMaxTexture);
+	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_MinMaxTexture, GPUMemoryTracker::Category::Terrain, "Patch min/max");
+
+	descUAV.Format = textureDesc.Format;
+	hr = device->CreateUnorderedAccessView(m_MinMaxTexture, &descUAV, &m_MinMaxUAV);
+	assert(hr == S_OK);
+
+	textureDesc.Usage = D3D11_USAGE_STAGING;
+	textureDesc.BindFlags = 0;
+	textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	hr = device->CreateTexture2D(&textureDesc, nullptr, &m_MinMaxStaging);
+	assert(hr == S_OK);
+	GPUMemoryTracker::Track(m_MinMaxStaging, GPUMemoryTracker::Category::Terrain, "Patch min/max readback");
 }
@@ -3,6 +3,10 @@
 #include <d3d11.h>
 #include <DirectXMath.h>
 
+#include <vector>
+
+#include "GraphicsBackend.h"
+
 
 class TerrainMesh
 {
@@ -14,7 +18,7 @@ class TerrainMesh
 	};
 
 public:
-	TerrainMesh(ID3D11Device* device, float size);
+	TerrainMesh(ID3D11Device* device, IGraphicsBackend* backend, float size);
 	~TerrainMesh();
 
 	void SendData(ID3D11DeviceContext* deviceContext);
@@ -36,12 +40,22 @@ public:
 	void PreprocessHeightmap(ID3D11DeviceContext* deviceContext);
 	inline ID3D11ShaderResourceView* GetPreprocessSRV() const { return m_PreprocessSRV; }
 
+	// min (x) and max (y) height of each patch, read back after preprocessing
+	// patches are indexed [x + z * GetPatchResolution()], empty from when the heightmap is preprocessed until the GPU
+	// has finished with it and UpdatePatchMinMax has read them back
+	inline const std::vector<DirectX::XMFLOAT2>& GetPatchMinMax() const { return m_PatchMinMax; }
+	inline unsigned int GetPatchResolution() const { return m_Resolution; }
+	// call once a frame, reads back the ranges of the last preprocess if the GPU has got to it, without waiting
+	void UpdatePatchMinMax(ID3D11DeviceContext* deviceContext);
+
 private:
 	void CreateHeightmapTexture(ID3D11Device* device);
 	void CreatePreprocessTexture(ID3D11Device* device);
 
 private:
 	// hard-coded heightmap resolution, but could be changed to any multiple of 16
+	IGraphicsBackend* m_Backend = nullptr;
+
 	const unsigned int m_HeightmapResolution = 1024;
 
 	const unsigned int m_Resolution = m_HeightmapResolution / 16; // number of cells along one axis of the terrain mesh
@@ -59,6 +73,14 @@ private:
 	ID3D11UnorderedAccessView* m_PreprocessUAV = nullptr;
 	ID3D11ShaderResourceView*  m_PreprocessSRV = nullptr;
 
+	// height range of each patch, and a copy on the CPU
+	ID3D11Texture2D* m_MinMaxTexture = nullptr;
+	ID3D11Texture2D* m_MinMaxStaging = nullptr;
+	ID3D11UnorderedAccessView* m_MinMaxUAV = nullptr;
+	// signalled once the copy to the staging texture is done, null when there is nothing to read back
+	IGraphicsBackend::FenceHandle m_MinMaxFence = nullptr;
+	std::vector<DirectX::XMFLOAT2> m_PatchMinMax;
+
 	// CS for preprocessing the heightmap
 	ID3D11ComputeShader* m_PreprocessCS;
 };
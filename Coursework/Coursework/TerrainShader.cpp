@@ -1,14 +1,15 @@
 #include "TerrainShader.h"
 
-#include "SceneLight.h"
 #include "Material.h"
 #include "GlobalLighting.h"
-#include "ShadowCubemap.h"
+#include "LightingCache.h"
+#include "ConstantBufferRing.h"
 #include "TerrainMesh.h"
+#include "MaterialArrays.h"
 
 
-TerrainShader::TerrainShader(ID3D11Device* device, GlobalLighting* globalLighting)
-	: m_Device(device), m_GlobalLighting(globalLighting)
+TerrainShader::TerrainShader(ID3D11Device* device, GlobalLighting* globalLighting, ConstantBufferRing* constantBufferRing)
+	: m_Device(device), m_GlobalLighting(globalLighting), m_ConstantBufferRing(constantBufferRing)
 {
 	InitShader();
 }
@@ -20,17 +21,10 @@ TerrainShader::~TerrainShader()
 	if (m_HullShader) m_HullShader->Release();
 	if (m_DomainShader) m_DomainShader->Release();
 	if (m_PixelShader) m_PixelShader->Release();
+	if (m_LayerArrayPixelShader) m_LayerArrayPixelShader->Release();
 
 	if (m_InputLayout) m_InputLayout->Release();
 	
-	if (m_VSMatrixBuffer) m_VSMatrixBuffer->Release();
-	if (m_DSMatrixBuffer) m_DSMatrixBuffer->Release();
-	if (m_DSLightBuffer) m_DSLightBuffer->Release();
-	if (m_PSLightBuffer) m_PSLightBuffer->Release();
-	if (m_TerrainBuffer) m_TerrainBuffer->Release();
-	if (m_MaterialBuffer) m_MaterialBuffer->Release();
-	if (m_TessellationBuffer) m_TessellationBuffer->Release();
-
 	if (m_HeightmapSampleState) m_HeightmapSampleState->Release();
 	if (m_MaterialSampler) m_MaterialSampler->Release();
 	if (m_ShadowSampler) m_ShadowSampler->Release();
@@ -43,16 +37,8 @@ void TerrainShader::InitShader()
 	LoadVS(L"terrain_vs.cso");
 	LoadHS(L"terrain_hs.cso");
 	LoadDS(L"terrain_ds.cso");
-	LoadPS(L"terrain_ps.cso");
-
-	// create constant buffers
-	ShaderUtility::CreateBuffer(m_Device, sizeof(VSMatrixBufferType), &m_VSMatrixBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(TessellationBufferType), &m_TessellationBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(DSMatrixBufferType), &m_DSMatrixBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::VSLightBufferType), &m_DSLightBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::PSLightBufferType), &m_PSLightBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::MaterialBufferType), &m_MaterialBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(TerrainBufferType), &m_TerrainBuffer);
+	LoadPS(L"terrain_ps.cso", &m_PixelShader);
+	LoadPS(L"terrainlayers_ps.cso", &m_LayerArrayPixelShader);
 
 	// create sampler state
 	D3D11_SAMPLER_DESC heightmapSamplerDesc;
@@ -161,7 +147,7 @@ void TerrainShader::LoadDS(const wchar_t* ds)
 	domainShaderBuffer->Release();
 }
 
-void TerrainShader::LoadPS(const wchar_t* ps)
+void TerrainShader::LoadPS(const wchar_t* ps, ID3D11PixelShader** pixelShader)
 {
 	ID3DBlob* pixelShaderBuffer = nullptr;
 
@@ -170,7 +156,7 @@ void TerrainShader::LoadPS(const wchar_t* ps)
 	assert(result == S_OK && "Failed to load shader");
 
 	// Create the shader from the buffer.
-	m_Device->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &m_PixelShader);
+	m_Device->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, pixelShader);
 	pixelShaderBuffer->Release();
 }
 
@@ -178,83 +164,87 @@ void TerrainShader::LoadPS(const wchar_t* ps)
 void TerrainShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
 	const XMMATRIX &worldMatrix, const XMMATRIX &viewMatrix, const XMMATRIX &projectionMatrix,
 	TerrainMesh* terrainMesh,
-	size_t lightCount, SceneLight** lights, Camera* camera, const std::vector<Material*>& materials)
+	LightingCache* lighting, Camera* camera, const std::vector<Material*>& materials, LightingCache::MaterialSetID materialSet,
+	const MaterialArrays* materialArrays)
 {
-	HRESULT result;
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	
-	ResourceBuffer tex2DBuffer, texCubeBuffer;
+	// light textures have already been placed into the frame's resource buffers
+	ResourceBuffer tex2DBuffer = lighting->GetTex2DResources();
+	ResourceBuffer texCubeBuffer = lighting->GetTexCubeResources();
 
 	// update data in buffers
-	{
-		// Transpose the matrices to prepare them for the shader.
-		result = deviceContext->Map(m_VSMatrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		VSMatrixBufferType* dataPtr = (VSMatrixBufferType*)mappedResource.pData;
-		dataPtr->world = XMMatrixTranspose(worldMatrix);
-		deviceContext->Unmap(m_VSMatrixBuffer, 0);
-	}
-	{
-		deviceContext->Map(m_TessellationBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		TessellationBufferType* dataPtr = (TessellationBufferType*)mappedResource.pData;
-		dataPtr->minMaxDistance = m_MinMaxDistance;
-		dataPtr->minMaxHeightDeviation = m_MinMaxHeightDeviation;
-		dataPtr->minMaxLOD = m_MinMaxLOD;
-		dataPtr->distanceLODBlending = m_DistanceLODBlending;
-		dataPtr->padding = 0.0f;
-		dataPtr->cameraPos = camera->getPosition();
-		dataPtr->size = terrainMesh->GetSize();
-		deviceContext->Unmap(m_TessellationBuffer, 0);
-	}
-	{
-		result = deviceContext->Map(m_DSMatrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		DSMatrixBufferType* dataPtr = (DSMatrixBufferType*)mappedResource.pData;
-		dataPtr->view = XMMatrixTranspose(viewMatrix);
-		dataPtr->projection = XMMatrixTranspose(projectionMatrix);
-		deviceContext->Unmap(m_DSMatrixBuffer, 0);
-	}
-	ShaderUtility::ConstructVSLightBuffer(deviceContext, m_DSLightBuffer, lights, lightCount, camera);
-	ShaderUtility::ConstructPSLightBuffer(deviceContext, m_PSLightBuffer, lights, lightCount, m_GlobalLighting, &tex2DBuffer, &texCubeBuffer);
-	ShaderUtility::ConstructMaterialBuffer(deviceContext, m_MaterialBuffer, materials.data(), materials.size(), &tex2DBuffer);
-	{
-		deviceContext->Map(m_TerrainBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		TerrainBufferType* dataPtr = (TerrainBufferType*)mappedResource.pData;
-		
-		dataPtr->heightmapDims = static_cast<float>(terrainMesh->GetHeightmapResolution());
-		dataPtr->terrainSize = terrainMesh->GetSize();
-
-		dataPtr->heightmapIndex = tex2DBuffer.AddResource(terrainMesh->GetHeightmapSRV());
-		dataPtr->uvScale = m_UVScale;
-
-		dataPtr->flatThreshold = m_FlatThreshold;
-		dataPtr->cliffThreshold = m_CliffThreshold;
-		dataPtr->shoreThreshold = m_ShoreThreshold;
-		dataPtr->snowHeightThreshold = m_SnowHeightThreshold;
-		dataPtr->minMaxSnowSteepness = m_MinMaxSnowSteepness;
-		dataPtr->steepnessSmoothing = m_SteepnessSmoothing;
-		dataPtr->heightSmoothing = m_HeightSmoothing;
-
-
-		deviceContext->Unmap(m_TerrainBuffer, 0);
-	}
-
-	deviceContext->VSSetConstantBuffers(0, 1, &m_VSMatrixBuffer);
-
-	deviceContext->HSSetConstantBuffers(0, 1, &m_TessellationBuffer);
+	VSMatrixBufferType vsMatrices;
+	vsMatrices.world = XMMatrixTranspose(worldMatrix);
+	ConstantBufferRing::Allocation vsMatrixBuffer = m_ConstantBufferRing->Upload(vsMatrices);
+
+	TessellationBufferType tessellation;
+	tessellation.minMaxDistance = m_MinMaxDistance;
+	tessellation.minMaxHeightDeviation = m_MinMaxHeightDeviation;
+	tessellation.minMaxLOD = m_MinMaxLOD;
+	tessellation.distanceLODBlending = m_DistanceLODBlending;
+	tessellation.padding = 0.0f;
+	tessellation.cameraPos = camera->getPosition();
+	tessellation.size = terrainMesh->GetSize();
+	ConstantBufferRing::Allocation tessellationBuffer = m_ConstantBufferRing->Upload(tessellation);
+
+	DSMatrixBufferType dsMatrices;
+	dsMatrices.view = XMMatrixTranspose(viewMatrix);
+	dsMatrices.projection = XMMatrixTranspose(projectionMatrix);
+	ConstantBufferRing::Allocation dsMatrixBuffer = m_ConstantBufferRing->Upload(dsMatrices);
+
+	// with the arrays, the materials' maps don't go in the resource buffer at all
+	TerrainLayerBufferType layers;
+	m_UsingLayerArrays = m_UseLayerArrays && FillLayerBuffer(&layers, materials, materialArrays);
+	ConstantBufferRing::Allocation layerBuffer;
+	ID3D11Buffer* materialBuffer = nullptr;
+	if (m_UsingLayerArrays)
+		layerBuffer = m_ConstantBufferRing->Upload(layers);
+	else
+		materialBuffer = lighting->GetMaterialBuffer(deviceContext, materialSet, &tex2DBuffer);
+
+	TerrainBufferType terrain;
+	terrain.heightmapDims = static_cast<float>(terrainMesh->GetHeightmapResolution());
+	terrain.terrainSize = terrainMesh->GetSize();
+
+	terrain.heightmapIndex = tex2DBuffer.AddResource(terrainMesh->GetHeightmapSRV());
+	terrain.uvScale = m_UVScale;
+
+	terrain.flatThreshold = m_FlatThreshold;
+	terrain.cliffThreshold = m_CliffThreshold;
+	terrain.shoreThreshold = m_ShoreThreshold;
+	terrain.snowHeightThreshold = m_SnowHeightThreshold;
+	terrain.minMaxSnowSteepness = m_MinMaxSnowSteepness;
+	terrain.steepnessSmoothing = m_SteepnessSmoothing;
+	terrain.heightSmoothing = m_HeightSmoothing;
+	ConstantBufferRing::Allocation terrainBuffer = m_ConstantBufferRing->Upload(terrain);
+
+	m_ConstantBufferRing->BindVS(0, { vsMatrixBuffer });
+
+	m_ConstantBufferRing->BindHS(0, { tessellationBuffer });
 	auto preprocessedHeightmap = terrainMesh->GetPreprocessSRV();
 	deviceContext->HSSetShaderResources(0, 1, &preprocessedHeightmap);
 	deviceContext->HSSetSamplers(0, 1, &m_PointSampler);
 
-	ID3D11Buffer* dsCBs[] = { m_DSMatrixBuffer, m_DSLightBuffer };
-	deviceContext->DSSetConstantBuffers(0, 2, dsCBs);
+	m_ConstantBufferRing->BindDS(0, { dsMatrixBuffer, ConstantBufferRing::WholeBuffer(lighting->GetVSLightBuffer()) });
 	auto heightmap = terrainMesh->GetHeightmapSRV();
 	deviceContext->DSSetShaderResources(0, 1, &heightmap);
 	deviceContext->DSSetSamplers(0, 1, &m_HeightmapSampleState);
 
-	ID3D11Buffer* psCBs[] = { m_PSLightBuffer, m_MaterialBuffer, m_TerrainBuffer };
-	deviceContext->PSSetConstantBuffers(0, 3, psCBs);
+	if (m_UsingLayerArrays)
+	{
+		m_ConstantBufferRing->BindPS(0, { ConstantBufferRing::WholeBuffer(lighting->GetPSLightBuffer()) });
+		m_ConstantBufferRing->BindPS(2, { terrainBuffer, layerBuffer });
+
+		ID3D11ShaderResourceView* arrays[] = {
+			materialArrays->GetArray(MaterialArrays::Map::Albedo),
+			materialArrays->GetArray(MaterialArrays::Map::Normal),
+			materialArrays->GetArray(MaterialArrays::Map::ORM)
+		};
+		deviceContext->PSSetShaderResources(64, 3, arrays);
+	}
+	else
+		m_ConstantBufferRing->BindPS(0, { ConstantBufferRing::WholeBuffer(lighting->GetPSLightBuffer()), ConstantBufferRing::WholeBuffer(materialBuffer), terrainBuffer });
 
-	deviceContext->PSSetShaderResources(0, RESOURCE_BUFFER_SIZE, tex2DBuffer.GetResourcePtr());
-	deviceContext->PSSetShaderResources(RESOURCE_BUFFER_SIZE, RESOURCE_BUFFER_SIZE, texCubeBuffer.GetResourcePtr());
+	lighting->BindPSResources(tex2DBuffer, texCubeBuffer);
 
 	ID3D11SamplerState* psSamplers[] = { m_GlobalLighting->GetBRDFIntegrationSampler(), m_GlobalLighting->GetCubemapSampler(), m_MaterialSampler, m_ShadowSampler, m_HeightmapSampleState };
 	deviceContext->PSSetSamplers(0, 5, psSamplers);
@@ -268,9 +258,9 @@ void TerrainShader::Render(ID3D11DeviceContext* deviceContext, unsigned int inde
 	deviceContext->HSSetShader(m_HullShader, nullptr, 0);
 	deviceContext->DSSetShader(m_DomainShader, nullptr, 0);
 	deviceContext->GSSetShader(nullptr, nullptr, 0);
-	deviceContext->PSSetShader(m_PixelShader, nullptr, 0);
+	deviceContext->PSSetShader(m_UsingLayerArrays ? m_LayerArrayPixelShader : m_PixelShader, nullptr, 0);
 
-	deviceContext->DrawIndexed(indexCount, 0, 0);
+	m_ConstantBufferRing->GetBackend()->DrawIndexed(indexCount, 0, 0);
 
 	deviceContext->VSSetShader(nullptr, nullptr, 0);
 	deviceContext->HSSetShader(nullptr, nullptr, 0);
@@ -278,9 +268,41 @@ void TerrainShader::Render(ID3D11DeviceContext* deviceContext, unsigned int inde
 	deviceContext->PSSetShader(nullptr, nullptr, 0);
 }
 
+bool TerrainShader::FillLayerBuffer(TerrainLayerBufferType* layerBuffer, const std::vector<Material*>& materials, const MaterialArrays* materialArrays) const
+{
+	if (!materialArrays || !materialArrays->IsLoaded() || materials.size() > MAX_TERRAIN_LAYERS)
+		return false;
+
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		const Material* mat = materials[i];
+		TerrainLayerType& layer = layerBuffer->layers[i];
+		layer.slice = materialArrays->GetSlice(mat);
+		if (layer.slice < 0)
+			return false;
+
+		// the slices were built from the same maps, so a map is used from the array when the material would use its own
+		layer.albedo = mat->GetAlbedo();
+		layer.useAlbedoMap = mat->UseAlbedoMap() ? 1.0f : 0.0f;
+		layer.useNormalMap = mat->UseNormalMap() ? 1.0f : 0.0f;
+
+		layer.orm = { 1.0f, mat->GetRoughness(), mat->GetMetalness() };
+		if (mat->UseORMMap())
+			layer.ormMapMask = mat->GetORMMapMask();
+		else
+			layer.ormMapMask = { 0.0f, mat->UseRoughnessMap() ? 1.0f : 0.0f, mat->UseMetalnessMap() ? 1.0f : 0.0f };
+	}
+	for (size_t i = materials.size(); i < MAX_TERRAIN_LAYERS; i++)
+		layerBuffer->layers[i] = {};
+	return true;
+}
+
 void TerrainShader::GUI()
 {
 	ImGui::Text("Materials");
+	ImGui::Checkbox("Use Texture Arrays", &m_UseLayerArrays);
+	if (m_UseLayerArrays && !m_UsingLayerArrays)
+		ImGui::Text("Texture arrays aren't built for these materials");
 	ImGui::DragFloat("UV Scale", &m_UVScale, 0.01f);
 	ImGui::SliderFloat("Flat Threshold", &m_FlatThreshold, 0.0f, m_CliffThreshold);
 	ImGui::SliderFloat("Cliff Threshold", &m_CliffThreshold, m_FlatThreshold, 1.0f);
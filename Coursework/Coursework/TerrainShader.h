@@ -4,11 +4,13 @@
 using namespace DirectX;
 
 #include "ShaderUtility.h"
+#include "LightingCache.h"
 
-class SceneLight;
 class Material;
 class GlobalLighting;
+class ConstantBufferRing;
 class TerrainMesh;
+class MaterialArrays;
 
 
 class TerrainShader
@@ -40,6 +42,22 @@ private:
 
 		XMFLOAT2 minMaxSnowSteepness;
 	};
+	struct TerrainLayerType
+	{
+		XMFLOAT3 albedo;
+		int slice;
+
+		// occlusion, roughness and metallic for the channels that don't come from the ORM slice
+		XMFLOAT3 orm;
+		float useAlbedoMap;
+
+		XMFLOAT3 ormMapMask;
+		float useNormalMap;
+	};
+	struct TerrainLayerBufferType
+	{
+		TerrainLayerType layers[MAX_TERRAIN_LAYERS];
+	};
 	struct TessellationBufferType
 	{
 		XMFLOAT2 minMaxDistance;
@@ -52,13 +70,14 @@ private:
 	};
 
 public:
-	TerrainShader(ID3D11Device* device, GlobalLighting* globalLighing);
+	TerrainShader(ID3D11Device* device, GlobalLighting* globalLighing, ConstantBufferRing* constantBufferRing);
 	~TerrainShader();
 
 	void SetShaderParameters(ID3D11DeviceContext* deviceContext,
 								const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection,
 								TerrainMesh* terrainMesh,
-								size_t lightCount, SceneLight** lights, Camera* camera, const std::vector<Material*>& materials);
+								LightingCache* lighting, Camera* camera, const std::vector<Material*>& materials, LightingCache::MaterialSetID materialSet,
+								const MaterialArrays* materialArrays = nullptr);
 	void Render(ID3D11DeviceContext* deviceContext, unsigned int indexCount);
 
 	void GUI();
@@ -67,6 +86,10 @@ public:
 	inline const XMFLOAT2& GetMinMaxHeightDeviation() const { return m_MinMaxHeightDeviation; }
 	inline float GetDistanceLODBlending() const { return m_DistanceLODBlending; }
 	inline const XMFLOAT2& GetMinMaxLOD() const { return m_MinMaxLOD; }
+	// how many times the materials repeat across the terrain
+	inline float GetUVScale() const { return m_UVScale; }
+	// the materials' own maps aren't sampled while the layer arrays are
+	inline bool IsUsingLayerArrays() const { return m_UsingLayerArrays; }
 
 private:
 	void InitShader();
@@ -74,7 +97,10 @@ private:
 	void LoadVS(const wchar_t* vs);
 	void LoadHS(const wchar_t* hs);
 	void LoadDS(const wchar_t* ds);
-	void LoadPS(const wchar_t* ps);
+	void LoadPS(const wchar_t* ps, ID3D11PixelShader** pixelShader);
+
+	// the arrays are only used if every material is a slice of them
+	bool FillLayerBuffer(TerrainLayerBufferType* layerBuffer, const std::vector<Material*>& materials, const MaterialArrays* materialArrays) const;
 
 private:
 	ID3D11Device* m_Device = nullptr;
@@ -83,23 +109,18 @@ private:
 	ID3D11HullShader* m_HullShader = nullptr;
 	ID3D11DomainShader* m_DomainShader = nullptr;
 	ID3D11PixelShader* m_PixelShader = nullptr;
+	// reads the materials from texture arrays
+	ID3D11PixelShader* m_LayerArrayPixelShader = nullptr;
 
 	ID3D11InputLayout* m_InputLayout = nullptr;
 
-	ID3D11Buffer* m_VSMatrixBuffer = nullptr;			// matrices to be sent to vertex shader
-	ID3D11Buffer* m_TessellationBuffer = nullptr;		// tessellation parameters
-	ID3D11Buffer* m_DSMatrixBuffer = nullptr;			// matrices to be sent to domain shader
-	ID3D11Buffer* m_DSLightBuffer = nullptr;			// camera and light matrices
-	ID3D11Buffer* m_PSLightBuffer = nullptr;				// lighting data
-	ID3D11Buffer* m_MaterialBuffer = nullptr;			// material data
-	ID3D11Buffer* m_TerrainBuffer = nullptr;			// terrain data
-
 	ID3D11SamplerState* m_HeightmapSampleState = nullptr;
 	ID3D11SamplerState* m_MaterialSampler = nullptr;
 	ID3D11SamplerState* m_ShadowSampler = nullptr;
 	ID3D11SamplerState* m_PointSampler = nullptr;
 
 	GlobalLighting* m_GlobalLighting = nullptr;
+	ConstantBufferRing* m_ConstantBufferRing = nullptr;
 
 	// terrain properties
 	float m_UVScale = 32.0f;
@@ -111,6 +132,10 @@ private:
 	float m_SteepnessSmoothing = 0.108f;
 	float m_HeightSmoothing = 1.0f;
 
+	bool m_UseLayerArrays = true;
+	// whether the last draw used them
+	bool m_UsingLayerArrays = false;
+
 	// tessellation params
 	XMFLOAT2 m_MinMaxDistance{ 5.0f, 25.0f };
 	XMFLOAT2 m_MinMaxHeightDeviation{ 0.5f, 2.0f };
@@ -0,0 +1,437 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+#include <iterator>
+
+#include "DTK/include/DDSTextureLoader.h"
+#include "stb_image.h"
+
+#include "Cubemap.h"
+#include "IBLCache.h"
+
+#include "imGUI/imgui.h"
+
+
+TextureCache::TextureCache(ID3D11Device* device)
+	: m_Device(device)
+{
+}
+
+TextureCache::~TextureCache()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	while (!m_Entries.empty())
+		FreeEntry(m_Entries.begin()->first);
+}
+
+ID3D11ShaderResourceView* TextureCache::Acquire(const std::wstring& filename, GPUMemoryTracker::Category category, const MipGenerator::Settings& mipSettings,
+	unsigned int skipMips)
+{
+	// normalised paths are lowercase, so ".DDS" is found too
+	std::wstring normalised = NormalisePath(filename);
+	bool dds = normalised.size() > 4 && normalised.compare(normalised.size() - 4, 4, L".dds") == 0;
+	// a DDS is created as it is, anything else depends on how its mips are made
+	unsigned int variant = dds ? 0 : 1 + (static_cast<unsigned int>(mipSettings.filter) << 2 | mipSettings.srgb << 1 | mipSettings.normalMap);
+	variant |= skipMips << 8;
+	std::wstring path = normalised + L"|" + std::to_wstring(variant);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto known = m_Paths.find(path);
+	if (known != m_Paths.end())
+	{
+		// Reference can wait with the lock released, and paths added meanwhile invalidate the iterator
+		uint64_t knownKey = known->second;
+		if (Reference(lock, knownKey, path, false))
+			return m_Entries[knownKey].texture;
+	}
+	lock.unlock();
+
+	// a path that hasn't been seen, but the same file may have been loaded from another
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.good()) return nullptr;
+	std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+	uint64_t key = IBLCache::Hash(bytes.data(), bytes.size(), IBLCache::Hash(&variant, sizeof(variant)));
+
+	lock.lock();
+	if (m_Entries.count(key) > 0 && Reference(lock, key, path, true))
+		return m_Entries[key].texture;
+
+	// other threads asking for it wait until it has been created
+	Entry& entry = m_Entries[key];
+	for (wchar_t c : filename) entry.name += static_cast<char>(c);
+	entry.category = category;
+	if (skipMips > 0) entry.name += " (from mip " + std::to_string(skipMips) + ")";
+	entry.references = 1;
+	entry.loading = true;
+	m_Paths[path] = key;
+	m_Stats.misses++;
+	lock.unlock();
+
+	ID3D11ShaderResourceView* texture = CreateTexture(bytes, dds, mipSettings, skipMips);
+
+	// the entry can't have been freed while it was loading
+	lock.lock();
+	entry.loading = false;
+	if (texture)
+	{
+		entry.texture = texture;
+		ID3D11Resource* resource = nullptr;
+		texture->GetResource(&resource);
+		entry.bytes = GPUMemoryTracker::CalculateSize(resource);
+		resource->Release();
+		GPUMemoryTracker::Track(texture, category, entry.name);
+		m_TextureKeys[texture] = key;
+	}
+	else
+		FreeEntry(key);
+	m_Loaded.notify_all();
+
+	return texture;
+}
+
+ID3D11ShaderResourceView* TextureCache::AcquireFallback(bool normalMap)
+{
+	std::wstring path = normalMap ? L"fallback|normal" : L"fallback";
+	uint64_t key = IBLCache::Hash(path.data(), path.size() * sizeof(wchar_t));
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (m_Entries.count(key) > 0 && Reference(lock, key, path, false))
+		return m_Entries[key].texture;
+
+	// small enough to make with the lock held
+	const uint32_t texel = normalMap ? 0xffff8080 : 0xffffffff;
+	D3D11_SUBRESOURCE_DATA data = { &texel, sizeof(texel), 0 };
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = desc.Height = desc.MipLevels = desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ID3D11Texture2D* resource = nullptr;
+	ID3D11ShaderResourceView* texture = nullptr;
+	HRESULT hr = m_Device->CreateTexture2D(&desc, &data, &resource);
+	if (hr == S_OK)
+	{
+		hr = m_Device->CreateShaderResourceView(resource, nullptr, &texture);
+		resource->Release();
+	}
+	if (hr != S_OK) return nullptr;
+
+	Entry& entry = m_Entries[key];
+	entry.name = normalMap ? "Fallback normal map" : "Fallback texture";
+	entry.category = GPUMemoryTracker::Category::Textures;
+	entry.texture = texture;
+	entry.references = 1;
+	entry.bytes = sizeof(texel);
+	GPUMemoryTracker::Track(texture, entry.category, entry.name);
+	m_TextureKeys[texture] = key;
+	m_Paths[path] = key;
+	return texture;
+}
+
+Cubemap* TextureCache::AcquireCubemap(const std::vector<std::string>& faces, const std::function<Cubemap*()>& create)
+{
+	std::wstring path = L"cube";
+	for (const std::string& face : faces)
+		path += L"|" + NormalisePath(std::wstring(face.begin(), face.end()));
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto known = m_Paths.find(path);
+	if (known != m_Paths.end())
+	{
+		// copied for the same reason as in Acquire
+		uint64_t knownKey = known->second;
+		if (Reference(lock, knownKey, path, false))
+			return m_Entries[knownKey].cubemap;
+	}
+	lock.unlock();
+
+	// faces that can't be read are keyed by their paths, the cubemap was made from something
+	const char seed[] = "cube";
+	uint64_t key = 0;
+	if (!IBLCache::HashFiles(faces, IBLCache::Hash(seed, sizeof(seed)), &key))
+		key = IBLCache::Hash(path.data(), path.size() * sizeof(wchar_t));
+
+	lock.lock();
+	if (m_Entries.count(key) > 0 && Reference(lock, key, path, true))
+		return m_Entries[key].cubemap;
+
+	Entry& entry = m_Entries[key];
+	entry.name = faces.empty() ? "Cubemap" : faces[0];
+	entry.category = GPUMemoryTracker::Category::Environment;
+	entry.references = 1;
+	entry.loading = true;
+	m_Paths[path] = key;
+	m_Stats.misses++;
+	lock.unlock();
+
+	Cubemap* cubemap = create();
+
+	lock.lock();
+	entry.loading = false;
+	if (cubemap)
+	{
+		entry.cubemap = cubemap;
+		entry.bytes = GPUMemoryTracker::CalculateSize(cubemap->GetTexture());
+		m_CubemapKeys[cubemap] = key;
+	}
+	else
+		FreeEntry(key);
+	m_Loaded.notify_all();
+
+	return cubemap;
+}
+
+void TextureCache::Release(ID3D11ShaderResourceView* texture)
+{
+	if (!texture) return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto key = m_TextureKeys.find(texture);
+	assert(key != m_TextureKeys.end() && "Texture isn't from the cache!");
+	ReleaseEntry(key->second);
+}
+
+void TextureCache::Release(Cubemap* cubemap)
+{
+	if (!cubemap) return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto key = m_CubemapKeys.find(cubemap);
+	assert(key != m_CubemapKeys.end() && "Cubemap isn't from the cache!");
+	ReleaseEntry(key->second);
+}
+
+void TextureCache::Trim()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	while (GPUMemoryTracker::IsOverBudget() && FreeLeastRecentlyUsed())
+		m_Stats.evictions++;
+}
+
+void TextureCache::Trim(GPUMemoryTracker::Category category, size_t targetBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	size_t bytes = 0;
+	for (const auto& entry : m_Entries)
+	{
+		if (entry.second.category == category) bytes += entry.second.bytes;
+	}
+
+	size_t freed = 0;
+	while (bytes > targetBytes && FreeLeastRecentlyUsed(&category, &freed))
+	{
+		bytes -= freed;
+		m_Stats.evictions++;
+	}
+}
+
+void TextureCache::FreeUnused()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	while (FreeLeastRecentlyUsed())
+		m_Stats.evictions++;
+}
+
+TextureCache::Stats TextureCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void TextureCache::SettingsGUI()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	unsigned int unused = 0;
+	size_t bytes = 0, unusedBytes = 0;
+	for (const auto& entry : m_Entries)
+	{
+		bytes += entry.second.bytes;
+		if (entry.second.references == 0)
+		{
+			unused++;
+			unusedBytes += entry.second.bytes;
+		}
+	}
+
+	const float BytesPerMB = 1024.0f * 1024.0f;
+	unsigned int requests = m_Stats.hits + m_Stats.contentHits + m_Stats.misses;
+	ImGui::Text("Hits: %u (%u by content), misses: %u, hit rate %.0f%%", m_Stats.hits + m_Stats.contentHits, m_Stats.contentHits, m_Stats.misses,
+		requests > 0 ? 100.0f * (m_Stats.hits + m_Stats.contentHits) / requests : 0.0f);
+	ImGui::Text("%u entries, %.1f MB", static_cast<unsigned int>(m_Entries.size()), bytes / BytesPerMB);
+	ImGui::Text("%u unused, %.1f MB (%u evicted)", unused, unusedBytes / BytesPerMB, m_Stats.evictions);
+
+	if (ImGui::Button("Free Unused"))
+	{
+		while (FreeLeastRecentlyUsed())
+			m_Stats.evictions++;
+	}
+}
+
+bool TextureCache::WaitForEntry(std::unique_lock<std::mutex>& lock, uint64_t key)
+{
+	m_Loaded.wait(lock, [this, key]()
+	{
+		auto entry = m_Entries.find(key);
+		return entry == m_Entries.end() || !entry->second.loading;
+	});
+	return m_Entries.count(key) > 0;
+}
+
+bool TextureCache::Reference(std::unique_lock<std::mutex>& lock, uint64_t key, const std::wstring& path, bool contentHit)
+{
+	if (!WaitForEntry(lock, key)) return false;
+
+	m_Entries[key].references++;
+	m_Paths[path] = key;
+	(contentHit ? m_Stats.contentHits : m_Stats.hits)++;
+	return true;
+}
+
+void TextureCache::ReleaseEntry(uint64_t key)
+{
+	// called with the mutex locked
+	Entry& entry = m_Entries.at(key);
+	assert(entry.references > 0 && "Released more times than it was acquired!");
+	if (--entry.references == 0)
+		entry.lastUsed = ++m_UseCounter;
+}
+
+void TextureCache::FreeEntry(uint64_t key)
+{
+	Entry& entry = m_Entries.at(key);
+	if (entry.texture)
+	{
+		GPUMemoryTracker::Untrack(entry.texture);
+		m_TextureKeys.erase(entry.texture);
+		entry.texture->Release();
+	}
+	if (entry.cubemap)
+	{
+		m_CubemapKeys.erase(entry.cubemap);
+		delete entry.cubemap;
+	}
+
+	for (auto path = m_Paths.begin(); path != m_Paths.end();)
+		path = path->second == key ? m_Paths.erase(path) : std::next(path);
+	m_Entries.erase(key);
+}
+
+bool TextureCache::FreeLeastRecentlyUsed(const GPUMemoryTracker::Category* category, size_t* freedBytes)
+{
+	// called with the mutex locked
+	auto oldest = m_Entries.end();
+	for (auto entry = m_Entries.begin(); entry != m_Entries.end(); entry++)
+	{
+		if (entry->second.references > 0 || entry->second.loading) continue;
+		if (category && entry->second.category != *category) continue;
+		if (oldest == m_Entries.end() || entry->second.lastUsed < oldest->second.lastUsed) oldest = entry;
+	}
+	if (oldest == m_Entries.end()) return false;
+
+	if (freedBytes) *freedBytes = oldest->second.bytes;
+	FreeEntry(oldest->first);
+	return true;
+}
+
+ID3D11ShaderResourceView* TextureCache::CreateTexture(const std::vector<unsigned char>& bytes, bool dds, const MipGenerator::Settings& mipSettings, unsigned int skipMips) const
+{
+	ID3D11ShaderResourceView* srv = nullptr;
+
+	// a DDS has its mips already, the loader leaves out the ones larger than maxSize
+	if (dds)
+	{
+		size_t maxSize = 0;
+		if (skipMips > 0 && bytes.size() >= 20)
+		{
+			// after the magic number, the header's size and flags come before the height and width
+			uint32_t height, width;
+			memcpy(&height, bytes.data() + 12, sizeof(height));
+			memcpy(&width, bytes.data() + 16, sizeof(width));
+			maxSize = (std::max)((std::max)(width, height) >> (std::min)(skipMips, 31u), 1u);
+		}
+		HRESULT hr = CreateDDSTextureFromMemory(m_Device, bytes.data(), bytes.size(), nullptr, &srv, maxSize);
+		return hr == S_OK ? srv : nullptr;
+	}
+
+	// single channel images stay single channel, like the WIC loader
+	int width = 0, height = 0, fileChannels = 0;
+	stbi_info_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &fileChannels);
+	unsigned int channels = fileChannels == 1 ? 1 : 4;
+	unsigned char* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &fileChannels, channels);
+	if (!pixels) return nullptr;
+
+	// the mips are made on the CPU so the texture is created whole, without the immediate context
+	// this is usually called from a job already running on the pool, so they are made on this thread
+	MipGenerator::MipChain mips = MipGenerator::Generate(pixels, width, height, channels, mipSettings);
+
+	// the smallest mip is always kept
+	UINT firstMip = (std::min)(skipMips, static_cast<unsigned int>(mips.size()));
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = (std::max)(static_cast<UINT>(width) >> firstMip, 1u);
+	desc.Height = (std::max)(static_cast<UINT>(height) >> firstMip, 1u);
+	desc.MipLevels = static_cast<UINT>(mips.size()) + 1 - firstMip;
+	desc.ArraySize = 1;
+	desc.Format = channels == 1 ? DXGI_FORMAT_R8_UNORM : DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> data(desc.MipLevels);
+	for (UINT mip = 0; mip < desc.MipLevels; mip++)
+	{
+		UINT level = firstMip + mip;
+		data[mip].pSysMem = level == 0 ? pixels : mips[level - 1].data();
+		data[mip].SysMemPitch = (std::max)(desc.Width >> mip, 1u) * channels;
+	}
+
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = m_Device->CreateTexture2D(&desc, data.data(), &texture);
+	stbi_image_free(pixels);
+	if (hr != S_OK) return nullptr;
+
+	hr = m_Device->CreateShaderResourceView(texture, nullptr, &srv);
+	// the view holds a reference
+	texture->Release();
+	return hr == S_OK ? srv : nullptr;
+}
+
+std::wstring TextureCache::NormalisePath(const std::wstring& path)
+{
+	// windows paths aren't case sensitive, and either slash can be used
+	std::wstring lower(path);
+	for (wchar_t& c : lower)
+		c = c == L'\\' ? L'/' : static_cast<wchar_t>(std::towlower(c));
+
+	// "." and "dir/.." segments are dropped
+	std::vector<std::wstring> segments;
+	size_t start = 0;
+	while (start <= lower.size())
+	{
+		size_t end = lower.find(L'/', start);
+		if (end == std::wstring::npos) end = lower.size();
+		std::wstring segment = lower.substr(start, end - start);
+		start = end + 1;
+
+		if (segment == L"." || (segment.empty() && !segments.empty())) continue;
+		if (segment == L".." && !segments.empty() && segments.back() != L".." && !segments.back().empty())
+			segments.pop_back();
+		else
+			segments.push_back(segment);
+	}
+
+	std::wstring normalised;
+	for (size_t i = 0; i < segments.size(); i++)
+		normalised += (i > 0 ? L"/" : L"") + segments[i];
+	return normalised;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GPUMemoryTracker.h"
+#include "MipGenerator.h"
+
+class Cubemap;
+
+
+// Reference counted cache of the textures and cubemaps loaded from files, so a file is only decoded and uploaded once
+// Entries are found by normalised path first, and a path that hasn't been seen is hashed so that files with the same
+// contents share a texture too. Textures are also keyed by their mip settings, as they change what is uploaded
+//
+// An entry with no references stays loaded for the next time it is asked for, until the GPU memory tracker goes over
+// budget and Trim frees the least recently used ones. A system with its own budget for a category, like the texture
+// streamer, can trim that category down to it. All of it can be called from any thread, e.g. asset loader jobs
+
+class TextureCache
+{
+public:
+	struct Stats
+	{
+		unsigned int hits = 0;
+		// a new path to a file that was already loaded
+		unsigned int contentHits = 0;
+		unsigned int misses = 0;
+		unsigned int evictions = 0;
+	};
+
+public:
+	TextureCache(ID3D11Device* device);
+	// frees every entry, referenced or not
+	~TextureCache();
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// DDS files are created as they are, anything else is decoded with stb_image and given mips
+	// skipMips drops the largest mips, for streaming, and each number of them is a different entry
+	// returns null if the file can't be loaded. Each successful call needs a Release
+	ID3D11ShaderResourceView* Acquire(const std::wstring& filename, GPUMemoryTracker::Category category, const MipGenerator::Settings& mipSettings = MipGenerator::Settings(),
+		unsigned int skipMips = 0);
+	// a 1x1 texture for a file that failed to load, white or a flat normal, made on first use. Needs a Release like any other
+	ID3D11ShaderResourceView* AcquireFallback(bool normalMap);
+	// faces in the Cubemap face order, create is called to make the cubemap on a miss
+	Cubemap* AcquireCubemap(const std::vector<std::string>& faces, const std::function<Cubemap*()>& create);
+
+	void Release(ID3D11ShaderResourceView* texture);
+	void Release(Cubemap* cubemap);
+
+	// call once a frame, frees unreferenced entries while over the memory budget
+	void Trim();
+	// frees unreferenced entries of a category until all of its entries, referenced or not, fit in targetBytes
+	void Trim(GPUMemoryTracker::Category category, size_t targetBytes);
+	void FreeUnused();
+
+	Stats GetStats() const;
+
+	void SettingsGUI();
+
+	// lowercase with forward slashes and no . or .. parts, so two spellings of a file compare equal
+	static std::wstring NormalisePath(const std::wstring& path);
+
+private:
+	struct Entry
+	{
+		std::string name;
+		GPUMemoryTracker::Category category = GPUMemoryTracker::Category::Textures;
+		ID3D11ShaderResourceView* texture = nullptr;
+		Cubemap* cubemap = nullptr;
+		unsigned int references = 0;
+		size_t bytes = 0;
+		// set when the last reference is released, the lowest is freed first
+		unsigned long long lastUsed = 0;
+		// another thread is creating it
+		bool loading = false;
+	};
+
+	// with the lock held, false if the entry failed to load while waiting for it
+	bool WaitForEntry(std::unique_lock<std::mutex>& lock, uint64_t key);
+	// with the lock held, adds a reference to an entry that is already there
+	bool Reference(std::unique_lock<std::mutex>& lock, uint64_t key, const std::wstring& path, bool contentHit);
+	void ReleaseEntry(uint64_t key);
+	// with the lock held
+	void FreeEntry(uint64_t key);
+	// only looks at entries of category when it isn't null, freedBytes is set to the size of the entry that was freed
+	bool FreeLeastRecentlyUsed(const GPUMemoryTracker::Category* category = nullptr, size_t* freedBytes = nullptr);
+
+	ID3D11ShaderResourceView* CreateTexture(const std::vector<unsigned char>& bytes, bool dds, const MipGenerator::Settings& mipSettings, unsigned int skipMips) const;
+
+private:
+	ID3D11Device* m_Device = nullptr;
+
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_Loaded;
+
+	// by content hash
+	std::unordered_map<uint64_t, Entry> m_Entries;
+	// normalised path (and mip settings) to content hash
+	std::unordered_map<std::wstring, uint64_t> m_Paths;
+	std::unordered_map<ID3D11ShaderResourceView*, uint64_t> m_TextureKeys;
+	std::unordered_map<Cubemap*, uint64_t> m_CubemapKeys;
+
+	unsigned long long m_UseCounter = 0;
+	Stats m_Stats;
+};
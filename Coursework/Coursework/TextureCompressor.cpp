@@ -0,0 +1,632 @@
+#include "TextureCompressor.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "stb_image.h"
+
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	// weights of BC7's 4-bit indices, out of 64
+	const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// BC7 fields are packed least significant bit first
+	struct BitWriter
+	{
+		unsigned char* block;
+		unsigned int position;
+
+		void Write(unsigned int value, unsigned int bits)
+		{
+			for (unsigned int i = 0; i < bits; i++, position++)
+			{
+				if ((value >> i) & 1) block[position >> 3] |= 1 << (position & 7);
+			}
+		}
+	};
+
+	struct BitReader
+	{
+		const unsigned char* block;
+		unsigned int position;
+
+		unsigned int Read(unsigned int bits)
+		{
+			unsigned int value = 0;
+			for (unsigned int i = 0; i < bits; i++, position++)
+				value |= ((block[position >> 3] >> (position & 7)) & 1) << i;
+			return value;
+		}
+	};
+
+	// r0 > r1 interpolates 6 values between them, otherwise 4 are interpolated and 0 and 255 are added
+	void BC4Palette(int r0, int r1, int palette[8])
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+		if (r0 > r1)
+		{
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * r0 + i * r1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * r0 + i * r1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	// the nearest palette entry for every value, returns the squared error
+	int FitBC4Indices(const unsigned char values[16], const int palette[8], unsigned char indices[16])
+	{
+		int error = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int bestError = INT_MAX;
+			for (int p = 0; p < 8; p++)
+			{
+				int e = (values[i] - palette[p]) * (values[i] - palette[p]);
+				if (e < bestError)
+				{
+					bestError = e;
+					indices[i] = static_cast<unsigned char>(p);
+				}
+			}
+			error += bestError;
+		}
+		return error;
+	}
+
+	struct BC7Mode6
+	{
+		// 7 bits per channel and a shared low bit per endpoint
+		int quantised[2][4];
+		int pBit[2];
+		unsigned char indices[16];
+		int error;
+	};
+
+	int BC7Endpoint(const BC7Mode6& block, int endpoint, int channel)
+	{
+		return (block.quantised[endpoint][channel] << 1) | block.pBit[endpoint];
+	}
+
+	// picks whichever p-bit lands the endpoint closest to where it should be
+	void QuantiseBC7Endpoint(const float endpoint[4], int quantised[4], int* pBit)
+	{
+		float bestError = FLT_MAX;
+		for (int p = 0; p < 2; p++)
+		{
+			int q[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				q[c] = (std::min)((std::max)(static_cast<int>(std::floor((endpoint[c] - p) * 0.5f + 0.5f)), 0), 127);
+				float d = static_cast<float>((q[c] << 1) | p) - endpoint[c];
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(quantised, q, sizeof(q));
+				*pBit = p;
+			}
+		}
+	}
+
+	void FitBC7Indices(const unsigned char rgba[64], BC7Mode6& block)
+	{
+		int palette[16][4];
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+				palette[i][c] = ((64 - BC7Weights[i]) * BC7Endpoint(block, 0, c) + BC7Weights[i] * BC7Endpoint(block, 1, c) + 32) >> 6;
+		}
+
+		block.error = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int bestError = INT_MAX;
+			for (int p = 0; p < 16; p++)
+			{
+				int error = 0;
+				for (int c = 0; c < 4; c++)
+				{
+					int d = rgba[i * 4 + c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					block.indices[i] = static_cast<unsigned char>(p);
+				}
+			}
+			block.error += bestError;
+		}
+	}
+
+	// 0 if the file doesn't exist
+	time_t GetModifiedTime(const std::string& file)
+	{
+		struct stat info;
+		return stat(file.c_str(), &info) == 0 ? info.st_mtime : 0;
+	}
+}
+
+
+DXGI_FORMAT TextureCompressor::GetMapFormat(const std::string& mapName)
+{
+	if (mapName == "albedo" || mapName == "orm") return DXGI_FORMAT_BC7_UNORM;
+	if (mapName == "normal") return DXGI_FORMAT_BC5_UNORM;
+	if (mapName == "roughness" || mapName == "metalness") return DXGI_FORMAT_BC4_UNORM;
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+MipGenerator::Settings TextureCompressor::GetMipSettings(const std::string& mapName)
+{
+	MipGenerator::Settings mipSettings;
+	mipSettings.srgb = mapName == "albedo";
+	mipSettings.normalMap = mapName == "normal";
+	return mipSettings;
+}
+
+DDSFile::Image TextureCompressor::Compress(const unsigned char* rgba, unsigned int width, unsigned int height, DXGI_FORMAT format, const MipGenerator::Settings& mipSettings, ThreadPool* threadPool)
+{
+	assert((format == DXGI_FORMAT_BC4_UNORM || format == DXGI_FORMAT_BC5_UNORM || format == DXGI_FORMAT_BC7_UNORM) && "Unsupported format!");
+
+	DDSFile::Image image;
+	image.format = format;
+	image.width = width;
+	image.height = height;
+	image.mipLevels = MipGenerator::CountMipLevels(width, height);
+	image.data.resize(DDSFile::CalculateDataSize(format, width, height, image.mipLevels, 1));
+
+	size_t blockSize = format == DXGI_FORMAT_BC4_UNORM ? 8 : 16;
+
+	MipGenerator::MipChain mips = MipGenerator::Generate(rgba, width, height, 4, mipSettings, threadPool);
+
+	unsigned char* output = image.data.data();
+	for (unsigned int mip = 0; mip < image.mipLevels; mip++)
+	{
+		const unsigned char* level = mip == 0 ? rgba : mips[mip - 1].data();
+		unsigned int w = (std::max)(width >> mip, 1u);
+		unsigned int h = (std::max)(height >> mip, 1u);
+		unsigned int blocksX = (w + 3) / 4;
+		unsigned int blocksY = (h + 3) / 4;
+
+		threadPool->ParallelFor(blocksY, 4, [&](size_t begin, size_t end)
+		{
+			unsigned char pixels[64], red[16], green[16];
+			for (size_t by = begin; by < end; by++)
+			{
+				for (unsigned int bx = 0; bx < blocksX; bx++)
+				{
+					// blocks hanging over the edge repeat the last row and column
+					for (unsigned int i = 0; i < 16; i++)
+					{
+						unsigned int x = (std::min)(bx * 4 + (i & 3), w - 1);
+						unsigned int y = (std::min)(static_cast<unsigned int>(by) * 4 + (i >> 2), h - 1);
+						memcpy(pixels + i * 4, level + (static_cast<size_t>(y) * w + x) * 4, 4);
+						red[i] = pixels[i * 4];
+						green[i] = pixels[i * 4 + 1];
+					}
+
+					unsigned char* block = output + (by * blocksX + bx) * blockSize;
+					if (format == DXGI_FORMAT_BC4_UNORM)
+						EncodeBC4Block(red, block);
+					else if (format == DXGI_FORMAT_BC5_UNORM)
+						EncodeBC5Block(red, green, block);
+					else
+						EncodeBC7Block(pixels, block);
+				}
+			}
+		});
+		output += blocksX * blocksY * blockSize;
+	}
+
+	return image;
+}
+
+bool TextureCompressor::CompressMaterialDirectory(const std::string& directory)
+{
+	ThreadPool threadPool;
+
+	// the packed map replaces the roughness and metalness maps, it isn't worth it for one map on its own
+	int ormSources = 0;
+	for (const char* map : { "occlusion", "roughness", "metalness" })
+	{
+		if (GetModifiedTime(directory + "/" + map + ".png") != 0) ormSources++;
+	}
+	bool packORM = ormSources >= 2;
+
+	bool success = true;
+	const char* maps[] = { "albedo", "normal", "roughness", "metalness" };
+	for (const char* map : maps)
+	{
+		if (packORM && GetMapFormat(map) == DXGI_FORMAT_BC4_UNORM)
+			continue;
+
+		std::string source = directory + "/" + map + ".png";
+		std::string compressed = directory + "/" + map + ".dds";
+
+		// up to date, or nothing to compress
+		time_t sourceTime = GetModifiedTime(source);
+		if (sourceTime == 0 || GetModifiedTime(compressed) >= sourceTime)
+			continue;
+
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(source.c_str(), &width, &height, &channels, 4);
+		if (!pixels)
+		{
+			success = false;
+			continue;
+		}
+
+		DDSFile::Image image = Compress(pixels, width, height, GetMapFormat(map), GetMipSettings(map), &threadPool);
+		stbi_image_free(pixels);
+
+		success = DDSFile::Write(compressed, image) && success;
+	}
+
+	if (packORM)
+		success = PackORM(directory, &threadPool) && success;
+	return success;
+}
+
+bool TextureCompressor::PackORM(const std::string& directory, ThreadPool* threadPool)
+{
+	const char* maps[3] = { "occlusion", "roughness", "metalness" };
+	const unsigned char defaults[3] = { 255, 128, 0 };
+	std::string packed = directory + "/orm.dds";
+
+	// up to date if it is newer than all of its sources
+	time_t newest = 0;
+	for (const char* map : maps)
+		newest = (std::max)(newest, GetModifiedTime(directory + "/" + map + ".png"));
+	if (newest == 0 || GetModifiedTime(packed) >= newest)
+		return true;
+
+	unsigned char* channels[3] = { nullptr, nullptr, nullptr };
+	int width = 0, height = 0;
+	bool success = true;
+	for (int c = 0; c < 3; c++)
+	{
+		std::string source = directory + "/" + maps[c] + ".png";
+		if (GetModifiedTime(source) == 0)
+			continue;
+
+		int w, h, n;
+		channels[c] = stbi_load(source.c_str(), &w, &h, &n, 1);
+		// the maps have to line up texel for texel
+		if (!channels[c] || (width != 0 && (w != width || h != height)))
+			success = false;
+		width = w;
+		height = h;
+	}
+
+	if (success)
+	{
+		std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+		for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+		{
+			for (int c = 0; c < 3; c++)
+				rgba[i * 4 + c] = channels[c] ? channels[c][i] : defaults[c];
+			rgba[i * 4 + 3] = 255;
+		}
+
+		DDSFile::Image image = Compress(rgba.data(), width, height, GetMapFormat("orm"), GetMipSettings("orm"), threadPool);
+		success = DDSFile::Write(packed, image);
+	}
+
+	for (unsigned char* channel : channels)
+	{
+		if (channel) stbi_image_free(channel);
+	}
+	return success;
+}
+
+void TextureCompressor::EncodeBC4Block(const unsigned char values[16], unsigned char block[8])
+{
+	int minValue = 255, maxValue = 0;
+	// without 0 and 255, which the 6 value palette has for free
+	int innerMin = 255, innerMax = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		minValue = (std::min)(minValue, static_cast<int>(values[i]));
+		maxValue = (std::max)(maxValue, static_cast<int>(values[i]));
+		if (values[i] != 0 && values[i] != 255)
+		{
+			innerMin = (std::min)(innerMin, static_cast<int>(values[i]));
+			innerMax = (std::max)(innerMax, static_cast<int>(values[i]));
+		}
+	}
+
+	int palette[8];
+	unsigned char indices[16];
+	int endpoints[2] = { maxValue, minValue };
+	BC4Palette(endpoints[0], endpoints[1], palette);
+	int bestError = FitBC4Indices(values, palette, indices);
+
+	if (bestError > 0 && innerMin < innerMax)
+	{
+		unsigned char innerIndices[16];
+		BC4Palette(innerMin, innerMax, palette);
+		int error = FitBC4Indices(values, palette, innerIndices);
+		if (error < bestError)
+		{
+			endpoints[0] = innerMin;
+			endpoints[1] = innerMax;
+			memcpy(indices, innerIndices, sizeof(indices));
+		}
+	}
+
+	block[0] = static_cast<unsigned char>(endpoints[0]);
+	block[1] = static_cast<unsigned char>(endpoints[1]);
+
+	// 3 bits per index, 48 bits in all
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= static_cast<uint64_t>(indices[i]) << (i * 3);
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+}
+
+void TextureCompressor::EncodeBC5Block(const unsigned char red[16], const unsigned char green[16], unsigned char block[16])
+{
+	// two BC4 blocks
+	EncodeBC4Block(red, block);
+	EncodeBC4Block(green, block + 8);
+}
+
+void TextureCompressor::EncodeBC7Block(const unsigned char rgba[64], unsigned char block[16])
+{
+	float pixels[16][4];
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			pixels[i][c] = rgba[i * 4 + c];
+			mean[c] += pixels[i][c] / 16.0f;
+		}
+	}
+
+	// principal axis of the colours, by power iteration on their covariance
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < 4; a++)
+		{
+			for (int b = 0; b < 4; b++)
+				covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+		}
+	}
+
+	// starting from the channel that varies most, as a fixed start like grey can be at right angles to the axis
+	int widest = 0;
+	for (int c = 1; c < 4; c++)
+	{
+		if (covariance[c][c] > covariance[widest][widest]) widest = c;
+	}
+	float axis[4] = { covariance[0][widest], covariance[1][widest], covariance[2][widest], covariance[3][widest] };
+	float length = 0.0f;
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (int a = 0; a < 4; a++)
+		{
+			for (int b = 0; b < 4; b++)
+				next[a] += covariance[a][b] * axis[b];
+		}
+
+		length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f) break;
+		for (int c = 0; c < 4; c++) axis[c] = next[c] / length;
+	}
+
+	// the extent of the colours along the axis, or a single colour if they don't vary
+	float endpoints[2][4];
+	float tMin = 0.0f, tMax = 0.0f;
+	if (length >= 1e-6f)
+	{
+		tMin = FLT_MAX;
+		tMax = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < 4; c++) t += (pixels[i][c] - mean[c]) * axis[c];
+			tMin = (std::min)(tMin, t);
+			tMax = (std::max)(tMax, t);
+		}
+	}
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = (std::min)((std::max)(mean[c] + axis[c] * tMin, 0.0f), 255.0f);
+		endpoints[1][c] = (std::min)((std::max)(mean[c] + axis[c] * tMax, 0.0f), 255.0f);
+	}
+
+	BC7Mode6 best;
+	best.error = INT_MAX;
+	for (int iteration = 0; iteration < 3; iteration++)
+	{
+		BC7Mode6 candidate;
+		QuantiseBC7Endpoint(endpoints[0], candidate.quantised[0], &candidate.pBit[0]);
+		QuantiseBC7Endpoint(endpoints[1], candidate.quantised[1], &candidate.pBit[1]);
+		FitBC7Indices(rgba, candidate);
+		if (candidate.error < best.error) best = candidate;
+		if (best.error == 0) break;
+
+		// least squares endpoints for the indices that were picked
+		float a = 0.0f, b = 0.0f, d = 0.0f;
+		float x0[4] = {}, x1[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float w = BC7Weights[candidate.indices[i]] / 64.0f;
+			a += (1.0f - w) * (1.0f - w);
+			b += (1.0f - w) * w;
+			d += w * w;
+			for (int c = 0; c < 4; c++)
+			{
+				x0[c] += (1.0f - w) * pixels[i][c];
+				x1[c] += w * pixels[i][c];
+			}
+		}
+		float determinant = a * d - b * b;
+		if (std::abs(determinant) < 1e-6f) break;
+
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = (std::min)((std::max)((d * x0[c] - b * x1[c]) / determinant, 0.0f), 255.0f);
+			endpoints[1][c] = (std::min)((std::max)((a * x1[c] - b * x0[c]) / determinant, 0.0f), 255.0f);
+		}
+	}
+
+	// the first index is stored without its top bit, so it has to be below 8
+	// the weights are symmetric, so swapping the endpoints and flipping the indices gives the same colours
+	if (best.indices[0] & 8)
+	{
+		std::swap(best.quantised[0], best.quantised[1]);
+		std::swap(best.pBit[0], best.pBit[1]);
+		for (unsigned char& index : best.indices) index = 15 - index;
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer = { block, 0 };
+	// mode 6 is six 0 bits and a 1
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writer.Write(best.quantised[0][c], 7);
+		writer.Write(best.quantised[1][c], 7);
+	}
+	writer.Write(best.pBit[0], 1);
+	writer.Write(best.pBit[1], 1);
+	writer.Write(best.indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writer.Write(best.indices[i], 4);
+}
+
+void TextureCompressor::DecodeBC4Block(const unsigned char block[8], unsigned char values[16])
+{
+	int palette[8];
+	BC4Palette(block[0], block[1], palette);
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+	for (int i = 0; i < 16; i++)
+		values[i] = static_cast<unsigned char>(palette[(bits >> (i * 3)) & 7]);
+}
+
+void TextureCompressor::DecodeBC7Mode6Block(const unsigned char block[16], unsigned char rgba[64])
+{
+	BitReader reader = { block, 0 };
+	if (reader.Read(7) != 1 << 6)
+	{
+		memset(rgba, 0, 64);
+		return;
+	}
+
+	BC7Mode6 mode6;
+	for (int c = 0; c < 4; c++)
+	{
+		mode6.quantised[0][c] = reader.Read(7);
+		mode6.quantised[1][c] = reader.Read(7);
+	}
+	mode6.pBit[0] = reader.Read(1);
+	mode6.pBit[1] = reader.Read(1);
+
+	for (int i = 0; i < 16; i++)
+	{
+		int index = reader.Read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+		{
+			int value = ((64 - BC7Weights[index]) * BC7Endpoint(mode6, 0, c) + BC7Weights[index] * BC7Endpoint(mode6, 1, c) + 32) >> 6;
+			rgba[i * 4 + c] = static_cast<unsigned char>(value);
+		}
+	}
+}
+
+bool TextureCompressor::SelfTest()
+{
+	bool passed = true;
+	auto check = [&passed](bool condition) { passed = passed && condition; };
+
+	// flat blocks are exact in both, as are blocks of only 0 and 255 in BC4
+	for (int value = 0; value < 256; value++)
+	{
+		unsigned char pixels[64], bc4[8], bc7[16], decoded[64];
+		memset(pixels, value, sizeof(pixels));
+		EncodeBC4Block(pixels, bc4);
+		DecodeBC4Block(bc4, decoded);
+		check(memcmp(pixels, decoded, 16) == 0);
+		EncodeBC7Block(pixels, bc7);
+		DecodeBC7Mode6Block(bc7, decoded);
+		check(memcmp(pixels, decoded, 64) == 0);
+
+		for (int i = 0; i < 16; i++) pixels[i] = (value >> (i & 7) & 1) ? 255 : 0;
+		EncodeBC4Block(pixels, bc4);
+		DecodeBC4Block(bc4, decoded);
+		check(memcmp(pixels, decoded, 16) == 0);
+	}
+
+	std::mt19937 random(1);
+	for (int test = 0; test < 10000; test++)
+	{
+		// BC4 values anywhere in a range come back within a step of its 8 value palette
+		unsigned char values[16], bc4[8], decodedValues[16];
+		int low = random() % 256, high = random() % 256;
+		if (low > high) std::swap(low, high);
+		for (int i = 0; i < 16; i++)
+			values[i] = static_cast<unsigned char>(test % 2 ? low + random() % (high - low + 1) : low + (high - low) * i / 15);
+		EncodeBC4Block(values, bc4);
+		DecodeBC4Block(bc4, decodedValues);
+		for (int i = 0; i < 16; i++)
+			check(std::abs(values[i] - decodedValues[i]) <= (high - low) / 7 + 1);
+
+		// BC7 gradients between two colours, in any direction, come back within its 16 index weights,
+		// and still close on average with noise on top
+		unsigned char from[4], to[4], rgba[64], bc7[16], decodedRGBA[64];
+		for (int c = 0; c < 4; c++)
+		{
+			from[c] = static_cast<unsigned char>(random() % 256);
+			to[c] = static_cast<unsigned char>(random() % 256);
+		}
+		int noise = test % 2 ? 8 : 0;
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int value = from[c] + (to[c] - from[c]) * (i % 4 + i / 4) / 6;
+				if (noise > 0) value += static_cast<int>(random() % (2 * noise + 1)) - noise;
+				rgba[i * 4 + c] = static_cast<unsigned char>((std::min)((std::max)(value, 0), 255));
+			}
+		}
+		EncodeBC7Block(rgba, bc7);
+		DecodeBC7Mode6Block(bc7, decodedRGBA);
+		int maxError = 0, totalError = 0;
+		for (int i = 0; i < 64; i++)
+		{
+			maxError = (std::max)(maxError, std::abs(rgba[i] - decodedRGBA[i]));
+			totalError += std::abs(rgba[i] - decodedRGBA[i]);
+		}
+		check(noise > 0 ? totalError <= 64 * noise : maxError <= 10);
+	}
+
+	return passed;
+}
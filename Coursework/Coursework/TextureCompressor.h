@@ -0,0 +1,53 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+
+#include "DDSFile.h"
+#include "MipGenerator.h"
+
+class ThreadPool;
+
+
+// CPU block compression of material maps to mip mapped DDS files, done offline so loading them is only a copy
+// Albedo is compressed to BC7, normal maps to BC5 (the shaders rebuild z) and single channel maps to BC4
+// Occlusion, roughness and metalness are packed into the RGB of one BC7 map when a material has at least two of them,
+// so the shaders read all three with a single sample and the material takes one texture slot instead of three
+//
+// The BC7 encoder only writes mode 6 (one subset, RGBA endpoints with a p-bit each and 4-bit indices).
+// The endpoints are fitted to the principal axis of the block's colours and refined by least squares, which is far
+// from a full mode search, but it is fast and keeps gradients that BC1 would band
+
+class TextureCompressor
+{
+public:
+	// pure static class
+	TextureCompressor() = delete;
+
+	// the format a map in a PBR material directory is compressed to, DXGI_FORMAT_UNKNOWN if it isn't one
+	static DXGI_FORMAT GetMapFormat(const std::string& mapName);
+	// the mip chain is filtered in linear space for albedo, and renormalised for normal maps
+	static MipGenerator::Settings GetMipSettings(const std::string& mapName);
+
+	// rgba is RGBA8, tightly packed
+	static DDSFile::Image Compress(const unsigned char* rgba, unsigned int width, unsigned int height, DXGI_FORMAT format, const MipGenerator::Settings& mipSettings, ThreadPool* threadPool);
+
+	// compresses every map in the directory that has no DDS, or a DDS older than its PNG, for the command line
+	// and packs occlusion.png, roughness.png and metalness.png into orm.dds when there are at least two of them
+	static bool CompressMaterialDirectory(const std::string& directory);
+	// missing maps are filled with the material defaults: no occlusion, a roughness of 0.5 and no metalness
+	static bool PackORM(const std::string& directory, ThreadPool* threadPool);
+
+	// blocks of 4x4 pixels in row order
+	static void EncodeBC4Block(const unsigned char values[16], unsigned char block[8]);
+	static void EncodeBC5Block(const unsigned char red[16], const unsigned char green[16], unsigned char block[16]);
+	static void EncodeBC7Block(const unsigned char rgba[64], unsigned char block[16]);
+
+	static void DecodeBC4Block(const unsigned char block[8], unsigned char values[16]);
+	// only mode 6, the one EncodeBC7Block writes
+	static void DecodeBC7Mode6Block(const unsigned char block[16], unsigned char rgba[64]);
+
+	// encodes flat, gradient and noisy blocks, decodes them again and checks they come back within the formats' precision
+	static bool SelfTest();
+};
@@ -1,6 +1,6 @@
 #include "TextureShader.h"
 
-TextureShader::TextureShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+TextureShader::TextureShader(ID3D11Device* device, IGraphicsBackend* backend, HWND hwnd) : BaseShader(device, hwnd), m_Backend(backend)
 {
 	initShader(L"texture_vs.cso", L"texture_ps.cso");
 }
@@ -96,3 +96,8 @@ void TextureShader::setShaderParameters(ID3D11DeviceContext* deviceContext, cons
 	deviceContext->PSSetShaderResources(0, 1, &texture);
 	deviceContext->PSSetSamplers(0, 1, &sampleState);
 }
+
+void TextureShader::draw(ID3D11DeviceContext* deviceContext, int indexCount)
+{
+	m_Backend->DrawIndexed(indexCount, 0, 0);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BaseShader.h"
+#include "GraphicsBackend.h"
 
 using namespace std;
 using namespace DirectX;
@@ -8,16 +9,18 @@ using namespace DirectX;
 class TextureShader : public BaseShader
 {
 public:
-	TextureShader(ID3D11Device* device, HWND hwnd);
+	TextureShader(ID3D11Device* device, IGraphicsBackend* backend, HWND hwnd);
 	~TextureShader();
 
 	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection, ID3D11ShaderResourceView* texture);
 
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
+	virtual void draw(ID3D11DeviceContext* deviceContext, int indexCount) override;
 
 private:
 	ID3D11Buffer * matrixBuffer;
 	ID3D11SamplerState* sampleState;
+	IGraphicsBackend* m_Backend = nullptr;
 };
 
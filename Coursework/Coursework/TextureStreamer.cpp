@@ -0,0 +1,273 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "GPUMemoryTracker.h"
+#include "TextureCache.h"
+
+#include "imGUI/imgui.h"
+
+
+namespace
+{
+	// a material only drops a mip once it needs one coarser than this much past it, so it doesn't swap back and forth
+	const float StreamOutHysteresis = 0.5f;
+}
+
+
+TextureStreamer::TextureStreamer(TextureCache* textureCache, size_t budget)
+	: m_TextureCache(textureCache), m_Budget(budget)
+{
+	m_Worker = std::thread(&TextureStreamer::WorkerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+		// requests that haven't started haven't acquired anything
+		m_Requests.clear();
+	}
+	m_Wake.notify_all();
+	m_Worker.join();
+
+	for (Request& finished : m_Finished)
+	{
+		for (ID3D11ShaderResourceView* map : finished.maps)
+			m_TextureCache->Release(map);
+	}
+}
+
+void TextureStreamer::AddMaterial(Material* material)
+{
+	StreamedMaterial streamed;
+	for (int m = 0; m < static_cast<int>(Material::Map::Count); m++)
+	{
+		ID3D11ShaderResourceView* map = material->GetMap(static_cast<Material::Map>(m));
+		if (!map || material->GetMapFile(static_cast<Material::Map>(m)).empty()) continue;
+
+		ID3D11Resource* resource = nullptr;
+		map->GetResource(&resource);
+		D3D11_TEXTURE2D_DESC desc;
+		static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+
+		// what the maps would be with nothing left out, each mip is a quarter of the one before
+		unsigned int mip = material->GetResidentMip();
+		streamed.fullSize = (std::max)(streamed.fullSize, (std::max)(desc.Width, desc.Height) << mip);
+		streamed.fullBytes += GPUMemoryTracker::CalculateSize(resource) << (2 * mip);
+		resource->Release();
+	}
+	if (streamed.fullSize == 0) return;
+
+	while ((streamed.fullSize >> (streamed.maxMip + 1)) >= MinResidentSize)
+		streamed.maxMip++;
+	streamed.targetMip = material->GetResidentMip();
+	m_Materials[material] = streamed;
+}
+
+void TextureStreamer::BeginFrame(const XMMATRIX& projection, float screenHeight)
+{
+	// the projection's y scale is 1 / tan(fov / 2), and the screen is 2 units high at that scale
+	XMFLOAT4X4 p;
+	XMStoreFloat4x4(&p, projection);
+	m_PixelsPerUnitAtUnitDistance = 0.5f * screenHeight * p._22;
+
+	for (auto& material : m_Materials)
+		material.second.neededMip = FLT_MAX;
+}
+
+void TextureStreamer::AddUse(const Material* material, float distance, float uvSize)
+{
+	auto streamed = m_Materials.find(const_cast<Material*>(material));
+	if (streamed == m_Materials.end()) return;
+
+	// texels of the full size maps over the pixels a unit covers at this distance
+	float texelsPerUnit = streamed->second.fullSize / (std::max)(uvSize, FLT_EPSILON);
+	float pixelsPerUnit = m_PixelsPerUnitAtUnitDistance / (std::max)(distance, 0.01f);
+	float mip = (std::max)(std::log2(texelsPerUnit / pixelsPerUnit), 0.0f);
+	streamed->second.neededMip = (std::min)(streamed->second.neededMip, mip);
+}
+
+void TextureStreamer::Update()
+{
+	std::vector<Request> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		finished.swap(m_Finished);
+	}
+
+	for (Request& request : finished)
+	{
+		Material* material = request.material;
+		StreamedMaterial& streamed = m_Materials[material];
+		streamed.streaming = false;
+
+		// a map that failed to load leaves the material as it was
+		bool loaded = true;
+		for (int m = 0; m < static_cast<int>(Material::Map::Count); m++)
+		{
+			if (!material->GetMapFile(static_cast<Material::Map>(m)).empty() && !request.maps[m]) loaded = false;
+		}
+
+		for (int m = 0; m < static_cast<int>(Material::Map::Count); m++)
+		{
+			if (!request.maps[m]) continue;
+			if (loaded)
+				m_TextureCache->Release(material->SwapMap(static_cast<Material::Map>(m), request.maps[m]));
+			else
+				m_TextureCache->Release(request.maps[m]);
+		}
+		if (!loaded) continue;
+
+		(request.mip < material->GetResidentMip() ? m_StreamedIn : m_StreamedOut)++;
+		material->SetResidentMip(request.mip);
+	}
+
+	// the maps that were swapped out stay cached for when they are needed again, as long as they fit in the budget too
+	m_TextureCache->Trim(GPUMemoryTracker::Category::Materials, m_Budget);
+
+	if (!m_Enabled) return;
+
+	unsigned int maxMip = 0;
+	for (auto& material : m_Materials)
+	{
+		StreamedMaterial& streamed = material.second;
+		unsigned int resident = material.first->GetResidentMip();
+		maxMip = (std::max)(maxMip, streamed.maxMip);
+
+		// finer as soon as it is needed, coarser once it is clearly not
+		unsigned int target = resident;
+		if (streamed.neededMip == FLT_MAX)
+			target = streamed.maxMip;
+		else if (static_cast<unsigned int>(streamed.neededMip) < resident)
+			target = static_cast<unsigned int>(streamed.neededMip);
+		else if (streamed.neededMip - StreamOutHysteresis > static_cast<float>(resident + 1))
+			target = static_cast<unsigned int>(streamed.neededMip - StreamOutHysteresis);
+		streamed.targetMip = (std::min)(target, streamed.maxMip);
+	}
+
+	// everything drops together until the materials fit
+	m_Bias = 0;
+	while (m_Bias < maxMip && CalculateBytes(m_Bias) > m_Budget)
+		m_Bias++;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& material : m_Materials)
+	{
+		StreamedMaterial& streamed = material.second;
+		unsigned int mip = (std::min)(streamed.targetMip + m_Bias, streamed.maxMip);
+		if (streamed.streaming || mip == material.first->GetResidentMip()) continue;
+
+		Request request;
+		request.material = material.first;
+		request.mip = mip;
+		// memory is freed by dropping mips, so those go first
+		if (mip > material.first->GetResidentMip())
+			m_Requests.push_front(request);
+		else
+			m_Requests.push_back(request);
+		streamed.streaming = true;
+	}
+	m_Wake.notify_one();
+}
+
+float TextureStreamer::DistanceToBounds(const XMFLOAT3& point, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMMATRIX& world, float* extent)
+{
+	// the world space box around the transformed corners
+	XMVECTOR worldMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR worldMax = XMVectorReplicate(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		XMVECTOR corner = XMVectorSet(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z, 1.0f);
+		corner = XMVector3TransformCoord(corner, world);
+		worldMin = XMVectorMin(worldMin, corner);
+		worldMax = XMVectorMax(worldMax, corner);
+	}
+
+	XMFLOAT3 size;
+	XMStoreFloat3(&size, worldMax - worldMin);
+	*extent = (std::max)((std::max)(size.x, size.y), size.z);
+
+	XMVECTOR p = XMLoadFloat3(&point);
+	XMVECTOR nearest = XMVectorClamp(p, worldMin, worldMax);
+	return XMVectorGetX(XMVector3Length(p - nearest));
+}
+
+void TextureStreamer::SettingsGUI()
+{
+	const float BytesPerMB = 1024.0f * 1024.0f;
+
+	ImGui::Checkbox("Enabled", &m_Enabled);
+	int budget = static_cast<int>(m_Budget / (1024 * 1024));
+	if (ImGui::SliderInt("Budget (MB)", &budget, 8, 1024))
+		m_Budget = static_cast<size_t>(budget) * 1024 * 1024;
+
+	size_t resident = 0;
+	for (const auto& material : m_Materials)
+		resident += material.second.fullBytes >> (2 * material.first->GetResidentMip());
+	ImGui::Text("Resident: %.1f MB, all mips: %.1f MB", resident / BytesPerMB, CalculateBytes(0) / BytesPerMB);
+	ImGui::Text("Budget bias: %u mips", m_Bias);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		ImGui::Text("Streamed in: %u, out: %u, queued: %u", m_StreamedIn, m_StreamedOut, static_cast<unsigned int>(m_Requests.size()));
+	}
+
+	ImGui::Columns(4);
+	ImGui::Text("Material"); ImGui::NextColumn();
+	ImGui::Text("Size"); ImGui::NextColumn();
+	ImGui::Text("Resident"); ImGui::NextColumn();
+	ImGui::Text("Needed"); ImGui::NextColumn();
+	for (const auto& material : m_Materials)
+	{
+		const std::wstring& directory = material.first->GetDirectory();
+		ImGui::Text("%s", std::string(directory.begin(), directory.end()).c_str()); ImGui::NextColumn();
+		ImGui::Text("%u", material.second.fullSize); ImGui::NextColumn();
+		ImGui::Text("%u%s", material.first->GetResidentMip(), material.second.streaming ? " (streaming)" : ""); ImGui::NextColumn();
+		if (material.second.neededMip == FLT_MAX)
+			ImGui::Text("unused");
+		else
+			ImGui::Text("%.1f", material.second.neededMip);
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+}
+
+void TextureStreamer::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_Wake.wait(lock, [this]() { return m_Quit || !m_Requests.empty(); });
+		if (m_Quit) return;
+
+		Request request = m_Requests.front();
+		m_Requests.pop_front();
+		lock.unlock();
+
+		// the files are read, decoded and created here, the cache makes any it already has at that mip free
+		for (int m = 0; m < static_cast<int>(Material::Map::Count); m++)
+		{
+			Material::Map map = static_cast<Material::Map>(m);
+			const std::wstring& file = request.material->GetMapFile(map);
+			if (!file.empty())
+				request.maps[m] = m_TextureCache->Acquire(file, GPUMemoryTracker::Category::Materials, Material::GetMipSettings(map), request.mip);
+		}
+
+		lock.lock();
+		m_Finished.push_back(request);
+	}
+}
+
+size_t TextureStreamer::CalculateBytes(unsigned int bias) const
+{
+	size_t bytes = 0;
+	for (const auto& material : m_Materials)
+	{
+		unsigned int mip = (std::min)(material.second.targetMip + bias, material.second.maxMip);
+		bytes += material.second.fullBytes >> (2 * mip);
+	}
+	return bytes;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Material.h"
+
+using namespace DirectX;
+
+class TextureCache;
+
+
+// Streams the largest mips of material maps in and out, to keep the materials within a video memory budget
+// Each frame the mip a material needs is estimated from its objects: how many texels of its maps would fall on a pixel
+// at the nearest point of each object's bounds, with the object's UVs assumed to span its bounds once (or the terrain's
+// UV scale). If the materials would go over budget at those mips, all of them are dropped a mip at a time until they fit
+//
+// A material that needs a different mip has its maps acquired again from the texture cache on a background thread,
+// with the larger mips left out, and Update swaps them in once they are all ready. The maps they replace are released
+// back to the cache, which keeps them around until the material textures in it no longer fit in the same budget
+
+class TextureStreamer
+{
+public:
+	// maps aren't dropped below this size
+	static const unsigned int MinResidentSize = 64;
+
+public:
+	TextureStreamer(TextureCache* textureCache, size_t budget);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// materials have to have been loaded
+	void AddMaterial(Material* material);
+
+	// call before adding the frame's uses, with the camera's perspective projection
+	void BeginFrame(const XMMATRIX& projection, float screenHeight);
+	// distance is from the camera to the nearest point of the object, and uvSize is how many units a UV repeat covers
+	void AddUse(const Material* material, float distance, float uvSize);
+	// call once a frame on the render thread, after the uses have been added
+	void Update();
+
+	// distance from a point to a local space bounding box, and the largest extent of the box in world space
+	static float DistanceToBounds(const XMFLOAT3& point, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMMATRIX& world, float* extent);
+
+	void SettingsGUI();
+
+private:
+	struct StreamedMaterial
+	{
+		// the size and memory of the maps with nothing left out
+		unsigned int fullSize = 0;
+		size_t fullBytes = 0;
+		unsigned int maxMip = 0;
+
+		// the finest mip asked for this frame, as a fraction for hysteresis
+		float neededMip = 0.0f;
+		unsigned int targetMip = 0;
+		bool streaming = false;
+	};
+
+	struct Request
+	{
+		Material* material = nullptr;
+		unsigned int mip = 0;
+		ID3D11ShaderResourceView* maps[static_cast<int>(Material::Map::Count)] = {};
+	};
+
+	void WorkerLoop();
+	// bytes of all the materials with every mip dropped by bias more
+	size_t CalculateBytes(unsigned int bias) const;
+
+private:
+	TextureCache* m_TextureCache = nullptr;
+	size_t m_Budget = 0;
+
+	std::unordered_map<Material*, StreamedMaterial> m_Materials;
+	float m_PixelsPerUnitAtUnitDistance = 1.0f;
+	unsigned int m_Bias = 0;
+	bool m_Enabled = true;
+
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	bool m_Quit = false;
+	std::deque<Request> m_Requests;
+	std::vector<Request> m_Finished;
+
+	// stats for the GUI
+	unsigned int m_StreamedIn = 0;
+	unsigned int m_StreamedOut = 0;
+};
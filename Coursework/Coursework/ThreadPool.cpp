@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	m_Workers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; i++)
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (auto& worker : m_Workers)
+		worker.join();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grainSize, const Task& task)
+{
+	if (count == 0) return;
+	grainSize = std::max<size_t>(grainSize, 1);
+
+	// not worth waking the workers for a single chunk
+	size_t chunkCount = (count + grainSize - 1) / grainSize;
+	if (chunkCount == 1 || m_Workers.empty())
+	{
+		task(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> dispatchLock(m_DispatchMutex);
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		// a worker may still be leaving the previous job
+		m_DoneCondition.wait(lock, [this] { return m_BusyWorkers == 0; });
+
+		m_Task = &task;
+		m_Count = count;
+		m_GrainSize = grainSize;
+		m_ChunkCount = chunkCount;
+		m_NextChunk = 0;
+		m_ChunksRemaining = chunkCount;
+		m_Generation++;
+	}
+	m_WakeCondition.notify_all();
+
+	// the calling thread does work too
+	RunChunks();
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_DoneCondition.wait(lock, [this] { return m_ChunksRemaining == 0; });
+	m_Task = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	unsigned long long seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeCondition.wait(lock, [&] { return m_Quit || m_Generation != seenGeneration; });
+			if (m_Quit) return;
+
+			seenGeneration = m_Generation;
+			m_BusyWorkers++;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_BusyWorkers--;
+		}
+		m_DoneCondition.notify_all();
+	}
+}
+
+void ThreadPool::RunChunks()
+{
+	while (true)
+	{
+		size_t chunk = m_NextChunk.fetch_add(1);
+		if (chunk >= m_ChunkCount) break;
+
+		size_t begin = chunk * m_GrainSize;
+		size_t end = std::min(begin + m_GrainSize, m_Count);
+		(*m_Task)(begin, end);
+
+		if (m_ChunksRemaining.fetch_sub(1) == 1)
+		{
+			// last chunk finished: wake the dispatching thread
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_DoneCondition.notify_all();
+		}
+	}
+}
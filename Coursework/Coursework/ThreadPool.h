@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+// A small fixed-size pool of worker threads
+// Work is submitted as a parallel-for over an index range, which is split into chunks
+// The calling thread helps process chunks and blocks until the whole range is complete
+
+class ThreadPool
+{
+public:
+	// task is called with the half-open range [begin, end)
+	typedef std::function<void(size_t begin, size_t end)> Task;
+
+	// threadCount = 0 will use one worker per hardware thread, minus the calling thread
+	ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void ParallelFor(size_t count, size_t grainSize, const Task& task);
+
+	// number of threads that will process work, including the calling thread
+	inline unsigned int GetConcurrency() const { return static_cast<unsigned int>(m_Workers.size()) + 1; }
+
+private:
+	void WorkerLoop();
+	void RunChunks();
+
+private:
+	std::vector<std::thread> m_Workers;
+
+	// only one parallel-for can be in flight at a time
+	std::mutex m_DispatchMutex;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_DoneCondition;
+	bool m_Quit = false;
+	unsigned long long m_Generation = 0;
+	unsigned int m_BusyWorkers = 0;
+
+	// current job
+	const Task* m_Task = nullptr;
+	size_t m_Count = 0;
+	size_t m_GrainSize = 1;
+	size_t m_ChunkCount = 0;
+	std::atomic<size_t> m_NextChunk{ 0 };
+	std::atomic<size_t> m_ChunksRemaining{ 0 };
+};
@@ -0,0 +1,206 @@
+#include "TonemapLUT.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+const float TonemapLUT::RatioExponent = 1.0f / 16.0f;
+const float TonemapLUT::PeakStops = 16.0f;
+const float TonemapLUT::MaxError = 0.005f;
+
+namespace
+{
+	// where a texture coordinate lands between texels i and i + 1, clamped to the edge texels
+	void FindTexels(float coord, unsigned int size, unsigned int* i, float* fraction)
+	{
+		float t = (std::min)((std::max)(coord * size - 0.5f, 0.0f), static_cast<float>(size - 1));
+		*i = (std::min)(static_cast<unsigned int>(t), size - 2);
+		*fraction = t - *i;
+	}
+
+	// what the back buffer keeps of a channel
+	float Saturate(float value)
+	{
+		return (std::min)((std::max)(value, 0.0f), 1.0f);
+	}
+}
+
+
+bool TonemapLUT::Curve::operator==(const Curve& other) const
+{
+	return hdrMax == other.hdrMax && contrast == other.contrast && shoulder == other.shoulder && midIn == other.midIn &&
+		midOut == other.midOut && crosstalk == other.crosstalk && white == other.white;
+}
+
+TonemapLUT::Table TonemapLUT::Bake(const Curve& curve, unsigned int ratioSize, unsigned int peakSize)
+{
+	Table table;
+	table.ratioSize = ratioSize;
+	table.peakSize = peakSize;
+	table.ratioShaper = GetRatioShaper(ratioSize);
+	table.peakShaper = GetPeakShaper(curve, peakSize);
+	table.texels.resize(static_cast<size_t>(ratioSize) * peakSize);
+
+	// the terms are worked out once for the whole table
+	float b = ColToneB(curve.hdrMax, curve.contrast, curve.shoulder, curve.midIn, curve.midOut);
+	float c = ColToneC(curve.hdrMax, curve.contrast, curve.shoulder, curve.midIn, curve.midOut);
+
+	for (unsigned int y = 0; y < peakSize; y++)
+	{
+		// the value at each texel centre, inverting the shaper
+		float peak = std::exp2(((y + 0.5f) / peakSize - table.peakShaper.bias) / table.peakShaper.scale);
+		for (unsigned int x = 0; x < ratioSize; x++)
+		{
+			float shapedRatio = ((x + 0.5f) / ratioSize - table.ratioShaper.bias) / table.ratioShaper.scale;
+			table.texels[x + static_cast<size_t>(y) * ratioSize] = Tonemap(curve, b, c, shapedRatio, peak);
+		}
+	}
+	return table;
+}
+
+XMFLOAT3 TonemapLUT::Sample(const Table& table, const XMFLOAT3& colour)
+{
+	float peak = (std::max)(colour.x, (std::max)(colour.y, colour.z));
+	if (peak <= 0.0f)
+		return XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	unsigned int y;
+	float fy;
+	FindTexels(std::log2(peak) * table.peakShaper.scale + table.peakShaper.bias, table.peakSize, &y, &fy);
+	const float* row0 = &table.texels[static_cast<size_t>(y) * table.ratioSize];
+	const float* row1 = row0 + table.ratioSize;
+
+	float in[3] = { colour.x, colour.y, colour.z };
+	float out[3];
+	for (int i = 0; i < 3; i++)
+	{
+		unsigned int x;
+		float fx;
+		FindTexels(std::pow(std::abs(in[i] / peak), RatioExponent) * table.ratioShaper.scale + table.ratioShaper.bias, table.ratioSize, &x, &fx);
+		float top = row0[x] + (row0[x + 1] - row0[x]) * fx;
+		float bottom = row1[x] + (row1[x + 1] - row1[x]) * fx;
+		out[i] = top + (bottom - top) * fy;
+	}
+	return XMFLOAT3(out[0], out[1], out[2]);
+}
+
+TonemapLUT::Comparison TonemapLUT::Compare(const Curve& curve, const Table& table)
+{
+	// ratios evenly spaced in the shaped axis, with 0 and 1 at the ends, and peaks a tenth of a stop apart from past
+	// the dark end of the table up to hdrMax. Neither grid lines up with the texel centres
+	const int ratioSteps = 257;
+	const float peakStep = 0.1f;
+	float maxLog2 = std::log2(curve.hdrMax);
+
+	Comparison result;
+	double totalError = 0.0;
+	int count = 0;
+	for (float peakLog2 = maxLog2 - PeakStops - 1.0f; peakLog2 <= maxLog2; peakLog2 += peakStep)
+	{
+		float peak = std::exp2(peakLog2);
+		for (int i = 0; i < ratioSteps; i++)
+		{
+			float ratio = std::pow(static_cast<float>(i) / (ratioSteps - 1), 1.0f / RatioExponent);
+			XMFLOAT3 colour(peak, ratio * peak, 0.0f);
+			XMFLOAT3 reference = Tonemap(curve, colour);
+			XMFLOAT3 sampled = Sample(table, colour);
+
+			// the green channel has the ratio and blue is always 0
+			float error = 0.0f;
+			error = (std::max)(error, std::abs(Saturate(reference.x) - Saturate(sampled.x)));
+			error = (std::max)(error, std::abs(Saturate(reference.y) - Saturate(sampled.y)));
+			error = (std::max)(error, std::abs(Saturate(reference.z) - Saturate(sampled.z)));
+			result.maxError = (std::max)(result.maxError, error);
+			totalError += error;
+			count++;
+		}
+	}
+	if (count > 0)
+		result.meanError = static_cast<float>(totalError / count);
+	return result;
+}
+
+bool TonemapLUT::SelfTest()
+{
+	bool passed = true;
+	auto check = [&passed](bool condition) { passed = passed && condition; };
+
+	// the default, more range, less contrast and less crosstalk
+	Curve curves[4];
+	curves[1].hdrMax = 64.0f;
+	curves[2].contrast = 1.5f;
+	curves[3].crosstalk = 1.0f;
+
+	for (const Curve& curve : curves)
+	{
+		Comparison comparison = Compare(curve, Bake(curve));
+		check(comparison.maxError <= MaxError);
+	}
+
+	return passed;
+}
+
+TonemapLUT::Shaper TonemapLUT::GetRatioShaper(unsigned int size)
+{
+	return MakeShaper(0.0f, 1.0f, size);
+}
+
+TonemapLUT::Shaper TonemapLUT::GetPeakShaper(const Curve& curve, unsigned int size)
+{
+	float maxLog2 = std::log2(curve.hdrMax);
+	return MakeShaper(maxLog2 - PeakStops, maxLog2, size);
+}
+
+XMFLOAT3 TonemapLUT::Tonemap(const Curve& curve, const XMFLOAT3& colour)
+{
+	float peak = (std::max)(colour.x, (std::max)(colour.y, colour.z));
+	if (peak <= 0.0f)
+		return XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	float b = ColToneB(curve.hdrMax, curve.contrast, curve.shoulder, curve.midIn, curve.midOut);
+	float c = ColToneC(curve.hdrMax, curve.contrast, curve.shoulder, curve.midIn, curve.midOut);
+	float red = std::pow(std::abs(colour.x / peak), RatioExponent);
+	float green = std::pow(std::abs(colour.y / peak), RatioExponent);
+	float blue = std::pow(std::abs(colour.z / peak), RatioExponent);
+	return XMFLOAT3(Tonemap(curve, b, c, red, peak), Tonemap(curve, b, c, green, peak), Tonemap(curve, b, c, blue, peak));
+}
+
+float TonemapLUT::ColToneB(float hdrMax, float contrast, float shoulder, float midIn, float midOut)
+{
+	return
+		-((-std::pow(midIn, contrast) + (midOut * (std::pow(hdrMax, contrast * shoulder) * std::pow(midIn, contrast) -
+			std::pow(hdrMax, contrast) * std::pow(midIn, contrast * shoulder) * midOut)) /
+			(std::pow(hdrMax, contrast * shoulder) * midOut - std::pow(midIn, contrast * shoulder) * midOut)) /
+			(std::pow(midIn, contrast * shoulder) * midOut));
+}
+
+float TonemapLUT::ColToneC(float hdrMax, float contrast, float shoulder, float midIn, float midOut)
+{
+	return (std::pow(hdrMax, contrast * shoulder) * std::pow(midIn, contrast) - std::pow(hdrMax, contrast) * std::pow(midIn, contrast * shoulder) * midOut) /
+		(std::pow(hdrMax, contrast * shoulder) * midOut - std::pow(midIn, contrast * shoulder) * midOut);
+}
+
+float TonemapLUT::Tonemap(const Curve& curve, float b, float c, float shapedRatio, float peak)
+{
+	// ColTone
+	float z = std::pow(peak, curve.contrast);
+	peak = z / (std::pow(z, curve.shoulder) * b + c);
+
+	// saturation is contrast and cross saturation is contrast * 16, crosstalk is wrapped in their transform
+	// the ratio comes in already raised to saturation / crossSaturation
+	float crossSaturation = curve.contrast * 16.0f;
+
+	float ratio = shapedRatio + (curve.white - shapedRatio) * std::pow(peak, curve.crosstalk);
+	ratio = std::pow(std::abs(ratio), crossSaturation);
+	return peak * ratio;
+}
+
+TonemapLUT::Shaper TonemapLUT::MakeShaper(float min, float max, unsigned int size)
+{
+	// min on the first texel's centre and max on the last's
+	float span = (size - 1.0f) / size;
+	Shaper shaper;
+	shaper.scale = span / (max - min);
+	shaper.bias = 0.5f / size - min * shaper.scale;
+	return shaper;
+}
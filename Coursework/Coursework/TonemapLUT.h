@@ -0,0 +1,100 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <vector>
+
+using namespace DirectX;
+
+
+// Bakes the Lottes tonemapper the final pass applies into a lookup table, so the pixel shader doesn't set up the curve
+// and raise every channel to several powers for each pixel
+//
+// The tonemapper scales each channel's ratio to the brightest channel by a curve of that peak, so a channel's output
+// only depends on its ratio and the peak. The table is that function in 2D: ratio along x and peak along y, and the
+// shader takes one fetch per channel. A 3D table of the colour can't follow the crosstalk term, which is sharp in the
+// ratio near white, without being far larger
+//
+// The ratio axis is linear in the ratio raised to RatioExponent, the first power the tonemapper applies to it, so it
+// covers 0 to 1 exactly and the function is a smooth polynomial along it. The peak axis is log2, from PeakStops below
+// hdrMax, where the curve reaches 1, up to hdrMax, and brighter peaks are clamped to it. With a white of 1 the curve
+// only goes past 1 there, which the back buffer clips to white anyway
+// Tonemap is the scalar reference the table is checked against, a straight port of TimothyTonemapper
+
+class TonemapLUT
+{
+public:
+	static const unsigned int DefaultRatioSize = 128;
+	static const unsigned int DefaultPeakSize = 512;
+	// saturation / cross saturation, which doesn't depend on the contrast
+	static const float RatioExponent;
+	static const float PeakStops;
+	// the most a default sized table may be off from the reference, in back buffer units
+	static const float MaxError;
+
+	struct Curve
+	{
+		float hdrMax = 16.0f;		// how much HDR range before clipping
+		float contrast = 2.0f;		// baseline for the amount of contrast
+		float shoulder = 0.97f;		// only needs changing if matching another tonemapper doesn't work
+		float midIn = 0.26f;		// the input that maps to midOut
+		float midOut = 0.1f;
+		float crosstalk = 4.0f;		// amount of channel crosstalk
+		float white = 1.0f;
+
+		bool operator==(const Curve& other) const;
+		inline bool operator!=(const Curve& other) const { return !(*this == other); }
+	};
+
+	// a texture coordinate from a shaped value, value * scale + bias, with the ends of the range on the edge texel centres
+	// the ratio is shaped by pow(ratio, RatioExponent) and the peak by log2(peak)
+	struct Shaper
+	{
+		float scale;
+		float bias;
+	};
+
+	struct Table
+	{
+		unsigned int ratioSize = 0;
+		unsigned int peakSize = 0;
+		Shaper ratioShaper;
+		Shaper peakShaper;
+		// ratioSize x peakSize, rows by peak
+		std::vector<float> texels;
+	};
+
+	struct Comparison
+	{
+		float maxError = 0.0f;
+		float meanError = 0.0f;
+	};
+
+public:
+	// pure static class
+	TonemapLUT() = delete;
+
+	static Table Bake(const Curve& curve, unsigned int ratioSize = DefaultRatioSize, unsigned int peakSize = DefaultPeakSize);
+	// what the pixel shader's lookups return, bilinear and clamped like its sampler
+	static XMFLOAT3 Sample(const Table& table, const XMFLOAT3& colour);
+	// checks Sample against Tonemap over a grid of ratios and peaks up to hdrMax, both clamped to what the back buffer holds
+	static Comparison Compare(const Curve& curve, const Table& table);
+
+	// bakes default sized tables for the default curve and a few others, and checks each against MaxError
+	static bool SelfTest();
+
+	static Shaper GetRatioShaper(unsigned int size);
+	static Shaper GetPeakShaper(const Curve& curve, unsigned int size);
+
+	// the reference
+	static XMFLOAT3 Tonemap(const Curve& curve, const XMFLOAT3& colour);
+
+	// the terms of the curve that only depend on its parameters
+	static float ColToneB(float hdrMax, float contrast, float shoulder, float midIn, float midOut);
+	static float ColToneC(float hdrMax, float contrast, float shoulder, float midIn, float midOut);
+
+private:
+	// one channel from its shaped ratio, with b and c worked out
+	static float Tonemap(const Curve& curve, float b, float c, float shapedRatio, float peak);
+	static Shaper MakeShaper(float min, float max, unsigned int size);
+};
@@ -11,18 +11,18 @@ class Transform
 public:
 	Transform() = default;
 
-	inline void SetTranslation(XMFLOAT3 t) { m_Translation = t; }
+	inline void SetTranslation(XMFLOAT3 t) { m_Translation = t; m_Dirty = true; }
 	inline XMFLOAT3 GetTranslation() const { return m_Translation; }
 
-	inline void SetPitch(float p) { m_Rotation.x = p; }
+	inline void SetPitch(float p) { m_Rotation.x = p; m_Dirty = true; }
 	inline float GetPitch() const { return m_Rotation.x; }
-	inline void SetYaw(float y) { m_Rotation.y = y; }
+	inline void SetYaw(float y) { m_Rotation.y = y; m_Dirty = true; }
 	inline float GetYaw() const { return m_Rotation.y; }
-	inline void SetRoll(float r) { m_Rotation.z = r; }
+	inline void SetRoll(float r) { m_Rotation.z = r; m_Dirty = true; }
 	inline float GetRoll() const { return m_Rotation.z; }
 
-	void SetScale(float s) { m_Scale = { s, s, s }; }
-	void SetScale(XMFLOAT3 s) { m_Scale = s; }
+	void SetScale(float s) { m_Scale = { s, s, s }; m_Dirty = true; }
+	void SetScale(XMFLOAT3 s) { m_Scale = s; m_Dirty = true; }
 	XMFLOAT3 GetScale() const { return m_Scale; }
 
 	XMMATRIX GetMatrix() const 
@@ -33,14 +33,18 @@ public:
 		return m;
 	}
 
+	// set whenever the transform is modified, so the scene graph knows to recalculate it
+	inline bool IsDirty() const { return m_Dirty; }
+	inline void ClearDirty() { m_Dirty = false; }
+
 	void SettingsGUI()
 	{
-		ImGui::DragFloat3("Position", &m_Translation.x, 0.01f);
+		m_Dirty |= ImGui::DragFloat3("Position", &m_Translation.x, 0.01f);
 		ImGui::Text("Rotation");
-		ImGui::SliderAngle("Pitch", &m_Rotation.x); 
-		ImGui::SliderAngle("Yaw", &m_Rotation.y); 
-		ImGui::SliderAngle("Roll", &m_Rotation.z);
-		ImGui::DragFloat3("Scale", &m_Scale.x, 0.01f);
+		m_Dirty |= ImGui::SliderAngle("Pitch", &m_Rotation.x); 
+		m_Dirty |= ImGui::SliderAngle("Yaw", &m_Rotation.y); 
+		m_Dirty |= ImGui::SliderAngle("Roll", &m_Rotation.z);
+		m_Dirty |= ImGui::DragFloat3("Scale", &m_Scale.x, 0.01f);
 	}
 
 
@@ -48,4 +52,6 @@ private:
 	XMFLOAT3 m_Translation { 0.0f, 0.0f, 0.0f };
 	XMFLOAT3 m_Rotation { 0.0f, 0.0f, 0.0f };
 	XMFLOAT3 m_Scale { 1.0f, 1.0f, 1.0f };
+
+	bool m_Dirty = true;
 };
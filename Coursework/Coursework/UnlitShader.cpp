@@ -1,7 +1,7 @@
 #include "UnlitShader.h"
 
 
-UnlitShader::UnlitShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
+UnlitShader::UnlitShader(ID3D11Device* device, IGraphicsBackend* backend, HWND hwnd) : BaseShader(device, hwnd), m_Backend(backend)
 {
 	initShader(L"unlit_vs.cso", L"unlit_ps.cso");
 }
@@ -61,3 +61,8 @@ void UnlitShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const
 
 	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
 }
+
+void UnlitShader::draw(ID3D11DeviceContext* deviceContext, int indexCount)
+{
+	m_Backend->DrawIndexed(indexCount, 0, 0);
+}
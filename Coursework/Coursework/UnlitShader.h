@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DXF.h"
+#include "GraphicsBackend.h"
 
 using namespace std;
 using namespace DirectX;
@@ -9,15 +10,17 @@ using namespace DirectX;
 class UnlitShader : public BaseShader
 {
 public:
-	UnlitShader(ID3D11Device* device, HWND hwnd);
+	UnlitShader(ID3D11Device* device, IGraphicsBackend* backend, HWND hwnd);
 	~UnlitShader();
 
 	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection);
 
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
+	virtual void draw(ID3D11DeviceContext* deviceContext, int indexCount) override;
 
 private:
 	ID3D11Buffer* matrixBuffer = nullptr;
+	IGraphicsBackend* m_Backend = nullptr;
 };
 
@@ -3,8 +3,8 @@
 #include "TerrainMesh.h"
 
 
-UnlitTerrainShader::UnlitTerrainShader(ID3D11Device* device)
-	: m_Device(device)
+UnlitTerrainShader::UnlitTerrainShader(ID3D11Device* device, IGraphicsBackend* backend)
+	: m_Device(device), m_Backend(backend)
 {
 	InitShader();
 }
@@ -177,7 +177,7 @@ void UnlitTerrainShader::Render(ID3D11DeviceContext* deviceContext, unsigned int
 	deviceContext->GSSetShader(nullptr, nullptr, 0);
 	deviceContext->PSSetShader(nullptr, nullptr, 0);
 
-	deviceContext->DrawIndexed(indexCount, 0, 0);
+	m_Backend->DrawIndexed(indexCount, 0, 0);
 
 	deviceContext->VSSetShader(nullptr, nullptr, 0);
 	deviceContext->HSSetShader(nullptr, nullptr, 0);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DXF.h"
+#include "GraphicsBackend.h"
 
 using namespace std;
 using namespace DirectX;
@@ -32,7 +33,7 @@ private:
 	};
 
 public:
-	UnlitTerrainShader(ID3D11Device* device);
+	UnlitTerrainShader(ID3D11Device* device, IGraphicsBackend* backend);
 	~UnlitTerrainShader();
 
 	void SetShaderParameters(ID3D11DeviceContext* deviceContext,
@@ -51,6 +52,7 @@ private:
 
 private:
 	ID3D11Device* m_Device = nullptr;
+	IGraphicsBackend* m_Backend = nullptr;
 
 	ID3D11VertexShader* m_VertexShader = nullptr;
 	ID3D11HullShader* m_HullShader = nullptr;
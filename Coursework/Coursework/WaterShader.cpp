@@ -2,14 +2,15 @@
 
 #include "SerializationHelper.h"
 
-#include "SceneLight.h"
 #include "RenderTarget.h"
 #include "GlobalLighting.h"
+#include "LightingCache.h"
+#include "ConstantBufferRing.h"
 
 
-WaterShader::WaterShader(ID3D11Device* device, GlobalLighting* globalLighting, ID3D11ShaderResourceView* normalMapA, ID3D11ShaderResourceView* normalMapB)
-	: BaseFullScreenShader(device),
-	m_NormalMapA(normalMapA), m_NormalMapB(normalMapB), m_GlobalLighting(globalLighting)
+WaterShader::WaterShader(ID3D11Device* device, GlobalLighting* globalLighting, ConstantBufferRing* constantBufferRing, ID3D11ShaderResourceView* normalMapA, ID3D11ShaderResourceView* normalMapB)
+	: BaseFullScreenShader(device, constantBufferRing->GetBackend()),
+	m_NormalMapA(normalMapA), m_NormalMapB(normalMapB), m_GlobalLighting(globalLighting), m_ConstantBufferRing(constantBufferRing)
 {
 	Init(L"water_ps.cso");
 }
@@ -17,18 +18,11 @@ WaterShader::WaterShader(ID3D11Device* device, GlobalLighting* globalLighting, I
 
 WaterShader::~WaterShader()
 {
-	if (m_CameraBuffer) m_CameraBuffer->Release();
-	if (m_WaterBuffer) m_WaterBuffer->Release();
-	if (m_PSLightBuffer) m_PSLightBuffer->Release();
 	if (m_NormalMapSamplerState) m_NormalMapSamplerState->Release();
 }
 
 void WaterShader::CreateShaderResources()
 {
-	ShaderUtility::CreateBuffer(m_Device, sizeof(CameraBufferType), &m_CameraBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(WaterBufferType), &m_WaterBuffer);
-	ShaderUtility::CreateBuffer(m_Device, sizeof(ShaderUtility::PSLightBufferType), &m_PSLightBuffer);
-
 	D3D11_SAMPLER_DESC normalMapSamplerDesc;
 	normalMapSamplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	normalMapSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -53,61 +47,51 @@ void WaterShader::UnbindShaderResources(ID3D11DeviceContext* deviceContext)
 	deviceContext->PSSetSamplers(0, 1, &nullSampler);
 }
 
-void WaterShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, RenderTarget* renderTarget, SceneLight** lights, size_t lightCount, Camera* camera, float time)
+void WaterShader::setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, RenderTarget* renderTarget, LightingCache* lighting, Camera* camera, float time)
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-
-	ResourceBuffer tex2DBuffer, texCubeBuffer;
+	// light textures have already been placed into the frame's resource buffers
+	ResourceBuffer tex2DBuffer = lighting->GetTex2DResources();
+	ResourceBuffer texCubeBuffer = lighting->GetTexCubeResources();
 
-	{
-		deviceContext->Map(m_CameraBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		CameraBufferType* cameraPtr = (CameraBufferType*)mappedResource.pData;
-		cameraPtr->invView = XMMatrixTranspose(XMMatrixInverse(nullptr, viewMatrix));
-		cameraPtr->projection = XMMatrixTranspose(projectionMatrix);
-		deviceContext->Unmap(m_CameraBuffer, 0);
-	}
-	{
-		deviceContext->Map(m_WaterBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		WaterBufferType* dataPtr = (WaterBufferType*)mappedResource.pData;
+	CameraBufferType cameraData;
+	cameraData.invView = XMMatrixTranspose(XMMatrixInverse(nullptr, viewMatrix));
+	cameraData.projection = XMMatrixTranspose(projectionMatrix);
+	ConstantBufferRing::Allocation cameraBuffer = m_ConstantBufferRing->Upload(cameraData);
 
-		dataPtr->projection = XMMatrixTranspose(projectionMatrix);
-		dataPtr->cameraPos = camera->getPosition();
+	WaterBufferType waterData;
+	waterData.projection = XMMatrixTranspose(projectionMatrix);
+	waterData.cameraPos = camera->getPosition();
 
-		dataPtr->rtColourMapIndex = tex2DBuffer.AddResource(renderTarget->GetColourSRV());
-		dataPtr->rtDepthMapIndex = tex2DBuffer.AddResource(renderTarget->GetDepthSRV());
-		dataPtr->normalMapAIndex = tex2DBuffer.AddResource(m_NormalMapA);
-		dataPtr->normalMapBIndex = tex2DBuffer.AddResource(m_NormalMapB);
+	waterData.rtColourMapIndex = tex2DBuffer.AddResource(renderTarget->GetColourSRV());
+	waterData.rtDepthMapIndex = tex2DBuffer.AddResource(renderTarget->GetDepthSRV());
+	waterData.normalMapAIndex = tex2DBuffer.AddResource(m_NormalMapA);
+	waterData.normalMapBIndex = tex2DBuffer.AddResource(m_NormalMapB);
 
-		dataPtr->specularColour = m_SpecularColour;
-		dataPtr->transmittanceColour = m_TransmittanceColour;
+	waterData.specularColour = m_SpecularColour;
+	waterData.transmittanceColour = m_TransmittanceColour;
 
-		dataPtr->oceanBoundsMin = m_OceanBoundsMin;
-		dataPtr->oceanBoundsMax = m_OceanBoundsMax;
+	waterData.oceanBoundsMin = m_OceanBoundsMin;
+	waterData.oceanBoundsMax = m_OceanBoundsMax;
 
-		dataPtr->transmittanceDepth= m_TransmittanceDepth;
-		
-		dataPtr->normalMapScale = m_NormalMapScale;
-		dataPtr->normalMapStrength = m_NormalMapStrength;
+	waterData.transmittanceDepth = m_TransmittanceDepth;
 
-		dataPtr->time = time;
-		dataPtr->waveSpeed = m_WaveSpeed;
-		dataPtr->waveAngle = m_WaveAngle;
+	waterData.normalMapScale = m_NormalMapScale;
+	waterData.normalMapStrength = m_NormalMapStrength;
 
-		dataPtr->specularBrightness = m_SpecularBrightness;
+	waterData.time = time;
+	waterData.waveSpeed = m_WaveSpeed;
+	waterData.waveAngle = m_WaveAngle;
 
-		deviceContext->Unmap(m_WaterBuffer, 0);
-	}
-	ShaderUtility::ConstructPSLightBuffer(deviceContext, m_PSLightBuffer, lights, lightCount, m_GlobalLighting, &tex2DBuffer, &texCubeBuffer);
+	waterData.specularBrightness = m_SpecularBrightness;
+	ConstantBufferRing::Allocation waterBuffer = m_ConstantBufferRing->Upload(waterData);
 
-	deviceContext->VSSetConstantBuffers(0, 1, &m_CameraBuffer);
+	m_ConstantBufferRing->BindVS(0, { cameraBuffer });
+	m_ConstantBufferRing->BindPS(0, { waterBuffer, ConstantBufferRing::WholeBuffer(lighting->GetPSLightBuffer()) });
 
-	ID3D11Buffer* psCBs[] = { m_WaterBuffer, m_PSLightBuffer };
-	deviceContext->PSSetConstantBuffers(0, 2, psCBs);
 	ID3D11SamplerState* psSamplers[] = { m_NormalMapSamplerState, m_GlobalLighting->GetBRDFIntegrationSampler(), m_GlobalLighting->GetCubemapSampler() };
 	deviceContext->PSSetSamplers(0, 3, psSamplers);
 
-	deviceContext->PSSetShaderResources(0, RESOURCE_BUFFER_SIZE, tex2DBuffer.GetResourcePtr());
-	deviceContext->PSSetShaderResources(RESOURCE_BUFFER_SIZE, RESOURCE_BUFFER_SIZE, texCubeBuffer.GetResourcePtr());
+	lighting->BindPSResources(tex2DBuffer, texCubeBuffer);
 }
 
 void WaterShader::SettingsGUI()
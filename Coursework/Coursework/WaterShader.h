@@ -4,9 +4,10 @@
 #include "BaseFullScreenShader.h"
 #include "ShaderUtility.h"
 
-class SceneLight;
 class RenderTarget;
 class GlobalLighting;
+class LightingCache;
+class ConstantBufferRing;
 
 using namespace DirectX;
 
@@ -52,10 +53,10 @@ private:
 	};
 
 public:
-	WaterShader(ID3D11Device* device, GlobalLighting* globalLighting, ID3D11ShaderResourceView* normalMapA, ID3D11ShaderResourceView* normalMapB);
+	WaterShader(ID3D11Device* device, GlobalLighting* globalLighting, ConstantBufferRing* constantBufferRing, ID3D11ShaderResourceView* normalMapA, ID3D11ShaderResourceView* normalMapB);
 	~WaterShader();
 
-	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, RenderTarget* renderTarget, SceneLight** lights, size_t lightCount, Camera* camera, float time);
+	void setShaderParameters(ID3D11DeviceContext* deviceContext, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, RenderTarget* renderTarget, LightingCache* lighting, Camera* camera, float time);
 
 	void SettingsGUI();
 
@@ -65,9 +66,6 @@ protected:
 	virtual void UnbindShaderResources(ID3D11DeviceContext* deviceContext) override;
 
 private:
-	ID3D11Buffer* m_CameraBuffer = nullptr;
-	ID3D11Buffer* m_WaterBuffer = nullptr;
-	ID3D11Buffer* m_PSLightBuffer = nullptr;
 	ID3D11SamplerState* m_NormalMapSamplerState = nullptr;
 
 	XMFLOAT3 m_OceanBoundsMin = { -50.0f, -10.0f, -50.0f };
@@ -90,4 +88,5 @@ private:
 	ID3D11ShaderResourceView* m_NormalMapB = nullptr;
 
 	GlobalLighting* m_GlobalLighting = nullptr;
+	ConstantBufferRing* m_ConstantBufferRing = nullptr;
 };
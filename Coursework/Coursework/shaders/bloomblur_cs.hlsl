@@ -0,0 +1,41 @@
+Texture2D input : register(t0);
+RWTexture2D<float4> output : register(u0);
+
+SamplerState samplerState : register(s0);
+
+cbuffer CSBuffer : register(b0)
+{
+    // (1, 0) for horizontal, (0, 1) for vertical
+    float2 direction;
+    float2 padding;
+    
+    // the 5 tap gaussian merged into 3 bilinear fetches, see BloomReference::MergeTaps
+    float centerWeight;
+    float sideWeight;
+    float sideOffset;
+    float padding2;
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    uint2 dims;
+    output.GetDimensions(dims.x, dims.y);
+    
+    if (DTid.x >= dims.x || DTid.y >= dims.y)
+        return;
+
+    float2 uv = ((float2) DTid.xy + 0.5f) / (float2) dims;
+
+    uint2 inDims;
+    input.GetDimensions(inDims.x, inDims.y);
+    float2 offset = direction * sideOffset / (float2) inDims;
+    
+    // each side fetch lands between two texels so the filter weights both of them
+    float4 colour = input.SampleLevel(samplerState, uv, 0) * centerWeight;
+    colour += (input.SampleLevel(samplerState, uv - offset, 0) + input.SampleLevel(samplerState, uv + offset, 0)) * sideWeight;
+    
+    colour.a = 1.0f;
+
+    output[DTid.xy] = colour;
+}
@@ -21,7 +21,7 @@ void main( uint3 DTid : SV_DispatchThreadID )
     if (DTid.x >= dims.x || DTid.y >= dims.y)
         return;
 
-    float2 uv = (float2) (DTid.xy) / (float2) (dims - uint2(1, 1));
+    float2 uv = ((float2) DTid.xy + 0.5f) / (float2) dims;
 
     // sample texture
     float4 s = input.SampleLevel(samplerState, uv, 0.0f);
@@ -0,0 +1,34 @@
+Texture2D input : register(t0);
+RWTexture2D<float4> output : register(u0);
+
+SamplerState samplerState : register(s0);
+
+// dual kawase upsample, the input is half the size of the output
+// a tent of 8 fetches around the output texel, added to the output like the combine pass
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    uint2 dims;
+    output.GetDimensions(dims.x, dims.y);
+    
+    if (DTid.x >= dims.x || DTid.y >= dims.y)
+        return;
+
+    float2 uv = ((float2) DTid.xy + 0.5f) / (float2) dims;
+
+    uint2 inDims;
+    input.GetDimensions(inDims.x, inDims.y);
+    float2 texelSize = 1.0f / (float2) inDims;
+
+    float4 colour = input.SampleLevel(samplerState, uv + texelSize * float2(-1.0f, 0.0f), 0);
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(1.0f, 0.0f), 0);
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(0.0f, -1.0f), 0);
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(0.0f, 1.0f), 0);
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(-0.5f, -0.5f), 0) * 2.0f;
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(0.5f, -0.5f), 0) * 2.0f;
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(-0.5f, 0.5f), 0) * 2.0f;
+    colour += input.SampleLevel(samplerState, uv + texelSize * float2(0.5f, 0.5f), 0) * 2.0f;
+    colour /= 12.0f;
+
+    output[DTid.xy] += float4(colour.rgb, 0.0f);
+}
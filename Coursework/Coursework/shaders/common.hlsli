@@ -32,7 +32,14 @@ struct MaterialData
     
     int normalMapIndex;
     
-    float3 padding;
+    // occlusion, roughness and metalness in one map, replaces the roughness and metalness maps
+    int ormMapIndex;
+    float occlusion;
+    float padding;
+    
+    // 1 for the channels taken from the ORM map, the others use the values above
+    float3 ormMapMask;
+    float padding2;
 };
 
 
@@ -62,11 +69,11 @@ struct PSLightBuffer
     
     int lightCount;
     bool enableEnvironmentalLighting;
-    int irradianceMapIndex;
     int prefilterMapIndex;
-    
     int brdfIntegrationMapIndex;
-    float3 padding;
+    
+    // spherical harmonic irradiance constants, see evaluateIrradianceSH
+    float4 irradianceSH[9];
 };
 
 struct MaterialBuffer
@@ -1,7 +1,8 @@
-#define TEX_BUFFER_SIZE 24
+#define TEX_BUFFER_SIZE 32
 
 #define MAX_LIGHTS 4
 #define MAX_MATERIALS 8
+#define MAX_TERRAIN_LAYERS 16
 
 #define LIGHT_TYPE_DIRECTIONAL 0.0f
 #define LIGHT_TYPE_POINT 1.0f
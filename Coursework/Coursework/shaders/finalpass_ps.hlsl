@@ -4,6 +4,7 @@ Texture2D renderTextureColour : register(t0);
 Texture2D renderTextureDepth : register(t1);
 StructuredBuffer<float> lum : register(t2);
 Texture2D bloomTex : register(t3);
+Texture2D<float> tonemapLUT : register(t4);
 
 SamplerState trilinearSampler;
 
@@ -12,19 +13,15 @@ cbuffer Params : register(b0)
     int enableTonemapping;
     float avgLumFactor; // avgLum = lum[0] * avgLumFactor
     
-    float hdrMax; // How much HDR range before clipping. HDR modes likely need this pushed up to say 25.0.
-    float contrast; // Use as a baseline to tune the amount of contrast the tonemapper has.
-    float shoulder; // Likely dont need to mess with this factor, unless matching existing tonemapper is not working well..
-    float midIn; // most games will have a {0.0 to 1.0} range for LDR so midIn should be 0.18.
-    float midOut; // Use for LDR. For HDR10 10:10:10:2 use maybe 0.18/25.0 to start. For scRGB, I forget what a good starting point is, need to re-calculate.
-    float crosstalk; // Amount of channel crosstalk
-    float white;
+    // texture coordinates into the tonemapping table, log2(x) * scale + bias, see TonemapLUT
+    float ratioScale;
+    float ratioBias;
+    float peakScale;
+    float peakBias;
     
 	// bloom
     int enableBloom;
     float bloomStrength;
-	
-    float padding;
 }
 
 struct InputType
@@ -35,52 +32,21 @@ struct InputType
 };
 
 
-// Timothy Lottes tonemapping function
-float ColToneB(float hdrMax, float contrast, float shoulder, float midIn, float midOut)
-{
-    return
-        -((-pow(midIn, contrast) + (midOut * (pow(hdrMax, contrast * shoulder) * pow(midIn, contrast) -
-            pow(hdrMax, contrast) * pow(midIn, contrast * shoulder) * midOut)) /
-            (pow(hdrMax, contrast * shoulder) * midOut - pow(midIn, contrast * shoulder) * midOut)) /
-            (pow(midIn, contrast * shoulder) * midOut));
-}
-
-// General tonemapping operator, build 'c' term.
-float ColToneC(float hdrMax, float contrast, float shoulder, float midIn, float midOut)
-{
-    return (pow(hdrMax, contrast * shoulder) * pow(midIn, contrast) - pow(hdrMax, contrast) * pow(midIn, contrast * shoulder) * midOut) /
-           (pow(hdrMax, contrast * shoulder) * midOut - pow(midIn, contrast * shoulder) * midOut);
-}
-
-// General tonemapping operator, p := {contrast,shoulder,b,c}.
-float ColTone(float x, float4 p)
-{
-    float z = pow(x, p.r);
-    return z / (pow(z, p.g) * p.b + p.a);
-}
-
+// Timothy Lottes tonemapping, baked by TonemapLUT on the CPU
+// each channel's output is a function of its ratio to the brightest channel and that peak, one fetch per channel
 float3 TimothyTonemapper(float3 color)
 {
-    float b = ColToneB(hdrMax, contrast, shoulder, midIn, midOut);
-    float c = ColToneC(hdrMax, contrast, shoulder, midIn, midOut);
-
     float peak = max(color.r, max(color.g, color.b));
-    float3 ratio = color / peak;
-    peak = ColTone(peak, float4(contrast, shoulder, b, c));
-    // then process ratio
-
-    // probably want send these pre-computed (so send over saturation/crossSaturation as a constant)
-    float saturation = contrast; // full tonal range saturation control
-    float crossSaturation = contrast * 16.0f; // crosstalk saturation
-
-    // wrap crosstalk in transform
-    ratio = pow(abs(ratio), saturation / crossSaturation);
-    ratio = lerp(ratio, white, pow(peak, crosstalk));
-    ratio = pow(abs(ratio), crossSaturation);
-
-    // then apply ratio to peak
-    color = peak * ratio;
-    return color;
+    
+    // the ratio is shaped by the first power the curve applies to it, TonemapLUT::RatioExponent, which takes 0 to the
+    // black end. The sampler clamps, so a peak past hdrMax reads the white end
+    float v = log2(peak) * peakScale + peakBias;
+    float3 u = pow(abs(color / peak), 1.0f / 16.0f) * ratioScale + ratioBias;
+    
+    color.r = tonemapLUT.SampleLevel(trilinearSampler, float2(u.r, v), 0);
+    color.g = tonemapLUT.SampleLevel(trilinearSampler, float2(u.g, v), 0);
+    color.b = tonemapLUT.SampleLevel(trilinearSampler, float2(u.b, v), 0);
+    return peak > 0.0f ? color : 0.0f;
 }
 
 
@@ -1,6 +1,7 @@
 
 Texture2D<float4> heightmap : register(t0);
 RWTexture2D<float4> preprocessMap : register(u0);
+RWTexture2D<float2> minMaxMap : register(u1);
 
 groupshared float   groupResults[16 * 16];
 groupshared float4  plane;
@@ -85,6 +86,18 @@ void main( uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTid
         
         plane = float4(n, -dot(n, p));
     }
+    else if (GI == 1)
+    {
+        // the height range of this patch, used to build occluders on the CPU
+        float minHeight = groupResults[0];
+        float maxHeight = groupResults[0];
+        for (int i = 1; i < 16 * 16; i++)
+        {
+            minHeight = min(minHeight, groupResults[i]);
+            maxHeight = max(maxHeight, groupResults[i]);
+        }
+        minMaxMap[Gid.xy] = float2(minHeight, maxHeight);
+    }
     
     GroupMemoryBarrierWithGroupSync();
     
@@ -215,9 +215,22 @@ float calculateShadowFactor(TextureCube texBuffer[TEX_BUFFER_SIZE], int shadowMa
 
 
 // ambient lighting
+
+// diffuse irradiance (divided by pi) from the environment's spherical harmonic projection, see SphericalHarmonics::ToIrradianceConstants
+float3 evaluateIrradianceSH(float4 sh[9], float3 n)
+{
+    float3 irradiance = sh[0].rgb
+                      + sh[1].rgb * n.y + sh[2].rgb * n.z + sh[3].rgb * n.x
+                      + sh[4].rgb * (n.x * n.y) + sh[5].rgb * (n.y * n.z) + sh[6].rgb * (3.0f * n.z * n.z - 1.0f)
+                      + sh[7].rgb * (n.x * n.z) + sh[8].rgb * (n.x * n.x - n.y * n.y);
+    
+    // ringing can take it slightly negative opposite very bright sources
+    return max(irradiance, 0.0f);
+}
+
 float3 calculateAmbientLighting(float3 n, float3 v, float3 albedo, float3 f0, float roughness, float metallic,
                                 Texture2D tex2dBuffer[TEX_BUFFER_SIZE], TextureCube texCubeBuffer[TEX_BUFFER_SIZE],
-                                int irradianceMapIndex, int prefilterMapIndex, int brdfMapIndex,
+                                float4 irradianceSH[9], int prefilterMapIndex, int brdfMapIndex,
                                 SamplerState trilinearSampler, SamplerState bilinearClampSampler)
 {
     // ues IBL for ambient lighting
@@ -227,7 +240,7 @@ float3 calculateAmbientLighting(float3 n, float3 v, float3 albedo, float3 f0, fl
     float3 kD = 1.0f - kS;
     kD *= 1.0f - metallic;
         
-    float3 irradiance = SampleTextureCube(texCubeBuffer, irradianceMapIndex, trilinearSampler, n).rgb;
+    float3 irradiance = evaluateIrradianceSH(irradianceSH, n);
     float3 diffuse = irradiance * albedo;
         
     // sample both the pre-filter map and the BRDF lut and combine them together as per the Split-Sum approximation to get the IBL specular part.
@@ -264,6 +277,22 @@ float3 calculateAmbientSpecular(float3 n, float3 v, float3 f0, float roughness,
 
 
 
+// occlusion, roughness and metalness, with a single sample when the material has them packed
+float3 sampleORM(const MaterialData material, float2 uv, Texture2D texture2DBuffer[TEX_BUFFER_SIZE], SamplerState materialSampler)
+{
+    if (material.ormMapIndex > -1)
+    {
+        // channels the packed map had no source for hold defaults, so the material's values are used for them
+        float3 orm = SampleTexture2D(texture2DBuffer, material.ormMapIndex, materialSampler, uv).rgb;
+        return lerp(float3(material.occlusion, material.roughnessValue, material.metallic), orm, material.ormMapMask);
+    }
+    
+    float roughness = material.roughnessMapIndex > -1 ? SampleTexture2D(texture2DBuffer, material.roughnessMapIndex, materialSampler, uv).r : material.roughnessValue;
+    float metalness = material.metalnessMapIndex > -1 ? SampleTexture2D(texture2DBuffer, material.metalnessMapIndex, materialSampler, uv).r : material.metallic;
+    return float3(material.occlusion, roughness, metalness);
+}
+
+
 // the big calculate lighting function
 float3 calculateLighting(
     float3 p,                       // world pos
@@ -288,8 +317,10 @@ float3 calculateLighting(
     }
     
     float3 albedo = material.albedoMapIndex > -1 ? SampleTexture2D(texture2DBuffer, material.albedoMapIndex, anisotropicSampler, uv).rgb : material.albedoColor.rgb;
-    float roughness = material.roughnessMapIndex > -1 ? SampleTexture2D(texture2DBuffer, material.roughnessMapIndex, anisotropicSampler, uv).r : material.roughnessValue;
-    float metalness = material.metalnessMapIndex > -1 ? SampleTexture2D(texture2DBuffer, material.metalnessMapIndex, anisotropicSampler, uv).r : material.metallic;
+    float3 orm = sampleORM(material, uv, texture2DBuffer, anisotropicSampler);
+    float occlusion = orm.r;
+    float roughness = orm.g;
+    float metalness = orm.b;
     
     float3 f0 = float3(0.04f, 0.04f, 0.04f);
     f0 = lerp(f0, albedo, metalness);
@@ -340,8 +371,10 @@ float3 calculateLighting(
     {
         ambient = calculateAmbientLighting( n, v, albedo, f0, roughness, metalness,
                                             texture2DBuffer, textureCubeBuffer,
-                                            lights.irradianceMapIndex, lights.prefilterMapIndex, lights.brdfIntegrationMapIndex,
+                                            lights.irradianceSH, lights.prefilterMapIndex, lights.brdfIntegrationMapIndex,
                                             trilinearSampler, bilinearSampler);
+        // occlusion only hides the environment, direct light is shadowed already
+        ambient *= occlusion;
     }
     
     return ambient + lo;
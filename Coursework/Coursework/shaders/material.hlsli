@@ -52,35 +52,20 @@ MaterialData materialMix(const MaterialData matA, const MaterialData matB, float
     mixed.albedoColor = lerp(albedoA, albedoB, t);
     mixed.albedoMapIndex = -1;
     
-    // mix roughness
-    float roughnessA, roughnessB;
-    if (matA.roughnessMapIndex > -1)
-        roughnessA = SampleTexture2D(tex2DBuffer, matA.roughnessMapIndex, materialSampler, uv).r;
-    else
-        roughnessA = matA.roughnessValue;
-    if (matB.roughnessMapIndex > -1)
-        roughnessB = SampleTexture2D(tex2DBuffer, matB.roughnessMapIndex, materialSampler, uv).r;
-    else
-        roughnessB = matB.roughnessValue;
-    mixed.roughnessValue = lerp(roughnessA, roughnessB, t);
+    // mix occlusion, roughness and metallic
+    float3 ormA = sampleORM(matA, uv, tex2DBuffer, materialSampler);
+    float3 ormB = sampleORM(matB, uv, tex2DBuffer, materialSampler);
+    float3 orm = lerp(ormA, ormB, t);
+    mixed.occlusion = orm.r;
+    mixed.roughnessValue = orm.g;
+    mixed.metallic = orm.b;
     mixed.roughnessMapIndex = -1;
+    mixed.metalnessMapIndex = -1;
+    mixed.ormMapIndex = -1;
+    mixed.ormMapMask = float3(0.0f, 0.0f, 0.0f);
     
     // mixing normals is more complicated than simply interpolating
     mixed.normalMapIndex = -1;
     
-    // mix metallic
-    float metallicA, metallicB;
-    //if (matA.metalnessMapIndex > -1)
-    if (false)
-        metallicA = SampleTexture2D(tex2DBuffer, matA.metalnessMapIndex, materialSampler, uv).r;
-    else
-        metallicA = matA.metallic;
-    if (matB.metalnessMapIndex > -1)
-        metallicB = SampleTexture2D(tex2DBuffer, matB.metalnessMapIndex, materialSampler, uv).r;
-    else
-        metallicB = matB.metallic;
-    mixed.metallic = lerp(metallicA, metallicB, t);
-    mixed.metalnessMapIndex = -1;
-    
     return mixed;
 }
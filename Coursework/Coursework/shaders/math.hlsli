@@ -148,7 +148,9 @@ float3 tangentSpaceToWorldSpace(float3 tangentSpace, float3 n, float3 t)
 
 float3 normalMapToWorld(float3 sample, float3 n, float3 v, float2 uv)
 {
-    sample = (sample * 2.0f) - 1.0f;
+    // z is rebuilt, so two channel (BC5) normal maps work too
+    sample.xy = (sample.xy * 2.0f) - 1.0f;
+    sample.z = sqrt(saturate(1.0f - dot(sample.xy, sample.xy)));
     
     return tangentSpaceToWorldSpace(sample, n, v, uv);
 }
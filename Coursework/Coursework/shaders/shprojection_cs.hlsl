@@ -0,0 +1,100 @@
+// projects the environment cubemap onto order 2 spherical harmonics, the GPU mirror of SphericalHarmonics::ProjectCubemap
+// each group sums every ROW_GROUPS'th band of 8 rows of one face, and the CPU adds up the results of all groups
+
+TextureCube environmentMap : register(t0);
+SamplerState environmentSampler : register(s0);
+
+// per group: the 9 coefficients, then the total solid angle weight in x
+RWStructuredBuffer<float4> partialSums : register(u0);
+
+// must match GlobalLighting::SHProjectionRowGroups
+#define ROW_GROUPS 32
+#define GROUP_THREADS 64
+#define OUTPUTS_PER_GROUP 10
+
+// same as the Cubemap face tables
+static const float3 faceNormals[6] =
+{
+    float3(1.0f, 0.0f, 0.0f), float3(-1.0f, 0.0f, 0.0f), float3(0.0f, 1.0f, 0.0f),
+    float3(0.0f, -1.0f, 0.0f), float3(0.0f, 0.0f, 1.0f), float3(0.0f, 0.0f, -1.0f)
+};
+static const float3 faceTangents[6] =
+{
+    float3(0.0f, 0.0f, -1.0f), float3(0.0f, 0.0f, 1.0f), float3(1.0f, 0.0f, 0.0f),
+    float3(1.0f, 0.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), float3(-1.0f, 0.0f, 0.0f)
+};
+static const float3 faceBitangents[6] =
+{
+    float3(0.0f, -1.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), float3(0.0f, 0.0f, 1.0f),
+    float3(0.0f, 0.0f, -1.0f), float3(0.0f, -1.0f, 0.0f), float3(0.0f, -1.0f, 0.0f)
+};
+
+groupshared float4 sums[GROUP_THREADS][OUTPUTS_PER_GROUP];
+
+
+[numthreads(8, 8, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 groupThreadID : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
+{
+    uint face = groupID.z;
+    float3 faceNormal = faceNormals[face];
+    float3 faceTangent = faceTangents[face];
+    float3 faceBitangent = faceBitangents[face];
+    
+    uint size, height, mipLevels;
+    environmentMap.GetDimensions(0, size, height, mipLevels);
+    
+    float4 local[OUTPUTS_PER_GROUP];
+    for (uint i = 0; i < OUTPUTS_PER_GROUP; i++)
+        local[i] = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    
+    for (uint y = groupID.x * 8 + groupThreadID.y; y < size; y += ROW_GROUPS * 8)
+    {
+        for (uint x = groupThreadID.x; x < size; x += 8)
+        {
+            // texel centre in [-1, 1]
+            float2 uv = (float2(x, y) + 0.5f) * (2.0f / size) - 1.0f;
+            float3 dir = faceNormal + uv.x * faceTangent + uv.y * faceBitangent;
+            
+            // the solid angle of a texel is proportional to 1 / |dir|^3
+            float invLength = rsqrt(dot(dir, dir));
+            float weight = invLength * invLength * invLength;
+            dir *= invLength;
+            
+            // sampling exactly at the texel centre returns the texel itself
+            float3 colour = environmentMap.SampleLevel(environmentSampler, dir, 0).rgb * weight;
+            
+            local[0].rgb += 0.282095f * colour;
+            local[1].rgb += 0.488603f * dir.y * colour;
+            local[2].rgb += 0.488603f * dir.z * colour;
+            local[3].rgb += 0.488603f * dir.x * colour;
+            local[4].rgb += 1.092548f * dir.x * dir.y * colour;
+            local[5].rgb += 1.092548f * dir.y * dir.z * colour;
+            local[6].rgb += 0.315392f * (3.0f * dir.z * dir.z - 1.0f) * colour;
+            local[7].rgb += 1.092548f * dir.x * dir.z * colour;
+            local[8].rgb += 0.546274f * (dir.x * dir.x - dir.y * dir.y) * colour;
+            local[9].x += weight;
+        }
+    }
+    
+    for (i = 0; i < OUTPUTS_PER_GROUP; i++)
+        sums[groupIndex][i] = local[i];
+    GroupMemoryBarrierWithGroupSync();
+    
+    // parallel reduction within the group
+    for (uint stride = GROUP_THREADS / 2; stride > 0; stride >>= 1)
+    {
+        if (groupIndex < stride)
+        {
+            for (i = 0; i < OUTPUTS_PER_GROUP; i++)
+                sums[groupIndex][i] += sums[groupIndex + stride][i];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    
+    if (groupIndex == 0)
+    {
+        uint base = (face * ROW_GROUPS + groupID.x) * OUTPUTS_PER_GROUP;
+        for (i = 0; i < OUTPUTS_PER_GROUP; i++)
+            partialSums[base + i] = sums[0][i];
+    }
+}
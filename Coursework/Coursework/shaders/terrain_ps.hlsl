@@ -4,7 +4,7 @@
 
 // textures
 Texture2D texture2DBuffer[TEX_BUFFER_SIZE] : register(t0);
-TextureCube textureCubeBuffer[TEX_BUFFER_SIZE] : register(t24);
+TextureCube textureCubeBuffer[TEX_BUFFER_SIZE] : register(t32);
 
 SamplerState bilinearSampler : register(s0);
 SamplerState trilinearSampler : register(s1);
@@ -42,6 +42,31 @@ cbuffer TerrainBuffer : register(b2)
     float2 minMaxSnowSteepness;
 };
 
+#ifdef TERRAIN_LAYER_ARRAYS
+// each material is a slice of the arrays, so none of them take a slot in texture2DBuffer
+Texture2DArray layerAlbedoArray : register(t64);
+Texture2DArray layerNormalArray : register(t65);
+Texture2DArray layerORMArray : register(t66);
+
+struct TerrainLayer
+{
+    float3 albedoColor;
+    int slice;
+    
+    // occlusion, roughness and metallic for the channels that don't come from the ORM slice
+    float3 orm;
+    float useAlbedoMap;
+    
+    float3 ormMapMask;
+    float useNormalMap;
+};
+
+cbuffer TerrainLayerBuffer : register(b3)
+{
+    TerrainLayer layers[MAX_TERRAIN_LAYERS];
+};
+#endif
+
 struct InputType
 {
     float4 position : SV_POSITION;
@@ -77,6 +102,52 @@ float3 calculateNormalTangentSpace(float2 pos)
     return normalize(cross(tangent, bitangent));
 }
 
+// a layer's material properties, with the maps sampled already when they are slices of the arrays
+// materialMix samples the maps of a material from the material buffer itself
+MaterialData layerMaterial(int i, float2 uv)
+{
+#ifdef TERRAIN_LAYER_ARRAYS
+    TerrainLayer layer = layers[i];
+    MaterialData material;
+    material.albedoColor = layer.albedoColor;
+    if (layer.useAlbedoMap)
+        material.albedoColor = layerAlbedoArray.Sample(anisotropicSampler, float3(uv, layer.slice)).rgb;
+    float3 orm = layer.orm;
+    if (any(layer.ormMapMask))
+        orm = lerp(orm, layerORMArray.Sample(anisotropicSampler, float3(uv, layer.slice)).rgb, layer.ormMapMask);
+    material.occlusion = orm.r;
+    material.roughnessValue = orm.g;
+    material.metallic = orm.b;
+    material.albedoMapIndex = -1;
+    material.roughnessMapIndex = -1;
+    material.metalnessMapIndex = -1;
+    material.normalMapIndex = -1;
+    material.ormMapIndex = -1;
+    material.ormMapMask = float3(0.0f, 0.0f, 0.0f);
+    material.padding = 0.0f;
+    material.padding2 = 0.0f;
+    return material;
+#else
+    return materialBuffer.materials[i];
+#endif
+}
+
+// a layer's world space normal
+float3 layerNormal(int i, float3 n, float3 v, float2 uv)
+{
+#ifdef TERRAIN_LAYER_ARRAYS
+    if (!layers[i].useNormalMap)
+        return n;
+    float3 map = layerNormalArray.Sample(anisotropicSampler, float3(uv, layers[i].slice)).rgb;
+#else
+    int normalMapIndex = materialBuffer.materials[i].normalMapIndex;
+    if (normalMapIndex < 0)
+        return n;
+    float3 map = SampleTexture2D(texture2DBuffer, normalMapIndex, anisotropicSampler, uv).rgb;
+#endif
+    return normalMapToWorld(map, n, v, uv);
+}
+
 float4 main(InputType input) : SV_TARGET
 {
     input.normal = normalize(input.normal);
@@ -103,46 +174,32 @@ float4 main(InputType input) : SV_TARGET
     
     // perform blending
     MaterialData groundMaterial = materialMix(
-            materialBuffer.materials[1],
-            materialBuffer.materials[2],
+            layerMaterial(1, uv),
+            layerMaterial(2, uv),
             dirtBlend,
             uv, texture2DBuffer, anisotropicSampler);
-    float3 materialNormal = blendNormals(
-            materialBuffer.materials[1].normalMapIndex,
-            materialBuffer.materials[2].normalMapIndex,
-            dirtBlend, n, v,
-            uv, texture2DBuffer, anisotropicSampler);
+    float3 materialNormal = normalize(lerp(layerNormal(1, n, v, uv), layerNormal(2, n, v, uv), dirtBlend));
      
     groundMaterial = materialMix(
             groundMaterial,
-            materialBuffer.materials[3],
+            layerMaterial(3, uv),
             cliffBlend,
             uv, texture2DBuffer, anisotropicSampler);
-    materialNormal = blendNormals(
-            materialBuffer.materials[3].normalMapIndex,
-            materialNormal,
-            1.0f - cliffBlend, n, v,
-            uv, texture2DBuffer, anisotropicSampler);
+    materialNormal = normalize(lerp(materialNormal, layerNormal(3, n, v, uv), cliffBlend));
 
     groundMaterial = materialMix(
-            materialBuffer.materials[0],
+            layerMaterial(0, uv),
             groundMaterial,
             shoreMix,
             uv, texture2DBuffer, anisotropicSampler);
-    materialNormal = blendNormals(materialBuffer.materials[0].normalMapIndex,
-            materialNormal,
-            shoreMix, n, v,
-            uv, texture2DBuffer, anisotropicSampler);
+    materialNormal = normalize(lerp(layerNormal(0, n, v, uv), materialNormal, shoreMix));
 
     groundMaterial = materialMix(
             groundMaterial,
-            materialBuffer.materials[4],
+            layerMaterial(4, uv),
             snowMix,
             uv, texture2DBuffer, anisotropicSampler);
-    materialNormal = blendNormals(materialBuffer.materials[4].normalMapIndex,
-            materialNormal,
-            1.0f - snowMix, n, v,
-            uv, texture2DBuffer, anisotropicSampler);
+    materialNormal = normalize(lerp(materialNormal, layerNormal(4, n, v, uv), snowMix));
 
     materialNormal.z = -materialNormal.z;
     
@@ -0,0 +1,4 @@
+// Terrain Pixel Shader, with the materials' maps read from texture arrays
+
+#define TERRAIN_LAYER_ARRAYS
+#include "terrain_ps.hlsl"
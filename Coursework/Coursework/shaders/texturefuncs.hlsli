@@ -17,6 +17,8 @@ float4 SampleTexture2D(Texture2D texBuffer[TEX_BUFFER_SIZE], int i, SamplerState
         CASESAMPLETEX2D(12) CASESAMPLETEX2D(13) CASESAMPLETEX2D(14) CASESAMPLETEX2D(15)
         CASESAMPLETEX2D(16) CASESAMPLETEX2D(17) CASESAMPLETEX2D(18) CASESAMPLETEX2D(19)
         CASESAMPLETEX2D(20) CASESAMPLETEX2D(21) CASESAMPLETEX2D(22) CASESAMPLETEX2D(23)
+        CASESAMPLETEX2D(24) CASESAMPLETEX2D(25) CASESAMPLETEX2D(26) CASESAMPLETEX2D(27)
+        CASESAMPLETEX2D(28) CASESAMPLETEX2D(29) CASESAMPLETEX2D(30) CASESAMPLETEX2D(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -33,6 +35,8 @@ float4 SampleTextureCube(TextureCube texBuffer[TEX_BUFFER_SIZE], int i, SamplerS
         CASESAMPLETEXCUBE(12) CASESAMPLETEXCUBE(13) CASESAMPLETEXCUBE(14) CASESAMPLETEXCUBE(15)
         CASESAMPLETEXCUBE(16) CASESAMPLETEXCUBE(17) CASESAMPLETEXCUBE(18) CASESAMPLETEXCUBE(19)
         CASESAMPLETEXCUBE(20) CASESAMPLETEXCUBE(21) CASESAMPLETEXCUBE(22) CASESAMPLETEXCUBE(23)
+        CASESAMPLETEXCUBE(24) CASESAMPLETEXCUBE(25) CASESAMPLETEXCUBE(26) CASESAMPLETEXCUBE(27)
+        CASESAMPLETEXCUBE(28) CASESAMPLETEXCUBE(29) CASESAMPLETEXCUBE(30) CASESAMPLETEXCUBE(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -50,6 +54,8 @@ float4 SampleTexture2DLOD(Texture2D texBuffer[TEX_BUFFER_SIZE], int i, SamplerSt
         CASESAMPLELEVELTEX2D(12) CASESAMPLELEVELTEX2D(13) CASESAMPLELEVELTEX2D(14) CASESAMPLELEVELTEX2D(15)
         CASESAMPLELEVELTEX2D(16) CASESAMPLELEVELTEX2D(17) CASESAMPLELEVELTEX2D(18) CASESAMPLELEVELTEX2D(19)
         CASESAMPLELEVELTEX2D(20) CASESAMPLELEVELTEX2D(21) CASESAMPLELEVELTEX2D(22) CASESAMPLELEVELTEX2D(23)
+        CASESAMPLELEVELTEX2D(24) CASESAMPLELEVELTEX2D(25) CASESAMPLELEVELTEX2D(26) CASESAMPLELEVELTEX2D(27)
+        CASESAMPLELEVELTEX2D(28) CASESAMPLELEVELTEX2D(29) CASESAMPLELEVELTEX2D(30) CASESAMPLELEVELTEX2D(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -66,6 +72,8 @@ float4 SampleTextureCubeLOD(TextureCube texBuffer[TEX_BUFFER_SIZE], int i, Sampl
         CASESAMPLELEVELTEXCUBE(12) CASESAMPLELEVELTEXCUBE(13) CASESAMPLELEVELTEXCUBE(14) CASESAMPLELEVELTEXCUBE(15)
         CASESAMPLELEVELTEXCUBE(16) CASESAMPLELEVELTEXCUBE(17) CASESAMPLELEVELTEXCUBE(18) CASESAMPLELEVELTEXCUBE(19)
         CASESAMPLELEVELTEXCUBE(20) CASESAMPLELEVELTEXCUBE(21) CASESAMPLELEVELTEXCUBE(22) CASESAMPLELEVELTEXCUBE(23)
+        CASESAMPLELEVELTEXCUBE(24) CASESAMPLELEVELTEXCUBE(25) CASESAMPLELEVELTEXCUBE(26) CASESAMPLELEVELTEXCUBE(27)
+        CASESAMPLELEVELTEXCUBE(28) CASESAMPLELEVELTEXCUBE(29) CASESAMPLELEVELTEXCUBE(30) CASESAMPLELEVELTEXCUBE(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -82,6 +90,8 @@ float4 SampleTexture2DComp(Texture2D texBuffer[TEX_BUFFER_SIZE], int i, SamplerC
         CASESAMPLECOMPTEX2D(12) CASESAMPLECOMPTEX2D(13) CASESAMPLECOMPTEX2D(14) CASESAMPLECOMPTEX2D(15)
         CASESAMPLECOMPTEX2D(16) CASESAMPLECOMPTEX2D(17) CASESAMPLECOMPTEX2D(18) CASESAMPLECOMPTEX2D(19)
         CASESAMPLECOMPTEX2D(20) CASESAMPLECOMPTEX2D(21) CASESAMPLECOMPTEX2D(22) CASESAMPLECOMPTEX2D(23)
+        CASESAMPLECOMPTEX2D(24) CASESAMPLECOMPTEX2D(25) CASESAMPLECOMPTEX2D(26) CASESAMPLECOMPTEX2D(27)
+        CASESAMPLECOMPTEX2D(28) CASESAMPLECOMPTEX2D(29) CASESAMPLECOMPTEX2D(30) CASESAMPLECOMPTEX2D(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -98,6 +108,8 @@ float4 SampleTextureCubeComp(TextureCube texBuffer[TEX_BUFFER_SIZE], int i, Samp
         CASESAMPLECOMPTEXCUBE(12) CASESAMPLECOMPTEXCUBE(13) CASESAMPLECOMPTEXCUBE(14) CASESAMPLECOMPTEXCUBE(15)
         CASESAMPLECOMPTEXCUBE(16) CASESAMPLECOMPTEXCUBE(17) CASESAMPLECOMPTEXCUBE(18) CASESAMPLECOMPTEXCUBE(19)
         CASESAMPLECOMPTEXCUBE(20) CASESAMPLECOMPTEXCUBE(21) CASESAMPLECOMPTEXCUBE(22) CASESAMPLECOMPTEXCUBE(23)
+        CASESAMPLECOMPTEXCUBE(24) CASESAMPLECOMPTEXCUBE(25) CASESAMPLECOMPTEXCUBE(26) CASESAMPLECOMPTEXCUBE(27)
+        CASESAMPLECOMPTEXCUBE(28) CASESAMPLECOMPTEXCUBE(29) CASESAMPLECOMPTEXCUBE(30) CASESAMPLECOMPTEXCUBE(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -115,6 +127,8 @@ float4 LoadTexture2D(Texture2D texBuffer[TEX_BUFFER_SIZE], int i, int2 pos)
         CASELOADTEX2D(12) CASELOADTEX2D(13) CASELOADTEX2D(14) CASELOADTEX2D(15)
         CASELOADTEX2D(16) CASELOADTEX2D(17) CASELOADTEX2D(18) CASELOADTEX2D(19)
         CASELOADTEX2D(20) CASELOADTEX2D(21) CASELOADTEX2D(22) CASELOADTEX2D(23)
+        CASELOADTEX2D(24) CASELOADTEX2D(25) CASELOADTEX2D(26) CASELOADTEX2D(27)
+        CASELOADTEX2D(28) CASELOADTEX2D(29) CASELOADTEX2D(30) CASELOADTEX2D(31)
         default:
             return float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -13,7 +13,7 @@ void main(uint3 DTid : SV_DispatchThreadID)
     if (DTid.x >= dims.x || DTid.y >= dims.y)
         return;
 
-    float2 uv = (float2) (DTid.xy) / (float2) (dims - uint2(1, 1));
+    float2 uv = ((float2) DTid.xy + 0.5f) / (float2) dims;
     
     // Create the weights that each neighbor pixel will contribute to the blur.
     float weight0 = 0.4062f;
@@ -72,6 +72,9 @@ void BaseApplication::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int
 	ImGui_ImplDX11_Init(/*hwnd,*/ renderer->getDevice(), renderer->getDeviceContext());
 
 	wireframeToggle = false;
+	playbackMode = false;
+	playbackTimestep = 1.0f / 60.0f;
+	deltaTime = 0.0f;
 }
 
 // Default frame processing. Check for escape key to exit, update timer, handle input and start UI.
@@ -84,7 +87,16 @@ bool BaseApplication::frame()
 
 	timer->frame();
 
-	handleInput(timer->getTime());
+	// the timer still measures real frame times in playback mode, they just don't drive the simulation
+	if (playbackMode)
+	{
+		deltaTime = playbackTimestep;
+	}
+	else
+	{
+		deltaTime = timer->getTime();
+		handleInput(deltaTime);
+	}
 
 	ImGui_ImplDX11_NewFrame();
 	ImGui_ImplWin32_NewFrame();
@@ -100,3 +112,19 @@ void BaseApplication::handleInput(float frameTime)
 {
 	camera->move(frameTime);
 }
+
+void BaseApplication::setPlaybackMode(bool enabled, float timestep)
+{
+	playbackMode = enabled;
+	playbackTimestep = timestep;
+}
+
+bool BaseApplication::isPlaybackMode()
+{
+	return playbackMode;
+}
+
+float BaseApplication::getDeltaTime()
+{
+	return deltaTime;
+}
@@ -495,6 +495,11 @@ void BaseShader::render(ID3D11DeviceContext* deviceContext, int indexCount)
 	}
 
 	// Render the triangle.
+	draw(deviceContext, indexCount);
+}
+
+void BaseShader::draw(ID3D11DeviceContext* deviceContext, int indexCount)
+{
 	deviceContext->DrawIndexed(indexCount, 0, 0);
 }
 
@@ -50,13 +50,20 @@ void TextureManager::loadTexture(const wchar_t* uid, const wchar_t* filename)
 	}
 
 	// Load the texture in.
-	if (extension == L"dds")
+	// not into the default texture's member, which is the only one released here
+	ID3D11ShaderResourceView* loaded = nullptr;
+	if (loadFunction)
 	{
-		result = CreateDDSTextureFromFile(device, deviceContext, filename, NULL, &texture);
+		loaded = loadFunction(filename);
+		result = loaded ? S_OK : E_FAIL;
+	}
+	else if (extension == L"dds")
+	{
+		result = CreateDDSTextureFromFile(device, deviceContext, filename, NULL, &loaded);
 	}
 	else
 	{
-		result = CreateWICTextureFromFile(device, deviceContext, filename, NULL, &texture, 0);
+		result = CreateWICTextureFromFile(device, deviceContext, filename, NULL, &loaded, 0);
 	}
 	
 	if (FAILED(result))
@@ -65,10 +72,20 @@ void TextureManager::loadTexture(const wchar_t* uid, const wchar_t* filename)
 	}
 	else
 	{
-		textureMap.insert(std::make_pair(const_cast<wchar_t*>(uid), texture));
+		textureMap.insert(std::make_pair(std::wstring(uid), loaded));
 	}
 }
 
+void TextureManager::addTexture(const wchar_t* uid, ID3D11ShaderResourceView* texture)
+{
+	textureMap.insert(std::make_pair(std::wstring(uid), texture));
+}
+
+void TextureManager::setLoadFunction(const LoadFunction& function)
+{
+	loadFunction = function;
+}
+
 // Release resource.
 TextureManager::~TextureManager()
 {
@@ -82,10 +99,11 @@ TextureManager::~TextureManager()
 // Return texture as a shader resource.
 ID3D11ShaderResourceView* TextureManager::getTexture(const wchar_t* uid)
 {
-	if (textureMap.find(const_cast<wchar_t*>(uid)) != textureMap.end())
+	auto found = textureMap.find(uid);
+	if (found != textureMap.end())
 	{
 		// texture exists
-		return textureMap.at(const_cast<wchar_t*>(uid));
+		return found->second;
 	}
 	else
 	{
@@ -139,7 +157,7 @@ void TextureManager::addDefaultTexture()
 		SRVDesc.Texture2D.MipLevels = 1;
 
 		hr = device->CreateShaderResourceView(pTexture, &SRVDesc, &texture);
-		textureMap.insert(std::make_pair(const_cast < wchar_t*>(L"default"), texture));
+		textureMap.insert(std::make_pair(std::wstring(L"default"), texture));
 	}
 	
 }
\ No newline at end of file
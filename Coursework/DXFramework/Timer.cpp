@@ -1,6 +1,12 @@
 // Timer object.
 // Calculate delta/frame time and FPS.
 #include "timer.h"
+#include <algorithm>
+#include <vector>
+#include <fstream>
+
+const unsigned int Timer::frameHistorySize;
+const float Timer::hitchFactor = 2.0f;
 
 // Initialise timer. Check for high performance timers.
 Timer::Timer()
@@ -19,6 +25,12 @@ Timer::Timer()
 	elapsedTime = 0.f;
 	frames = 0.f;
 	fps = 0.f;
+
+	for (auto& time : frameHistory)
+		time.store(0.f, std::memory_order_relaxed);
+	framesRecorded.store(0);
+	hitchCount.store(0);
+	hitchThreshold = 0.f;
 }
 
 
@@ -47,6 +59,19 @@ void Timer::frame()
 		elapsedTime = 0.0f;
 	}
 	
+	// Record in the frame history
+	float frameMs = frameTime * 1000.f;
+	unsigned int index = framesRecorded.load(std::memory_order_relaxed);
+	frameHistory[index & (frameHistorySize - 1)].store(frameMs, std::memory_order_relaxed);
+	framesRecorded.store(index + 1, std::memory_order_release);
+
+	if (hitchThreshold > 0.f && frameMs > hitchThreshold)
+		hitchCount.fetch_add(1, std::memory_order_relaxed);
+
+	// Refresh the hitch threshold every so often, the median is too expensive to find every frame
+	if ((index & 63) == 63)
+		hitchThreshold = getFrameStats().p50 * hitchFactor;
+
 	// Restart the timer.
 	startTime = currentTime;
 
@@ -62,4 +87,76 @@ float Timer::getTime()
 float Timer::getFPS()
 {
 	return fps;
-}
\ No newline at end of file
+}
+
+Timer::FrameStats Timer::getFrameStats() const
+{
+	FrameStats stats;
+
+	std::vector<float> times(frameHistorySize);
+	unsigned int count = getFrameTimes(times.data(), frameHistorySize);
+	if (count == 0)
+		return stats;
+	times.resize(count);
+
+	float total = 0.f;
+	for (float t : times)
+		total += t;
+
+	std::sort(times.begin(), times.end());
+
+	// nearest rank percentiles
+	auto percentile = [&](float p)
+	{
+		unsigned int rank = static_cast<unsigned int>(p * count + 0.999f);
+		return times[(std::min)((std::max)(rank, 1u), count) - 1];
+	};
+
+	stats.count = static_cast<int>(count);
+	stats.mean = total / count;
+	stats.p50 = percentile(0.50f);
+	stats.p95 = percentile(0.95f);
+	stats.p99 = percentile(0.99f);
+	stats.max = times.back();
+
+	float threshold = stats.p50 * hitchFactor;
+	stats.hitches = static_cast<int>(times.end() - std::upper_bound(times.begin(), times.end(), threshold));
+
+	return stats;
+}
+
+unsigned int Timer::getFrameTimes(float* out, unsigned int maxCount) const
+{
+	unsigned int recorded = framesRecorded.load(std::memory_order_acquire);
+	unsigned int count = (std::min)((std::min)(recorded, frameHistorySize), maxCount);
+
+	unsigned int first = recorded - count;
+	for (unsigned int i = 0; i < count; i++)
+		out[i] = frameHistory[(first + i) & (frameHistorySize - 1)].load(std::memory_order_relaxed);
+
+	return count;
+}
+
+unsigned int Timer::getHitchCount() const
+{
+	return hitchCount.load(std::memory_order_relaxed);
+}
+
+bool Timer::writeCSV(const char* filename) const
+{
+	std::vector<float> times(frameHistorySize);
+	unsigned int count = getFrameTimes(times.data(), frameHistorySize);
+	FrameStats stats = getFrameStats();
+	float threshold = stats.p50 * hitchFactor;
+
+	std::ofstream file(filename);
+	if (!file.is_open())
+		return false;
+
+	unsigned int firstFrame = framesRecorded.load(std::memory_order_acquire) - count;
+	file << "frame,time_ms,hitch\n";
+	for (unsigned int i = 0; i < count; i++)
+		file << (firstFrame + i) << "," << times[i] << "," << (times[i] > threshold ? 1 : 0) << "\n";
+
+	return file.good();
+}
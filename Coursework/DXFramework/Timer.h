@@ -1,7 +1,7 @@
 /**
 * \class Timer
 *
-* \brief Calculates frame/delta time and FPS
+* \brief Calculates frame/delta time and FPS, and keeps a history of frame times for percentile and hitch statistics
 *
 * \author Paul Robertson
 */
@@ -13,6 +13,7 @@
 #define _TIMER_H_
 
 #include <windows.h>
+#include <atomic>
 
 class Timer
 {
@@ -25,6 +26,26 @@ public:
 	float getTime();	///< Get delta time
 	float getFPS();		///< Get FPS (for display)
 
+	/// Statistics over the frame history, times in milliseconds
+	struct FrameStats
+	{
+		int count = 0;
+		float mean = 0.f;
+		float p50 = 0.f;
+		float p95 = 0.f;
+		float p99 = 0.f;
+		float max = 0.f;
+		int hitches = 0;	///< frames in the history longer than hitchFactor times the median
+	};
+
+	static const unsigned int frameHistorySize = 1024;	///< Number of frame times kept, must be a power of two
+	static const float hitchFactor;						///< A frame is a hitch if it takes this many times longer than the median
+
+	FrameStats getFrameStats() const;							///< Compute statistics over the frame history
+	unsigned int getFrameTimes(float* out, unsigned int maxCount) const;	///< Copy the most recent frame times (ms), oldest first. Returns the number copied
+	unsigned int getHitchCount() const;						///< Total hitches since the timer was created
+	bool writeCSV(const char* filename) const;				///< Write the frame history to a CSV file
+
 private:
 	INT64 frequency;
 	float ticksPerS;
@@ -33,6 +54,15 @@ private:
 	float fps;
 	float frames;
 	float elapsedTime;
+
+	// ring buffer of frame times, written only by frame() and safe to read from any thread without locking
+	// readers may see the oldest entries overwritten while copying, which only affects statistics
+	std::atomic<float> frameHistory[frameHistorySize];
+	std::atomic<unsigned int> framesRecorded;
+
+	// hitches are counted against the median of the history, which is refreshed periodically
+	std::atomic<unsigned int> hitchCount;
+	float hitchThreshold;
 };
 
 #endif
\ No newline at end of file
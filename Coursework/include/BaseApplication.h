@@ -54,6 +54,16 @@ public:
 	*/
 	virtual bool frame();
 
+	/** \brief Enable or disable playback mode
+	* In playback mode every frame advances by a fixed timestep instead of the measured frame time, and input does not move the camera.
+	* Used to replay scripted camera paths deterministically
+	* @param enabled turns playback mode on or off
+	* @param timestep is the simulated time in seconds between frames
+	*/
+	void setPlaybackMode(bool enabled, float timestep = 1.0f / 60.0f);
+	bool isPlaybackMode();	///< Is playback mode enabled
+	float getDeltaTime();	///< Delta time for this frame, either measured by the timer or the playback timestep
+
 protected:
 	/** \brief Protected Virtual function for handling input
 	* Function provides default input handling for camera and UI functions. 
@@ -75,6 +85,9 @@ protected:
 	Timer* timer;			///< Pointer to timer object (for delta time and FPS)
 	TextureManager* textureMgr;	///< Pointer to texture manager (handles loading and storing of textures)
 	bool wireframeToggle;	///< Boolean tracking if wireframe is de/activated
+	bool playbackMode;		///< Fixed timestep and no input when true
+	float playbackTimestep;	///< Timestep used in playback mode
+	float deltaTime;		///< Delta time for the current frame
 };
 
 #endif
\ No newline at end of file
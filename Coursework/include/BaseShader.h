@@ -58,6 +58,8 @@ public:
 
 protected:
 	virtual void initShader(const wchar_t*, const wchar_t*) = 0;
+	// submits the draw once render has set the shader stages, so a derived shader can send it through its own backend
+	virtual void draw(ID3D11DeviceContext* deviceContext, int indexCount);
 	void loadVertexShader(const wchar_t* filename);		///< Load Vertex shader, for stand position, tex, normal geomtry
 	void loadColourVertexShader(const wchar_t* filename);		///< Load Vertex shader, pre-made for position and colour only
 	void loadTextureVertexShader(const wchar_t* filename);		///< Load Vertex shader, pre-made for position and tex only
@@ -15,6 +15,7 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <functional>
 //#include "Texture.h"
 
 using namespace DirectX;
@@ -26,8 +27,15 @@ public:
 	~TextureManager();
 
 	void loadTexture(const wchar_t* uid, const wchar_t* filename);
+	// adds a texture that was loaded elsewhere
+	void addTexture(const wchar_t* uid, ID3D11ShaderResourceView* texture);
 	ID3D11ShaderResourceView* getTexture(const wchar_t* uid);
 
+	// replaces the WIC/DDS loaders, e.g. so the application can share its textures with the framework
+	// returns null if the texture failed to load
+	typedef std::function<ID3D11ShaderResourceView*(const wchar_t* filename)> LoadFunction;
+	void setLoadFunction(const LoadFunction& function);
+
 private:
 	bool does_file_exist(const wchar_t *fileName);
 	void generateTexture(ID3D11Device* device);
@@ -37,7 +45,9 @@ private:
 	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
 
-	std::map<wchar_t*, ID3D11ShaderResourceView*> textureMap;
+	// keyed by the uid's contents, not its address
+	std::map<std::wstring, ID3D11ShaderResourceView*> textureMap;
+	LoadFunction loadFunction;
 	ID3D11Texture2D *pTexture;
 };
 